@@ -1,7 +1,26 @@
 #include "benchmark/benchmark.h"
 #include "krypto/util.h"
 #include "krypto/internal/math.h"
+#include "krypto/internal/kernels.h"
+#include "krypto/dispatch.h"
 #include "krypto/aes.h"
+#include "krypto/aegis.h"
+#include "krypto/haraka.h"
+#include "krypto/fixed_key.h"
+#include "krypto/random.h"
+#include "krypto/fasthash.h"
+#include "krypto/sha256.h"
+#include "krypto/cbc_hmac.h"
+#include "krypto/gcm.h"
+#include "krypto/reencrypt.h"
+#include "krypto/dedup.h"
+#include "krypto/chunk_cache.h"
+#include "krypto/sealed_map.h"
+#include "krypto/job_manager.h"
+#include "krypto/views.h"
+#include "krypto/jit.h"
+
+#include <random>
 
 /**
  * Multiplication lookup
@@ -110,4 +129,432 @@ static void BM_MIXCOLUMNINV_SLOW(benchmark::State& state) {
 }
 BENCHMARK(BM_MIXCOLUMNINV_SLOW);
 
+/**
+ * CTR kernel widths
+ */
+
+// AES-128 CTR with the width forced by the dispatch policy: 128, 256 or 512 bits
+static void BM_CTR_WIDTH(benchmark::State& state, size_t width) {
+	const std::array<unsigned char, 16> key{};
+	const std::array<unsigned char, 16> iv{};
+	const krypto::internal::key_schedule<128> ks(key);
+	const krypto::internal::ctr_stream ctr(iv.data(), false);
+	std::vector<unsigned char> data(state.range(0), 1);
+
+	const auto saved = krypto::get_dispatch_policy();
+	krypto::set_dispatch_policy({ width >= 256 ? 0 : SIZE_MAX, width >= 512 ? 0 : SIZE_MAX });
+
+	for (auto _ : state) {
+		krypto::internal::ctr_xor(data.data(), data.data(), data.size(), ks, ctr, 0);
+		benchmark::ClobberMemory();
+	}
+
+	krypto::set_dispatch_policy(saved);
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_CAPTURE(BM_CTR_WIDTH, 128, 128)->Range(64, 1 << 16);
+BENCHMARK_CAPTURE(BM_CTR_WIDTH, 256, 256)->Range(64, 1 << 16);
+BENCHMARK_CAPTURE(BM_CTR_WIDTH, 512, 512)->Range(64, 1 << 16);
+
+// AES-128 CTR with the generated kernel for the key, by blocks in flight
+static void BM_CTR_JIT(benchmark::State& state) {
+	const std::array<unsigned char, 16> key{};
+	const std::array<unsigned char, 16> iv{};
+	const krypto::jit_ctr<128> jit(key, state.range(1));
+	std::vector<unsigned char> data(state.range(0), 1);
+
+	for (auto _ : state) {
+		jit.apply(data, data, iv);
+		benchmark::ClobberMemory();
+	}
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CTR_JIT)->ArgsProduct({ { 4096, 1 << 16 }, { 8, 12, 14 } });
+
+/**
+ * AEGIS
+ */
+
+static void BM_AEGIS128L(benchmark::State& state) {
+	std::array<unsigned char, 16> key{};
+	std::array<unsigned char, 16> nonce{};
+	std::vector<unsigned char> data(state.range(0), 1);
+
+	krypto::aegis128l aegis(key);
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(aegis.seal(nonce, data));
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AEGIS128L)->Range(64, 1 << 16);
+
+static void BM_AEGIS256(benchmark::State& state) {
+	std::array<unsigned char, 32> key{};
+	std::array<unsigned char, 32> nonce{};
+	std::vector<unsigned char> data(state.range(0), 1);
+
+	krypto::aegis256 aegis(key);
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(aegis.seal(nonce, data));
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AEGIS256)->Range(64, 1 << 16);
+
+/**
+ * Haraka
+ */
+
+static void BM_HARAKA256(benchmark::State& state) {
+	std::vector<unsigned char> in(32 * state.range(0), 1);
+	std::vector<unsigned char> out(32 * state.range(0));
+
+	for (auto _ : state)
+		krypto::haraka256_batch(out, in);
+
+	state.SetBytesProcessed(state.iterations() * in.size());
+}
+BENCHMARK(BM_HARAKA256)->Arg(1)->Arg(4)->Arg(1024);
+
+static void BM_HARAKA512(benchmark::State& state) {
+	std::vector<unsigned char> in(64 * state.range(0), 1);
+	std::vector<unsigned char> out(32 * state.range(0));
+
+	for (auto _ : state)
+		krypto::haraka512_batch(out, in);
+
+	state.SetBytesProcessed(state.iterations() * in.size());
+}
+BENCHMARK(BM_HARAKA512)->Arg(1)->Arg(4)->Arg(1024);
+
+/**
+ * Fixed key AES
+ */
+
+static void BM_FIXEDKEY_HASH(benchmark::State& state) {
+	std::vector<krypto::block128> data(state.range(0));
+	krypto::fixed_key_aes aes;
+
+	for (auto _ : state)
+		aes.hash(data);
+
+	state.SetBytesProcessed(state.iterations() * state.range(0) * 16);
+}
+BENCHMARK(BM_FIXEDKEY_HASH)->Arg(8)->Arg(1024);
+
+static void BM_PRG(benchmark::State& state) {
+	std::array<unsigned char, 16> seed{};
+	std::vector<krypto::block128> data(state.range(0));
+	krypto::prg prg(seed);
+
+	for (auto _ : state)
+		prg.generate(data);
+
+	state.SetBytesProcessed(state.iterations() * state.range(0) * 16);
+}
+BENCHMARK(BM_PRG)->Arg(8)->Arg(1024);
+
+/**
+ * Counter based random
+ */
+
+static void BM_ARS_ENGINE(benchmark::State& state) {
+	krypto::random::ars_engine engine({ 1, 2 });
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(engine());
+
+}
+BENCHMARK(BM_ARS_ENGINE);
+
+static void BM_AES_ENGINE(benchmark::State& state) {
+	krypto::random::aes_engine engine({ 1, 2 });
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(engine());
+
+}
+BENCHMARK(BM_AES_ENGINE);
+
+static void BM_MT19937_64(benchmark::State& state) {
+	std::mt19937_64 engine(1);
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(engine());
+
+}
+BENCHMARK(BM_MT19937_64);
+
+/**
+ * Fast hash
+ */
+
+static void BM_FAST_HASH(benchmark::State& state) {
+	std::vector<unsigned char> data(state.range(0));
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(krypto::fast_hash::hash(data));
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FAST_HASH)->Arg(64)->Arg(4096)->Arg(1 << 20);
+
+/**
+ * SHA-256 and CBC-HMAC-SHA256
+ */
+
+static void BM_SHA256(benchmark::State& state) {
+	std::vector<unsigned char> data(state.range(0));
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(krypto::sha256::hash(data));
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SHA256)->Range(64, 1 << 16);
+
+static void BM_CBC_HMAC_SHA256(benchmark::State& state) {
+	std::array<unsigned char, 16> key{};
+	std::array<unsigned char, 16> iv{};
+	std::vector<unsigned char> data(state.range(0));
+	krypto::cbc_hmac_sha256<128> cipher(key, key);
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(cipher.seal(iv, data));
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CBC_HMAC_SHA256)->Range(64, 1 << 16);
+
+/**
+ * GCM and re-encryption
+ */
+
+static void BM_GCM(benchmark::State& state) {
+	std::array<unsigned char, 16> key{};
+	std::array<unsigned char, 12> nonce{};
+	std::vector<unsigned char> data(state.range(0));
+	krypto::gcm<128> gcm(key);
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(gcm.seal(nonce, data));
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GCM)->Range(64, 1 << 16);
+
+static void BM_GCM_LARGE(benchmark::State& state) {
+	std::array<unsigned char, 16> key{};
+	std::array<unsigned char, 12> nonce{};
+	std::vector<unsigned char> data(64 << 20);
+	krypto::gcm<128> gcm(key);
+
+	// Threads encrypting segments of one message
+	krypto::set_max_threads(state.range(0));
+	for (auto _ : state)
+		benchmark::DoNotOptimize(gcm.seal(nonce, data));
+	krypto::set_max_threads(0);
+
+	state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_GCM_LARGE)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
+static void BM_REENCRYPT_CTR(benchmark::State& state) {
+	std::array<unsigned char, 16> key{};
+	krypto::reencryptor<128> rekey(key, key);
+	krypto::byte_array data(state.range(0) + 16);
+
+	for (auto _ : state) {
+		rekey.ctr(data);
+		benchmark::ClobberMemory();
+	}
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_REENCRYPT_CTR)->Range(64, 1 << 20);
+
+static void BM_REENCRYPT_GCM(benchmark::State& state) {
+	std::array<unsigned char, 16> key{};
+	krypto::reencryptor<128> rekey(key, key);
+	auto data = krypto::gcm<128>(key).encrypt(std::vector<unsigned char>(state.range(0)));
+
+	// Same old and new key, so the object stays valid between iterations
+	for (auto _ : state)
+		benchmark::DoNotOptimize(rekey.gcm(data));
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_REENCRYPT_GCM)->Range(64, 1 << 20);
+
+/**
+ * Content defined chunking and convergent encryption
+ */
+
+static void BM_FASTCDC(benchmark::State& state) {
+	std::vector<unsigned char> data(state.range(0));
+	std::mt19937_64 rng;
+	for (auto& b : data)
+		b = static_cast<unsigned char>(rng());
+
+	krypto::fastcdc cdc;
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(cdc.split(data));
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FASTCDC)->Arg(1 << 16)->Arg(1 << 24);
+
+static void BM_DEDUP(benchmark::State& state) {
+	std::vector<unsigned char> data(state.range(0));
+	std::mt19937_64 rng;
+	for (auto& b : data)
+		b = static_cast<unsigned char>(rng());
+
+	std::array<unsigned char, 32> secret{};
+	krypto::dedup<128> dedup(secret);
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(dedup.encrypt(data));
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DEDUP)->Arg(1 << 24);
+
+/**
+ * Decrypted chunk cache
+ */
+
+static void BM_CHUNK_CACHE_READ(benchmark::State& state) {
+	std::array<unsigned char, 16> key{};
+	std::array<unsigned char, 12> nonce{};
+	krypto::gcm<128> gcm(key);
+	const auto chunk = gcm.seal(nonce, std::vector<unsigned char>(1 << 16));
+
+	krypto::chunk_cache cache([&](uint64_t, uint64_t, krypto::byte_view<> out) -> std::optional<size_t> {
+		const auto plain_text = gcm.open(nonce, chunk);
+		std::copy(plain_text->begin(), plain_text->end(), out.begin());
+		return plain_text->size();
+	}, state.range(0) << 16);
+
+	// Random 4 KiB reads over 64 hot chunks
+	std::vector<unsigned char> out(4096);
+	std::mt19937_64 rng;
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(cache.read(0, (rng() % 64) << 16 | (rng() % 15) << 12, out));
+
+	state.SetBytesProcessed(state.iterations() * out.size());
+}
+BENCHMARK(BM_CHUNK_CACHE_READ)->Arg(0)->Arg(256);
+
+/**
+ * Sealed key value store
+ */
+
+static void BM_SEALED_MAP_GET(benchmark::State& state) {
+	krypto::sealed_map<uint64_t> map;
+
+	std::vector<uint64_t> keys(1024);
+	for (uint64_t i = 0; i < keys.size(); i++) {
+		keys[i] = i;
+		map.put(i, std::vector<unsigned char>(state.range(0)));
+	}
+
+	for (auto _ : state) {
+		for (const auto k : keys)
+			benchmark::DoNotOptimize(map.get(k));
+	}
+
+	state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_SEALED_MAP_GET)->Arg(16)->Arg(256);
+
+static void BM_SEALED_MAP_MULTI_GET(benchmark::State& state) {
+	krypto::sealed_map<uint64_t> map;
+
+	std::vector<uint64_t> keys(1024);
+	for (uint64_t i = 0; i < keys.size(); i++) {
+		keys[i] = i;
+		map.put(i, std::vector<unsigned char>(state.range(0)));
+	}
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(map.get(keys));
+
+	state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_SEALED_MAP_MULTI_GET)->Arg(16)->Arg(256);
+
+/**
+ * Job manager
+ */
+
+// Mixed size jobs of one type with 16 different keys, flushed after every job for Arg(0)
+static void BM_JOB_MANAGER(benchmark::State& state, krypto::job_type type) {
+	std::vector<krypto::job_manager<128>::key> keys;
+	for (unsigned char i = 0; i < 16; i++)
+		keys.emplace_back(std::array<unsigned char, 16>{ i });
+
+	std::mt19937_64 rng;
+	std::vector<krypto::byte_array> buffers(1024);
+	size_t bytes = 0;
+	for (auto& b : buffers) {
+		b.resize(16 * (1 + rng() % 16));
+		bytes += b.size();
+	}
+
+	krypto::job_manager<128> jobs;
+
+	for (auto _ : state) {
+		for (size_t i = 0; i < buffers.size(); i++) {
+			jobs.submit({ type, &keys[i % keys.size()], {}, buffers[i].data(), buffers[i].data(), buffers[i].size(), i });
+			if (state.range(0) == 0)
+				jobs.flush();
+		}
+		jobs.flush();
+		while (jobs.pop());
+	}
+
+	state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK_CAPTURE(BM_JOB_MANAGER, cbc_encrypt, krypto::job_type::cbc_encrypt)->Arg(0)->Arg(1);
+BENCHMARK_CAPTURE(BM_JOB_MANAGER, ctr, krypto::job_type::ctr)->Arg(0)->Arg(1);
+
+/**
+ * Range views
+ */
+
+// Find a byte at offset Arg of a 1 MiB cipher text, decrypting lazily or the whole object first
+static void BM_VIEWS_FIND(benchmark::State& state, bool lazy) {
+	std::array<unsigned char, 16> key{};
+	std::array<unsigned char, 16> iv{};
+
+	krypto::byte_array plain_text(1 << 20);
+	plain_text[state.range(0)] = 1;
+
+	krypto::byte_array cipher_text(plain_text.size());
+	std::ranges::copy(plain_text | krypto::views::encrypt<128>(key, iv), cipher_text.begin());
+
+	for (auto _ : state) {
+		if (lazy) {
+			auto plain = cipher_text | krypto::views::decrypt<128>(key, iv);
+			benchmark::DoNotOptimize(std::ranges::find(plain, 1).offset());
+		}
+		else {
+			const krypto::internal::key_schedule<128> ks(key);
+			krypto::byte_array out(cipher_text.size());
+			krypto::internal::ctr_xor(cipher_text.data(), out.data(), out.size(), ks, krypto::internal::ctr_stream(iv.data(), false), 0);
+			benchmark::DoNotOptimize(std::ranges::find(out, 1));
+		}
+	}
+
+	state.SetBytesProcessed(state.iterations() * (state.range(0) + 1));
+}
+BENCHMARK_CAPTURE(BM_VIEWS_FIND, lazy, true)->Arg(100)->Arg(1 << 16)->Arg((1 << 20) - 1);
+BENCHMARK_CAPTURE(BM_VIEWS_FIND, whole, false)->Arg(100)->Arg(1 << 16)->Arg((1 << 20) - 1);
+
 BENCHMARK_MAIN();
\ No newline at end of file
@@ -0,0 +1,747 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <span>
+#include <optional>
+#include <algorithm>
+#include <type_traits>
+
+#include "util.h"
+#include "internal/block.h"
+
+namespace krypto {
+
+	// Implementation based on https://datatracker.ietf.org/doc/draft-irtf-cfrg-aegis-aead/
+	namespace internal::inline KRYPTO_ISA::aegis {
+
+		constexpr std::array<unsigned char, 16> C0 = { 0x00, 0x01, 0x01, 0x02, 0x03, 0x05, 0x08, 0x0d, 0x15, 0x22, 0x37, 0x59, 0x90, 0xe9, 0x79, 0x62 };
+		constexpr std::array<unsigned char, 16> C1 = { 0xdb, 0x3d, 0x18, 0x55, 0x6d, 0xc2, 0x2f, 0xf1, 0x20, 0x11, 0x31, 0x42, 0x73, 0xb5, 0x28, 0xdd };
+
+		// Encode bit lengths of ad and message as two little endian 64 bit words
+		inline block encode_lengths(uint64_t ad_size, uint64_t msg_size) noexcept;
+
+		/**
+		 * AEGIS-128L state. 8 blocks, absorbs 32 bytes per update
+		 */
+		struct state_128l {
+			constexpr static size_t KEY_SIZE = 16;
+			constexpr static size_t NONCE_SIZE = 16;
+			constexpr static size_t RATE = 32;
+
+			void init(const unsigned char* key, const unsigned char* nonce) noexcept;
+			void absorb(const unsigned char* in) noexcept;
+			void enc(unsigned char* out, const unsigned char* in) noexcept;
+			void dec(unsigned char* out, const unsigned char* in) noexcept;
+			void dec_partial(unsigned char* out, const unsigned char* in, size_t size) noexcept;
+			block finalize(uint64_t ad_size, uint64_t msg_size) noexcept;
+
+			void update(block m0, block m1) noexcept;
+
+			block s[8];
+		};
+
+		/**
+		 * AEGIS-256 state. 6 blocks, absorbs 16 bytes per update
+		 */
+		struct state_256 {
+			constexpr static size_t KEY_SIZE = 32;
+			constexpr static size_t NONCE_SIZE = 32;
+			constexpr static size_t RATE = 16;
+
+			void init(const unsigned char* key, const unsigned char* nonce) noexcept;
+			void absorb(const unsigned char* in) noexcept;
+			void enc(unsigned char* out, const unsigned char* in) noexcept;
+			void dec(unsigned char* out, const unsigned char* in) noexcept;
+			void dec_partial(unsigned char* out, const unsigned char* in, size_t size) noexcept;
+			block finalize(uint64_t ad_size, uint64_t msg_size) noexcept;
+
+			void update(block m) noexcept;
+
+			block s[6];
+		};
+
+		// Messages per call of seal_lanes / open_lanes
+		constexpr size_t LANES = 4;
+
+		struct lane {
+			const unsigned char* nonce;
+			const unsigned char* in;
+			unsigned char* out;
+			// Plain text bytes
+			size_t size;
+		};
+
+#ifdef KRYPTO_VAES
+		/**
+		 * 4 AEGIS-128L states, one per 128 bit lane of the zmm registers
+		 */
+		struct state_128l_x4 {
+			void init(const unsigned char* key, const lane* lanes) noexcept;
+			void enc(const lane* lanes, size_t offset) noexcept;
+			void dec(const lane* lanes, size_t offset) noexcept;
+			void finalize(const lane* lanes, unsigned char* tags) noexcept;
+
+			void load(const state_128l* states) noexcept;
+			void store(state_128l* states) const noexcept;
+
+			void update(__m512i m0, __m512i m1) noexcept;
+
+			__m512i s[8];
+		};
+#endif
+
+		/**
+		 * Encrypt count <= LANES messages without associated data, out receives cipher text followed by tag.
+		 * With VAES and AVX-512 4 AEGIS-128L messages are processed by one instruction stream
+		 */
+		template <typename State>
+		inline void seal_lanes(const unsigned char* key, const lane* lanes, size_t count) noexcept;
+
+		/**
+		 * Decrypt count <= LANES messages, in is cipher text followed by tag.
+		 * ok[i] is false and out is zeroed if message i fails authentication
+		 */
+		template <typename State>
+		inline void open_lanes(const unsigned char* key, const lane* lanes, size_t count, bool* ok) noexcept;
+
+	}
+
+	/**
+	 * AEGIS authenticated encryption with associated data.
+	 * The state update is the AES round function, so there is no key schedule
+	 * and no GHASH. Use the aegis128l / aegis256 aliases.
+	 */
+	template <typename State>
+	class aegis {
+	public:
+		constexpr static size_t KEY_SIZE = State::KEY_SIZE;
+		constexpr static size_t NONCE_SIZE = State::NONCE_SIZE;
+		constexpr static size_t TAG_SIZE = 16;
+
+		/**
+		 * Construct an AEGIS encryption object
+		 * Set key used for encryption
+		 */
+		constexpr aegis(const_byte_view<KEY_SIZE> key) noexcept;
+
+		/**
+		 * Encrypt data using a random nonce
+		 * Output is cipher text followed by tag and nonce
+		 */
+		byte_array encrypt(const_byte_view<> data, const_byte_view<> ad = {}) const noexcept;
+		/**
+		 * Decrypt data produced by encrypt
+		 * Returns empty optional if authentication fails
+		 */
+		std::optional<byte_array> decrypt(const_byte_view<> data, const_byte_view<> ad = {}) const noexcept;
+
+		/**
+		 * Encrypt data using nonce. Output is cipher text followed by tag
+		 * A nonce must never be used twice with the same key
+		 */
+		byte_array seal(const_byte_view<NONCE_SIZE> nonce, const_byte_view<> data, const_byte_view<> ad = {}) const noexcept;
+		/**
+		 * Decrypt cipher text followed by tag
+		 * Returns empty optional if authentication fails
+		 */
+		std::optional<byte_array> open(const_byte_view<NONCE_SIZE> nonce, const_byte_view<> data, const_byte_view<> ad = {}) const noexcept;
+
+	private:
+
+		void absorb_ad(State& state, const_byte_view<> ad) const noexcept;
+
+		std::array<unsigned char, KEY_SIZE> key{};
+
+	};
+
+	using aegis128l = aegis<internal::aegis::state_128l>;
+	using aegis256 = aegis<internal::aegis::state_256>;
+
+	///
+	// Implementation
+	///
+
+	template <typename State>
+	constexpr aegis<State>::aegis(const_byte_view<KEY_SIZE> key) noexcept
+	{
+		std::copy(key.begin(), key.end(), this->key.begin());
+	}
+
+	template <typename State>
+	inline byte_array aegis<State>::encrypt(const_byte_view<> data, const_byte_view<> ad) const noexcept
+	{
+		const auto nonce = krypto::get_srandom_bytes<NONCE_SIZE>();
+
+		auto cipher_text = seal(nonce, data, ad);
+		cipher_text.insert(cipher_text.end(), nonce.begin(), nonce.end());
+
+		return cipher_text;
+	}
+
+	template <typename State>
+	inline std::optional<byte_array> aegis<State>::decrypt(const_byte_view<> data, const_byte_view<> ad) const noexcept
+	{
+		if (data.size() < TAG_SIZE + NONCE_SIZE)
+			return std::nullopt;
+
+		// Last bytes are nonce
+		const auto nonce = data.last<NONCE_SIZE>();
+		return open(nonce, data.first(data.size() - NONCE_SIZE), ad);
+	}
+
+	template <typename State>
+	inline byte_array aegis<State>::seal(const_byte_view<NONCE_SIZE> nonce, const_byte_view<> data, const_byte_view<> ad) const noexcept
+	{
+		constexpr size_t RATE = State::RATE;
+
+		State state;
+		state.init(key.data(), nonce.data());
+		absorb_ad(state, ad);
+
+		byte_array cipher_text;
+		cipher_text.resize(data.size() + TAG_SIZE);
+
+		const size_t full = data.size() / RATE;
+		for (size_t i = 0; i < full; i++) {
+			state.enc(&cipher_text[i * RATE], &data[i * RATE]);
+		}
+
+		// Zero pad last partial block
+		const size_t rest = data.size() - full * RATE;
+		if (rest) {
+			std::array<unsigned char, RATE> in{};
+			std::array<unsigned char, RATE> out{};
+			std::copy_n(data.begin() + full * RATE, rest, in.begin());
+			state.enc(out.data(), in.data());
+			std::copy_n(out.begin(), rest, cipher_text.begin() + full * RATE);
+		}
+
+		internal::block_store(&cipher_text[data.size()], state.finalize(ad.size(), data.size()));
+
+		return cipher_text;
+	}
+
+	template <typename State>
+	inline std::optional<byte_array> aegis<State>::open(const_byte_view<NONCE_SIZE> nonce, const_byte_view<> data, const_byte_view<> ad) const noexcept
+	{
+		constexpr size_t RATE = State::RATE;
+
+		if (data.size() < TAG_SIZE)
+			return std::nullopt;
+
+		State state;
+		state.init(key.data(), nonce.data());
+		absorb_ad(state, ad);
+
+		const size_t size = data.size() - TAG_SIZE;
+
+		byte_array plain_text;
+		plain_text.resize(size);
+
+		const size_t full = size / RATE;
+		for (size_t i = 0; i < full; i++) {
+			state.dec(&plain_text[i * RATE], &data[i * RATE]);
+		}
+
+		const size_t rest = size - full * RATE;
+		if (rest) {
+			state.dec_partial(&plain_text[full * RATE], &data[full * RATE], rest);
+		}
+
+		std::array<unsigned char, TAG_SIZE> tag;
+		internal::block_store(tag.data(), state.finalize(ad.size(), size));
+
+		if (!krypto::secure_equal(tag, data.last<TAG_SIZE>())) {
+			krypto::secure_zero(plain_text);
+			return std::nullopt;
+		}
+
+		return plain_text;
+	}
+
+	template <typename State>
+	inline void aegis<State>::absorb_ad(State& state, const_byte_view<> ad) const noexcept
+	{
+		constexpr size_t RATE = State::RATE;
+
+		const size_t full = ad.size() / RATE;
+		for (size_t i = 0; i < full; i++) {
+			state.absorb(&ad[i * RATE]);
+		}
+
+		const size_t rest = ad.size() - full * RATE;
+		if (rest) {
+			std::array<unsigned char, RATE> in{};
+			std::copy_n(ad.begin() + full * RATE, rest, in.begin());
+			state.absorb(in.data());
+		}
+	}
+
+	namespace internal::inline KRYPTO_ISA::aegis {
+
+		inline block encode_lengths(uint64_t ad_size, uint64_t msg_size) noexcept
+		{
+			std::array<unsigned char, 16> data{};
+			for (size_t i = 0; i < 8; i++) {
+				data[i] = static_cast<unsigned char>((ad_size * 8) >> (i * 8));
+				data[i + 8] = static_cast<unsigned char>((msg_size * 8) >> (i * 8));
+			}
+			return block_load(data.data());
+		}
+
+		/**
+		 * AEGIS-128L
+		 */
+
+		inline void state_128l::update(block m0, block m1) noexcept
+		{
+			const block tmp = s[7];
+			s[7] = aesenc(s[6], s[7]);
+			s[6] = aesenc(s[5], s[6]);
+			s[5] = aesenc(s[4], s[5]);
+			s[4] = aesenc(s[3], block_xor(s[4], m1));
+			s[3] = aesenc(s[2], s[3]);
+			s[2] = aesenc(s[1], s[2]);
+			s[1] = aesenc(s[0], s[1]);
+			s[0] = aesenc(tmp, block_xor(s[0], m0));
+		}
+
+		inline void state_128l::init(const unsigned char* key, const unsigned char* nonce) noexcept
+		{
+			const block k = block_load(key);
+			const block n = block_load(nonce);
+			const block c0 = block_load(C0.data());
+			const block c1 = block_load(C1.data());
+
+			s[0] = block_xor(k, n);
+			s[1] = c1;
+			s[2] = c0;
+			s[3] = c1;
+			s[4] = block_xor(k, n);
+			s[5] = block_xor(k, c0);
+			s[6] = block_xor(k, c1);
+			s[7] = block_xor(k, c0);
+
+			for (size_t i = 0; i < 10; i++) {
+				update(n, k);
+			}
+		}
+
+		inline void state_128l::absorb(const unsigned char* in) noexcept
+		{
+			update(block_load(in), block_load(in + 16));
+		}
+
+		inline void state_128l::enc(unsigned char* out, const unsigned char* in) noexcept
+		{
+			const block z0 = block_xor(block_xor(s[6], s[1]), block_and(s[2], s[3]));
+			const block z1 = block_xor(block_xor(s[2], s[5]), block_and(s[6], s[7]));
+			const block t0 = block_load(in);
+			const block t1 = block_load(in + 16);
+
+			block_store(out, block_xor(t0, z0));
+			block_store(out + 16, block_xor(t1, z1));
+
+			update(t0, t1);
+		}
+
+		inline void state_128l::dec(unsigned char* out, const unsigned char* in) noexcept
+		{
+			const block z0 = block_xor(block_xor(s[6], s[1]), block_and(s[2], s[3]));
+			const block z1 = block_xor(block_xor(s[2], s[5]), block_and(s[6], s[7]));
+			const block t0 = block_xor(block_load(in), z0);
+			const block t1 = block_xor(block_load(in + 16), z1);
+
+			block_store(out, t0);
+			block_store(out + 16, t1);
+
+			update(t0, t1);
+		}
+
+		inline void state_128l::dec_partial(unsigned char* out, const unsigned char* in, size_t size) noexcept
+		{
+			std::array<unsigned char, RATE> pad{};
+			std::copy_n(in, size, pad.begin());
+
+			const block z0 = block_xor(block_xor(s[6], s[1]), block_and(s[2], s[3]));
+			const block z1 = block_xor(block_xor(s[2], s[5]), block_and(s[6], s[7]));
+			block_store(pad.data(), block_xor(block_load(pad.data()), z0));
+			block_store(pad.data() + 16, block_xor(block_load(pad.data() + 16), z1));
+
+			// Plain text is zero padded before it is absorbed
+			std::copy_n(pad.begin(), size, out);
+			std::fill(pad.begin() + size, pad.end(), 0);
+
+			update(block_load(pad.data()), block_load(pad.data() + 16));
+		}
+
+		inline block state_128l::finalize(uint64_t ad_size, uint64_t msg_size) noexcept
+		{
+			const block t = block_xor(s[2], encode_lengths(ad_size, msg_size));
+
+			for (size_t i = 0; i < 7; i++) {
+				update(t, t);
+			}
+
+			block tag = s[0];
+			for (size_t i = 1; i < 7; i++) {
+				tag = block_xor(tag, s[i]);
+			}
+			return tag;
+		}
+
+		/**
+		 * AEGIS-256
+		 */
+
+		inline void state_256::update(block m) noexcept
+		{
+			const block tmp = s[5];
+			s[5] = aesenc(s[4], s[5]);
+			s[4] = aesenc(s[3], s[4]);
+			s[3] = aesenc(s[2], s[3]);
+			s[2] = aesenc(s[1], s[2]);
+			s[1] = aesenc(s[0], s[1]);
+			s[0] = aesenc(tmp, block_xor(s[0], m));
+		}
+
+		inline void state_256::init(const unsigned char* key, const unsigned char* nonce) noexcept
+		{
+			const block k0 = block_load(key);
+			const block k1 = block_load(key + 16);
+			const block n0 = block_load(nonce);
+			const block n1 = block_load(nonce + 16);
+			const block c0 = block_load(C0.data());
+			const block c1 = block_load(C1.data());
+
+			s[0] = block_xor(k0, n0);
+			s[1] = block_xor(k1, n1);
+			s[2] = c1;
+			s[3] = c0;
+			s[4] = block_xor(k0, c0);
+			s[5] = block_xor(k1, c1);
+
+			const block kn0 = block_xor(k0, n0);
+			const block kn1 = block_xor(k1, n1);
+
+			for (size_t i = 0; i < 4; i++) {
+				update(k0);
+				update(k1);
+				update(kn0);
+				update(kn1);
+			}
+		}
+
+		inline void state_256::absorb(const unsigned char* in) noexcept
+		{
+			update(block_load(in));
+		}
+
+		inline void state_256::enc(unsigned char* out, const unsigned char* in) noexcept
+		{
+			const block z = block_xor(block_xor(block_xor(s[1], s[4]), s[5]), block_and(s[2], s[3]));
+			const block t = block_load(in);
+
+			block_store(out, block_xor(t, z));
+
+			update(t);
+		}
+
+		inline void state_256::dec(unsigned char* out, const unsigned char* in) noexcept
+		{
+			const block z = block_xor(block_xor(block_xor(s[1], s[4]), s[5]), block_and(s[2], s[3]));
+			const block t = block_xor(block_load(in), z);
+
+			block_store(out, t);
+
+			update(t);
+		}
+
+		inline void state_256::dec_partial(unsigned char* out, const unsigned char* in, size_t size) noexcept
+		{
+			std::array<unsigned char, RATE> pad{};
+			std::copy_n(in, size, pad.begin());
+
+			const block z = block_xor(block_xor(block_xor(s[1], s[4]), s[5]), block_and(s[2], s[3]));
+			block_store(pad.data(), block_xor(block_load(pad.data()), z));
+
+			// Plain text is zero padded before it is absorbed
+			std::copy_n(pad.begin(), size, out);
+			std::fill(pad.begin() + size, pad.end(), 0);
+
+			update(block_load(pad.data()));
+		}
+
+		inline block state_256::finalize(uint64_t ad_size, uint64_t msg_size) noexcept
+		{
+			const block t = block_xor(s[3], encode_lengths(ad_size, msg_size));
+
+			for (size_t i = 0; i < 7; i++) {
+				update(t);
+			}
+
+			block tag = s[0];
+			for (size_t i = 1; i < 6; i++) {
+				tag = block_xor(tag, s[i]);
+			}
+			return tag;
+		}
+
+		/**
+		 * Lanes
+		 */
+
+		// Encrypt the blocks of a lane from block index first on, then the partial block
+		template <typename State>
+		inline void seal_rest(State& state, const lane& l, size_t first) noexcept
+		{
+			constexpr size_t RATE = State::RATE;
+
+			const size_t full = l.size / RATE;
+			for (size_t i = first; i < full; i++) {
+				state.enc(l.out + i * RATE, l.in + i * RATE);
+			}
+
+			const size_t rest = l.size - full * RATE;
+			if (rest) {
+				std::array<unsigned char, RATE> in{};
+				std::array<unsigned char, RATE> out{};
+				std::copy_n(l.in + full * RATE, rest, in.begin());
+				state.enc(out.data(), in.data());
+				std::copy_n(out.begin(), rest, l.out + full * RATE);
+			}
+		}
+
+		template <typename State>
+		inline void open_rest(State& state, const lane& l, size_t first) noexcept
+		{
+			constexpr size_t RATE = State::RATE;
+
+			const size_t full = l.size / RATE;
+			for (size_t i = first; i < full; i++) {
+				state.dec(l.out + i * RATE, l.in + i * RATE);
+			}
+
+			const size_t rest = l.size - full * RATE;
+			if (rest)
+				state.dec_partial(l.out + full * RATE, l.in + full * RATE, rest);
+		}
+
+		inline bool check_tag(const lane& l, const unsigned char* tag) noexcept
+		{
+			const bool ok = krypto::secure_equal(const_byte_view<16>(tag, 16), const_byte_view<16>(l.in + l.size, 16));
+			if (!ok)
+				krypto::secure_zero(byte_view<>(l.out, l.size));
+			return ok;
+		}
+
+#ifdef KRYPTO_VAES
+
+		inline __m512i load_lanes(const lane* lanes, const unsigned char* lane::* p, size_t offset) noexcept
+		{
+			__m512i v = _mm512_castsi128_si512(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes[0].*p + offset)));
+			v = _mm512_inserti32x4(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes[1].*p + offset)), 1);
+			v = _mm512_inserti32x4(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes[2].*p + offset)), 2);
+			v = _mm512_inserti32x4(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes[3].*p + offset)), 3);
+			return v;
+		}
+
+		inline void store_lanes(const lane* lanes, size_t offset, __m512i v) noexcept
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[0].out + offset), _mm512_extracti32x4_epi32(v, 0));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[1].out + offset), _mm512_extracti32x4_epi32(v, 1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[2].out + offset), _mm512_extracti32x4_epi32(v, 2));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes[3].out + offset), _mm512_extracti32x4_epi32(v, 3));
+		}
+
+		inline void state_128l_x4::update(__m512i m0, __m512i m1) noexcept
+		{
+			const __m512i tmp = s[7];
+			s[7] = _mm512_aesenc_epi128(s[6], s[7]);
+			s[6] = _mm512_aesenc_epi128(s[5], s[6]);
+			s[5] = _mm512_aesenc_epi128(s[4], s[5]);
+			s[4] = _mm512_aesenc_epi128(s[3], _mm512_xor_si512(s[4], m1));
+			s[3] = _mm512_aesenc_epi128(s[2], s[3]);
+			s[2] = _mm512_aesenc_epi128(s[1], s[2]);
+			s[1] = _mm512_aesenc_epi128(s[0], s[1]);
+			s[0] = _mm512_aesenc_epi128(tmp, _mm512_xor_si512(s[0], m0));
+		}
+
+		inline void state_128l_x4::init(const unsigned char* key, const lane* lanes) noexcept
+		{
+			const __m512i k = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(key)));
+			const __m512i n = load_lanes(lanes, &lane::nonce, 0);
+			const __m512i c0 = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(C0.data())));
+			const __m512i c1 = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(C1.data())));
+
+			s[0] = _mm512_xor_si512(k, n);
+			s[1] = c1;
+			s[2] = c0;
+			s[3] = c1;
+			s[4] = _mm512_xor_si512(k, n);
+			s[5] = _mm512_xor_si512(k, c0);
+			s[6] = _mm512_xor_si512(k, c1);
+			s[7] = _mm512_xor_si512(k, c0);
+
+			for (size_t i = 0; i < 10; i++) {
+				update(n, k);
+			}
+		}
+
+		inline void state_128l_x4::enc(const lane* lanes, size_t offset) noexcept
+		{
+			const __m512i z0 = _mm512_xor_si512(_mm512_xor_si512(s[6], s[1]), _mm512_and_si512(s[2], s[3]));
+			const __m512i z1 = _mm512_xor_si512(_mm512_xor_si512(s[2], s[5]), _mm512_and_si512(s[6], s[7]));
+			const __m512i t0 = load_lanes(lanes, &lane::in, offset);
+			const __m512i t1 = load_lanes(lanes, &lane::in, offset + 16);
+
+			store_lanes(lanes, offset, _mm512_xor_si512(t0, z0));
+			store_lanes(lanes, offset + 16, _mm512_xor_si512(t1, z1));
+
+			update(t0, t1);
+		}
+
+		inline void state_128l_x4::dec(const lane* lanes, size_t offset) noexcept
+		{
+			const __m512i z0 = _mm512_xor_si512(_mm512_xor_si512(s[6], s[1]), _mm512_and_si512(s[2], s[3]));
+			const __m512i z1 = _mm512_xor_si512(_mm512_xor_si512(s[2], s[5]), _mm512_and_si512(s[6], s[7]));
+			const __m512i t0 = _mm512_xor_si512(load_lanes(lanes, &lane::in, offset), z0);
+			const __m512i t1 = _mm512_xor_si512(load_lanes(lanes, &lane::in, offset + 16), z1);
+
+			store_lanes(lanes, offset, t0);
+			store_lanes(lanes, offset + 16, t1);
+
+			update(t0, t1);
+		}
+
+		inline void state_128l_x4::finalize(const lane* lanes, unsigned char* tags) noexcept
+		{
+			__m512i lengths = _mm512_setzero_si512();
+			for (size_t l = 0; l < LANES; l++) {
+				lengths = _mm512_mask_broadcast_i32x4(lengths, static_cast<__mmask16>(0xf << (l * 4)), encode_lengths(0, lanes[l].size));
+			}
+
+			const __m512i t = _mm512_xor_si512(s[2], lengths);
+
+			for (size_t i = 0; i < 7; i++) {
+				update(t, t);
+			}
+
+			__m512i tag = s[0];
+			for (size_t i = 1; i < 7; i++) {
+				tag = _mm512_xor_si512(tag, s[i]);
+			}
+			_mm512_storeu_si512(tags, tag);
+		}
+
+		inline void state_128l_x4::load(const state_128l* states) noexcept
+		{
+			for (size_t i = 0; i < 8; i++) {
+				__m512i v = _mm512_castsi128_si512(states[0].s[i]);
+				v = _mm512_inserti32x4(v, states[1].s[i], 1);
+				v = _mm512_inserti32x4(v, states[2].s[i], 2);
+				s[i] = _mm512_inserti32x4(v, states[3].s[i], 3);
+			}
+		}
+
+		inline void state_128l_x4::store(state_128l* states) const noexcept
+		{
+			for (size_t i = 0; i < 8; i++) {
+				states[0].s[i] = _mm512_extracti32x4_epi32(s[i], 0);
+				states[1].s[i] = _mm512_extracti32x4_epi32(s[i], 1);
+				states[2].s[i] = _mm512_extracti32x4_epi32(s[i], 2);
+				states[3].s[i] = _mm512_extracti32x4_epi32(s[i], 3);
+			}
+		}
+
+		// Blocks all 4 lanes have are processed together, the rest of each lane alone
+		template <bool Seal>
+		inline void crypt_lanes_x4(const unsigned char* key, const lane* lanes, unsigned char* tags) noexcept
+		{
+			size_t common = lanes[0].size / state_128l::RATE;
+			for (size_t l = 1; l < LANES; l++) {
+				common = std::min(common, lanes[l].size / state_128l::RATE);
+			}
+
+			state_128l_x4 x;
+			x.init(key, lanes);
+
+			for (size_t i = 0; i < common; i++) {
+				if constexpr (Seal)
+					x.enc(lanes, i * state_128l::RATE);
+				else
+					x.dec(lanes, i * state_128l::RATE);
+			}
+
+			state_128l states[LANES];
+			x.store(states);
+
+			for (size_t l = 0; l < LANES; l++) {
+				if constexpr (Seal)
+					seal_rest(states[l], lanes[l], common);
+				else
+					open_rest(states[l], lanes[l], common);
+			}
+
+			x.load(states);
+			x.finalize(lanes, tags);
+		}
+
+#endif
+
+		template <typename State>
+		inline void seal_lanes(const unsigned char* key, const lane* lanes, size_t count) noexcept
+		{
+#ifdef KRYPTO_VAES
+			if constexpr (std::is_same_v<State, state_128l>) {
+				if (count == LANES) {
+					std::array<unsigned char, 16 * LANES> tags;
+					crypt_lanes_x4<true>(key, lanes, tags.data());
+					for (size_t l = 0; l < LANES; l++) {
+						std::copy_n(tags.begin() + l * 16, 16, lanes[l].out + lanes[l].size);
+					}
+					return;
+				}
+			}
+#endif
+
+			for (size_t l = 0; l < count; l++) {
+				State state;
+				state.init(key, lanes[l].nonce);
+				seal_rest(state, lanes[l], 0);
+				block_store(lanes[l].out + lanes[l].size, state.finalize(0, lanes[l].size));
+			}
+		}
+
+		template <typename State>
+		inline void open_lanes(const unsigned char* key, const lane* lanes, size_t count, bool* ok) noexcept
+		{
+#ifdef KRYPTO_VAES
+			if constexpr (std::is_same_v<State, state_128l>) {
+				if (count == LANES) {
+					std::array<unsigned char, 16 * LANES> tags;
+					crypt_lanes_x4<false>(key, lanes, tags.data());
+					for (size_t l = 0; l < LANES; l++) {
+						ok[l] = check_tag(lanes[l], tags.data() + l * 16);
+					}
+					return;
+				}
+			}
+#endif
+
+			for (size_t l = 0; l < count; l++) {
+				State state;
+				state.init(key, lanes[l].nonce);
+				open_rest(state, lanes[l], 0);
+
+				std::array<unsigned char, 16> tag;
+				block_store(tag.data(), state.finalize(0, lanes[l].size));
+				ok[l] = check_tag(lanes[l], tag.data());
+			}
+		}
+
+	}
+
+}
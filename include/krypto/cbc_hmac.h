@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <span>
+#include <optional>
+
+#include "util.h"
+#include "sha256.h"
+#include "internal/kernels.h"
+#include "internal/padding.h"
+
+namespace krypto {
+
+	/**
+	 * AES-CBC with HMAC-SHA256, encrypt then MAC over cipher text and IV.
+	 *
+	 * CBC encryption is latency bound, every block waits on the AES result of
+	 * the previous one. Encryption is stitched: while 4 blocks are encrypted the
+	 * previous 64 bytes of cipher text are compressed by SHA-256, a quarter of
+	 * the rounds next to each block, so the two dependency chains overlap.
+	 */
+	template <size_t Size, typename Pad = pad::pkcs7>
+	class cbc_hmac_sha256 {
+	public:
+		static_assert(Size == 128 || Size == 194 || Size == 256, "Invalid key size");
+
+		constexpr static size_t IV_SIZE = 16;
+		constexpr static size_t TAG_SIZE = hmac_sha256::TAG_SIZE;
+
+		/**
+		 * Construct from separate encryption and MAC keys
+		 */
+		cbc_hmac_sha256(const_byte_view<Size / 8> enc_key, const_byte_view<> mac_key) noexcept;
+
+		/**
+		 * Encrypt data using a random IV
+		 * Output is cipher text followed by tag and IV
+		 */
+		byte_array encrypt(const_byte_view<> data) const noexcept;
+		/**
+		 * Decrypt data produced by encrypt
+		 * Returns empty optional if authentication fails
+		 */
+		std::optional<byte_array> decrypt(const_byte_view<> data) const noexcept;
+
+		/**
+		 * Encrypt data using iv. Output is padded cipher text followed by tag
+		 */
+		byte_array seal(const_byte_view<IV_SIZE> iv, const_byte_view<> data) const noexcept;
+		/**
+		 * Decrypt cipher text followed by tag
+		 * Returns empty optional if authentication or padding check fails
+		 */
+		std::optional<byte_array> open(const_byte_view<IV_SIZE> iv, const_byte_view<> data) const noexcept;
+
+	private:
+
+		internal::key_schedule<Size> enc;
+		internal::inv_key_schedule<Size> dec;
+		hmac_sha256 mac;
+
+	};
+
+	///
+	// Implementation
+	///
+
+	template <size_t Size, typename Pad>
+	inline cbc_hmac_sha256<Size, Pad>::cbc_hmac_sha256(const_byte_view<Size / 8> enc_key, const_byte_view<> mac_key) noexcept
+		: enc(enc_key), dec(enc), mac(mac_key)
+	{
+	}
+
+	template <size_t Size, typename Pad>
+	inline byte_array cbc_hmac_sha256<Size, Pad>::encrypt(const_byte_view<> data) const noexcept
+	{
+		const auto iv = krypto::get_srandom_bytes<IV_SIZE>();
+
+		auto cipher_text = seal(iv, data);
+
+		cipher_text.resize(cipher_text.size() + IV_SIZE);
+		std::copy(iv.begin(), iv.end(), cipher_text.end() - IV_SIZE);
+
+		return cipher_text;
+	}
+
+	template <size_t Size, typename Pad>
+	inline std::optional<byte_array> cbc_hmac_sha256<Size, Pad>::decrypt(const_byte_view<> data) const noexcept
+	{
+		if (data.size() < IV_SIZE)
+			return std::nullopt;
+
+		const auto iv = data.last<IV_SIZE>();
+		return open(iv, data.first(data.size() - IV_SIZE));
+	}
+
+	template <size_t Size, typename Pad>
+	inline byte_array cbc_hmac_sha256<Size, Pad>::seal(const_byte_view<IV_SIZE> iv, const_byte_view<> data) const noexcept
+	{
+		using namespace internal;
+
+		// Pad 1 to 16 bytes
+		const uint8_t pad_size = 16 - (data.size() % 16);
+		const size_t blocks = (data.size() + pad_size) / 16;
+
+		byte_array cipher_text(blocks * 16 + TAG_SIZE);
+		std::copy(data.begin(), data.end(), cipher_text.begin());
+		Pad::apply(cipher_text.begin() + data.size(), pad_size);
+
+		unsigned char* out = cipher_text.data();
+		block prev = block_load(iv.data());
+
+		const auto cbc_block = [&](size_t i) {
+			block b[1] = { block_xor(block_load(out + i * 16), prev) };
+			encrypt_blocks(b, enc);
+			block_store(out + i * 16, b[0]);
+			prev = b[0];
+		};
+
+		// Inner hash state after the key block
+		internal::sha256::state h = mac.inner.h;
+		internal::sha256::work w;
+
+		internal::sha256::prepare();
+
+		size_t i = 0;
+		for (; i < blocks && i < 4; i++) {
+			cbc_block(i);
+		}
+
+		// Hash the previous 4 cipher blocks while encrypting the next 4
+		for (; i + 4 <= blocks; i += 4) {
+			internal::sha256::begin(w, h, out + (i - 4) * 16);
+			internal::sha256::rounds<0>(w);
+			cbc_block(i);
+			internal::sha256::rounds<1>(w);
+			cbc_block(i + 1);
+			internal::sha256::rounds<2>(w);
+			cbc_block(i + 2);
+			internal::sha256::rounds<3>(w);
+			cbc_block(i + 3);
+			internal::sha256::end(h, w);
+		}
+
+		for (; i < blocks; i++) {
+			cbc_block(i);
+		}
+
+		// Finish the MAC over the remaining cipher text and the IV
+		const size_t hashed = blocks >= 4 ? (i / 4 - 1) * 64 : 0;
+
+		hmac_sha256 m = mac;
+		m.inner.h = h;
+		m.inner.total += hashed;
+		m.update(const_byte_view<>(out + hashed, blocks * 16 - hashed));
+		m.update(iv);
+
+		const auto tag = m.digest();
+		std::copy(tag.begin(), tag.end(), cipher_text.end() - TAG_SIZE);
+
+		return cipher_text;
+	}
+
+	template <size_t Size, typename Pad>
+	inline std::optional<byte_array> cbc_hmac_sha256<Size, Pad>::open(const_byte_view<IV_SIZE> iv, const_byte_view<> data) const noexcept
+	{
+		using namespace internal;
+
+		if (data.size() < TAG_SIZE + 16 || (data.size() - TAG_SIZE) % 16 != 0)
+			return std::nullopt;
+
+		const auto cipher = data.first(data.size() - TAG_SIZE);
+
+		// Verify before decrypting
+		hmac_sha256 m = mac;
+		m.update(cipher);
+		m.update(iv);
+		if (!secure_equal(m.digest(), data.last<TAG_SIZE>()))
+			return std::nullopt;
+
+		byte_array plain_text(cipher.size());
+		decrypt_cbc(cipher.data(), plain_text.data(), cipher.size() / 16, iv.data(), dec);
+
+		const uint8_t last = plain_text.back();
+		if (last == 0 || last > 16)
+			return std::nullopt;
+
+		const auto pad_size = Pad::detect(plain_text.end() - 1);
+		if (pad_size == 0)
+			return std::nullopt;
+
+		plain_text.resize(plain_text.size() - pad_size);
+		return plain_text;
+	}
+
+}
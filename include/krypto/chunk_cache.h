@@ -0,0 +1,367 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "util.h"
+#include "parallel.h"
+
+namespace krypto {
+
+	/**
+	 * Cache of decrypted chunks of encrypted files, for random reads.
+	 *
+	 * Chunks are keyed by (file id, chunk index) and decrypted on a miss by
+	 * the decryptor, a thread safe callable
+	 *     std::optional<size_t>(uint64_t file, uint64_t index, byte_view<> out)
+	 * which writes up to chunk_size bytes of plain text to out and returns the
+	 * count, 0 past the end of the file and an empty optional if decryption fails.
+	 *
+	 * The cache is split into shards, each with its own lock and CLOCK eviction
+	 * within an equal part of the memory budget, at most one shard per chunk
+	 * of the budget so each can hold a chunk. When a chunk misses and the
+	 * chunk before it is cached the access is taken as sequential, and the
+	 * next chunks are decrypted together with it on all threads.
+	 * Evicted chunks are wiped once the last reader releases them.
+	 */
+	template <typename Decryptor>
+	class chunk_cache {
+	public:
+
+		using chunk_ptr = std::shared_ptr<const byte_array>;
+
+		/**
+		 * budget is the maximum number of plain text bytes held
+		 */
+		chunk_cache(Decryptor decryptor, size_t budget, size_t chunk_size = 1 << 16, size_t readahead = 4, size_t shards = 16) noexcept;
+
+		/**
+		 * Decrypted chunk index of file, valid for as long as the pointer is held
+		 * Returns nullptr if decryption fails
+		 */
+		chunk_ptr get(uint64_t file, uint64_t index) noexcept;
+
+		/**
+		 * Copy plain text of file starting at offset to out
+		 * Returns the number of bytes copied, less than out.size() at the end of the file or if decryption fails
+		 */
+		size_t read(uint64_t file, uint64_t offset, byte_view<> out) noexcept;
+
+		/**
+		 * Drop all chunks of file, e.g. after it is rewritten
+		 * Chunks of file still being decrypted by a get are not cached
+		 */
+		void invalidate(uint64_t file) noexcept;
+
+		/**
+		 * Drop all chunks
+		 */
+		void clear() noexcept;
+
+		/**
+		 * Plain text bytes held
+		 */
+		size_t size() const noexcept;
+
+		uint64_t hits() const noexcept { return hit_count; }
+		uint64_t misses() const noexcept { return miss_count; }
+
+	private:
+
+		struct key {
+			uint64_t file;
+			uint64_t index;
+
+			bool operator==(const key&) const = default;
+		};
+
+		struct key_hash {
+			size_t operator()(const key& k) const noexcept;
+		};
+
+		struct slot {
+			key k;
+			chunk_ptr data;
+			bool referenced;
+		};
+
+		struct shard {
+			mutable std::mutex lock;
+			std::unordered_map<key, size_t, key_hash> map;
+			std::vector<slot> slots;
+			std::vector<size_t> free;
+			size_t hand = 0;
+			size_t bytes = 0;
+		};
+
+		// Counters the generations of files are hashed to
+		constexpr static size_t GENERATIONS = 256;
+
+		static size_t shard_count(size_t budget, size_t chunk_size, size_t shards) noexcept;
+
+		shard& shard_of(const key& k) noexcept;
+
+		/**
+		 * Generation of the chunks of file, changed by invalidate and clear
+		 */
+		uint64_t generation(uint64_t file) const noexcept;
+
+		chunk_ptr lookup(const key& k, bool touch = true) noexcept;
+		chunk_ptr decrypt(const key& k) noexcept;
+		chunk_ptr insert(const key& k, chunk_ptr data, uint64_t generation) noexcept;
+
+		void evict(shard& s, size_t i) noexcept;
+
+		Decryptor decryptor;
+		size_t chunk_size;
+		size_t readahead;
+		size_t shard_budget;
+
+		std::vector<shard> shards;
+
+		// Files share a counter by hash, invalidating one only keeps the others from caching a chunk in flight
+		std::unique_ptr<std::atomic<uint64_t>[]> generations;
+		std::atomic<uint64_t> epoch = 0;
+
+		std::atomic<uint64_t> hit_count = 0;
+		std::atomic<uint64_t> miss_count = 0;
+
+	};
+
+	///
+	// Implementation
+	///
+
+	template <typename Decryptor>
+	inline size_t chunk_cache<Decryptor>::key_hash::operator()(const key& k) const noexcept
+	{
+		uint64_t x = k.file * 0x9e3779b97f4a7c15 ^ k.index;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+		return static_cast<size_t>(x ^ (x >> 31));
+	}
+
+	template <typename Decryptor>
+	inline chunk_cache<Decryptor>::chunk_cache(Decryptor decryptor, size_t budget, size_t chunk_size, size_t readahead, size_t shards) noexcept
+		: decryptor(std::move(decryptor)), chunk_size(chunk_size), readahead(readahead),
+		shard_budget(budget / shard_count(budget, chunk_size, shards)), shards(shard_count(budget, chunk_size, shards)),
+		generations(new std::atomic<uint64_t>[GENERATIONS]())
+	{
+	}
+
+	template <typename Decryptor>
+	inline size_t chunk_cache<Decryptor>::shard_count(size_t budget, size_t chunk_size, size_t shards) noexcept
+	{
+		return std::clamp<size_t>(shards, 1, std::max<size_t>(1, budget / std::max<size_t>(chunk_size, 1)));
+	}
+
+	template <typename Decryptor>
+	inline typename chunk_cache<Decryptor>::shard& chunk_cache<Decryptor>::shard_of(const key& k) noexcept
+	{
+		// High bits, the map of the shard uses the low bits
+		return shards[(key_hash()(k) >> 32) % shards.size()];
+	}
+
+	template <typename Decryptor>
+	inline uint64_t chunk_cache<Decryptor>::generation(uint64_t file) const noexcept
+	{
+		return epoch + generations[key_hash()({ file, 0 }) % GENERATIONS];
+	}
+
+	template <typename Decryptor>
+	inline typename chunk_cache<Decryptor>::chunk_ptr chunk_cache<Decryptor>::lookup(const key& k, bool touch) noexcept
+	{
+		shard& s = shard_of(k);
+		std::lock_guard guard(s.lock);
+
+		const auto it = s.map.find(k);
+		if (it == s.map.end())
+			return nullptr;
+
+		slot& e = s.slots[it->second];
+		e.referenced |= touch;
+		return e.data;
+	}
+
+	template <typename Decryptor>
+	inline typename chunk_cache<Decryptor>::chunk_ptr chunk_cache<Decryptor>::decrypt(const key& k) noexcept
+	{
+		// Wipe the plain text when the cache and all readers are done with it
+		std::shared_ptr<byte_array> data(new byte_array(chunk_size), [](byte_array* p) {
+			secure_zero(*p);
+			delete p;
+		});
+
+		const auto size = decryptor(k.file, k.index, byte_view<>(*data));
+		if (!size)
+			return nullptr;
+
+		data->resize(*size);
+		return data;
+	}
+
+	template <typename Decryptor>
+	inline typename chunk_cache<Decryptor>::chunk_ptr chunk_cache<Decryptor>::insert(const key& k, chunk_ptr data, uint64_t generation) noexcept
+	{
+		// Nothing to hold past the end of the file
+		if (data->empty() || data->size() > shard_budget)
+			return data;
+
+		shard& s = shard_of(k);
+		std::lock_guard guard(s.lock);
+
+		// Invalidated while it was decrypted, possibly from the old file.
+		// invalidate changes the generation before it takes the shard lock
+		if (this->generation(k.file) != generation)
+			return data;
+
+		// Another thread decrypted it first
+		const auto it = s.map.find(k);
+		if (it != s.map.end())
+			return s.slots[it->second].data;
+
+		// Second chance: clear the referenced bit on the first pass, evict on the next
+		while (s.bytes + data->size() > shard_budget) {
+			slot& e = s.slots[s.hand];
+			if (e.data) {
+				if (e.referenced)
+					e.referenced = false;
+				else
+					evict(s, s.hand);
+			}
+			s.hand = (s.hand + 1) % s.slots.size();
+		}
+
+		size_t i;
+		if (s.free.empty()) {
+			i = s.slots.size();
+			s.slots.push_back({});
+		}
+		else {
+			i = s.free.back();
+			s.free.pop_back();
+		}
+
+		s.slots[i] = { k, data, false };
+		s.map.emplace(k, i);
+		s.bytes += data->size();
+
+		return data;
+	}
+
+	template <typename Decryptor>
+	inline void chunk_cache<Decryptor>::evict(shard& s, size_t i) noexcept
+	{
+		slot& e = s.slots[i];
+		s.bytes -= e.data->size();
+		s.map.erase(e.k);
+		e.data.reset();
+		s.free.push_back(i);
+	}
+
+	template <typename Decryptor>
+	inline typename chunk_cache<Decryptor>::chunk_ptr chunk_cache<Decryptor>::get(uint64_t file, uint64_t index) noexcept
+	{
+		const key k = { file, index };
+
+		if (auto data = lookup(k)) {
+			hit_count++;
+			return data;
+		}
+
+		miss_count++;
+
+		// Sequential access, decrypt the next chunks with this one
+		const bool sequential = readahead && index > 0 && lookup({ file, index - 1 }, false) != nullptr;
+		const int64_t count = sequential ? readahead + 1 : 1;
+
+		std::vector<chunk_ptr> chunks(count);
+		const uint64_t current = generation(file);
+
+		#pragma omp parallel for schedule(dynamic) if(count > 1) num_threads(internal::parallel::threads())
+		for (int64_t i = 0; i < count; i++) {
+			const key next = { file, index + i };
+			if (i == 0 || !lookup(next, false)) {
+				chunks[i] = decrypt(next);
+				if (chunks[i])
+					chunks[i] = insert(next, chunks[i], current);
+			}
+		}
+
+		return chunks[0];
+	}
+
+	template <typename Decryptor>
+	inline size_t chunk_cache<Decryptor>::read(uint64_t file, uint64_t offset, byte_view<> out) noexcept
+	{
+		size_t done = 0;
+
+		while (done < out.size()) {
+			const uint64_t position = offset + done;
+			const auto data = get(file, position / chunk_size);
+			if (!data)
+				break;
+
+			const size_t begin = position % chunk_size;
+			if (begin >= data->size())
+				break;
+
+			const size_t n = std::min(data->size() - begin, out.size() - done);
+			std::copy_n(data->begin() + begin, n, out.begin() + done);
+			done += n;
+
+			// Short chunk is the last of the file
+			if (data->size() < chunk_size)
+				break;
+		}
+
+		return done;
+	}
+
+	template <typename Decryptor>
+	inline void chunk_cache<Decryptor>::invalidate(uint64_t file) noexcept
+	{
+		generations[key_hash()({ file, 0 }) % GENERATIONS]++;
+
+		for (auto& s : shards) {
+			std::lock_guard guard(s.lock);
+			for (size_t i = 0; i < s.slots.size(); i++) {
+				if (s.slots[i].data && s.slots[i].k.file == file)
+					evict(s, i);
+			}
+		}
+	}
+
+	template <typename Decryptor>
+	inline void chunk_cache<Decryptor>::clear() noexcept
+	{
+		epoch++;
+
+		for (auto& s : shards) {
+			std::lock_guard guard(s.lock);
+			for (size_t i = 0; i < s.slots.size(); i++) {
+				if (s.slots[i].data)
+					evict(s, i);
+			}
+		}
+	}
+
+	template <typename Decryptor>
+	inline size_t chunk_cache<Decryptor>::size() const noexcept
+	{
+		size_t bytes = 0;
+		for (const auto& s : shards) {
+			std::lock_guard guard(s.lock);
+			bytes += s.bytes;
+		}
+		return bytes;
+	}
+
+}
@@ -0,0 +1,348 @@
+#pragma once
+
+#include <cstdint>
+#include <cassert>
+#include <array>
+#include <vector>
+#include <span>
+#include <optional>
+#include <algorithm>
+#include <bit>
+
+#include "util.h"
+#include "sha256.h"
+#include "internal/kernels.h"
+#include "parallel.h"
+
+namespace krypto::internal::cdc {
+
+	/**
+	 * Random table of the gear hash, generated with splitmix64.
+	 * Chunk boundaries depend on it and must not change between versions
+	 */
+	constexpr std::array<uint64_t, 256> make_gear() noexcept
+	{
+		std::array<uint64_t, 256> gear{};
+		uint64_t x = 0;
+		for (auto& g : gear) {
+			x += 0x9e3779b97f4a7c15;
+			uint64_t z = x;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+			g = z ^ (z >> 31);
+		}
+		return gear;
+	}
+
+	constexpr std::array<uint64_t, 256> GEAR = make_gear();
+
+	// Bytes that affect the hash at a position
+	constexpr size_t WINDOW = 64;
+	// Positions hashed in lock step
+	constexpr size_t LANES = 4;
+	// Bytes per thread when searching candidates
+	constexpr size_t SEGMENT = 1 << 20;
+
+	/**
+	 * Hash of the window ending before pos
+	 */
+	inline uint64_t warm(const unsigned char* data, size_t pos) noexcept;
+
+	/**
+	 * Find cut candidates of the bytes in [begin, end).
+	 * A candidate is encoded as chunk end offset << 1 | 1 if it also matches mask_s
+	 */
+	inline void scan(const unsigned char* data, size_t begin, size_t end, uint64_t mask_s, uint64_t mask_l, std::vector<uint64_t>& out) noexcept;
+
+}
+
+namespace krypto {
+
+	/**
+	 * FastCDC content defined chunking, https://www.usenix.org/system/files/conference/atc16/atc16-paper-xia.pdf
+	 *
+	 * A boundary only depends on the 64 bytes before it, so an insert in the
+	 * data moves the boundaries next to it and leaves the rest in place.
+	 * Candidates are searched in 1 MiB segments on all threads, each segment
+	 * hashed at 4 positions in lock step since the gear hash is one long
+	 * dependency chain. The minimum, normal and maximum chunk sizes are then
+	 * applied in one cheap serial pass.
+	 */
+	class fastcdc {
+	public:
+
+		/**
+		 * avg_size must be a power of two. Chunks are avg_size / 4 to avg_size * 8 bytes
+		 */
+		explicit fastcdc(size_t avg_size = 8192) noexcept;
+
+		/**
+		 * End offsets of the chunks of data
+		 */
+		std::vector<size_t> split(const_byte_view<> data) const noexcept;
+
+		size_t min_size() const noexcept { return min; }
+		size_t avg_size() const noexcept { return avg; }
+		size_t max_size() const noexcept { return max; }
+
+	private:
+
+		size_t min;
+		size_t avg;
+		size_t max;
+
+		// Harder mask before avg_size, easier after, normalized chunking level 2
+		uint64_t mask_s;
+		uint64_t mask_l;
+
+	};
+
+	/**
+	 * Convergent encryption of content defined chunks for deduplicated storage.
+	 *
+	 * The key of a chunk is HMAC-SHA256(secret, chunk), the chunk is encrypted
+	 * with AES-CTR under that key and a zero IV. Equal chunks encrypted by
+	 * clients sharing the secret give equal cipher text and id, so storage can
+	 * deduplicate without seeing the data. The key also authenticates the
+	 * chunk, as the synthetic IV does in SIV mode.
+	 * Chunks are encrypted in parallel.
+	 */
+	template <size_t Size = 256>
+	class dedup {
+	public:
+		static_assert(Size == 128 || Size == 194 || Size == 256, "Invalid key size");
+
+		constexpr static size_t KEY_SIZE = Size / 8;
+		constexpr static size_t ID_SIZE = sha256::DIGEST_SIZE;
+
+		using key_type = std::array<unsigned char, KEY_SIZE>;
+		using id_type = sha256::digest_type;
+
+		struct chunk {
+			// Position in the input
+			size_t offset;
+			// Needed to decrypt, keep it with the file manifest
+			key_type key;
+			// Storage address, SHA-256 of the key
+			id_type id;
+			byte_array cipher_text;
+		};
+
+		/**
+		 * Construct from the secret shared by the clients that deduplicate together
+		 */
+		explicit dedup(const_byte_view<> secret, fastcdc cdc = fastcdc()) noexcept;
+
+		/**
+		 * Split data into chunks and encrypt them
+		 */
+		std::vector<chunk> encrypt(const_byte_view<> data) const noexcept;
+
+		/**
+		 * Encrypt a single chunk, offset is set to 0
+		 */
+		chunk encrypt_chunk(const_byte_view<> data) const noexcept;
+
+		/**
+		 * Decrypt the cipher text of a chunk
+		 * Returns empty optional if it does not match the key
+		 */
+		std::optional<byte_array> decrypt(const_byte_view<KEY_SIZE> key, const_byte_view<> cipher_text) const noexcept;
+
+	private:
+
+		void crypt(const key_type& key, const unsigned char* in, unsigned char* out, size_t size) const noexcept;
+
+		fastcdc cdc;
+		hmac_sha256 mac;
+
+	};
+
+	///
+	// Implementation
+	///
+
+	namespace internal::cdc {
+
+		inline uint64_t warm(const unsigned char* data, size_t pos) noexcept
+		{
+			uint64_t h = 0;
+			for (size_t i = pos >= WINDOW - 1 ? pos - (WINDOW - 1) : 0; i < pos; i++) {
+				h = (h << 1) + GEAR[data[i]];
+			}
+			return h;
+		}
+
+		inline void scan(const unsigned char* data, size_t begin, size_t end, uint64_t mask_s, uint64_t mask_l, std::vector<uint64_t>& out) noexcept
+		{
+			// Lanes cover equal runs, the rest is hashed serially
+			const size_t len = (end - begin) / LANES;
+
+			uint64_t h[LANES];
+			const unsigned char* lane[LANES];
+			std::vector<uint64_t> found[LANES];
+
+			for (size_t l = 0; l < LANES; l++) {
+				lane[l] = data + begin + l * len;
+				h[l] = warm(data, begin + l * len);
+			}
+
+			// Candidates are rare, the branch is almost never taken
+			for (size_t i = 0; i < len; i++) {
+				KRYPTO_UNROLL
+				for (size_t l = 0; l < LANES; l++) {
+					h[l] = (h[l] << 1) + GEAR[lane[l][i]];
+					if ((h[l] & mask_l) == 0) [[unlikely]]
+						found[l].push_back(static_cast<uint64_t>(lane[l] - data + i + 1) << 1 | ((h[l] & mask_s) == 0));
+				}
+			}
+
+			for (size_t l = 0; l < LANES; l++) {
+				out.insert(out.end(), found[l].begin(), found[l].end());
+			}
+
+			uint64_t t = warm(data, begin + LANES * len);
+			for (size_t i = begin + LANES * len; i < end; i++) {
+				t = (t << 1) + GEAR[data[i]];
+				if ((t & mask_l) == 0)
+					out.push_back(static_cast<uint64_t>(i + 1) << 1 | ((t & mask_s) == 0));
+			}
+		}
+
+	}
+
+	inline fastcdc::fastcdc(size_t avg_size) noexcept
+		: min(avg_size / 4), avg(avg_size), max(avg_size * 8)
+	{
+		assert(std::has_single_bit(avg_size) && avg_size >= 256);
+
+		// The high bits of the hash depend on the most bytes
+		const int bits = std::countr_zero(avg_size);
+		mask_s = ~uint64_t(0) << (64 - (bits + 2));
+		mask_l = ~uint64_t(0) << (64 - (bits - 2));
+	}
+
+	inline std::vector<size_t> fastcdc::split(const_byte_view<> data) const noexcept
+	{
+		using namespace internal::cdc;
+
+		const size_t size = data.size();
+		const int64_t segments = (size + SEGMENT - 1) / SEGMENT;
+
+		std::vector<std::vector<uint64_t>> found(segments);
+
+		#pragma omp parallel for schedule(dynamic) if(segments > 1) num_threads(internal::parallel::threads())
+		for (int64_t s = 0; s < segments; s++) {
+			const size_t begin = s * SEGMENT;
+			scan(data.data(), begin, std::min(begin + SEGMENT, size), mask_s, mask_l, found[s]);
+		}
+
+		std::vector<uint64_t> candidates;
+		for (const auto& f : found) {
+			candidates.insert(candidates.end(), f.begin(), f.end());
+		}
+
+		std::vector<size_t> ends;
+		ends.reserve(size / avg + 1);
+
+		auto it = candidates.begin();
+		size_t start = 0;
+
+		while (start < size) {
+			size_t end = std::min(start + max, size);
+
+			if (size - start > min) {
+				while (it != candidates.end() && (*it >> 1) < start + min)
+					it++;
+
+				// First strong candidate before the normal size, else the first weak one after
+				auto c = it;
+				for (; c != candidates.end() && (*c >> 1) < start + avg; c++) {
+					if (*c & 1)
+						break;
+				}
+
+				if (c != candidates.end() && (*c >> 1) < end)
+					end = *c >> 1;
+			}
+			else {
+				end = size;
+			}
+
+			ends.push_back(end);
+			start = end;
+		}
+
+		return ends;
+	}
+
+	template <size_t Size>
+	inline dedup<Size>::dedup(const_byte_view<> secret, fastcdc cdc) noexcept
+		: cdc(cdc), mac(secret)
+	{
+	}
+
+	template <size_t Size>
+	inline void dedup<Size>::crypt(const key_type& key, const unsigned char* in, unsigned char* out, size_t size) const noexcept
+	{
+		// Every key encrypts a single message, so the IV can be fixed
+		const std::array<unsigned char, 16> iv{};
+		const internal::key_schedule<Size> ks(key);
+		internal::ctr_xor(in, out, size, ks, internal::ctr_stream(iv.data(), false), 0);
+	}
+
+	template <size_t Size>
+	inline typename dedup<Size>::chunk dedup<Size>::encrypt_chunk(const_byte_view<> data) const noexcept
+	{
+		hmac_sha256 m = mac;
+		m.update(data);
+		const auto tag = m.digest();
+
+		chunk c;
+		c.offset = 0;
+		std::copy_n(tag.begin(), KEY_SIZE, c.key.begin());
+		c.id = sha256::hash(c.key);
+		c.cipher_text.resize(data.size());
+		crypt(c.key, data.data(), c.cipher_text.data(), data.size());
+
+		return c;
+	}
+
+	template <size_t Size>
+	inline std::vector<typename dedup<Size>::chunk> dedup<Size>::encrypt(const_byte_view<> data) const noexcept
+	{
+		const auto ends = cdc.split(data);
+		std::vector<chunk> chunks(ends.size());
+
+		#pragma omp parallel for schedule(dynamic) num_threads(internal::parallel::threads())
+		for (int64_t i = 0; i < static_cast<int64_t>(ends.size()); i++) {
+			const size_t begin = i == 0 ? 0 : ends[i - 1];
+			chunks[i] = encrypt_chunk(data.subspan(begin, ends[i] - begin));
+			chunks[i].offset = begin;
+		}
+
+		return chunks;
+	}
+
+	template <size_t Size>
+	inline std::optional<byte_array> dedup<Size>::decrypt(const_byte_view<KEY_SIZE> key, const_byte_view<> cipher_text) const noexcept
+	{
+		key_type k;
+		std::copy(key.begin(), key.end(), k.begin());
+
+		byte_array plain_text(cipher_text.size());
+		crypt(k, cipher_text.data(), plain_text.data(), cipher_text.size());
+
+		hmac_sha256 m = mac;
+		m.update(plain_text);
+		const auto tag = m.digest();
+
+		if (!secure_equal(const_byte_view<>(tag).first(KEY_SIZE), key)) {
+			secure_zero(plain_text);
+			return std::nullopt;
+		}
+
+		return plain_text;
+	}
+
+}
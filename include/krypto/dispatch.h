@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+
+#include "internal/block.h"
+
+namespace krypto {
+
+	/**
+	 * Message sizes at which the bulk AES kernels switch to wider registers.
+	 *
+	 * 128 bit AES-NI is used below vaes256, 256 bit VAES from vaes256 and
+	 * 512 bit VAES from vaes512 bytes. On parts that lower the core clock
+	 * while 512 bit instructions run, a short burst of them slows everything
+	 * else on the core for much longer than the burst, so they are kept to
+	 * messages large enough to pay for it. SIZE_MAX disables a width.
+	 *
+	 * Widths are only available when compiled for them (-mvaes with -mavx2,
+	 * and -mavx512f -mavx512bw for 512 bit). Messages are the unit of
+	 * dispatch, the stripes of a large GCM message all use its width.
+	 * A backend fixed with krypto_FORCE_BACKEND ignores the policy.
+	 */
+	struct dispatch_policy {
+		size_t vaes256 = 512;
+		size_t vaes512 = 1 << 16;
+	};
+
+	/**
+	 * Policy used by all threads from the next call of a kernel
+	 */
+	inline void set_dispatch_policy(const dispatch_policy& policy) noexcept;
+	inline dispatch_policy get_dispatch_policy() noexcept;
+
+	inline namespace KRYPTO_ISA {
+
+		/**
+		 * AES backend of the widest CTR kernel the program runs: "table", "aesni",
+		 * "vaes256" or "vaes512". With the runtime selected kernels of the compiled
+		 * library it depends on the CPU. In the inline namespace of the instruction
+		 * set, translation units built with other flags have their own answer
+		 */
+		inline const char* backend() noexcept;
+
+	}
+
+	///
+	// Implementation
+	///
+
+	namespace internal::dispatch {
+
+		inline std::atomic<size_t> vaes256 = dispatch_policy{}.vaes256;
+		inline std::atomic<size_t> vaes512 = dispatch_policy{}.vaes512;
+
+	}
+
+	inline void set_dispatch_policy(const dispatch_policy& policy) noexcept
+	{
+		internal::dispatch::vaes256.store(policy.vaes256, std::memory_order_relaxed);
+		internal::dispatch::vaes512.store(policy.vaes512, std::memory_order_relaxed);
+	}
+
+	inline dispatch_policy get_dispatch_policy() noexcept
+	{
+		return { internal::dispatch::vaes256.load(std::memory_order_relaxed), internal::dispatch::vaes512.load(std::memory_order_relaxed) };
+	}
+
+	inline namespace KRYPTO_ISA {
+
+		inline const char* backend() noexcept
+		{
+#if defined(KRYPTO_VAES512)
+			return "vaes512";
+#elif defined(KRYPTO_VAES256)
+			return "vaes256";
+#elif defined(KRYPTO_RUNTIME_VAES)
+			if (internal::isa::vaes512())
+				return "vaes512";
+			if (internal::isa::vaes256())
+				return "vaes256";
+			return "aesni";
+#elif defined(KRYPTO_AESNI)
+			return "aesni";
+#else
+			return "table";
+#endif
+		}
+
+	}
+
+}
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include <span>
+#include <string>
+#include <optional>
+
+#ifdef WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "util.h"
+#include "internal/block.h"
+
+namespace krypto {
+
+	/**
+	 * Non cryptographic 128 bit hash built from AES rounds, for checksums
+	 * and hash tables. Do not use where an adversary chooses the input.
+	 *
+	 * Input is consumed in 64 byte stripes by 4 independent lanes, each lane
+	 * runs one AES round per 16 bytes with the data as round key.
+	 */
+	class fast_hash {
+	public:
+		constexpr static size_t LANES = 4;
+		constexpr static size_t STRIPE = LANES * 16;
+
+		explicit fast_hash(uint64_t seed = 0) noexcept;
+
+		/**
+		 * Add data to the hash
+		 */
+		void update(const_byte_view<> data) noexcept;
+
+		/**
+		 * Digest of all data added so far, the state is not modified
+		 */
+		block128 digest() const noexcept;
+
+		/**
+		 * Hash data in one call
+		 */
+		static block128 hash(const_byte_view<> data, uint64_t seed = 0) noexcept;
+
+	private:
+
+		void absorb(const unsigned char* stripe) noexcept;
+
+		internal::block lanes[LANES];
+
+		std::array<unsigned char, STRIPE> buffer{};
+		size_t buffered = 0;
+		uint64_t total = 0;
+
+	};
+
+	/**
+	 * Hash a file with fast_hash through a read only memory mapping.
+	 * Returns empty optional if the file cannot be read
+	 */
+	std::optional<block128> hash_file(const std::string& path, uint64_t seed = 0) noexcept;
+
+	///
+	// Implementation
+	///
+
+	namespace internal::fasthash {
+
+		// Initial lane values, fractional parts of pi and e
+		constexpr std::array<std::array<uint64_t, 2>, 4> INIT = { {
+			{ 0x243f6a8885a308d3, 0x13198a2e03707344 },
+			{ 0xa4093822299f31d0, 0x082efa98ec4e6c89 },
+			{ 0xb7e151628aed2a6a, 0xbf7158809cf4f3c7 },
+			{ 0x62e7160f38b4da56, 0xa784d9045190cfef }
+		} };
+
+	}
+
+	inline fast_hash::fast_hash(uint64_t seed) noexcept
+	{
+		using namespace internal;
+
+		for (size_t i = 0; i < LANES; i++) {
+			lanes[i] = block_set64(fasthash::INIT[i][0] ^ seed, fasthash::INIT[i][1] + seed);
+		}
+	}
+
+	inline void fast_hash::absorb(const unsigned char* stripe) noexcept
+	{
+		using namespace internal;
+
+		KRYPTO_UNROLL
+		for (size_t i = 0; i < LANES; i++) {
+			lanes[i] = aesenc(lanes[i], block_load(stripe + i * 16));
+		}
+	}
+
+	inline void fast_hash::update(const_byte_view<> data) noexcept
+	{
+		const unsigned char* in = data.data();
+		size_t size = data.size();
+
+		total += size;
+
+		// Fill up a previously started stripe
+		if (buffered) {
+			const size_t take = std::min(STRIPE - buffered, size);
+			std::copy_n(in, take, buffer.begin() + buffered);
+			buffered += take;
+			in += take;
+			size -= take;
+
+			if (buffered < STRIPE)
+				return;
+
+			absorb(buffer.data());
+			buffered = 0;
+		}
+
+		// Two stripes per iteration keeps more loads in flight
+		for (; size >= 2 * STRIPE; in += 2 * STRIPE, size -= 2 * STRIPE) {
+			absorb(in);
+			absorb(in + STRIPE);
+		}
+
+		for (; size >= STRIPE; in += STRIPE, size -= STRIPE) {
+			absorb(in);
+		}
+
+		std::copy_n(in, size, buffer.begin());
+		buffered = size;
+	}
+
+	inline block128 fast_hash::digest() const noexcept
+	{
+		using namespace internal;
+
+		block l[LANES];
+		std::copy(std::begin(lanes), std::end(lanes), l);
+
+		// Zero padded last stripe, the length below tells padding from data
+		if (buffered) {
+			std::array<unsigned char, STRIPE> last{};
+			std::copy_n(buffer.begin(), buffered, last.begin());
+
+			for (size_t i = 0; i < LANES; i++) {
+				l[i] = aesenc(l[i], block_load(&last[i * 16]));
+			}
+		}
+
+		const block length = block_set64(total, ~total);
+
+		// Mix lanes into each other
+		for (size_t r = 0; r < 3; r++) {
+			const block t = l[0];
+			l[0] = aesenc(l[0], block_xor(l[1], length));
+			l[1] = aesenc(l[1], l[2]);
+			l[2] = aesenc(l[2], l[3]);
+			l[3] = aesenc(l[3], t);
+		}
+
+		block res = aesenc(block_xor(l[0], l[2]), block_xor(l[1], l[3]));
+		res = aesenc(res, length);
+		res = aesenclast(res, block_zero());
+
+		block128 out;
+		block_store(out.data(), res);
+		return out;
+	}
+
+	inline block128 fast_hash::hash(const_byte_view<> data, uint64_t seed) noexcept
+	{
+		fast_hash h(seed);
+		h.update(data);
+		return h.digest();
+	}
+
+	inline std::optional<block128> hash_file(const std::string& path, uint64_t seed) noexcept
+	{
+		fast_hash h(seed);
+
+#ifdef WIN32
+
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return std::nullopt;
+
+		std::vector<char> chunk(1 << 20);
+		while (file) {
+			file.read(chunk.data(), chunk.size());
+			h.update(const_byte_view<>(reinterpret_cast<const unsigned char*>(chunk.data()), file.gcount()));
+		}
+
+		if (file.bad())
+			return std::nullopt;
+
+#else
+
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return std::nullopt;
+
+		struct stat st;
+		if (::fstat(fd, &st) != 0) {
+			::close(fd);
+			return std::nullopt;
+		}
+
+		const size_t size = static_cast<size_t>(st.st_size);
+
+		// mmap of an empty file fails
+		if (size > 0) {
+			void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map == MAP_FAILED) {
+				::close(fd);
+				return std::nullopt;
+			}
+
+			::madvise(map, size, MADV_SEQUENTIAL);
+			h.update(const_byte_view<>(static_cast<const unsigned char*>(map), size));
+			::munmap(map, size);
+		}
+
+		::close(fd);
+
+#endif
+
+		return h.digest();
+	}
+
+}
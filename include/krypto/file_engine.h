@@ -0,0 +1,421 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "internal/kernels.h"
+#include "parallel.h"
+#include "governor.h"
+
+namespace krypto::internal::files {
+
+	// Alignment of buffers, offsets and sizes for O_DIRECT
+	constexpr size_t ALIGNMENT = 4096;
+
+	struct buffer_deleter {
+		void operator()(unsigned char* p) const noexcept { std::free(p); }
+	};
+
+	using buffer = std::unique_ptr<unsigned char, buffer_deleter>;
+
+	struct chunk {
+		unsigned char* data;
+		uint64_t offset;
+		size_t size;
+		// Short read or cancelled, the chunk is dropped
+		bool failed;
+	};
+
+	/**
+	 * Blocking queue between the stages of the pipeline, closed by the producer
+	 */
+	class channel {
+	public:
+		void push(const chunk& c) noexcept;
+		std::optional<chunk> pop() noexcept;
+		void close() noexcept;
+
+	private:
+		std::mutex lock;
+		std::condition_variable ready;
+		std::deque<chunk> items;
+		bool closed = false;
+	};
+
+	/**
+	 * Open path with O_DIRECT, falling back to buffered I/O if the file system does not support it
+	 */
+	inline int open_direct(const std::string& path, int flags, bool& direct) noexcept;
+
+	/**
+	 * Read or write all size bytes at offset, returns the bytes transferred
+	 */
+	inline size_t read_full(int fd, unsigned char* data, size_t size, uint64_t offset) noexcept;
+	inline size_t write_full(int fd, const unsigned char* data, size_t size, uint64_t offset) noexcept;
+
+}
+
+namespace krypto {
+
+	/**
+	 * Bulk AES-CTR file encryption and re-encryption with O_DIRECT.
+	 *
+	 * Files are streamed through a pool of 4 KiB aligned buffers: a reader
+	 * thread keeps up to depth buffers read ahead, the calling thread
+	 * encrypts each buffer in place on all threads and a writer thread
+	 * writes it back. The page cache is bypassed, so a pass over a file
+	 * much larger than memory neither copies every byte through the cache
+	 * nor evicts the hot data of other processes. Where O_DIRECT is not
+	 * supported buffered I/O is used and the cache is dropped behind.
+	 *
+	 * Output is the raw CTR stream without IV, as long as the input.
+	 * Input and output may be the same file, also under another name or through a link.
+	 */
+	template <size_t Size = 256>
+	class file_engine {
+	public:
+		static_assert(Size == 128 || Size == 194 || Size == 256, "Invalid key size");
+
+		constexpr static size_t KEY_SIZE = Size / 8;
+		constexpr static size_t ALIGNMENT = internal::files::ALIGNMENT;
+
+		/**
+		 * buffer_size must be a multiple of ALIGNMENT, depth is the number of buffers
+		 */
+		explicit file_engine(size_t buffer_size = 1 << 20, size_t depth = 8) noexcept;
+
+		/**
+		 * Encrypt or decrypt in to out with key and initial counter block iv
+		 * With a governor the work is paced by its budget and counted in its progress
+		 * Returns the bytes processed, or empty optional on an I/O error or if gov is cancelled
+		 * committed is set to the length of the prefix of out that holds the result, see run
+		 */
+		std::optional<uint64_t> ctr(const std::string& in, const std::string& out, const_byte_view<KEY_SIZE> key, const_byte_view<16> iv,
+			governor* gov = nullptr, uint64_t* committed = nullptr) const noexcept;
+
+		/**
+		 * Cipher text of in under (from, iv_from) to out under (to, iv_to) in one pass,
+		 * the plain text is never written to memory
+		 * Returns the bytes processed, or empty optional on an I/O error or if gov is cancelled
+		 * committed is set to the length of the prefix of out that holds the result, see run
+		 */
+		std::optional<uint64_t> rekey(const std::string& in, const std::string& out, const_byte_view<KEY_SIZE> from, const_byte_view<16> iv_from,
+			const_byte_view<KEY_SIZE> to, const_byte_view<16> iv_to, governor* gov = nullptr, uint64_t* committed = nullptr) const noexcept;
+
+		size_t buffer_size() const noexcept { return size; }
+		size_t depth() const noexcept { return count; }
+
+	private:
+
+		// Bytes per thread when a buffer is encrypted
+		constexpr static size_t STRIPE = 1 << 16;
+
+		/**
+		 * Stream in through transform(data, offset, size) to out
+		 *
+		 * Cancelling gov stops the run between buffers, a buffer is transformed
+		 * and written whole. committed is the prefix of out written before the
+		 * run stopped: in place the rest of the file is unchanged, a separate
+		 * out is truncated to it. After a failed write the buffer being written
+		 * may be partly written beyond committed.
+		 */
+		template <typename Transform>
+		std::optional<uint64_t> run(const std::string& in, const std::string& out, governor* gov, uint64_t* committed, Transform transform) const noexcept;
+
+		size_t size;
+		size_t count;
+
+	};
+
+	///
+	// Implementation
+	///
+
+	namespace internal::files {
+
+		inline void channel::push(const chunk& c) noexcept
+		{
+			{
+				std::lock_guard guard(lock);
+				items.push_back(c);
+			}
+			ready.notify_one();
+		}
+
+		inline std::optional<chunk> channel::pop() noexcept
+		{
+			std::unique_lock guard(lock);
+			ready.wait(guard, [this] { return !items.empty() || closed; });
+
+			if (items.empty())
+				return std::nullopt;
+
+			const chunk c = items.front();
+			items.pop_front();
+			return c;
+		}
+
+		inline void channel::close() noexcept
+		{
+			{
+				std::lock_guard guard(lock);
+				closed = true;
+			}
+			ready.notify_all();
+		}
+
+		inline int open_direct(const std::string& path, int flags, bool& direct) noexcept
+		{
+#ifdef O_DIRECT
+			const int fd = ::open(path.c_str(), flags | O_DIRECT, 0600);
+			if (fd >= 0 || errno != EINVAL) {
+				direct = fd >= 0;
+				return fd;
+			}
+#endif
+			direct = false;
+			return ::open(path.c_str(), flags, 0600);
+		}
+
+		inline size_t read_full(int fd, unsigned char* data, size_t size, uint64_t offset) noexcept
+		{
+			size_t done = 0;
+			while (done < size) {
+				const ssize_t n = ::pread(fd, data + done, size - done, offset + done);
+				if (n < 0 && errno == EINTR)
+					continue;
+				if (n <= 0)
+					break;
+				done += n;
+			}
+			return done;
+		}
+
+		inline size_t write_full(int fd, const unsigned char* data, size_t size, uint64_t offset) noexcept
+		{
+			size_t done = 0;
+			while (done < size) {
+				const ssize_t n = ::pwrite(fd, data + done, size - done, offset + done);
+				if (n < 0 && errno == EINTR)
+					continue;
+				if (n <= 0)
+					break;
+				done += n;
+			}
+			return done;
+		}
+
+	}
+
+	template <size_t Size>
+	inline file_engine<Size>::file_engine(size_t buffer_size, size_t depth) noexcept
+		: size(buffer_size), count(std::max<size_t>(depth, 1))
+	{
+		assert(buffer_size > 0 && buffer_size % ALIGNMENT == 0);
+	}
+
+	template <size_t Size>
+	template <typename Transform>
+	inline std::optional<uint64_t> file_engine<Size>::run(const std::string& in, const std::string& out, governor* gov, uint64_t* committed, Transform transform) const noexcept
+	{
+		using namespace internal::files;
+
+		if (committed)
+			*committed = 0;
+
+		bool direct_in;
+		bool direct_out;
+
+		const int fd_in = open_direct(in, O_RDONLY, direct_in);
+		if (fd_in < 0)
+			return std::nullopt;
+
+		// Not truncated yet, out may be in under another name or a link
+		const int fd_out = open_direct(out, O_WRONLY | O_CREAT, direct_out);
+
+		struct stat st;
+		struct stat st_out;
+		if (fd_out < 0 || ::fstat(fd_in, &st) != 0 || ::fstat(fd_out, &st_out) != 0) {
+			::close(fd_in);
+			if (fd_out >= 0)
+				::close(fd_out);
+			return std::nullopt;
+		}
+
+		// In place, each chunk is written after it is read
+		const bool same = st.st_dev == st_out.st_dev && st.st_ino == st_out.st_ino;
+		if (!same && ::ftruncate(fd_out, 0) != 0) {
+			::close(fd_in);
+			::close(fd_out);
+			return std::nullopt;
+		}
+
+		const uint64_t total = st.st_size;
+		if (gov)
+			gov->expect(total);
+
+		std::vector<buffer> buffers;
+		channel free;
+		channel filled;
+		channel encrypted;
+
+		for (size_t i = 0; i < count; i++) {
+			buffers.emplace_back(static_cast<unsigned char*>(std::aligned_alloc(ALIGNMENT, size)));
+			if (!buffers.back()) {
+				::close(fd_in);
+				::close(fd_out);
+				return std::nullopt;
+			}
+			free.push({ buffers.back().get(), 0, 0, false });
+		}
+
+		// Stops the reader after a failed write
+		std::atomic<bool> failed = false;
+		// Stops the reader after a cancel, the buffers before it are still written
+		std::atomic<bool> stopped = false;
+		// End of the chunks written, they are written in order
+		uint64_t written = 0;
+
+		std::thread reader([&] {
+			for (uint64_t offset = 0; offset < total && !failed && !stopped; offset += size) {
+				auto c = free.pop();
+				c->offset = offset;
+				c->size = static_cast<size_t>(std::min<uint64_t>(size, total - offset));
+
+				// Whole buffers for O_DIRECT, the last read is short
+				c->failed = read_full(fd_in, c->data, direct_in ? size : c->size, offset) < c->size;
+				filled.push(*c);
+			}
+			filled.close();
+		});
+
+		std::thread writer([&] {
+			while (auto c = encrypted.pop()) {
+				if (!failed && !c->failed) {
+					// The last chunk is padded to the alignment and the file truncated after
+					const size_t n = direct_out ? (c->size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT : c->size;
+					if (write_full(fd_out, c->data, n, c->offset) < n)
+						failed = true;
+					else
+						written = c->offset + c->size;
+#ifdef POSIX_FADV_DONTNEED
+					if (!direct_out)
+						::posix_fadvise(fd_out, c->offset, c->size, POSIX_FADV_DONTNEED);
+#endif
+				}
+				else {
+					failed = true;
+				}
+				free.push(*c);
+			}
+		});
+
+		while (auto c = filled.pop()) {
+			// Only checked between buffers, a buffer in place is never left half converted
+			if (gov && gov->cancelled()) {
+				c->failed = true;
+				stopped = true;
+			}
+			if (!c->failed)
+				transform(c->data, c->offset, c->size);
+			encrypted.push(*c);
+		}
+		encrypted.close();
+
+		reader.join();
+		writer.join();
+
+		// A separate output holds exactly the written prefix, padding of the last write included
+		bool ok = !failed;
+		if (ok || !same)
+			ok = ::ftruncate(fd_out, ok ? total : written) == 0 && ok;
+		ok = ::fdatasync(fd_out) == 0 && ok;
+
+		::close(fd_in);
+		::close(fd_out);
+
+		// Plain text passed through the buffers
+		for (auto& b : buffers) {
+			krypto::secure_zero(byte_view<>(b.get(), size));
+		}
+
+		if (committed)
+			*committed = written;
+
+		if (!ok)
+			return std::nullopt;
+		return total;
+	}
+
+	template <size_t Size>
+	inline std::optional<uint64_t> file_engine<Size>::ctr(const std::string& in, const std::string& out, const_byte_view<KEY_SIZE> key, const_byte_view<16> iv,
+		governor* gov, uint64_t* committed) const noexcept
+	{
+		const internal::key_schedule<Size> ks(key);
+		const internal::ctr_stream stream(iv.data(), false);
+
+		return run(in, out, gov, committed, [&](unsigned char* data, uint64_t offset, size_t n) {
+			const int64_t stripes = (n + STRIPE - 1) / STRIPE;
+
+			#pragma omp parallel for schedule(dynamic) if(stripes > 1) num_threads(internal::parallel::governed_threads(gov))
+			for (int64_t s = 0; s < stripes; s++) {
+				const size_t begin = s * STRIPE;
+				const size_t m = std::min(STRIPE, n - begin);
+				internal::parallel::governed_finish(gov, m, [&] {
+					internal::ctr_xor(data + begin, data + begin, m, ks, stream, (offset + begin) / 16);
+				});
+			}
+		});
+	}
+
+	template <size_t Size>
+	inline std::optional<uint64_t> file_engine<Size>::rekey(const std::string& in, const std::string& out, const_byte_view<KEY_SIZE> from, const_byte_view<16> iv_from,
+		const_byte_view<KEY_SIZE> to, const_byte_view<16> iv_to, governor* gov, uint64_t* committed) const noexcept
+	{
+		const internal::key_schedule<Size> ks_from(from);
+		const internal::key_schedule<Size> ks_to(to);
+		const internal::ctr_stream stream_from(iv_from.data(), false);
+		const internal::ctr_stream stream_to(iv_to.data(), false);
+
+		return run(in, out, gov, committed, [&](unsigned char* data, uint64_t offset, size_t n) {
+			const int64_t stripes = (n + STRIPE - 1) / STRIPE;
+
+			#pragma omp parallel for schedule(dynamic) if(stripes > 1) num_threads(internal::parallel::governed_threads(gov))
+			for (int64_t s = 0; s < stripes; s++) {
+				const size_t begin = s * STRIPE;
+				const size_t m = std::min(STRIPE, n - begin);
+				const uint64_t index = (offset + begin) / 16;
+				internal::parallel::governed_finish(gov, m, [&] {
+					internal::ctr_rekey(data + begin, m, ks_from, stream_from, index, ks_to, stream_to, index);
+				});
+			}
+		});
+	}
+
+#ifdef KRYPTO_PRECOMPILED
+
+	// Instantiated by the compiled library in src/file_engine.cpp
+	extern template class file_engine<128>;
+	extern template class file_engine<194>;
+	extern template class file_engine<256>;
+
+#endif
+
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <span>
+
+#include "util.h"
+#include "internal/kernels.h"
+
+namespace krypto {
+
+	/**
+	 * Fixed key AES permutation pi and the hashes built from it.
+	 * Used by OT extension and garbled circuits, see https://eprint.iacr.org/2019/074.pdf
+	 * The key schedule is expanded once, blocks are processed 8 at a time.
+	 */
+	class fixed_key_aes {
+	public:
+		constexpr static size_t WIDTH = internal::KERNEL_WIDTH;
+
+		/**
+		 * Public fixed key, the first 128 bits of the fractional part of pi
+		 */
+		constexpr static std::array<unsigned char, 16> DEFAULT_KEY = { 0x24, 0x3f, 0x6a, 0x88, 0x85, 0xa3, 0x08, 0xd3, 0x13, 0x19, 0x8a, 0x2e, 0x03, 0x70, 0x73, 0x44 };
+
+		fixed_key_aes() noexcept;
+		explicit fixed_key_aes(const_byte_view<16> key) noexcept;
+
+		/**
+		 * Apply pi(x) to every block in place
+		 */
+		void permute(std::span<block128> data) const noexcept;
+
+		/**
+		 * Correlation robust MMO hash H(x) = pi(x) ^ x, in place
+		 */
+		void hash(std::span<block128> data) const noexcept;
+
+		/**
+		 * Circular correlation robust hash H(x) = pi(s(x)) ^ s(x), in place
+		 * with the linear orthomorphism s(xL || xR) = (xL ^ xR) || xL
+		 */
+		void ccr_hash(std::span<block128> data) const noexcept;
+
+		/**
+		 * Tweakable correlation robust hash H(x, i) = pi(pi(x) ^ i) ^ pi(x), in place
+		 * Block n uses the tweak i = tweak + n
+		 */
+		void tccr_hash(std::span<block128> data, uint64_t tweak) const noexcept;
+
+	private:
+
+		template <bool Sigma>
+		void mmo(std::span<block128> data) const noexcept;
+
+		internal::key_schedule<128> schedule;
+
+	};
+
+	/**
+	 * Pseudo random generator expanding a 128 bit seed with AES-CTR,
+	 * the seed is the key. Output blocks are AES_seed(counter).
+	 */
+	class prg {
+	public:
+		constexpr static size_t WIDTH = internal::KERNEL_WIDTH;
+
+		explicit prg(const_byte_view<16> seed, uint64_t counter = 0) noexcept;
+
+		/**
+		 * Fill out with the next out.size() blocks of the stream
+		 */
+		void generate(std::span<block128> out) noexcept;
+
+		/**
+		 * Fill out with the next bytes of the stream.
+		 * A trailing partial block consumes a whole counter value
+		 */
+		void generate(byte_view<> out) noexcept;
+
+		uint64_t position() const noexcept { return counter; }
+
+	private:
+
+		void fill(unsigned char* out, size_t blocks) noexcept;
+
+		internal::key_schedule<128> schedule;
+		uint64_t counter;
+
+	};
+
+	///
+	// Implementation
+	///
+
+	namespace internal {
+
+		inline block128 sigma(const block128& x) noexcept
+		{
+			uint64_t lo, hi;
+			std::memcpy(&lo, x.data(), 8);
+			std::memcpy(&hi, x.data() + 8, 8);
+
+			const uint64_t res_lo = hi;
+			const uint64_t res_hi = hi ^ lo;
+
+			block128 res;
+			std::memcpy(res.data(), &res_lo, 8);
+			std::memcpy(res.data() + 8, &res_hi, 8);
+			return res;
+		}
+
+	}
+
+	inline fixed_key_aes::fixed_key_aes() noexcept
+		: schedule(DEFAULT_KEY)
+	{
+	}
+
+	inline fixed_key_aes::fixed_key_aes(const_byte_view<16> key) noexcept
+		: schedule(key)
+	{
+	}
+
+	inline void fixed_key_aes::permute(std::span<block128> data) const noexcept
+	{
+		internal::encrypt_ecb(reinterpret_cast<unsigned char*>(data.data()), data.size(), schedule);
+	}
+
+	inline void fixed_key_aes::hash(std::span<block128> data) const noexcept
+	{
+		mmo<false>(data);
+	}
+
+	inline void fixed_key_aes::ccr_hash(std::span<block128> data) const noexcept
+	{
+		mmo<true>(data);
+	}
+
+	template <bool Sigma>
+	inline void fixed_key_aes::mmo(std::span<block128> data) const noexcept
+	{
+		using namespace internal;
+
+		size_t i = 0;
+
+		for (; i + WIDTH <= data.size(); i += WIDTH) {
+			block x[WIDTH];
+			block b[WIDTH];
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < WIDTH; n++) {
+				x[n] = block_load(Sigma ? sigma(data[i + n]).data() : data[i + n].data());
+				b[n] = x[n];
+			}
+
+			encrypt_blocks(b, schedule);
+
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < WIDTH; n++) {
+				block_store(data[i + n].data(), block_xor(b[n], x[n]));
+			}
+		}
+
+		for (; i < data.size(); i++) {
+			const block x = block_load(Sigma ? sigma(data[i]).data() : data[i].data());
+			block b[1] = { x };
+			encrypt_blocks(b, schedule);
+			block_store(data[i].data(), block_xor(b[0], x));
+		}
+	}
+
+	inline void fixed_key_aes::tccr_hash(std::span<block128> data, uint64_t tweak) const noexcept
+	{
+		using namespace internal;
+
+		size_t i = 0;
+
+		for (; i + WIDTH <= data.size(); i += WIDTH) {
+			block p[WIDTH];
+			block b[WIDTH];
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < WIDTH; n++) {
+				p[n] = block_load(data[i + n].data());
+			}
+
+			encrypt_blocks(p, schedule);
+
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < WIDTH; n++) {
+				b[n] = block_xor(p[n], counter_block(tweak + i + n));
+			}
+
+			encrypt_blocks(b, schedule);
+
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < WIDTH; n++) {
+				block_store(data[i + n].data(), block_xor(b[n], p[n]));
+			}
+		}
+
+		for (; i < data.size(); i++) {
+			block p[1] = { block_load(data[i].data()) };
+			encrypt_blocks(p, schedule);
+
+			block b[1] = { block_xor(p[0], counter_block(tweak + i)) };
+			encrypt_blocks(b, schedule);
+
+			block_store(data[i].data(), block_xor(b[0], p[0]));
+		}
+	}
+
+	inline prg::prg(const_byte_view<16> seed, uint64_t counter) noexcept
+		: schedule(seed), counter(counter)
+	{
+	}
+
+	inline void prg::generate(std::span<block128> out) noexcept
+	{
+		fill(reinterpret_cast<unsigned char*>(out.data()), out.size());
+	}
+
+	inline void prg::generate(byte_view<> out) noexcept
+	{
+		const size_t full = out.size() / 16;
+		fill(out.data(), full);
+
+		const size_t rest = out.size() - full * 16;
+		if (rest) {
+			block128 last;
+			fill(last.data(), 1);
+			std::copy_n(last.begin(), rest, out.begin() + full * 16);
+		}
+	}
+
+	inline void prg::fill(unsigned char* out, size_t blocks) noexcept
+	{
+		using namespace internal;
+
+		size_t i = 0;
+
+		for (; i + WIDTH <= blocks; i += WIDTH) {
+			block b[WIDTH];
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < WIDTH; n++) {
+				b[n] = counter_block(counter + n);
+			}
+			counter += WIDTH;
+
+			encrypt_blocks(b, schedule);
+
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < WIDTH; n++) {
+				block_store(out + (i + n) * 16, b[n]);
+			}
+		}
+
+		for (; i < blocks; i++) {
+			block b[1] = { counter_block(counter++) };
+			encrypt_blocks(b, schedule);
+			block_store(out + i * 16, b[0]);
+		}
+	}
+
+}
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <span>
+#include <optional>
+
+#include "util.h"
+#include "internal/kernels.h"
+#include "internal/ghash.h"
+#include "parallel.h"
+
+namespace krypto::internal::inline KRYPTO_ISA::gcm {
+
+	// Bytes encrypted between GHASH updates, keeps the cipher text in L1
+	constexpr size_t STRIPE = 16 * 16 * KERNEL_WIDTH;
+
+	// Part of a large message encrypted and hashed by one thread, a multiple of STRIPE
+	constexpr size_t SEGMENT = 1 << 20;
+
+	/**
+	 * Round keys and hash key of one GCM key
+	 */
+	template <size_t Size>
+	struct context {
+		explicit context(const_byte_view<Size / 8> key) noexcept;
+
+		key_schedule<Size> ks;
+		ghash::key hk;
+	};
+
+	/**
+	 * Counter blocks for a 96 bit nonce, J0 = nonce || 1
+	 */
+	inline ctr_stream counter(const_byte_view<12> nonce) noexcept;
+
+	/**
+	 * Encrypt size bytes starting at byte offset of the message and hash the cipher text.
+	 * offset must be a multiple of 16. From 2 segments the segments are encrypted and
+	 * hashed in parallel, and their hashes combined in order into the one of the message
+	 */
+	template <size_t Size>
+	inline void encrypt(const context<Size>& ctx, const ctr_stream& ctr, uint64_t offset, const unsigned char* in, unsigned char* out, size_t size, ghash::state& hash) noexcept;
+
+	/**
+	 * Hash the cipher text and decrypt it, see encrypt
+	 */
+	template <size_t Size>
+	inline void decrypt(const context<Size>& ctx, const ctr_stream& ctr, uint64_t offset, const unsigned char* in, unsigned char* out, size_t size, ghash::state& hash) noexcept;
+
+	/**
+	 * Tag E(K, J0) ^ GHASH(A, C)
+	 */
+	template <size_t Size>
+	inline std::array<unsigned char, 16> tag(const context<Size>& ctx, const ctr_stream& ctr, ghash::state hash, uint64_t ad_bytes, uint64_t cipher_bytes) noexcept;
+
+}
+
+namespace krypto {
+
+	/**
+	 * AES-GCM authenticated encryption with a 96 bit nonce.
+	 * Implementation based on https://nvlpubs.nist.gov/nistpubs/Legacy/SP/nistspecialpublication800-38d.pdf
+	 */
+	template <size_t Size>
+	class gcm {
+	public:
+		static_assert(Size == 128 || Size == 194 || Size == 256, "Invalid key size");
+
+		constexpr static size_t KEY_SIZE = Size / 8;
+		constexpr static size_t NONCE_SIZE = 12;
+		constexpr static size_t TAG_SIZE = 16;
+
+		/**
+		 * Construct a GCM encryption object
+		 * Set key used for encryption
+		 */
+		gcm(const_byte_view<KEY_SIZE> key) noexcept;
+
+		/**
+		 * Encrypt data using a random nonce
+		 * Output is cipher text followed by tag and nonce
+		 */
+		byte_array encrypt(const_byte_view<> data, const_byte_view<> ad = {}) const noexcept;
+		/**
+		 * Decrypt data produced by encrypt
+		 * Returns empty optional if authentication fails
+		 */
+		std::optional<byte_array> decrypt(const_byte_view<> data, const_byte_view<> ad = {}) const noexcept;
+
+		/**
+		 * Encrypt data using nonce. Output is cipher text followed by tag
+		 * A nonce must never be used twice with the same key
+		 */
+		byte_array seal(const_byte_view<NONCE_SIZE> nonce, const_byte_view<> data, const_byte_view<> ad = {}) const noexcept;
+		/**
+		 * Decrypt cipher text followed by tag
+		 * Returns empty optional if authentication fails
+		 */
+		std::optional<byte_array> open(const_byte_view<NONCE_SIZE> nonce, const_byte_view<> data, const_byte_view<> ad = {}) const noexcept;
+
+	private:
+
+		internal::gcm::context<Size> ctx;
+
+	};
+
+	///
+	// Implementation
+	///
+
+	namespace internal::inline KRYPTO_ISA::gcm {
+
+		template <size_t Size>
+		inline context<Size>::context(const_byte_view<Size / 8> key) noexcept
+			: ks(key), hk([&] {
+				// H = E(K, 0)
+				block b[1] = { block_zero() };
+				encrypt_blocks(b, ks);
+
+				std::array<unsigned char, 16> h;
+				block_store(h.data(), b[0]);
+				return ghash::key(h.data());
+			}())
+		{
+		}
+
+		inline ctr_stream counter(const_byte_view<12> nonce) noexcept
+		{
+			std::array<unsigned char, 16> j0{};
+			std::copy(nonce.begin(), nonce.end(), j0.begin());
+			j0[15] = 1;
+			return ctr_stream(j0.data(), true);
+		}
+
+		/**
+		 * Encrypt or decrypt size bytes one stripe at a time, message is the size for kernel dispatch
+		 */
+		template <bool Encrypt, size_t Size>
+		inline void stripes(const context<Size>& ctx, const ctr_stream& ctr, uint64_t offset, const unsigned char* in, unsigned char* out, size_t size, size_t message, ghash::state& hash) noexcept
+		{
+			for (size_t i = 0; i < size; i += STRIPE) {
+				const size_t n = std::min(STRIPE, size - i);
+
+				// Counter block 1 encrypts the first 16 bytes
+				if constexpr (Encrypt) {
+					ctr_xor(in + i, out + i, n, ctx.ks, ctr, (offset + i) / 16 + 1, message);
+					hash.update(ctx.hk, out + i, n);
+				}
+				else {
+					hash.update(ctx.hk, in + i, n);
+					ctr_xor(in + i, out + i, n, ctx.ks, ctr, (offset + i) / 16 + 1, message);
+				}
+			}
+		}
+
+		template <bool Encrypt, size_t Size>
+		inline void segments(const context<Size>& ctx, const ctr_stream& ctr, uint64_t offset, const unsigned char* in, unsigned char* out, size_t size, ghash::state& hash) noexcept
+		{
+			const int threads = parallel::threads(size);
+			if (size < 2 * SEGMENT || threads == 1) {
+				stripes<Encrypt>(ctx, ctr, offset, in, out, size, size, hash);
+				return;
+			}
+
+			const int64_t count = (size + SEGMENT - 1) / SEGMENT;
+			std::vector<ghash::state> hashes(count);
+
+			#pragma omp parallel for schedule(dynamic) num_threads(threads)
+			for (int64_t s = 0; s < count; s++) {
+				const size_t begin = s * SEGMENT;
+				stripes<Encrypt>(ctx, ctr, offset + begin, in + begin, out + begin, std::min(SEGMENT, size - begin), size, hashes[s]);
+			}
+
+			for (int64_t s = 0; s < count; s++) {
+				const size_t n = std::min(SEGMENT, size - s * SEGMENT);
+				hash.combine(ctx.hk, hashes[s], (n + 15) / 16);
+			}
+		}
+
+		template <size_t Size>
+		inline void encrypt(const context<Size>& ctx, const ctr_stream& ctr, uint64_t offset, const unsigned char* in, unsigned char* out, size_t size, ghash::state& hash) noexcept
+		{
+			segments<true>(ctx, ctr, offset, in, out, size, hash);
+		}
+
+		template <size_t Size>
+		inline void decrypt(const context<Size>& ctx, const ctr_stream& ctr, uint64_t offset, const unsigned char* in, unsigned char* out, size_t size, ghash::state& hash) noexcept
+		{
+			segments<false>(ctx, ctr, offset, in, out, size, hash);
+		}
+
+		template <size_t Size>
+		inline std::array<unsigned char, 16> tag(const context<Size>& ctx, const ctr_stream& ctr, ghash::state hash, uint64_t ad_bytes, uint64_t cipher_bytes) noexcept
+		{
+			std::array<unsigned char, 16> s;
+			hash.finish(ctx.hk, ad_bytes, cipher_bytes, s.data());
+
+			block b[1] = { ctr[0] };
+			encrypt_blocks(b, ctx.ks);
+
+			std::array<unsigned char, 16> t;
+			block_store(t.data(), block_xor(b[0], block_load(s.data())));
+			return t;
+		}
+
+	}
+
+	template <size_t Size>
+	inline gcm<Size>::gcm(const_byte_view<KEY_SIZE> key) noexcept
+		: ctx(key)
+	{
+	}
+
+	template <size_t Size>
+	inline byte_array gcm<Size>::encrypt(const_byte_view<> data, const_byte_view<> ad) const noexcept
+	{
+		const auto nonce = krypto::get_srandom_bytes<NONCE_SIZE>();
+
+		auto cipher_text = seal(nonce, data, ad);
+
+		cipher_text.resize(cipher_text.size() + NONCE_SIZE);
+		std::copy(nonce.begin(), nonce.end(), cipher_text.end() - NONCE_SIZE);
+
+		return cipher_text;
+	}
+
+	template <size_t Size>
+	inline std::optional<byte_array> gcm<Size>::decrypt(const_byte_view<> data, const_byte_view<> ad) const noexcept
+	{
+		if (data.size() < NONCE_SIZE + TAG_SIZE)
+			return std::nullopt;
+
+		const auto nonce = data.last<NONCE_SIZE>();
+		return open(nonce, data.first(data.size() - NONCE_SIZE), ad);
+	}
+
+	template <size_t Size>
+	inline byte_array gcm<Size>::seal(const_byte_view<NONCE_SIZE> nonce, const_byte_view<> data, const_byte_view<> ad) const noexcept
+	{
+		byte_array cipher_text(data.size() + TAG_SIZE);
+
+		const auto ctr = internal::gcm::counter(nonce);
+
+		internal::ghash::state hash;
+		hash.update(ctx.hk, ad.data(), ad.size());
+
+		internal::gcm::encrypt(ctx, ctr, 0, data.data(), cipher_text.data(), data.size(), hash);
+
+		const auto tag = internal::gcm::tag(ctx, ctr, hash, ad.size(), data.size());
+		std::copy(tag.begin(), tag.end(), cipher_text.end() - TAG_SIZE);
+
+		return cipher_text;
+	}
+
+	template <size_t Size>
+	inline std::optional<byte_array> gcm<Size>::open(const_byte_view<NONCE_SIZE> nonce, const_byte_view<> data, const_byte_view<> ad) const noexcept
+	{
+		if (data.size() < TAG_SIZE)
+			return std::nullopt;
+
+		const size_t size = data.size() - TAG_SIZE;
+		byte_array plain_text(size);
+
+		const auto ctr = internal::gcm::counter(nonce);
+
+		internal::ghash::state hash;
+		hash.update(ctx.hk, ad.data(), ad.size());
+
+		internal::gcm::decrypt(ctx, ctr, 0, data.data(), plain_text.data(), size, hash);
+
+		const auto tag = internal::gcm::tag(ctx, ctr, hash, ad.size(), size);
+		if (!secure_equal(tag, data.last<TAG_SIZE>())) {
+			secure_zero(plain_text);
+			return std::nullopt;
+		}
+
+		return plain_text;
+	}
+
+}
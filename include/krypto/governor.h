@@ -0,0 +1,249 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "parallel.h"
+
+namespace krypto {
+
+	/**
+	 * Limits of a background bulk operation, 0 is unlimited
+	 */
+	struct governor_budget {
+		// Bytes processed per second over all threads
+		uint64_t bytes_per_second = 0;
+		// Fraction of the time each thread may be busy, the rest it sleeps
+		double cpu_share = 1;
+		// Threads of parallel loops, at most krypto::max_threads()
+		size_t threads = 0;
+	};
+
+	/**
+	 * Paces long running bulk work so it stays within a budget, and reports progress.
+	 *
+	 * Work is done in chunks through run: a chunk waits for its turn under
+	 * the byte rate, and after it the thread sleeps long enough to keep its
+	 * busy time to the CPU share. Foreground work on the same cores then
+	 * sees short gaps instead of cores taken for the whole operation.
+	 *
+	 * The file engine and the batch functions of the reencryptor take an
+	 * optional governor. One governor may be shared by several operations
+	 * and threads, the budget is for all of them together and may be
+	 * changed while they run. cancel stops them at the next chunk, or for
+	 * work that must not stop halfway, such as a buffer of a file encrypted
+	 * in place, at the next unit the caller commits to.
+	 */
+	class governor {
+	public:
+		using clock = std::chrono::steady_clock;
+
+		explicit governor(const governor_budget& budget = {}) noexcept;
+
+		/**
+		 * Run work on bytes within the budget and count them as processed
+		 * Returns false without running work if the governor is cancelled
+		 */
+		template <typename Work>
+		bool run(size_t bytes, Work&& work) noexcept;
+
+		/**
+		 * Run work on bytes within the budget and count them as processed, also if the governor is cancelled
+		 * For the rest of a unit of work whose start was checked against cancelled()
+		 */
+		template <typename Work>
+		void finish(size_t bytes, Work&& work) noexcept;
+
+		/**
+		 * Threads for a parallel loop under the budget
+		 */
+		int threads() const noexcept;
+
+		void set_budget(const governor_budget& budget) noexcept;
+		governor_budget budget() const noexcept;
+
+		/**
+		 * Add bytes to the total of work expected, for progress
+		 */
+		void expect(uint64_t bytes) noexcept { expected += bytes; }
+
+		uint64_t processed() const noexcept { return done; }
+		uint64_t total() const noexcept { return expected; }
+
+		/**
+		 * Fraction of the expected bytes processed, 0 if nothing is expected
+		 */
+		double progress() const noexcept;
+
+		void cancel() noexcept { stopped = true; }
+		bool cancelled() const noexcept { return stopped; }
+
+	private:
+
+		/**
+		 * Wait for the turn of bytes under the byte rate
+		 */
+		void pace(size_t bytes) noexcept;
+
+		/**
+		 * Run work and keep the thread to the CPU share after it
+		 */
+		template <typename Work>
+		void busy(size_t bytes, Work&& work) noexcept;
+
+		mutable std::mutex lock;
+		governor_budget limits;
+		// Time the byte rate allows the next chunk to start
+		clock::time_point next;
+
+		std::atomic<uint64_t> done = 0;
+		std::atomic<uint64_t> expected = 0;
+		std::atomic<bool> stopped = false;
+
+	};
+
+	namespace internal::parallel {
+
+		/**
+		 * Run work on bytes through gov, or directly without a governor
+		 */
+		template <typename Work>
+		inline bool governed(governor* gov, size_t bytes, Work&& work) noexcept;
+
+		/**
+		 * Run work on bytes through gov even if it is cancelled, or directly without a governor
+		 */
+		template <typename Work>
+		inline void governed_finish(governor* gov, size_t bytes, Work&& work) noexcept;
+
+		/**
+		 * Threads for a parallel loop, under gov if given
+		 */
+		inline int governed_threads(const governor* gov) noexcept;
+
+	}
+
+	///
+	// Implementation
+	///
+
+	inline governor::governor(const governor_budget& budget) noexcept
+		: limits(budget), next(clock::now())
+	{
+	}
+
+	template <typename Work>
+	inline bool governor::run(size_t bytes, Work&& work) noexcept
+	{
+		if (stopped)
+			return false;
+
+		pace(bytes);
+		if (stopped)
+			return false;
+
+		busy(bytes, std::forward<Work>(work));
+		return true;
+	}
+
+	template <typename Work>
+	inline void governor::finish(size_t bytes, Work&& work) noexcept
+	{
+		pace(bytes);
+		busy(bytes, std::forward<Work>(work));
+	}
+
+	template <typename Work>
+	inline void governor::busy(size_t bytes, Work&& work) noexcept
+	{
+		const auto start = clock::now();
+		work();
+		const auto elapsed = clock::now() - start;
+		done += bytes;
+
+		double share;
+		{
+			std::lock_guard guard(lock);
+			share = limits.cpu_share;
+		}
+
+		// Busy for elapsed, idle for elapsed * (1 - share) / share
+		if (share > 0 && share < 1)
+			std::this_thread::sleep_for(std::chrono::duration_cast<clock::duration>(elapsed * ((1 - share) / share)));
+	}
+
+	inline void governor::pace(size_t bytes) noexcept
+	{
+		clock::time_point start;
+		{
+			std::lock_guard guard(lock);
+			if (limits.bytes_per_second == 0)
+				return;
+
+			// No credit for time the work was idle, so a pause is not followed by a burst
+			start = std::max(next, clock::now());
+			next = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(static_cast<double>(bytes) / limits.bytes_per_second));
+		}
+
+		std::this_thread::sleep_until(start);
+	}
+
+	inline int governor::threads() const noexcept
+	{
+		std::lock_guard guard(lock);
+		const int max = internal::parallel::threads();
+		return limits.threads == 0 ? max : std::min(max, static_cast<int>(limits.threads));
+	}
+
+	inline void governor::set_budget(const governor_budget& budget) noexcept
+	{
+		std::lock_guard guard(lock);
+		limits = budget;
+		next = std::min(next, clock::now());
+	}
+
+	inline governor_budget governor::budget() const noexcept
+	{
+		std::lock_guard guard(lock);
+		return limits;
+	}
+
+	inline double governor::progress() const noexcept
+	{
+		const uint64_t total = expected;
+		return total == 0 ? 0 : std::min(1.0, static_cast<double>(done) / total);
+	}
+
+	namespace internal::parallel {
+
+		template <typename Work>
+		inline bool governed(governor* gov, size_t bytes, Work&& work) noexcept
+		{
+			if (gov)
+				return gov->run(bytes, std::forward<Work>(work));
+
+			work();
+			return true;
+		}
+
+		template <typename Work>
+		inline void governed_finish(governor* gov, size_t bytes, Work&& work) noexcept
+		{
+			if (gov)
+				gov->finish(bytes, std::forward<Work>(work));
+			else
+				work();
+		}
+
+		inline int governed_threads(const governor* gov) noexcept
+		{
+			return gov ? gov->threads() : threads();
+		}
+
+	}
+
+}
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <cstdint>
+#include <cassert>
+#include <array>
+#include <span>
+
+#include "util.h"
+#include "internal/block.h"
+
+namespace krypto {
+
+	// Implementation based on https://eprint.iacr.org/2016/098.pdf (Haraka v2)
+	namespace internal::haraka {
+
+		constexpr size_t ROUNDS = 5;
+
+		// Number of independent instances processed together by the batch functions
+		constexpr size_t LANES = 4;
+
+		/**
+		 * Round constants as given in the reference implementation.
+		 * Each row is one 128 bit constant, most significant 32 bit word first.
+		 */
+		constexpr std::array<std::array<uint32_t, 4>, 40> RC_WORDS = { {
+			{ 0x0684704c, 0xe620c00a, 0xb2c5fef0, 0x75817b9d }, { 0x8b66b4e1, 0x88f3a06b, 0x640f6ba4, 0x2f08f717 },
+			{ 0x3402de2d, 0x53f28498, 0xcf029d60, 0x9f029114 }, { 0x0ed6eae6, 0x2e7b4f08, 0xbbf3bcaf, 0xfd5b4f79 },
+			{ 0xcbcfb0cb, 0x4872448b, 0x79eecd1c, 0xbe397044 }, { 0x7eeacdee, 0x6e9032b7, 0x8d5335ed, 0x2b8a057b },
+			{ 0x67c28f43, 0x5e2e7cd0, 0xe2412761, 0xda4fef1b }, { 0x2924d9b0, 0xafcacc07, 0x675ffde2, 0x1fc70b3b },
+			{ 0xab4d63f1, 0xe6867fe9, 0xecdb8fca, 0xb9d465ee }, { 0x1c30bf84, 0xd4b7cd64, 0x5b2a404f, 0xad037e33 },
+			{ 0xb2cc0bb9, 0x941723bf, 0x69028b2e, 0x8df69800 }, { 0xfa0478a6, 0xde6f5572, 0x4aaa9ec8, 0x5c9d2d8a },
+			{ 0xdfb49f2b, 0x6b772a12, 0x0efa4f2e, 0x29129fd4 }, { 0x1ea10344, 0xf449a236, 0x32d611ae, 0xbb6a12ee },
+			{ 0xaf044988, 0x4b050084, 0x5f9600c9, 0x9ca8eca6 }, { 0x21025ed8, 0x9d199c4f, 0x78a2c7e3, 0x27e593ec },
+			{ 0xbf3aaaf8, 0xa759c9b7, 0xb9282ecd, 0x82d40173 }, { 0x6260700d, 0x6186b017, 0x37f2efd9, 0x10307d6b },
+			{ 0x5aca45c2, 0x21300443, 0x81c29153, 0xf6fc9ac6 }, { 0x9223973c, 0x226b68bb, 0x2caf92e8, 0x36d1943a },
+			{ 0xd3bf9238, 0x225886eb, 0x6cbab958, 0xe51071b4 }, { 0xdb863ce5, 0xaef0c677, 0x933dfddd, 0x24e1128d },
+			{ 0xbb606268, 0xffeba09c, 0x83e48de3, 0xcb2212b1 }, { 0x734bd3dc, 0xe2e4d19c, 0x2db91a4e, 0xc72bf77d },
+			{ 0x43bb47c3, 0x61301b43, 0x4b1415c4, 0x2cb3924e }, { 0xdba775a8, 0xe707eff6, 0x03b231dd, 0x16eb6899 },
+			{ 0x6df3614b, 0x3c755977, 0x8e5e2302, 0x7eca472c }, { 0xcda75a17, 0xd6de7d77, 0x6d1be5b9, 0xb88617f9 },
+			{ 0xec6b43f0, 0x6ba8e9aa, 0x9d6c069d, 0xa946ee5d }, { 0xcb1e6950, 0xf957332b, 0xa2531159, 0x3bf327c1 },
+			{ 0x2cee0c75, 0x00da619c, 0xe4ed0353, 0x600ed0d9 }, { 0xf0b1a5a1, 0x96e90cab, 0x80bbbabc, 0x63a4a350 },
+			{ 0xae3db102, 0x5e962988, 0xab0dde30, 0x938dca39 }, { 0x17bb8f38, 0xd554a40b, 0x8814f3a8, 0x2e75b442 },
+			{ 0x34bb8a5b, 0x5f427fd7, 0xaeb6b779, 0x360a16f6 }, { 0x26f65241, 0xcbe55438, 0x43ce5918, 0xffbaafde },
+			{ 0x4ce99a54, 0xb9f3026a, 0xa2ca9cf7, 0x839ec978 }, { 0xae51a51a, 0x1bdff7be, 0x40c06e28, 0x22901235 },
+			{ 0xa0c1613c, 0xba7ed22b, 0xc173bc0f, 0x48a659cf }, { 0x756acc03, 0x02288288, 0x4ad6bdfd, 0xe9c59da1 }
+		} };
+
+		// Lay out the constants in memory order, least significant byte first
+		constexpr std::array<std::array<unsigned char, 16>, 40> compute_round_constants() {
+
+			std::array<std::array<unsigned char, 16>, 40> rc{};
+
+			for (size_t i = 0; i < rc.size(); i++) {
+				for (size_t w = 0; w < 4; w++) {
+					const uint32_t word = RC_WORDS[i][3 - w];
+					for (size_t b = 0; b < 4; b++) {
+						rc[i][w * 4 + b] = static_cast<unsigned char>(word >> (b * 8));
+					}
+				}
+			}
+
+			return rc;
+		}
+
+		inline constexpr std::array<std::array<unsigned char, 16>, 40> RC = compute_round_constants();
+
+		/**
+		 * Hash N independent inputs with the rounds interleaved,
+		 * so consecutive AES rounds do not depend on each other
+		 */
+		template <size_t N>
+		inline void haraka256(unsigned char* out, const unsigned char* in) noexcept;
+
+		template <size_t N>
+		inline void haraka512(unsigned char* out, const unsigned char* in) noexcept;
+
+#ifdef KRYPTO_VAES
+		// 4 instances, one per 128 bit lane of a zmm register
+		inline void haraka256_vaes(unsigned char* out, const unsigned char* in) noexcept;
+		inline void haraka512_vaes(unsigned char* out, const unsigned char* in) noexcept;
+#endif
+
+	}
+
+	/**
+	 * Haraka-256 v2. Hash a 32 byte input to a 32 byte output
+	 */
+	inline void haraka256(byte_view<32> out, const_byte_view<32> in) noexcept;
+
+	/**
+	 * Haraka-512 v2. Hash a 64 byte input to a 32 byte output
+	 */
+	inline void haraka512(byte_view<32> out, const_byte_view<64> in) noexcept;
+
+	/**
+	 * Hash in.size() / 32 independent inputs with Haraka-256.
+	 * Output i is written to out[32 * i], out must be as large as in
+	 */
+	inline void haraka256_batch(byte_view<> out, const_byte_view<> in) noexcept;
+
+	/**
+	 * Hash in.size() / 64 independent inputs with Haraka-512.
+	 * Output i is written to out[32 * i], out must be half the size of in
+	 */
+	inline void haraka512_batch(byte_view<> out, const_byte_view<> in) noexcept;
+
+	///
+	// Implementation
+	///
+
+	inline void haraka256(byte_view<32> out, const_byte_view<32> in) noexcept
+	{
+		internal::haraka::haraka256<1>(out.data(), in.data());
+	}
+
+	inline void haraka512(byte_view<32> out, const_byte_view<64> in) noexcept
+	{
+		internal::haraka::haraka512<1>(out.data(), in.data());
+	}
+
+	inline void haraka256_batch(byte_view<> out, const_byte_view<> in) noexcept
+	{
+		using namespace internal::haraka;
+
+		assert(in.size() % 32 == 0 && out.size() >= in.size());
+
+		const size_t count = in.size() / 32;
+		size_t i = 0;
+
+		for (; i + LANES <= count; i += LANES) {
+#ifdef KRYPTO_VAES
+			haraka256_vaes(&out[i * 32], &in[i * 32]);
+#else
+			internal::haraka::haraka256<LANES>(&out[i * 32], &in[i * 32]);
+#endif
+		}
+
+		for (; i < count; i++) {
+			internal::haraka::haraka256<1>(&out[i * 32], &in[i * 32]);
+		}
+	}
+
+	inline void haraka512_batch(byte_view<> out, const_byte_view<> in) noexcept
+	{
+		using namespace internal::haraka;
+
+		assert(in.size() % 64 == 0 && out.size() >= in.size() / 2);
+
+		const size_t count = in.size() / 64;
+		size_t i = 0;
+
+		for (; i + LANES <= count; i += LANES) {
+#ifdef KRYPTO_VAES
+			haraka512_vaes(&out[i * 32], &in[i * 64]);
+#else
+			internal::haraka::haraka512<LANES>(&out[i * 32], &in[i * 64]);
+#endif
+		}
+
+		for (; i < count; i++) {
+			internal::haraka::haraka512<1>(&out[i * 32], &in[i * 64]);
+		}
+	}
+
+	namespace internal::haraka {
+
+		template <size_t N>
+		inline void haraka256(unsigned char* out, const unsigned char* in) noexcept
+		{
+			block rc[4 * ROUNDS];
+			for (size_t i = 0; i < 4 * ROUNDS; i++) {
+				rc[i] = block_load(RC[i].data());
+			}
+
+			block s[N][2];
+			for (size_t n = 0; n < N; n++) {
+				s[n][0] = block_load(in + n * 32);
+				s[n][1] = block_load(in + n * 32 + 16);
+			}
+
+			for (size_t r = 0; r < ROUNDS; r++) {
+
+				// Two AES rounds per block
+				for (size_t k = 0; k < 2; k++) {
+					for (size_t n = 0; n < N; n++) {
+						s[n][0] = aesenc(s[n][0], rc[4 * r + 2 * k]);
+						s[n][1] = aesenc(s[n][1], rc[4 * r + 2 * k + 1]);
+					}
+				}
+
+				// Mix columns of the two blocks
+				for (size_t n = 0; n < N; n++) {
+					const block tmp = block_unpacklo32(s[n][0], s[n][1]);
+					s[n][1] = block_unpackhi32(s[n][0], s[n][1]);
+					s[n][0] = tmp;
+				}
+			}
+
+			// Feed forward
+			for (size_t n = 0; n < N; n++) {
+				block_store(out + n * 32, block_xor(s[n][0], block_load(in + n * 32)));
+				block_store(out + n * 32 + 16, block_xor(s[n][1], block_load(in + n * 32 + 16)));
+			}
+		}
+
+		template <size_t N>
+		inline void haraka512(unsigned char* out, const unsigned char* in) noexcept
+		{
+			block rc[8 * ROUNDS];
+			for (size_t i = 0; i < 8 * ROUNDS; i++) {
+				rc[i] = block_load(RC[i].data());
+			}
+
+			block s[N][4];
+			for (size_t n = 0; n < N; n++) {
+				for (size_t j = 0; j < 4; j++) {
+					s[n][j] = block_load(in + n * 64 + j * 16);
+				}
+			}
+
+			for (size_t r = 0; r < ROUNDS; r++) {
+
+				// Two AES rounds per block
+				for (size_t k = 0; k < 2; k++) {
+					for (size_t n = 0; n < N; n++) {
+						for (size_t j = 0; j < 4; j++) {
+							s[n][j] = aesenc(s[n][j], rc[8 * r + 4 * k + j]);
+						}
+					}
+				}
+
+				// Mix columns of the four blocks
+				for (size_t n = 0; n < N; n++) {
+					const block tmp = block_unpacklo32(s[n][0], s[n][1]);
+					const block s0 = block_unpackhi32(s[n][0], s[n][1]);
+					const block s1 = block_unpacklo32(s[n][2], s[n][3]);
+					const block s2 = block_unpackhi32(s[n][2], s[n][3]);
+					s[n][3] = block_unpacklo32(s0, s2);
+					s[n][0] = block_unpackhi32(s0, s2);
+					s[n][2] = block_unpackhi32(s1, tmp);
+					s[n][1] = block_unpacklo32(s1, tmp);
+				}
+			}
+
+			// Feed forward and truncate to 256 bits
+			for (size_t n = 0; n < N; n++) {
+				std::array<unsigned char, 64> buf;
+				for (size_t j = 0; j < 4; j++) {
+					block_store(&buf[j * 16], block_xor(s[n][j], block_load(in + n * 64 + j * 16)));
+				}
+
+				std::copy_n(buf.begin() + 8, 8, out + n * 32);
+				std::copy_n(buf.begin() + 24, 8, out + n * 32 + 8);
+				std::copy_n(buf.begin() + 32, 8, out + n * 32 + 16);
+				std::copy_n(buf.begin() + 48, 8, out + n * 32 + 24);
+			}
+		}
+
+#ifdef KRYPTO_VAES
+
+		// Gather block j of 4 inputs with the given stride into one zmm register
+		inline __m512i gather_lanes(const unsigned char* in, size_t stride) noexcept
+		{
+			__m512i v = _mm512_castsi128_si512(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+			v = _mm512_inserti32x4(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + stride)), 1);
+			v = _mm512_inserti32x4(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * stride)), 2);
+			v = _mm512_inserti32x4(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 3 * stride)), 3);
+			return v;
+		}
+
+		inline void scatter_lanes(unsigned char* out, size_t stride, __m512i v) noexcept
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm512_extracti32x4_epi32(v, 0));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + stride), _mm512_extracti32x4_epi32(v, 1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * stride), _mm512_extracti32x4_epi32(v, 2));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 3 * stride), _mm512_extracti32x4_epi32(v, 3));
+		}
+
+		inline void haraka256_vaes(unsigned char* out, const unsigned char* in) noexcept
+		{
+			__m512i rc[4 * ROUNDS];
+			for (size_t i = 0; i < 4 * ROUNDS; i++) {
+				rc[i] = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(RC[i].data())));
+			}
+
+			const __m512i in0 = gather_lanes(in, 32);
+			const __m512i in1 = gather_lanes(in + 16, 32);
+			__m512i s0 = in0;
+			__m512i s1 = in1;
+
+			for (size_t r = 0; r < ROUNDS; r++) {
+				s0 = _mm512_aesenc_epi128(s0, rc[4 * r]);
+				s1 = _mm512_aesenc_epi128(s1, rc[4 * r + 1]);
+				s0 = _mm512_aesenc_epi128(s0, rc[4 * r + 2]);
+				s1 = _mm512_aesenc_epi128(s1, rc[4 * r + 3]);
+
+				const __m512i tmp = _mm512_unpacklo_epi32(s0, s1);
+				s1 = _mm512_unpackhi_epi32(s0, s1);
+				s0 = tmp;
+			}
+
+			scatter_lanes(out, 32, _mm512_xor_si512(s0, in0));
+			scatter_lanes(out + 16, 32, _mm512_xor_si512(s1, in1));
+		}
+
+		inline void haraka512_vaes(unsigned char* out, const unsigned char* in) noexcept
+		{
+			__m512i rc[8 * ROUNDS];
+			for (size_t i = 0; i < 8 * ROUNDS; i++) {
+				rc[i] = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(RC[i].data())));
+			}
+
+			__m512i input[4];
+			__m512i s[4];
+			for (size_t j = 0; j < 4; j++) {
+				input[j] = gather_lanes(in + j * 16, 64);
+				s[j] = input[j];
+			}
+
+			for (size_t r = 0; r < ROUNDS; r++) {
+				for (size_t k = 0; k < 2; k++) {
+					for (size_t j = 0; j < 4; j++) {
+						s[j] = _mm512_aesenc_epi128(s[j], rc[8 * r + 4 * k + j]);
+					}
+				}
+
+				const __m512i tmp = _mm512_unpacklo_epi32(s[0], s[1]);
+				const __m512i s0 = _mm512_unpackhi_epi32(s[0], s[1]);
+				const __m512i s1 = _mm512_unpacklo_epi32(s[2], s[3]);
+				const __m512i s2 = _mm512_unpackhi_epi32(s[2], s[3]);
+				s[3] = _mm512_unpacklo_epi32(s0, s2);
+				s[0] = _mm512_unpackhi_epi32(s0, s2);
+				s[2] = _mm512_unpackhi_epi32(s1, tmp);
+				s[1] = _mm512_unpacklo_epi32(s1, tmp);
+			}
+
+			// Feed forward and truncate to 256 bits
+			std::array<unsigned char, 4 * 64> buf;
+			for (size_t j = 0; j < 4; j++) {
+				scatter_lanes(&buf[j * 16], 64, _mm512_xor_si512(s[j], input[j]));
+			}
+
+			for (size_t n = 0; n < 4; n++) {
+				std::copy_n(buf.begin() + n * 64 + 8, 8, out + n * 32);
+				std::copy_n(buf.begin() + n * 64 + 24, 8, out + n * 32 + 8);
+				std::copy_n(buf.begin() + n * 64 + 32, 8, out + n * 32 + 16);
+				std::copy_n(buf.begin() + n * 64 + 48, 8, out + n * 32 + 24);
+			}
+		}
+
+#endif
+
+	}
+
+}
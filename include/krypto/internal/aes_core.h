@@ -0,0 +1,375 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <algorithm>
+#include <span>
+
+#include "../util.h"
+#include "math.h"
+
+namespace krypto {
+
+	namespace internal {
+
+		// Keep static tables for aes
+		struct aes_base {
+			constexpr static math::aes_sub_tables SUB_TABLES = math::compute_aes_sub_tables();
+			constexpr static math::aes_mult_tables MULT_TABLES = math::compute_aes_mult_tables();
+			constexpr static math::aes_rcon RCON = math::compute_aes_rcon();
+		};
+
+		// Implementation based on https://nvlpubs.nist.gov/nistpubs/FIPS/NIST.FIPS.197.pdf
+		namespace aes {
+
+			/**
+			 * Size in bytes of the expanded key for a key of Size bits
+			 */
+			constexpr size_t expanded_key_size(size_t size) noexcept;
+
+			/**
+			 * Expand key into the round keys used by encrypt / decrypt
+			 */
+			template <size_t Size>
+			constexpr std::array<unsigned char, expanded_key_size(Size)> expand_key(const_byte_view<Size / 8> key) noexcept;
+
+			template <typename It>
+			constexpr void add_round_key(byte_view<16> data, It key) noexcept;
+
+			constexpr void shift_rows(byte_view<16> data) noexcept;
+			constexpr void inv_shift_rows(byte_view<16> data) noexcept;
+
+			constexpr void mix_columns(byte_view<16> data) noexcept;
+			constexpr void mix_columns_slow(byte_view<16> data) noexcept;
+			
+			constexpr void inv_mix_columns(byte_view<16> data) noexcept;
+			constexpr void inv_mix_columns_slow(byte_view<16> data) noexcept;
+
+			template <size_t Size>
+			constexpr void encrypt(byte_view<16> data, const_byte_view<Size> key) noexcept;
+
+			template <size_t Size>
+			constexpr void decrypt(byte_view<16> data, const_byte_view<Size> key) noexcept;
+
+			/**
+			 * Single encryption round, same semantics as the AESENC instruction.
+			 * Used as a building block by constructions on the AES round function.
+			 */
+			template <typename It>
+			constexpr void round(byte_view<16> data, It key) noexcept;
+
+			/**
+			 * Final encryption round (no MixColumns), same semantics as AESENCLAST
+			 */
+			template <typename It>
+			constexpr void round_last(byte_view<16> data, It key) noexcept;
+
+			/**
+			 * Single decryption round of the equivalent inverse cipher, same semantics as AESDEC
+			 */
+			template <typename It>
+			constexpr void inv_round(byte_view<16> data, It key) noexcept;
+
+			/**
+			 * Final decryption round (no InvMixColumns), same semantics as AESDECLAST
+			 */
+			template <typename It>
+			constexpr void inv_round_last(byte_view<16> data, It key) noexcept;
+
+		}
+
+
+	}
+
+
+	namespace internal::aes {
+
+		constexpr size_t expanded_key_size(size_t size) noexcept
+		{
+			// NB * (NR + 1) words of 4 bytes
+			return 4 * ((size / 32) + 7) * 4;
+		}
+
+		template <size_t Size>
+		constexpr std::array<unsigned char, expanded_key_size(Size)> expand_key(const_byte_view<Size / 8> key) noexcept
+		{
+			constexpr size_t NB = 4;
+			constexpr size_t NK = Size / 32;
+			constexpr size_t NR = NK + 6;
+
+			std::array<unsigned char, expanded_key_size(Size)> expanded{};
+
+			// Copy key into first bytes of expanded key
+			std::copy(key.begin(), key.end(), expanded.begin());
+
+			// 1 word = 4 chars
+			std::array<unsigned char, 4> temp{};
+			std::array<unsigned char, 4> rcon_temp = { 0,0,0,0 };
+
+			size_t i = NK;
+			while (i < NB * (NR + 1)) {
+
+				auto key_it = expanded.begin() + (i * 4);
+				std::span<unsigned char, 4> window(key_it - (NK * 4), 4);
+
+				std::copy_n(key_it - 4, 4, temp.begin());
+
+				if (i % NK == 0) {
+					rcon_temp[0] = aes_base::RCON[(i / NK) - 1];
+
+					math::rot_word(temp);
+					math::sub_bytes<4>(temp, aes_base::SUB_TABLES.sbox);
+					math::xor_word(temp, rcon_temp);
+				}
+				else if (NK > 6 && i % NK == 4) {
+					math::sub_bytes<4>(temp, aes_base::SUB_TABLES.sbox); 
+				}
+
+				math::xor_word(temp, window);
+				std::copy_n(temp.begin(), 4, key_it);
+
+				i++;
+			}
+
+			return expanded;
+		}
+
+		template <size_t Size>
+		constexpr void encrypt(byte_view<16> data, const_byte_view<Size> key) noexcept
+		{
+			constexpr size_t NR = (Size / 16) - 1;
+			
+			add_round_key(data, key.begin());
+
+			for (int i = 1; i < NR; i++) {
+				math::sub_bytes(data, aes_base::SUB_TABLES.sbox);
+				shift_rows(data);
+				mix_columns(data);
+				add_round_key(data, key.begin() + i * 16);
+			}
+
+			math::sub_bytes(data, aes_base::SUB_TABLES.sbox);
+			shift_rows(data);
+			add_round_key(data, key.begin() + NR * 16);
+		}
+
+		template <size_t Size>
+		constexpr void decrypt(byte_view<16> data, const_byte_view<Size> key) noexcept
+		{
+			constexpr size_t NR = (Size / 16) - 1;
+
+			add_round_key(data, key.begin() + NR * 16);
+
+			for (int i = NR - 1; i > 0; i--) {
+				inv_shift_rows(data);
+				math::sub_bytes(data, aes_base::SUB_TABLES.inv_sbox);
+				add_round_key(data, key.begin() + i * 16);
+				inv_mix_columns(data);
+			}
+
+			inv_shift_rows(data);
+			math::sub_bytes(data, aes_base::SUB_TABLES.inv_sbox);
+			add_round_key(data, key.begin());
+
+		}
+
+		template <typename It>
+		constexpr void round(byte_view<16> data, It key) noexcept
+		{
+			math::sub_bytes(data, aes_base::SUB_TABLES.sbox);
+			shift_rows(data);
+			mix_columns(data);
+			add_round_key(data, key);
+		}
+
+		template <typename It>
+		constexpr void round_last(byte_view<16> data, It key) noexcept
+		{
+			math::sub_bytes(data, aes_base::SUB_TABLES.sbox);
+			shift_rows(data);
+			add_round_key(data, key);
+		}
+
+		template <typename It>
+		constexpr void inv_round(byte_view<16> data, It key) noexcept
+		{
+			inv_shift_rows(data);
+			math::sub_bytes(data, aes_base::SUB_TABLES.inv_sbox);
+			inv_mix_columns(data);
+			add_round_key(data, key);
+		}
+
+		template <typename It>
+		constexpr void inv_round_last(byte_view<16> data, It key) noexcept
+		{
+			inv_shift_rows(data);
+			math::sub_bytes(data, aes_base::SUB_TABLES.inv_sbox);
+			add_round_key(data, key);
+		}
+
+		constexpr void inv_mix_columns_slow(byte_view<16> data) noexcept
+		{
+			std::array<uint8_t, 16> buf{};
+
+			// C1
+			buf[0] = math::fast_mult256(0x0e, data[0]) ^ math::fast_mult256(0x0b, data[1]) ^ math::fast_mult256(0x0d, data[2]) ^ math::fast_mult256(0x09, data[3]);
+			buf[1] = math::fast_mult256(0x09, data[0]) ^ math::fast_mult256(0x0e, data[1]) ^ math::fast_mult256(0x0b, data[2]) ^ math::fast_mult256(0x0d, data[3]);
+			buf[2] = math::fast_mult256(0x0d, data[0]) ^ math::fast_mult256(0x09, data[1]) ^ math::fast_mult256(0x0e, data[2]) ^ math::fast_mult256(0x0b, data[3]);
+			buf[3] = math::fast_mult256(0x0b, data[0]) ^ math::fast_mult256(0x0d, data[1]) ^ math::fast_mult256(0x09, data[2]) ^ math::fast_mult256(0x0e, data[3]);
+
+			//// C2
+			buf[4] = math::fast_mult256(0x0e, data[4]) ^ math::fast_mult256(0x0b, data[5]) ^ math::fast_mult256(0x0d, data[6]) ^ math::fast_mult256(0x09, data[7]);
+			buf[5] = math::fast_mult256(0x09, data[4]) ^ math::fast_mult256(0x0e, data[5]) ^ math::fast_mult256(0x0b, data[6]) ^ math::fast_mult256(0x0d, data[7]);
+			buf[6] = math::fast_mult256(0x0d, data[4]) ^ math::fast_mult256(0x09, data[5]) ^ math::fast_mult256(0x0e, data[6]) ^ math::fast_mult256(0x0b, data[7]);
+			buf[7] = math::fast_mult256(0x0b, data[4]) ^ math::fast_mult256(0x0d, data[5]) ^ math::fast_mult256(0x09, data[6]) ^ math::fast_mult256(0x0e, data[7]);
+
+			//// C3
+			buf[8] = math::fast_mult256(0x0e, data[8]) ^ math::fast_mult256(0x0b, data[9]) ^ math::fast_mult256(0x0d, data[10]) ^ math::fast_mult256(0x09, data[11]);
+			buf[9] = math::fast_mult256(0x09, data[8]) ^ math::fast_mult256(0x0e, data[9]) ^ math::fast_mult256(0x0b, data[10]) ^ math::fast_mult256(0x0d, data[11]);
+			buf[10] = math::fast_mult256(0x0d, data[8]) ^ math::fast_mult256(0x09, data[9]) ^ math::fast_mult256(0x0e, data[10]) ^ math::fast_mult256(0x0b, data[11]);
+			buf[11] = math::fast_mult256(0x0b, data[8]) ^ math::fast_mult256(0x0d, data[9]) ^ math::fast_mult256(0x09, data[10]) ^ math::fast_mult256(0x0e, data[11]);
+
+			//// C4
+			buf[12] = math::fast_mult256(0x0e, data[12]) ^ math::fast_mult256(0x0b, data[13]) ^ math::fast_mult256(0x0d, data[14]) ^ math::fast_mult256(0x09, data[15]);
+			buf[13] = math::fast_mult256(0x09, data[12]) ^ math::fast_mult256(0x0e, data[13]) ^ math::fast_mult256(0x0b, data[14]) ^ math::fast_mult256(0x0d, data[15]);
+			buf[14] = math::fast_mult256(0x0d, data[12]) ^ math::fast_mult256(0x09, data[13]) ^ math::fast_mult256(0x0e, data[14]) ^ math::fast_mult256(0x0b, data[15]);
+			buf[15] = math::fast_mult256(0x0b, data[12]) ^ math::fast_mult256(0x0d, data[13]) ^ math::fast_mult256(0x09, data[14]) ^ math::fast_mult256(0x0e, data[15]);
+
+			std::copy(buf.begin(), buf.end(), data.begin());
+		}
+
+		constexpr void inv_mix_columns(byte_view<16> data) noexcept
+		{
+
+			uint8_t a, b, c, d;
+			for (size_t i = 0; i < 16; i = i + 4) {
+
+				a = aes_base::MULT_TABLES.mult_14[data[i]] ^ aes_base::MULT_TABLES.mult_11[data[i + 1]] ^ aes_base::MULT_TABLES.mult_13[data[i + 2]] ^ aes_base::MULT_TABLES.mult_9[data[i + 3]];
+				b = aes_base::MULT_TABLES.mult_9[data[i]] ^ aes_base::MULT_TABLES.mult_14[data[i + 1]] ^ aes_base::MULT_TABLES.mult_11[data[i + 2]] ^ aes_base::MULT_TABLES.mult_13[data[i + 3]];
+				c = aes_base::MULT_TABLES.mult_13[data[i]] ^ aes_base::MULT_TABLES.mult_9[data[i + 1]] ^ aes_base::MULT_TABLES.mult_14[data[i + 2]] ^ aes_base::MULT_TABLES.mult_11[data[i + 3]];
+				d = aes_base::MULT_TABLES.mult_11[data[i]] ^ aes_base::MULT_TABLES.mult_13[data[i + 1]] ^ aes_base::MULT_TABLES.mult_9[data[i + 2]] ^ aes_base::MULT_TABLES.mult_14[data[i + 3]];
+				
+				data[i] = a;
+				data[i + 1] = b;
+				data[i + 2] = c;
+				data[i + 3] = d;
+			}
+		}
+
+		constexpr void inv_shift_rows(byte_view<16> data) noexcept
+		{
+			uint8_t i, j, k, l;
+
+			// cyclically shifts 1
+			i = data[13];
+			data[13] = data[9];
+			data[9] = data[5];
+			data[5] = data[1];
+			data[1] = i;
+			
+			// cyclically shifts 2
+			j = data[2];
+			data[2] = data[10];
+			data[10] = j;
+			k = data[6];
+			data[6] = data[14];
+			data[14] = k;
+
+			// cyclically shifts 3
+			l = data[3];
+			data[3] = data[7];
+			data[7] = data[11];
+			data[11] = data[15];
+			data[15] = l;
+
+		}
+
+		constexpr void mix_columns(byte_view<16> data) noexcept
+		{
+			for (size_t i = 0; i < 16; i = i + 4) {
+				uint8_t a = data[i];
+				uint8_t e = data[i] ^ data[i + 1] ^ data[i + 2] ^ data[i + 3];
+				data[i] ^= e ^ aes_base::MULT_TABLES.mult_2[a ^ data[i + 1]]; 
+				data[i + 1] ^= e ^ aes_base::MULT_TABLES.mult_2[data[i + 1] ^ data[i + 2]]; 
+				data[i + 2] ^= e ^ aes_base::MULT_TABLES.mult_2[data[i + 2] ^ data[i + 3]]; 
+				data[i + 3] ^= e ^ aes_base::MULT_TABLES.mult_2[data[i + 3] ^ a]; 
+			}
+		}
+
+
+		constexpr void mix_columns_slow(byte_view<16> data) noexcept
+		{
+			// Todo: Improve this function
+			std::array<uint8_t, 16> buf{};
+
+			//// C1
+			buf[0] = math::fast_mult256(2, data[0]) ^ math::fast_mult256(3, data[1]) ^ data[2] ^ data[3];
+			buf[1] = data[0] ^ math::fast_mult256(2, data[1]) ^ math::fast_mult256(3, data[2]) ^ data[3];
+			buf[2] = data[0] ^ data[1] ^ math::fast_mult256(2, data[2]) ^ math::fast_mult256(3, data[3]);
+			buf[3] = math::fast_mult256(3, data[0]) ^ data[1] ^ data[2] ^ math::fast_mult256(2, data[3]);
+
+			//// C2
+			buf[4] = math::fast_mult256(2, data[4]) ^ math::fast_mult256(3, data[5]) ^ data[6] ^ data[7];
+			buf[5] = data[4] ^ math::fast_mult256(2, data[5]) ^ math::fast_mult256(3, data[6]) ^ data[7];
+			buf[6] = data[4] ^ data[5] ^ math::fast_mult256(2, data[6]) ^ math::fast_mult256(3, data[7]);
+			buf[7] = math::fast_mult256(3, data[4]) ^ data[5] ^ data[6] ^ math::fast_mult256(2, data[7]);
+
+			//// C3
+			buf[8] = math::fast_mult256(2, data[8]) ^ math::fast_mult256(3, data[9]) ^ data[10] ^ data[11];
+			buf[9] = data[8] ^ math::fast_mult256(2, data[9]) ^ math::fast_mult256(3, data[10]) ^ data[11];
+			buf[10] = data[8] ^ data[9] ^ math::fast_mult256(2, data[10]) ^ math::fast_mult256(3, data[11]);
+			buf[11] = math::fast_mult256(3, data[8]) ^ data[9] ^ data[10] ^ math::fast_mult256(2, data[11]);
+
+			//// C4
+			buf[12] = math::fast_mult256(2, data[12]) ^ math::fast_mult256(3, data[13]) ^ data[14] ^ data[15];
+			buf[13] = data[12] ^ math::fast_mult256(2, data[13]) ^ math::fast_mult256(3, data[14]) ^ data[15];
+			buf[14] = data[12] ^ data[13] ^ math::fast_mult256(2, data[14]) ^ math::fast_mult256(3, data[15]);
+			buf[15] = math::fast_mult256(3, data[12]) ^ data[13] ^ data[14] ^ math::fast_mult256(2, data[15]);
+
+			std::copy(buf.begin(), buf.end(), data.begin());
+		}
+
+		constexpr void shift_rows(byte_view<16> data) noexcept
+		{
+			
+			uint8_t i, j, k, l;
+
+			// cyclically shifts 1
+			i = data[1];
+			data[1] = data[5];
+			data[5] = data[9];
+			data[9] = data[13];
+			data[13] = i;
+
+			// cyclically shifts 2
+			j = data[2];
+			data[2] = data[10];
+			data[10] = j;
+			k = data[6];
+			data[6] = data[14];
+			data[14] = k;
+			
+			// cyclically shifts 3
+			l = data[15];
+			data[15] = data[11];
+			data[11] = data[7];
+			data[7] = data[3];
+			data[3] = l;
+
+		}
+
+
+		template <typename It>
+		constexpr void add_round_key(byte_view<16> data, It it) noexcept
+		{
+			// Todo: Check with 4 element loop unrolling
+			for (size_t i = 0; i < 16; i++) {
+				data[i] ^= it[i];
+			}
+		}
+
+
+
+	}
+
+}
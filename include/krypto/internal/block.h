@@ -0,0 +1,321 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <algorithm>
+
+// The backend is picked from the compiler flags, or fixed by krypto_FORCE_BACKEND
+// with KRYPTO_BACKEND_TABLE, KRYPTO_BACKEND_AESNI or KRYPTO_BACKEND_VAES
+#if defined(KRYPTO_BACKEND_TABLE) || defined(KRYPTO_BACKEND_AESNI) || defined(KRYPTO_BACKEND_VAES)
+#define KRYPTO_FORCED_BACKEND 1
+#endif
+
+#if defined(__AES__) && !defined(KRYPTO_BACKEND_TABLE)
+#include <immintrin.h>
+#define KRYPTO_AESNI 1
+#if !defined(KRYPTO_BACKEND_AESNI)
+#if defined(__VAES__) && defined(__AVX512F__)
+#define KRYPTO_VAES 1
+#endif
+// Wide CTR kernels, 512 bit needs the AVX-512 byte shuffle
+#if defined(__VAES__) && defined(__AVX2__)
+#define KRYPTO_VAES256 1
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+#define KRYPTO_VAES512 1
+#endif
+#endif
+#endif
+#endif
+
+#if defined(KRYPTO_BACKEND_AESNI) && !defined(KRYPTO_AESNI)
+#error "KRYPTO_BACKEND_AESNI needs -maes"
+#endif
+#if defined(KRYPTO_BACKEND_VAES) && !defined(KRYPTO_VAES256)
+#error "KRYPTO_BACKEND_VAES needs -maes -mvaes -mavx2"
+#endif
+
+// Wide CTR kernels of the compiled library, picked at runtime by programs built for AES-NI
+#if defined(KRYPTO_PRECOMPILED_VAES) && defined(KRYPTO_AESNI) && !defined(KRYPTO_VAES256) && !defined(KRYPTO_FORCED_BACKEND)
+#include "isa.h"
+#define KRYPTO_RUNTIME_VAES 1
+#endif
+
+#include "aes_core.h"
+
+// Unroll loops over independent blocks so they stay in registers
+#if defined(__GNUC__)
+#define KRYPTO_UNROLL _Pragma("GCC unroll 16")
+#else
+#define KRYPTO_UNROLL
+#endif
+
+// Carry less multiplication for GHASH
+#if defined(__PCLMUL__) && defined(__SSSE3__)
+#include <immintrin.h>
+#define KRYPTO_PCLMUL 1
+#endif
+
+// Inline namespace of the block type, the kernels and every internal type whose
+// layout depends on the instruction set, named for it so translation units built
+// with different flags never share a definition
+#if defined(KRYPTO_VAES512) && defined(KRYPTO_PCLMUL)
+#define KRYPTO_ISA isa_vaes512_clmul
+#elif defined(KRYPTO_VAES512)
+#define KRYPTO_ISA isa_vaes512
+#elif defined(KRYPTO_VAES256) && defined(KRYPTO_PCLMUL)
+#define KRYPTO_ISA isa_vaes256_clmul
+#elif defined(KRYPTO_VAES256)
+#define KRYPTO_ISA isa_vaes256
+#elif defined(KRYPTO_AESNI) && defined(KRYPTO_PCLMUL)
+#define KRYPTO_ISA isa_aesni_clmul
+#elif defined(KRYPTO_AESNI)
+#define KRYPTO_ISA isa_aesni
+#elif defined(KRYPTO_PCLMUL)
+#define KRYPTO_ISA isa_generic_clmul
+#else
+#define KRYPTO_ISA isa_generic
+#endif
+
+/**
+ * 128 bit block type used by constructions built on the AES round function.
+ * When compiled with AES-NI (-maes) the block is a SSE register and the round
+ * is a single AESENC instruction, otherwise the table based round is used.
+ */
+namespace krypto::internal::inline KRYPTO_ISA {
+
+#ifdef KRYPTO_AESNI
+	using block = __m128i;
+#else
+	using block = std::array<unsigned char, 16>;
+#endif
+
+	inline block block_load(const unsigned char* in) noexcept;
+	inline void block_store(unsigned char* out, block b) noexcept;
+
+	inline block block_zero() noexcept;
+
+	// Block from two 64 bit words, stored little endian (lo in bytes 0..7)
+	inline block block_set64(uint64_t hi, uint64_t lo) noexcept;
+	inline block block_xor(block a, block b) noexcept;
+	inline block block_and(block a, block b) noexcept;
+
+	// Add the two 64 bit words of a and b, without carry between them
+	inline block block_add64(block a, block b) noexcept;
+
+	// Interleave the low / high 32 bit words of a and b (PUNPCKLDQ / PUNPCKHDQ)
+	inline block block_unpacklo32(block a, block b) noexcept;
+	inline block block_unpackhi32(block a, block b) noexcept;
+
+	/**
+	 * One AES round with key as round key (AESENC)
+	 */
+	inline block aesenc(block data, block key) noexcept;
+
+	/**
+	 * Last AES round with key as round key (AESENCLAST)
+	 */
+	inline block aesenclast(block data, block key) noexcept;
+
+	/**
+	 * One AES decryption round with key as round key (AESDEC)
+	 */
+	inline block aesdec(block data, block key) noexcept;
+
+	/**
+	 * Last AES decryption round with key as round key (AESDECLAST)
+	 */
+	inline block aesdeclast(block data, block key) noexcept;
+
+	/**
+	 * InvMixColumns of a round key, for the equivalent inverse cipher (AESIMC)
+	 */
+	inline block aesimc(block key) noexcept;
+
+	///
+	// Implementation
+	///
+
+#ifdef KRYPTO_AESNI
+
+	inline block block_load(const unsigned char* in) noexcept
+	{
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+	}
+
+	inline void block_store(unsigned char* out, block b) noexcept
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), b);
+	}
+
+	inline block block_zero() noexcept
+	{
+		return _mm_setzero_si128();
+	}
+
+	inline block block_set64(uint64_t hi, uint64_t lo) noexcept
+	{
+		return _mm_set_epi64x(static_cast<long long>(hi), static_cast<long long>(lo));
+	}
+
+	inline block block_xor(block a, block b) noexcept
+	{
+		return _mm_xor_si128(a, b);
+	}
+
+	inline block block_and(block a, block b) noexcept
+	{
+		return _mm_and_si128(a, b);
+	}
+
+	inline block block_add64(block a, block b) noexcept
+	{
+		return _mm_add_epi64(a, b);
+	}
+
+	inline block block_unpacklo32(block a, block b) noexcept
+	{
+		return _mm_unpacklo_epi32(a, b);
+	}
+
+	inline block block_unpackhi32(block a, block b) noexcept
+	{
+		return _mm_unpackhi_epi32(a, b);
+	}
+
+	inline block aesenc(block data, block key) noexcept
+	{
+		return _mm_aesenc_si128(data, key);
+	}
+
+	inline block aesenclast(block data, block key) noexcept
+	{
+		return _mm_aesenclast_si128(data, key);
+	}
+
+	inline block aesdec(block data, block key) noexcept
+	{
+		return _mm_aesdec_si128(data, key);
+	}
+
+	inline block aesdeclast(block data, block key) noexcept
+	{
+		return _mm_aesdeclast_si128(data, key);
+	}
+
+	inline block aesimc(block key) noexcept
+	{
+		return _mm_aesimc_si128(key);
+	}
+
+#else
+
+	inline block block_load(const unsigned char* in) noexcept
+	{
+		block b;
+		std::memcpy(b.data(), in, 16);
+		return b;
+	}
+
+	inline void block_store(unsigned char* out, block b) noexcept
+	{
+		std::memcpy(out, b.data(), 16);
+	}
+
+	inline block block_zero() noexcept
+	{
+		return block{};
+	}
+
+	inline block block_set64(uint64_t hi, uint64_t lo) noexcept
+	{
+		block b;
+		for (size_t i = 0; i < 8; i++) {
+			b[i] = static_cast<unsigned char>(lo >> (i * 8));
+			b[i + 8] = static_cast<unsigned char>(hi >> (i * 8));
+		}
+		return b;
+	}
+
+	inline block block_xor(block a, block b) noexcept
+	{
+		for (size_t i = 0; i < 16; i++) {
+			a[i] ^= b[i];
+		}
+		return a;
+	}
+
+	inline block block_and(block a, block b) noexcept
+	{
+		for (size_t i = 0; i < 16; i++) {
+			a[i] &= b[i];
+		}
+		return a;
+	}
+
+	inline block block_add64(block a, block b) noexcept
+	{
+		for (size_t w = 0; w < 16; w += 8) {
+			unsigned int carry = 0;
+			for (size_t i = w; i < w + 8; i++) {
+				const unsigned int sum = a[i] + b[i] + carry;
+				a[i] = static_cast<unsigned char>(sum);
+				carry = sum >> 8;
+			}
+		}
+		return a;
+	}
+
+	inline block block_unpacklo32(block a, block b) noexcept
+	{
+		block r;
+		std::copy_n(a.begin(), 4, r.begin());
+		std::copy_n(b.begin(), 4, r.begin() + 4);
+		std::copy_n(a.begin() + 4, 4, r.begin() + 8);
+		std::copy_n(b.begin() + 4, 4, r.begin() + 12);
+		return r;
+	}
+
+	inline block block_unpackhi32(block a, block b) noexcept
+	{
+		block r;
+		std::copy_n(a.begin() + 8, 4, r.begin());
+		std::copy_n(b.begin() + 8, 4, r.begin() + 4);
+		std::copy_n(a.begin() + 12, 4, r.begin() + 8);
+		std::copy_n(b.begin() + 12, 4, r.begin() + 12);
+		return r;
+	}
+
+	inline block aesenc(block data, block key) noexcept
+	{
+		aes::round(data, key.begin());
+		return data;
+	}
+
+	inline block aesenclast(block data, block key) noexcept
+	{
+		aes::round_last(data, key.begin());
+		return data;
+	}
+
+	inline block aesdec(block data, block key) noexcept
+	{
+		aes::inv_round(data, key.begin());
+		return data;
+	}
+
+	inline block aesdeclast(block data, block key) noexcept
+	{
+		aes::inv_round_last(data, key.begin());
+		return data;
+	}
+
+	inline block aesimc(block key) noexcept
+	{
+		aes::inv_mix_columns(key);
+		return key;
+	}
+
+#endif
+
+}
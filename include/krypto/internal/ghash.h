@@ -0,0 +1,363 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <algorithm>
+
+#include "block.h"
+
+/**
+ * GHASH universal hash of GCM, https://nvlpubs.nist.gov/nistpubs/Legacy/SP/nistspecialpublication800-38d.pdf
+ * With PCLMULQDQ (-mpclmul) 4 blocks are multiplied by H^4 .. H and reduced once,
+ * otherwise the 4 bit table method of Shoup is used. The layout of the key and state
+ * depends on it, so they are in the namespace of the instruction set.
+ */
+namespace krypto::internal::inline KRYPTO_ISA::ghash {
+
+	/**
+	 * Multiplication tables / powers of the hash key H
+	 */
+	struct key {
+		explicit key(const unsigned char* h) noexcept;
+
+#ifdef KRYPTO_PCLMUL
+		// H, H^2, H^3, H^4 byte reversed
+		__m128i powers[4];
+#else
+		std::array<uint64_t, 16> hh;
+		std::array<uint64_t, 16> hl;
+#endif
+	};
+
+	/**
+	 * Running hash value
+	 */
+	class state {
+	public:
+
+		state() noexcept;
+
+		/**
+		 * Hash size bytes, a trailing partial block is padded with zeros.
+		 * Only the last call for the AD or cipher text may end in a partial block
+		 */
+		void update(const key& k, const unsigned char* data, size_t size) noexcept;
+
+		/**
+		 * Hash the bit lengths block and store the hash value
+		 */
+		void finish(const key& k, uint64_t ad_bytes, uint64_t cipher_bytes, unsigned char* out) noexcept;
+
+		/**
+		 * Append the hash of the next part of the message, hashed from a new state.
+		 * blocks is the number of 16 byte blocks of that part, the hash becomes
+		 * x * H^blocks ^ next, the same as hashing both parts in one state
+		 */
+		void combine(const key& k, const state& next, uint64_t blocks) noexcept;
+
+	private:
+
+		void update_block(const key& k, const unsigned char* block) noexcept;
+
+#ifdef KRYPTO_PCLMUL
+		void update_4(const key& k, const unsigned char* blocks) noexcept;
+
+		__m128i x;
+#else
+		uint64_t hi;
+		uint64_t lo;
+#endif
+	};
+
+	///
+	// Implementation
+	///
+
+#ifdef KRYPTO_PCLMUL
+
+	inline __m128i reverse(__m128i x) noexcept
+	{
+		return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+	}
+
+	/**
+	 * Accumulate the unreduced 256 bit carry less product a * b
+	 */
+	inline void mul_acc(__m128i a, __m128i b, __m128i& lo, __m128i& mid, __m128i& hi) noexcept
+	{
+		lo = _mm_xor_si128(lo, _mm_clmulepi64_si128(a, b, 0x00));
+		hi = _mm_xor_si128(hi, _mm_clmulepi64_si128(a, b, 0x11));
+		mid = _mm_xor_si128(mid, _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01)));
+	}
+
+	/**
+	 * Reduce a 256 bit product modulo x^128 + x^7 + x^2 + x + 1 in the bit reflected domain
+	 */
+	inline __m128i reduce(__m128i lo, __m128i mid, __m128i hi) noexcept
+	{
+		lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+		hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+		// Shift the product left by one bit
+		__m128i carry_lo = _mm_srli_epi32(lo, 31);
+		__m128i carry_hi = _mm_srli_epi32(hi, 31);
+		lo = _mm_slli_epi32(lo, 1);
+		hi = _mm_slli_epi32(hi, 1);
+
+		const __m128i cross = _mm_srli_si128(carry_lo, 12);
+		carry_hi = _mm_slli_si128(carry_hi, 4);
+		carry_lo = _mm_slli_si128(carry_lo, 4);
+		lo = _mm_or_si128(lo, carry_lo);
+		hi = _mm_or_si128(hi, _mm_or_si128(carry_hi, cross));
+
+		// First phase
+		__m128i t = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+		const __m128i t_hi = _mm_srli_si128(t, 4);
+		lo = _mm_xor_si128(lo, _mm_slli_si128(t, 12));
+
+		// Second phase
+		t = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+		t = _mm_xor_si128(t, t_hi);
+
+		return _mm_xor_si128(hi, _mm_xor_si128(lo, t));
+	}
+
+	inline __m128i mul(__m128i a, __m128i b) noexcept
+	{
+		__m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+		mul_acc(a, b, lo, mid, hi);
+		return reduce(lo, mid, hi);
+	}
+
+	inline key::key(const unsigned char* h) noexcept
+	{
+		powers[0] = reverse(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h)));
+		for (size_t i = 1; i < 4; i++) {
+			powers[i] = mul(powers[i - 1], powers[0]);
+		}
+	}
+
+	inline state::state() noexcept
+		: x(_mm_setzero_si128())
+	{
+	}
+
+	inline void state::update_block(const key& k, const unsigned char* block) noexcept
+	{
+		x = mul(_mm_xor_si128(x, reverse(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block)))), k.powers[0]);
+	}
+
+	inline void state::update_4(const key& k, const unsigned char* blocks) noexcept
+	{
+		__m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+
+		// (x ^ c0) * H^4 ^ c1 * H^3 ^ c2 * H^2 ^ c3 * H
+		const __m128i c0 = _mm_xor_si128(x, reverse(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks))));
+		mul_acc(c0, k.powers[3], lo, mid, hi);
+
+		KRYPTO_UNROLL
+		for (size_t i = 1; i < 4; i++) {
+			const __m128i c = reverse(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + i * 16)));
+			mul_acc(c, k.powers[3 - i], lo, mid, hi);
+		}
+
+		x = reduce(lo, mid, hi);
+	}
+
+	inline void state::update(const key& k, const unsigned char* data, size_t size) noexcept
+	{
+		const size_t blocks = size / 16;
+		size_t i = 0;
+
+		for (; i + 4 <= blocks; i += 4) {
+			update_4(k, data + i * 16);
+		}
+
+		for (; i < blocks; i++) {
+			update_block(k, data + i * 16);
+		}
+
+		const size_t rest = size - blocks * 16;
+		if (rest) {
+			std::array<unsigned char, 16> last{};
+			std::copy_n(data + blocks * 16, rest, last.begin());
+			update_block(k, last.data());
+		}
+	}
+
+	inline void state::finish(const key& k, uint64_t ad_bytes, uint64_t cipher_bytes, unsigned char* out) noexcept
+	{
+		// Reversed, the big endian bit lengths are two little endian words
+		x = mul(_mm_xor_si128(x, _mm_set_epi64x(static_cast<long long>(ad_bytes * 8), static_cast<long long>(cipher_bytes * 8))), k.powers[0]);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), reverse(x));
+	}
+
+	inline void state::combine(const key& k, const state& next, uint64_t blocks) noexcept
+	{
+		// Square and multiply, H^blocks in log2(blocks) steps
+		__m128i power = k.powers[0];
+		for (; blocks; blocks >>= 1) {
+			if (blocks & 1)
+				x = mul(x, power);
+			if (blocks > 1)
+				power = mul(power, power);
+		}
+
+		x = _mm_xor_si128(x, next.x);
+	}
+
+#else
+
+	// Reduction of the 4 bits shifted out, see Shoup's method
+	constexpr std::array<uint64_t, 16> LAST4 = {
+		0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+		0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+	};
+
+	inline uint64_t load_be64(const unsigned char* in) noexcept
+	{
+		uint64_t v = 0;
+		for (size_t i = 0; i < 8; i++) {
+			v = (v << 8) | in[i];
+		}
+		return v;
+	}
+
+	/**
+	 * z = z * y bit by bit, only for the few products of combine
+	 */
+	inline void mul(uint64_t& zh, uint64_t& zl, uint64_t yh, uint64_t yl) noexcept
+	{
+		uint64_t rh = 0, rl = 0;
+
+		for (size_t i = 0; i < 128; i++) {
+			const uint64_t bit = i < 64 ? (zh >> (63 - i)) & 1 : (zl >> (127 - i)) & 1;
+			rh ^= yh & (0 - bit);
+			rl ^= yl & (0 - bit);
+
+			const uint64_t t = (yl & 1) * 0xe100000000000000;
+			yl = (yh << 63) | (yl >> 1);
+			yh = (yh >> 1) ^ t;
+		}
+
+		zh = rh;
+		zl = rl;
+	}
+
+	inline key::key(const unsigned char* h) noexcept
+		: hh{}, hl{}
+	{
+		uint64_t vh = load_be64(h);
+		uint64_t vl = load_be64(h + 8);
+
+		// Entry 8 is H, entries 4, 2, 1 are H * x, H * x^2, H * x^3
+		hh[8] = vh;
+		hl[8] = vl;
+
+		for (size_t i = 4; i > 0; i >>= 1) {
+			const uint64_t t = (vl & 1) * 0xe1000000;
+			vl = (vh << 63) | (vl >> 1);
+			vh = (vh >> 1) ^ (t << 32);
+			hh[i] = vh;
+			hl[i] = vl;
+		}
+
+		for (size_t i = 2; i <= 8; i *= 2) {
+			for (size_t j = 1; j < i; j++) {
+				hh[i + j] = hh[i] ^ hh[j];
+				hl[i + j] = hl[i] ^ hl[j];
+			}
+		}
+	}
+
+	inline state::state() noexcept
+		: hi(0), lo(0)
+	{
+	}
+
+	inline void state::update_block(const key& k, const unsigned char* block) noexcept
+	{
+		std::array<unsigned char, 16> x;
+		const uint64_t h = hi ^ load_be64(block);
+		const uint64_t l = lo ^ load_be64(block + 8);
+		for (size_t i = 0; i < 8; i++) {
+			x[i] = static_cast<unsigned char>(h >> (56 - i * 8));
+			x[i + 8] = static_cast<unsigned char>(l >> (56 - i * 8));
+		}
+
+		size_t nibble = x[15] & 0xf;
+		uint64_t zh = k.hh[nibble];
+		uint64_t zl = k.hl[nibble];
+
+		for (int i = 15; i >= 0; i--) {
+			const size_t low = x[i] & 0xf;
+			const size_t high = x[i] >> 4;
+
+			if (i != 15) {
+				const size_t rem = zl & 0xf;
+				zl = (zh << 60) | (zl >> 4);
+				zh = (zh >> 4) ^ (LAST4[rem] << 48);
+				zh ^= k.hh[low];
+				zl ^= k.hl[low];
+			}
+
+			const size_t rem = zl & 0xf;
+			zl = (zh << 60) | (zl >> 4);
+			zh = (zh >> 4) ^ (LAST4[rem] << 48);
+			zh ^= k.hh[high];
+			zl ^= k.hl[high];
+		}
+
+		hi = zh;
+		lo = zl;
+	}
+
+	inline void state::update(const key& k, const unsigned char* data, size_t size) noexcept
+	{
+		const size_t blocks = size / 16;
+
+		for (size_t i = 0; i < blocks; i++) {
+			update_block(k, data + i * 16);
+		}
+
+		const size_t rest = size - blocks * 16;
+		if (rest) {
+			std::array<unsigned char, 16> last{};
+			std::copy_n(data + blocks * 16, rest, last.begin());
+			update_block(k, last.data());
+		}
+	}
+
+	inline void state::finish(const key& k, uint64_t ad_bytes, uint64_t cipher_bytes, unsigned char* out) noexcept
+	{
+		std::array<unsigned char, 16> lengths;
+		for (size_t i = 0; i < 8; i++) {
+			lengths[i] = static_cast<unsigned char>((ad_bytes * 8) >> (56 - i * 8));
+			lengths[i + 8] = static_cast<unsigned char>((cipher_bytes * 8) >> (56 - i * 8));
+		}
+		update_block(k, lengths.data());
+
+		for (size_t i = 0; i < 8; i++) {
+			out[i] = static_cast<unsigned char>(hi >> (56 - i * 8));
+			out[i + 8] = static_cast<unsigned char>(lo >> (56 - i * 8));
+		}
+	}
+
+	inline void state::combine(const key& k, const state& next, uint64_t blocks) noexcept
+	{
+		// Entry 8 of the tables is H
+		uint64_t ph = k.hh[8], pl = k.hl[8];
+		for (; blocks; blocks >>= 1) {
+			if (blocks & 1)
+				mul(hi, lo, ph, pl);
+			if (blocks > 1)
+				mul(ph, pl, ph, pl);
+		}
+
+		hi ^= next.hi;
+		lo ^= next.lo;
+	}
+
+#endif
+
+}
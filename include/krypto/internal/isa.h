@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <immintrin.h>
+
+/**
+ * Wide CTR kernels of the compiled library, krypto_static and krypto_shared.
+ * Each is built in its own translation unit with the flags of its instruction
+ * set and picked at runtime, so a program built for AES-NI uses VAES on CPUs
+ * that have it. Only declared when linking the library (KRYPTO_PRECOMPILED_VAES).
+ */
+namespace krypto::internal::isa {
+
+	/**
+	 * True if the CPU and OS support the 256 bit kernels, VAES and AVX2
+	 */
+	inline bool vaes256() noexcept;
+
+	/**
+	 * True if the CPU and OS support the 512 bit kernels, VAES, AVX-512F and AVX-512BW
+	 */
+	inline bool vaes512() noexcept;
+
+	/**
+	 * ctr_xor_vaes256 and ctr_xor_vaes512 on the Rounds + 1 round keys rk of a
+	 * key_schedule and the counter words of a ctr_stream
+	 */
+	template <size_t Rounds>
+	void ctr_xor_vaes256(const unsigned char* in, unsigned char* out, size_t size, const __m128i* rk, uint64_t hi, uint64_t lo, bool inc32, uint64_t index) noexcept;
+
+	template <size_t Rounds>
+	void ctr_xor_vaes512(const unsigned char* in, unsigned char* out, size_t size, const __m128i* rk, uint64_t hi, uint64_t lo, bool inc32, uint64_t index) noexcept;
+
+	extern template void ctr_xor_vaes256<10>(const unsigned char*, unsigned char*, size_t, const __m128i*, uint64_t, uint64_t, bool, uint64_t) noexcept;
+	extern template void ctr_xor_vaes256<12>(const unsigned char*, unsigned char*, size_t, const __m128i*, uint64_t, uint64_t, bool, uint64_t) noexcept;
+	extern template void ctr_xor_vaes256<14>(const unsigned char*, unsigned char*, size_t, const __m128i*, uint64_t, uint64_t, bool, uint64_t) noexcept;
+	extern template void ctr_xor_vaes512<10>(const unsigned char*, unsigned char*, size_t, const __m128i*, uint64_t, uint64_t, bool, uint64_t) noexcept;
+	extern template void ctr_xor_vaes512<12>(const unsigned char*, unsigned char*, size_t, const __m128i*, uint64_t, uint64_t, bool, uint64_t) noexcept;
+	extern template void ctr_xor_vaes512<14>(const unsigned char*, unsigned char*, size_t, const __m128i*, uint64_t, uint64_t, bool, uint64_t) noexcept;
+
+	///
+	// Implementation
+	///
+
+	inline bool vaes256() noexcept
+	{
+		// Checks the OS saves the AVX state too
+		static const bool supported = __builtin_cpu_supports("vaes") && __builtin_cpu_supports("avx2");
+		return supported;
+	}
+
+	inline bool vaes512() noexcept
+	{
+		static const bool supported = vaes256() && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+		return supported;
+	}
+
+}
@@ -0,0 +1,623 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+
+#include "aes_core.h"
+#include "block.h"
+#include "../dispatch.h"
+
+/**
+ * Multi block AES kernels on the internal block type.
+ * Independent blocks are encrypted with their rounds interleaved, so the
+ * AES unit pipeline is kept full instead of waiting on one block at a time.
+ */
+namespace krypto::internal::inline KRYPTO_ISA {
+
+	// Number of blocks the bulk kernels keep in flight
+	constexpr size_t KERNEL_WIDTH = 8;
+
+	/**
+	 * AES round keys loaded as blocks
+	 */
+	template <size_t Size>
+	struct key_schedule {
+		constexpr static size_t NR = Size / 32 + 6;
+
+		key_schedule() noexcept = default;
+		explicit key_schedule(const_byte_view<Size / 8> key) noexcept;
+
+		/**
+		 * Load round keys already expanded by aes::expand_key
+		 */
+		explicit key_schedule(const_byte_view<(NR + 1) * 16> expanded) noexcept;
+
+		block rk[NR + 1];
+	};
+
+	/**
+	 * Round keys of the equivalent inverse cipher, in decryption order
+	 */
+	template <size_t Size>
+	struct inv_key_schedule {
+		constexpr static size_t NR = key_schedule<Size>::NR;
+
+		inv_key_schedule() noexcept = default;
+		explicit inv_key_schedule(const key_schedule<Size>& ks) noexcept;
+
+		block rk[NR + 1];
+	};
+
+	/**
+	 * Counter as little endian 64 bit value in the low half of a block
+	 */
+	inline block counter_block(uint64_t counter) noexcept;
+
+	/**
+	 * Counter blocks of CTR mode: a big endian 128 bit initial block plus the
+	 * block index, incremented on all 128 bits or, as in GCM, the low 32 bits
+	 */
+	struct ctr_stream {
+		ctr_stream(const unsigned char* iv, bool inc32) noexcept;
+
+		block operator[](uint64_t index) const noexcept;
+
+		/**
+		 * Counter block index as native words, h the high and l the low 64 bits.
+		 * Returns false if counting count blocks from index carries out of the
+		 * incremented low bits, then blocks must be built one at a time
+		 */
+		bool words(uint64_t index, size_t count, uint64_t& h, uint64_t& l) const noexcept;
+
+		uint64_t hi;
+		uint64_t lo;
+		bool inc32;
+	};
+
+	/**
+	 * Encrypt N blocks held in registers
+	 */
+	template <size_t N, size_t Size>
+	inline void encrypt_blocks(block (&data)[N], const key_schedule<Size>& ks) noexcept;
+
+	/**
+	 * Decrypt N blocks held in registers
+	 */
+	template <size_t N, size_t Size>
+	inline void decrypt_blocks(block (&data)[N], const inv_key_schedule<Size>& ks) noexcept;
+
+	/**
+	 * Encrypt N blocks held in registers, block n with key schedule ks[n].
+	 * For blocks of independent messages with different keys
+	 */
+	template <size_t N, size_t Size>
+	inline void encrypt_lanes(block (&data)[N], const key_schedule<Size>* const (&ks)[N]) noexcept;
+
+	/**
+	 * Decrypt N blocks held in registers, block n with key schedule ks[n]
+	 */
+	template <size_t N, size_t Size>
+	inline void decrypt_lanes(block (&data)[N], const inv_key_schedule<Size>* const (&ks)[N]) noexcept;
+
+	/**
+	 * Encrypt count consecutive 16 byte blocks in place
+	 */
+	template <size_t Size>
+	inline void encrypt_ecb(unsigned char* data, size_t count, const key_schedule<Size>& ks) noexcept;
+
+	/**
+	 * CBC decrypt count blocks from in to out, iv is the cipher block before in.
+	 * in and out must not overlap
+	 */
+	template <size_t Size>
+	inline void decrypt_cbc(const unsigned char* in, unsigned char* out, size_t count, const unsigned char* iv, const inv_key_schedule<Size>& ks) noexcept;
+
+	/**
+	 * XOR size bytes with the key stream of counter blocks index, index + 1, ...
+	 * in and out may be the same buffer. The kernel width is picked by the
+	 * dispatch policy from message, the size of the whole message when size
+	 * is one stripe of it, or size if 0. With KRYPTO_BACKEND_VAES it is always
+	 * the widest kernel
+	 */
+	template <size_t Size>
+	inline void ctr_xor(const unsigned char* in, unsigned char* out, size_t size, const key_schedule<Size>& ks, const ctr_stream& ctr, uint64_t index, size_t message = 0) noexcept;
+
+	/**
+	 * ctr_xor on 128 bit blocks, and with 256 / 512 bit VAES
+	 */
+	template <size_t Size>
+	inline void ctr_xor_128(const unsigned char* in, unsigned char* out, size_t size, const key_schedule<Size>& ks, const ctr_stream& ctr, uint64_t index) noexcept;
+#ifdef KRYPTO_VAES256
+	template <size_t Size>
+	inline void ctr_xor_vaes256(const unsigned char* in, unsigned char* out, size_t size, const key_schedule<Size>& ks, const ctr_stream& ctr, uint64_t index) noexcept;
+#endif
+#ifdef KRYPTO_VAES512
+	template <size_t Size>
+	inline void ctr_xor_vaes512(const unsigned char* in, unsigned char* out, size_t size, const key_schedule<Size>& ks, const ctr_stream& ctr, uint64_t index) noexcept;
+#endif
+
+	/**
+	 * XOR size bytes in place with the key streams of two keys at once.
+	 * Turns CTR cipher text under key a into cipher text under key b
+	 */
+	template <size_t SizeA, size_t SizeB>
+	inline void ctr_rekey(unsigned char* data, size_t size, const key_schedule<SizeA>& ks_a, const ctr_stream& ctr_a, uint64_t index_a,
+		const key_schedule<SizeB>& ks_b, const ctr_stream& ctr_b, uint64_t index_b) noexcept;
+
+	///
+	// Implementation
+	///
+
+	template <size_t Size>
+	inline key_schedule<Size>::key_schedule(const_byte_view<Size / 8> key) noexcept
+	{
+		const auto expanded = aes::expand_key<Size>(key);
+
+		for (size_t i = 0; i <= NR; i++) {
+			rk[i] = block_load(&expanded[i * 16]);
+		}
+	}
+
+	template <size_t Size>
+	inline key_schedule<Size>::key_schedule(const_byte_view<(NR + 1) * 16> expanded) noexcept
+	{
+		for (size_t i = 0; i <= NR; i++) {
+			rk[i] = block_load(&expanded[i * 16]);
+		}
+	}
+
+	template <size_t Size>
+	inline inv_key_schedule<Size>::inv_key_schedule(const key_schedule<Size>& ks) noexcept
+	{
+		rk[0] = ks.rk[NR];
+		for (size_t i = 1; i < NR; i++) {
+			rk[i] = aesimc(ks.rk[NR - i]);
+		}
+		rk[NR] = ks.rk[0];
+	}
+
+	inline block counter_block(uint64_t counter) noexcept
+	{
+		return block_set64(0, counter);
+	}
+
+	constexpr uint64_t byte_swap64(uint64_t x) noexcept
+	{
+		x = ((x & 0x00ff00ff00ff00ff) << 8) | ((x >> 8) & 0x00ff00ff00ff00ff);
+		x = ((x & 0x0000ffff0000ffff) << 16) | ((x >> 16) & 0x0000ffff0000ffff);
+		return (x << 32) | (x >> 32);
+	}
+
+	inline ctr_stream::ctr_stream(const unsigned char* iv, bool inc32) noexcept
+		: hi(0), lo(0), inc32(inc32)
+	{
+		for (size_t i = 0; i < 8; i++) {
+			hi = (hi << 8) | iv[i];
+			lo = (lo << 8) | iv[i + 8];
+		}
+	}
+
+	inline block ctr_stream::operator[](uint64_t index) const noexcept
+	{
+		uint64_t h = hi;
+		uint64_t l;
+
+		if (inc32) {
+			l = (lo & 0xffffffff00000000) | static_cast<uint32_t>(lo + index);
+		}
+		else {
+			l = lo + index;
+			h += l < lo;
+		}
+
+		// Big endian words, byte 0 is the most significant byte of h
+		return block_set64(byte_swap64(l), byte_swap64(h));
+	}
+
+	inline bool ctr_stream::words(uint64_t index, size_t count, uint64_t& h, uint64_t& l) const noexcept
+	{
+		h = hi;
+
+		if (inc32) {
+			l = (lo & 0xffffffff00000000) | static_cast<uint32_t>(lo + index);
+			return static_cast<uint32_t>(l) <= UINT32_MAX - (count - 1);
+		}
+
+		l = lo + index;
+		h += l < lo;
+		return l <= UINT64_MAX - (count - 1);
+	}
+
+	template <size_t N, size_t Size>
+	inline void encrypt_blocks(block (&data)[N], const key_schedule<Size>& ks) noexcept
+	{
+		constexpr size_t NR = key_schedule<Size>::NR;
+
+		KRYPTO_UNROLL
+		for (size_t n = 0; n < N; n++) {
+			data[n] = block_xor(data[n], ks.rk[0]);
+		}
+
+		for (size_t r = 1; r < NR; r++) {
+			const block key = ks.rk[r];
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < N; n++) {
+				data[n] = aesenc(data[n], key);
+			}
+		}
+
+		KRYPTO_UNROLL
+		for (size_t n = 0; n < N; n++) {
+			data[n] = aesenclast(data[n], ks.rk[NR]);
+		}
+	}
+
+	template <size_t N, size_t Size>
+	inline void decrypt_blocks(block (&data)[N], const inv_key_schedule<Size>& ks) noexcept
+	{
+		constexpr size_t NR = inv_key_schedule<Size>::NR;
+
+		KRYPTO_UNROLL
+		for (size_t n = 0; n < N; n++) {
+			data[n] = block_xor(data[n], ks.rk[0]);
+		}
+
+		for (size_t r = 1; r < NR; r++) {
+			const block key = ks.rk[r];
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < N; n++) {
+				data[n] = aesdec(data[n], key);
+			}
+		}
+
+		KRYPTO_UNROLL
+		for (size_t n = 0; n < N; n++) {
+			data[n] = aesdeclast(data[n], ks.rk[NR]);
+		}
+	}
+
+	template <size_t N, size_t Size>
+	inline void encrypt_lanes(block (&data)[N], const key_schedule<Size>* const (&ks)[N]) noexcept
+	{
+		constexpr size_t NR = key_schedule<Size>::NR;
+
+		KRYPTO_UNROLL
+		for (size_t n = 0; n < N; n++) {
+			data[n] = block_xor(data[n], ks[n]->rk[0]);
+		}
+
+		for (size_t r = 1; r < NR; r++) {
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < N; n++) {
+				data[n] = aesenc(data[n], ks[n]->rk[r]);
+			}
+		}
+
+		KRYPTO_UNROLL
+		for (size_t n = 0; n < N; n++) {
+			data[n] = aesenclast(data[n], ks[n]->rk[NR]);
+		}
+	}
+
+	template <size_t N, size_t Size>
+	inline void decrypt_lanes(block (&data)[N], const inv_key_schedule<Size>* const (&ks)[N]) noexcept
+	{
+		constexpr size_t NR = inv_key_schedule<Size>::NR;
+
+		KRYPTO_UNROLL
+		for (size_t n = 0; n < N; n++) {
+			data[n] = block_xor(data[n], ks[n]->rk[0]);
+		}
+
+		for (size_t r = 1; r < NR; r++) {
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < N; n++) {
+				data[n] = aesdec(data[n], ks[n]->rk[r]);
+			}
+		}
+
+		KRYPTO_UNROLL
+		for (size_t n = 0; n < N; n++) {
+			data[n] = aesdeclast(data[n], ks[n]->rk[NR]);
+		}
+	}
+
+	template <size_t Size>
+	inline void encrypt_ecb(unsigned char* data, size_t count, const key_schedule<Size>& ks) noexcept
+	{
+		size_t i = 0;
+
+		for (; i + KERNEL_WIDTH <= count; i += KERNEL_WIDTH) {
+			block b[KERNEL_WIDTH];
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < KERNEL_WIDTH; n++) {
+				b[n] = block_load(data + (i + n) * 16);
+			}
+
+			encrypt_blocks(b, ks);
+
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < KERNEL_WIDTH; n++) {
+				block_store(data + (i + n) * 16, b[n]);
+			}
+		}
+
+		for (; i < count; i++) {
+			block b[1] = { block_load(data + i * 16) };
+			encrypt_blocks(b, ks);
+			block_store(data + i * 16, b[0]);
+		}
+	}
+
+	template <size_t Size>
+	inline void decrypt_cbc(const unsigned char* in, unsigned char* out, size_t count, const unsigned char* iv, const inv_key_schedule<Size>& ks) noexcept
+	{
+		// No chain dependency when decrypting, blocks are decrypted KERNEL_WIDTH at a time
+		size_t i = 0;
+		for (; i + KERNEL_WIDTH <= count; i += KERNEL_WIDTH) {
+			block b[KERNEL_WIDTH];
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < KERNEL_WIDTH; n++) {
+				b[n] = block_load(in + (i + n) * 16);
+			}
+
+			decrypt_blocks(b, ks);
+
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < KERNEL_WIDTH; n++) {
+				const block prev = block_load(i + n == 0 ? iv : in + (i + n - 1) * 16);
+				block_store(out + (i + n) * 16, block_xor(b[n], prev));
+			}
+		}
+
+		for (; i < count; i++) {
+			block b[1] = { block_load(in + i * 16) };
+			decrypt_blocks(b, ks);
+			const block prev = block_load(i == 0 ? iv : in + (i - 1) * 16);
+			block_store(out + i * 16, block_xor(b[0], prev));
+		}
+	}
+
+	template <size_t Size>
+	inline void ctr_xor(const unsigned char* in, unsigned char* out, size_t size, const key_schedule<Size>& ks, const ctr_stream& ctr, uint64_t index, size_t message) noexcept
+	{
+#if defined(KRYPTO_BACKEND_VAES)
+		// Fixed at build time, the widest kernel for every size and no policy to load
+		static_cast<void>(message);
+#ifdef KRYPTO_VAES512
+		ctr_xor_vaes512(in, out, size, ks, ctr, index);
+#else
+		ctr_xor_vaes256(in, out, size, ks, ctr, index);
+#endif
+#else
+		[[maybe_unused]] const size_t bytes = message ? message : size;
+
+#ifdef KRYPTO_VAES512
+		if (bytes >= dispatch::vaes512.load(std::memory_order_relaxed))
+			return ctr_xor_vaes512(in, out, size, ks, ctr, index);
+#endif
+#ifdef KRYPTO_VAES256
+		if (bytes >= dispatch::vaes256.load(std::memory_order_relaxed))
+			return ctr_xor_vaes256(in, out, size, ks, ctr, index);
+#endif
+#ifdef KRYPTO_RUNTIME_VAES
+		// Kernels of the compiled library for CPUs newer than the program is built for
+		if (bytes >= dispatch::vaes512.load(std::memory_order_relaxed) && isa::vaes512())
+			return isa::ctr_xor_vaes512<key_schedule<Size>::NR>(in, out, size, ks.rk, ctr.hi, ctr.lo, ctr.inc32, index);
+		if (bytes >= dispatch::vaes256.load(std::memory_order_relaxed) && isa::vaes256())
+			return isa::ctr_xor_vaes256<key_schedule<Size>::NR>(in, out, size, ks.rk, ctr.hi, ctr.lo, ctr.inc32, index);
+#endif
+		ctr_xor_128(in, out, size, ks, ctr, index);
+#endif
+	}
+
+	template <size_t Size>
+	inline void ctr_xor_128(const unsigned char* in, unsigned char* out, size_t size, const key_schedule<Size>& ks, const ctr_stream& ctr, uint64_t index) noexcept
+	{
+		const size_t blocks = size / 16;
+		size_t i = 0;
+
+		for (; i + KERNEL_WIDTH <= blocks; i += KERNEL_WIDTH) {
+			block b[KERNEL_WIDTH];
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < KERNEL_WIDTH; n++) {
+				b[n] = ctr[index + i + n];
+			}
+
+			encrypt_blocks(b, ks);
+
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < KERNEL_WIDTH; n++) {
+				block_store(out + (i + n) * 16, block_xor(b[n], block_load(in + (i + n) * 16)));
+			}
+		}
+
+		for (; i < blocks; i++) {
+			block b[1] = { ctr[index + i] };
+			encrypt_blocks(b, ks);
+			block_store(out + i * 16, block_xor(b[0], block_load(in + i * 16)));
+		}
+
+		const size_t rest = size - blocks * 16;
+		if (rest) {
+			block b[1] = { ctr[index + blocks] };
+			encrypt_blocks(b, ks);
+
+			std::array<unsigned char, 16> stream;
+			block_store(stream.data(), b[0]);
+			for (size_t n = 0; n < rest; n++) {
+				out[blocks * 16 + n] = in[blocks * 16 + n] ^ stream[n];
+			}
+		}
+	}
+
+#ifdef KRYPTO_VAES256
+
+	template <size_t Size>
+	inline void ctr_xor_vaes256(const unsigned char* in, unsigned char* out, size_t size, const key_schedule<Size>& ks, const ctr_stream& ctr, uint64_t index) noexcept
+	{
+		constexpr size_t NR = key_schedule<Size>::NR;
+		// Registers in flight, of 2 blocks each
+		constexpr size_t WIDTH = 8;
+		constexpr size_t GROUP = 2 * WIDTH;
+
+		__m256i rk[NR + 1];
+		for (size_t r = 0; r <= NR; r++) {
+			rk[r] = _mm256_broadcastsi128_si256(ks.rk[r]);
+		}
+
+		// Native words to big endian, per 64 bit word
+		const __m256i swap = _mm256_broadcastsi128_si256(_mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7));
+		const __m256i step = _mm256_set_epi64x(1, 0, 0, 0);
+		const __m256i two = _mm256_set_epi64x(2, 0, 2, 0);
+
+		const size_t blocks = size / 16;
+		size_t i = 0;
+
+		for (; i + GROUP <= blocks; i += GROUP) {
+			__m256i b[WIDTH];
+
+			uint64_t h, l;
+			if (ctr.words(index + i, GROUP, h, l)) {
+				__m256i c = _mm256_add_epi64(_mm256_set_epi64x(l, h, l, h), step);
+				KRYPTO_UNROLL
+				for (size_t n = 0; n < WIDTH; n++) {
+					b[n] = _mm256_shuffle_epi8(c, swap);
+					c = _mm256_add_epi64(c, two);
+				}
+			}
+			else {
+				KRYPTO_UNROLL
+				for (size_t n = 0; n < WIDTH; n++) {
+					b[n] = _mm256_set_m128i(ctr[index + i + 2 * n + 1], ctr[index + i + 2 * n]);
+				}
+			}
+
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < WIDTH; n++) {
+				b[n] = _mm256_xor_si256(b[n], rk[0]);
+			}
+
+			for (size_t r = 1; r < NR; r++) {
+				KRYPTO_UNROLL
+				for (size_t n = 0; n < WIDTH; n++) {
+					b[n] = _mm256_aesenc_epi128(b[n], rk[r]);
+				}
+			}
+
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < WIDTH; n++) {
+				b[n] = _mm256_aesenclast_epi128(b[n], rk[NR]);
+				const auto* src = reinterpret_cast<const __m256i*>(in + (i + 2 * n) * 16);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + (i + 2 * n) * 16), _mm256_xor_si256(b[n], _mm256_loadu_si256(src)));
+			}
+		}
+
+		ctr_xor_128(in + i * 16, out + i * 16, size - i * 16, ks, ctr, index + i);
+	}
+
+#endif
+
+#ifdef KRYPTO_VAES512
+
+	template <size_t Size>
+	inline void ctr_xor_vaes512(const unsigned char* in, unsigned char* out, size_t size, const key_schedule<Size>& ks, const ctr_stream& ctr, uint64_t index) noexcept
+	{
+		constexpr size_t NR = key_schedule<Size>::NR;
+		// Registers in flight, of 4 blocks each
+		constexpr size_t WIDTH = 8;
+		constexpr size_t GROUP = 4 * WIDTH;
+
+		__m512i rk[NR + 1];
+		for (size_t r = 0; r <= NR; r++) {
+			rk[r] = _mm512_broadcast_i32x4(ks.rk[r]);
+		}
+
+		const __m512i swap = _mm512_broadcast_i32x4(_mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7));
+		const __m512i step = _mm512_set_epi64(3, 0, 2, 0, 1, 0, 0, 0);
+		const __m512i four = _mm512_set_epi64(4, 0, 4, 0, 4, 0, 4, 0);
+
+		const size_t blocks = size / 16;
+		size_t i = 0;
+
+		for (; i + GROUP <= blocks; i += GROUP) {
+			__m512i b[WIDTH];
+
+			uint64_t h, l;
+			if (ctr.words(index + i, GROUP, h, l)) {
+				__m512i c = _mm512_add_epi64(_mm512_set_epi64(l, h, l, h, l, h, l, h), step);
+				KRYPTO_UNROLL
+				for (size_t n = 0; n < WIDTH; n++) {
+					b[n] = _mm512_shuffle_epi8(c, swap);
+					c = _mm512_add_epi64(c, four);
+				}
+			}
+			else {
+				KRYPTO_UNROLL
+				for (size_t n = 0; n < WIDTH; n++) {
+					const uint64_t k = index + i + 4 * n;
+					const __m256i lo = _mm256_set_m128i(ctr[k + 1], ctr[k]);
+					const __m256i hi = _mm256_set_m128i(ctr[k + 3], ctr[k + 2]);
+					b[n] = _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+				}
+			}
+
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < WIDTH; n++) {
+				b[n] = _mm512_xor_si512(b[n], rk[0]);
+			}
+
+			for (size_t r = 1; r < NR; r++) {
+				KRYPTO_UNROLL
+				for (size_t n = 0; n < WIDTH; n++) {
+					b[n] = _mm512_aesenc_epi128(b[n], rk[r]);
+				}
+			}
+
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < WIDTH; n++) {
+				b[n] = _mm512_aesenclast_epi128(b[n], rk[NR]);
+				_mm512_storeu_si512(out + (i + 4 * n) * 16, _mm512_xor_si512(b[n], _mm512_loadu_si512(in + (i + 4 * n) * 16)));
+			}
+		}
+
+		ctr_xor_128(in + i * 16, out + i * 16, size - i * 16, ks, ctr, index + i);
+	}
+
+#endif
+
+	template <size_t SizeA, size_t SizeB>
+	inline void ctr_rekey(unsigned char* data, size_t size, const key_schedule<SizeA>& ks_a, const ctr_stream& ctr_a, uint64_t index_a,
+		const key_schedule<SizeB>& ks_b, const ctr_stream& ctr_b, uint64_t index_b) noexcept
+	{
+		const size_t blocks = size / 16;
+		size_t i = 0;
+
+		// Both key streams are generated together, 2 * KERNEL_WIDTH blocks in flight
+		for (; i + KERNEL_WIDTH <= blocks; i += KERNEL_WIDTH) {
+			block a[KERNEL_WIDTH];
+			block b[KERNEL_WIDTH];
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < KERNEL_WIDTH; n++) {
+				a[n] = ctr_a[index_a + i + n];
+				b[n] = ctr_b[index_b + i + n];
+			}
+
+			encrypt_blocks(a, ks_a);
+			encrypt_blocks(b, ks_b);
+
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < KERNEL_WIDTH; n++) {
+				unsigned char* p = data + (i + n) * 16;
+				block_store(p, block_xor(block_load(p), block_xor(a[n], b[n])));
+			}
+		}
+
+		const size_t done = i * 16;
+		if (done < size) {
+			ctr_xor(data + done, data + done, size - done, ks_a, ctr_a, index_a + i);
+			ctr_xor(data + done, data + done, size - done, ks_b, ctr_b, index_b + i);
+		}
+	}
+
+}
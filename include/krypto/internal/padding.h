@@ -63,7 +63,7 @@ namespace krypto::pad {
 		const auto pad_size = *it;
 
 		// Make sure padding is valid
-		const auto to = std::prev(it, pad_size - 1);
+		const auto to = std::prev(it, pad_size);
 		it--;
 		for (; it != to; it--) {
 			if (*it != 0)
@@ -88,7 +88,7 @@ namespace krypto::pad {
 		const auto pad_size = *it;
 
 		// Make sure padding is valid
-		const auto to = std::prev(it, pad_size - 1);
+		const auto to = std::prev(it, pad_size);
 		it--;
 		for (; it != to; it--) {
 			if (*it != pad_size)
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <optional>
+#include <vector>
+
+/**
+ * Bounded lock free queues between one producer and one consumer thread.
+ * Head and tail only ever grow, the slot of an index is index & mask.
+ */
+namespace krypto::internal {
+
+	template <typename T>
+	class spsc_ring {
+	public:
+
+		/**
+		 * capacity is rounded up to a power of two
+		 */
+		explicit spsc_ring(size_t capacity) noexcept;
+
+		/**
+		 * Producer side, returns false if the ring is full
+		 */
+		bool push(const T& value) noexcept;
+
+		/**
+		 * Consumer side, returns empty optional if the ring is empty
+		 */
+		std::optional<T> pop() noexcept;
+
+		/**
+		 * Items in the ring, exact on either side when the other is idle
+		 */
+		size_t size() const noexcept;
+
+		size_t capacity() const noexcept { return items.size(); }
+
+	private:
+
+		std::vector<T> items;
+		size_t mask;
+
+		// Written by the consumer and the producer, on separate cache lines
+		alignas(64) std::atomic<size_t> head = 0;
+		alignas(64) std::atomic<size_t> tail = 0;
+
+	};
+
+	/**
+	 * spsc_ring with N items stored inline, for memory shared between processes.
+	 * Placed in the shared memory with new, lock free atomics work at any mapping address
+	 */
+	template <typename T, size_t N>
+	class shared_ring {
+	public:
+		static_assert(std::has_single_bit(N), "N must be a power of two");
+		static_assert(std::atomic<uint64_t>::is_always_lock_free, "Lock free 64 bit atomics required");
+
+		bool push(const T& value) noexcept;
+		std::optional<T> pop() noexcept;
+		size_t size() const noexcept;
+
+	private:
+
+		alignas(64) std::atomic<uint64_t> head = 0;
+		alignas(64) std::atomic<uint64_t> tail = 0;
+
+		alignas(64) T items[N];
+
+	};
+
+	///
+	// Implementation
+	///
+
+	template <typename T>
+	inline spsc_ring<T>::spsc_ring(size_t capacity) noexcept
+		: items(std::bit_ceil(std::max<size_t>(capacity, 2))), mask(items.size() - 1)
+	{
+	}
+
+	template <typename T>
+	inline bool spsc_ring<T>::push(const T& value) noexcept
+	{
+		const size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == items.size())
+			return false;
+
+		items[t & mask] = value;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	template <typename T>
+	inline std::optional<T> spsc_ring<T>::pop() noexcept
+	{
+		const size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return std::nullopt;
+
+		T value = items[h & mask];
+		head.store(h + 1, std::memory_order_release);
+		return value;
+	}
+
+	template <typename T>
+	inline size_t spsc_ring<T>::size() const noexcept
+	{
+		const size_t h = head.load(std::memory_order_acquire);
+		return tail.load(std::memory_order_acquire) - h;
+	}
+
+	template <typename T, size_t N>
+	inline bool shared_ring<T, N>::push(const T& value) noexcept
+	{
+		const uint64_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == N)
+			return false;
+
+		items[t & (N - 1)] = value;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	template <typename T, size_t N>
+	inline std::optional<T> shared_ring<T, N>::pop() noexcept
+	{
+		const uint64_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return std::nullopt;
+
+		T value = items[h & (N - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return value;
+	}
+
+	template <typename T, size_t N>
+	inline size_t shared_ring<T, N>::size() const noexcept
+	{
+		const uint64_t h = head.load(std::memory_order_acquire);
+		return tail.load(std::memory_order_acquire) - h;
+	}
+
+}
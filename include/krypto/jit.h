@@ -0,0 +1,378 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <initializer_list>
+#include <vector>
+
+#include "util.h"
+#include "internal/kernels.h"
+
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__)
+#include <sys/mman.h>
+#define KRYPTO_JIT 1
+#endif
+
+/**
+ * Runtime generated AES-CTR kernels for one key, x86-64 only.
+ * The round keys are constants next to the code and read by RIP relative
+ * memory operands of AESENC, so no register holds a round key and up to
+ * 14 of the 16 SSE registers carry blocks in flight.
+ */
+namespace krypto::internal::jit {
+
+	// Blocks in flight, xmm14 is a scratch register and xmm15 the counter
+	constexpr size_t MAX_WIDTH = 14;
+
+	/**
+	 * Entry point: in, out, groups of width blocks, counter block as native words { low, high }
+	 */
+	using ctr_function = void (*)(const unsigned char*, unsigned char*, size_t, const uint64_t*);
+
+	/**
+	 * True if the CPU runs the generated code, AES-NI and SSSE3
+	 */
+	inline bool supported() noexcept;
+
+	/**
+	 * Blocks in flight for the CPU, more where AESENC has the throughput for them
+	 */
+	inline size_t default_width() noexcept;
+
+	/**
+	 * Machine code of legacy SSE encoded instructions
+	 */
+	class assembler {
+	public:
+
+		/**
+		 * op xmm reg, xmm rm
+		 */
+		void sse(unsigned char prefix, std::initializer_list<unsigned char> op, int reg, int rm) noexcept;
+
+		/**
+		 * op xmm reg, [rip + target], target is an offset into the code
+		 */
+		void sse_rip(unsigned char prefix, std::initializer_list<unsigned char> op, int reg, size_t target) noexcept;
+
+		/**
+		 * op xmm reg, [base + disp] with base a general purpose register other than rsp and r12
+		 */
+		void sse_mem(unsigned char prefix, std::initializer_list<unsigned char> op, int reg, int base, int32_t disp) noexcept;
+
+		void bytes(std::initializer_list<unsigned char> b) noexcept;
+		void u32(uint32_t v) noexcept;
+
+		std::vector<unsigned char> code;
+
+	private:
+
+		void opcode(unsigned char prefix, std::initializer_list<unsigned char> op, int reg, int rm) noexcept;
+
+	};
+
+	/**
+	 * Code and constants of the CTR kernel for the expanded key, width blocks at a time
+	 */
+	template <size_t Size>
+	inline std::vector<unsigned char> emit_ctr(const_byte_view<(key_schedule<Size>::NR + 1) * 16> expanded, size_t width, size_t& entry) noexcept;
+
+	/**
+	 * Code mapped read and execute, never writable and executable at once
+	 */
+	class executable {
+	public:
+		executable() noexcept = default;
+		~executable() noexcept;
+
+		executable(const executable&) = delete;
+		executable& operator=(const executable&) = delete;
+
+		/**
+		 * Map code, returns false if the system does not allow it
+		 */
+		bool map(const std::vector<unsigned char>& code) noexcept;
+
+		const unsigned char* data() const noexcept { return static_cast<const unsigned char*>(region); }
+
+	private:
+		void* region = nullptr;
+		size_t length = 0;
+	};
+
+}
+
+namespace krypto {
+
+	/**
+	 * AES-CTR with a kernel generated at runtime for one long lived key.
+	 *
+	 * For keys that encrypt large volumes, such as the data key of a storage
+	 * node. The kernel is generated once in the constructor with width blocks
+	 * in flight, 0 picks the width for the CPU, and mapped executable after it
+	 * is written. Without AES-NI at runtime, outside x86-64 Linux, or if the
+	 * system denies executable memory the generic kernel is used and compiled()
+	 * is false. The output is the same either way.
+	 *
+	 * The code page holds the expanded key, it is wiped when the object is
+	 * destroyed. Objects are not copyable, apply may be called from several
+	 * threads at once.
+	 */
+	template <size_t Size>
+	class jit_ctr {
+	public:
+		static_assert(Size == 128 || Size == 194 || Size == 256, "Invalid key size");
+
+		constexpr static size_t KEY_SIZE = Size / 8;
+
+		explicit jit_ctr(const_byte_view<KEY_SIZE> key, size_t width = 0) noexcept;
+
+		jit_ctr(const jit_ctr&) = delete;
+		jit_ctr& operator=(const jit_ctr&) = delete;
+
+		/**
+		 * XOR in with the key stream of counter blocks iv + index, iv + index + 1, ...
+		 * to out, which is at least as large as in. in and out may be the same
+		 */
+		void apply(const_byte_view<> in, byte_view<> out, const_byte_view<16> iv, uint64_t index = 0) const noexcept;
+
+		/**
+		 * True if apply runs the generated kernel
+		 */
+		bool compiled() const noexcept { return kernel != nullptr; }
+
+		size_t width() const noexcept { return blocks; }
+
+	private:
+
+		internal::key_schedule<Size> ks;
+		internal::jit::executable code;
+		internal::jit::ctr_function kernel = nullptr;
+		size_t blocks;
+
+	};
+
+	///
+	// Implementation
+	///
+
+	namespace internal::jit {
+
+		inline bool supported() noexcept
+		{
+#ifdef KRYPTO_JIT
+			return __builtin_cpu_supports("aes") && __builtin_cpu_supports("ssse3");
+#else
+			return false;
+#endif
+		}
+
+		inline size_t default_width() noexcept
+		{
+#ifdef KRYPTO_JIT
+			// Two AESENC per cycle from Ice Lake and Zen 3, the parts with VAES
+			if (__builtin_cpu_supports("vaes"))
+				return 12;
+#endif
+			return KERNEL_WIDTH;
+		}
+
+		inline void assembler::bytes(std::initializer_list<unsigned char> b) noexcept
+		{
+			code.insert(code.end(), b);
+		}
+
+		inline void assembler::u32(uint32_t v) noexcept
+		{
+			for (size_t i = 0; i < 4; i++)
+				code.push_back(static_cast<unsigned char>(v >> (i * 8)));
+		}
+
+		inline void assembler::opcode(unsigned char prefix, std::initializer_list<unsigned char> op, int reg, int rm) noexcept
+		{
+			code.push_back(prefix);
+			// REX.R and REX.B extend the ModRM fields to registers 8 to 15
+			if (reg >= 8 || rm >= 8)
+				code.push_back(static_cast<unsigned char>(0x40 | (reg >= 8) << 2 | (rm >= 8)));
+			code.push_back(0x0f);
+			code.insert(code.end(), op);
+		}
+
+		inline void assembler::sse(unsigned char prefix, std::initializer_list<unsigned char> op, int reg, int rm) noexcept
+		{
+			opcode(prefix, op, reg, rm);
+			code.push_back(static_cast<unsigned char>(0xc0 | (reg & 7) << 3 | (rm & 7)));
+		}
+
+		inline void assembler::sse_rip(unsigned char prefix, std::initializer_list<unsigned char> op, int reg, size_t target) noexcept
+		{
+			opcode(prefix, op, reg, 0);
+			code.push_back(static_cast<unsigned char>((reg & 7) << 3 | 5));
+			// Relative to the end of the instruction
+			u32(static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(code.size() + 4)));
+		}
+
+		inline void assembler::sse_mem(unsigned char prefix, std::initializer_list<unsigned char> op, int reg, int base, int32_t disp) noexcept
+		{
+			opcode(prefix, op, reg, base);
+			code.push_back(static_cast<unsigned char>(0x80 | (reg & 7) << 3 | (base & 7)));
+			u32(static_cast<uint32_t>(disp));
+		}
+
+		template <size_t Size>
+		inline std::vector<unsigned char> emit_ctr(const_byte_view<(key_schedule<Size>::NR + 1) * 16> expanded, size_t width, size_t& entry) noexcept
+		{
+			constexpr size_t NR = key_schedule<Size>::NR;
+
+			// Registers
+			constexpr int RCX = 1, RSI = 6, RDI = 7;
+			constexpr int SCRATCH = 14, COUNTER = 15;
+
+			// Opcodes after 0F, with their mandatory prefix
+			constexpr unsigned char P66 = 0x66, PF3 = 0xf3;
+			const std::initializer_list<unsigned char> MOVDQA = { 0x6f }, MOVDQU_LOAD = { 0x6f }, MOVDQU_STORE = { 0x7f };
+			const std::initializer_list<unsigned char> PADDQ = { 0xd4 }, PXOR = { 0xef }, PSHUFB = { 0x38, 0x00 };
+			const std::initializer_list<unsigned char> AESENC = { 0x38, 0xdc }, AESENCLAST = { 0x38, 0xdd };
+
+			assembler a;
+
+			// Constants first, 16 byte aligned for the legacy SSE memory operands:
+			// the byte reversal mask, the increments 1 .. width and the round keys
+			const size_t mask = 0;
+			a.code.resize(16 * (1 + width) + expanded.size());
+			for (size_t i = 0; i < 16; i++)
+				a.code[mask + i] = static_cast<unsigned char>(15 - i);
+
+			const auto increment = [&](size_t n) { return 16 * n; };
+			for (size_t n = 1; n <= width; n++) {
+				for (size_t i = 0; i < 8; i++)
+					a.code[increment(n) + i] = static_cast<unsigned char>(static_cast<uint64_t>(n) >> (i * 8));
+			}
+
+			const size_t keys = 16 * (1 + width);
+			std::memcpy(a.code.data() + keys, expanded.data(), expanded.size());
+			const auto round_key = [&](size_t r) { return keys + 16 * r; };
+
+			// void kernel(const unsigned char* in (rdi), unsigned char* out (rsi), size_t groups (rdx), const uint64_t* counter (rcx))
+			entry = a.code.size();
+			a.sse_mem(PF3, MOVDQU_LOAD, COUNTER, RCX, 0);
+
+			const size_t loop = a.code.size();
+
+			// Counter blocks, big endian, whitened with round key 0
+			for (size_t n = 0; n < width; n++) {
+				const int x = static_cast<int>(n);
+				a.sse(P66, MOVDQA, x, COUNTER);
+				if (n)
+					a.sse_rip(P66, PADDQ, x, increment(n));
+				a.sse_rip(P66, PSHUFB, x, mask);
+				a.sse_rip(P66, PXOR, x, round_key(0));
+			}
+			a.sse_rip(P66, PADDQ, COUNTER, increment(width));
+
+			// Rounds interleaved over the blocks
+			for (size_t r = 1; r <= NR; r++) {
+				for (size_t n = 0; n < width; n++)
+					a.sse_rip(P66, r < NR ? AESENC : AESENCLAST, static_cast<int>(n), round_key(r));
+			}
+
+			for (size_t n = 0; n < width; n++) {
+				const int x = static_cast<int>(n);
+				const int32_t offset = static_cast<int32_t>(16 * n);
+				a.sse_mem(PF3, MOVDQU_LOAD, SCRATCH, RDI, offset);
+				a.sse(P66, PXOR, x, SCRATCH);
+				a.sse_mem(PF3, MOVDQU_STORE, x, RSI, offset);
+			}
+
+			// add rdi, 16 * width; add rsi, 16 * width; dec rdx; jnz loop; ret
+			a.bytes({ 0x48, 0x81, 0xc7 });
+			a.u32(static_cast<uint32_t>(16 * width));
+			a.bytes({ 0x48, 0x81, 0xc6 });
+			a.u32(static_cast<uint32_t>(16 * width));
+			a.bytes({ 0x48, 0xff, 0xca });
+			a.bytes({ 0x0f, 0x85 });
+			a.u32(static_cast<uint32_t>(static_cast<int64_t>(loop) - static_cast<int64_t>(a.code.size() + 4)));
+			a.bytes({ 0xc3 });
+
+			return std::move(a.code);
+		}
+
+		inline bool executable::map(const std::vector<unsigned char>& code) noexcept
+		{
+#ifdef KRYPTO_JIT
+			void* p = ::mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p == MAP_FAILED)
+				return false;
+
+			region = p;
+			length = code.size();
+			std::memcpy(region, code.data(), code.size());
+
+			// Denied by W^X policies that forbid making written memory executable
+			if (::mprotect(region, length, PROT_READ | PROT_EXEC) != 0) {
+				secure_zero(byte_view<>(static_cast<unsigned char*>(region), length));
+				::munmap(region, length);
+				region = nullptr;
+				return false;
+			}
+			return true;
+#else
+			static_cast<void>(code);
+			return false;
+#endif
+		}
+
+		inline executable::~executable() noexcept
+		{
+#ifdef KRYPTO_JIT
+			if (!region)
+				return;
+
+			// Wipe the round keys before the page is returned
+			if (::mprotect(region, length, PROT_READ | PROT_WRITE) == 0)
+				secure_zero(byte_view<>(static_cast<unsigned char*>(region), length));
+			::munmap(region, length);
+#endif
+		}
+
+	}
+
+	template <size_t Size>
+	inline jit_ctr<Size>::jit_ctr(const_byte_view<KEY_SIZE> key, size_t width) noexcept
+		: ks(key), blocks(std::clamp<size_t>(width ? width : internal::jit::default_width(), 1, internal::jit::MAX_WIDTH))
+	{
+		if (!internal::jit::supported())
+			return;
+
+		auto expanded = internal::aes::expand_key<Size>(key);
+		size_t entry;
+		auto machine_code = internal::jit::emit_ctr<Size>(expanded, blocks, entry);
+
+		if (code.map(machine_code))
+			kernel = reinterpret_cast<internal::jit::ctr_function>(code.data() + entry);
+
+		secure_zero(machine_code);
+		secure_zero(expanded);
+	}
+
+	template <size_t Size>
+	inline void jit_ctr<Size>::apply(const_byte_view<> in, byte_view<> out, const_byte_view<16> iv, uint64_t index) const noexcept
+	{
+		const internal::ctr_stream ctr(iv.data(), false);
+		const size_t groups = in.size() / 16 / blocks;
+		size_t done = 0;
+
+		// The kernel adds to the low word only, ranges that carry into the high word use the generic kernel
+		uint64_t h, l;
+		if (kernel && groups && ctr.words(index, groups * blocks, h, l)) {
+			const uint64_t counter[2] = { l, h };
+			kernel(in.data(), out.data(), groups, counter);
+			done = groups * blocks * 16;
+		}
+
+		internal::ctr_xor(in.data() + done, out.data() + done, in.size() - done, ks, ctr, index + done / 16);
+	}
+
+}
@@ -0,0 +1,474 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include "util.h"
+#include "internal/kernels.h"
+#include "internal/ring.h"
+
+namespace krypto {
+
+	enum class job_type {
+		// AES-CTR, encryption and decryption are the same
+		ctr,
+		// AES-CBC without padding, size must be a multiple of 16
+		cbc_encrypt,
+		// As cbc_encrypt, in and out must not overlap
+		cbc_decrypt,
+		// AES-CMAC of in, 16 byte tag to out. https://www.rfc-editor.org/rfc/rfc4493
+		cmac
+	};
+
+	/**
+	 * Multi buffer manager for many small independent AES jobs, in the style of
+	 * the Intel IPsec-mb job manager.
+	 *
+	 * Jobs have their own key, mode and size. CBC encryption and CMAC are one
+	 * chain of blocks per job, so each job takes a lane and the lanes advance
+	 * one block per step through a single multi key kernel. A lane is refilled
+	 * with the next queued job as soon as its job completes. CTR and CBC
+	 * decryption have no chain, the blocks of all queued jobs are cut into
+	 * groups of LANES regardless of which job they belong to.
+	 *
+	 * Lanes run when they are full, i.e. LANES jobs of a kind are queued.
+	 * Queued work is also flushed by poll once it waited longer than the
+	 * timeout, or by flush.
+	 * A manager is used by one thread. Completions are returned through a lock
+	 * free ring that one other thread may drain.
+	 */
+	template <size_t Size = 128>
+	class job_manager {
+	public:
+		static_assert(Size == 128 || Size == 194 || Size == 256, "Invalid key size");
+
+		constexpr static size_t KEY_SIZE = Size / 8;
+		constexpr static size_t LANES = internal::KERNEL_WIDTH;
+
+		/**
+		 * Expanded key, shared by any number of jobs. Must outlive the jobs using it
+		 */
+		class key {
+		public:
+			explicit key(const_byte_view<KEY_SIZE> k) noexcept;
+
+		private:
+			friend class job_manager;
+
+			internal::key_schedule<Size> enc;
+			internal::inv_key_schedule<Size> dec;
+
+			// CMAC subkeys
+			internal::block k1;
+			internal::block k2;
+		};
+
+		struct job {
+			job_type type;
+			const key* k;
+			// Initial counter block for CTR, IV for CBC, unused by CMAC
+			std::array<unsigned char, 16> iv;
+			const unsigned char* in;
+			// size bytes, 16 bytes for CMAC
+			unsigned char* out;
+			size_t size;
+			// Returned on completion
+			uint64_t user;
+		};
+
+		/**
+		 * capacity bounds the jobs queued plus the completions not yet popped
+		 */
+		explicit job_manager(std::chrono::microseconds timeout = std::chrono::microseconds(20), size_t capacity = 4096) noexcept;
+
+		/**
+		 * Queue a job, its buffers must stay valid until it completes.
+		 * Runs the lanes if they are full.
+		 * Returns false if the capacity is reached, pop completions and retry
+		 */
+		bool submit(const job& j) noexcept;
+
+		/**
+		 * Flush if the oldest queued job waited longer than the timeout
+		 */
+		void poll() noexcept;
+
+		/**
+		 * Complete all queued jobs
+		 */
+		void flush() noexcept;
+
+		/**
+		 * User value of a completed job, empty optional if there is none.
+		 * Lock free, may be called from one thread other than the one submitting
+		 */
+		std::optional<uint64_t> pop() noexcept;
+
+		/**
+		 * Jobs submitted and not yet completed
+		 */
+		size_t pending() const noexcept { return queued; }
+
+	private:
+
+		// Job of a lane advancing one chained block per step
+		struct lane {
+			job j;
+			size_t block;
+			size_t blocks;
+			internal::block chain;
+			bool busy = false;
+		};
+
+		struct stream_job {
+			job j;
+			internal::ctr_stream ctr;
+			size_t blocks;
+			// First block left to the groups of mixed jobs
+			size_t first;
+		};
+
+		using stream_queue = std::vector<stream_job>;
+
+		static size_t block_count(const job& j) noexcept;
+
+		/**
+		 * Start the next waiting job with blocks in lane l
+		 */
+		void start(lane& l) noexcept;
+
+		/**
+		 * Advance the lanes while all are busy, or until all are idle if drain is set
+		 */
+		void run_lanes(bool drain) noexcept;
+
+		template <job_type Type>
+		void run_stream(stream_queue& q) noexcept;
+
+		internal::block cmac_block(const lane& l) const noexcept;
+
+		void complete(const job& j) noexcept;
+
+		std::chrono::microseconds timeout;
+		// Time the queue last became non empty, under constant load poll flushes once per timeout
+		std::chrono::steady_clock::time_point oldest;
+		size_t queued = 0;
+
+		std::array<lane, LANES> lanes;
+		size_t busy = 0;
+		std::deque<job> waiting;
+
+		stream_queue ctr_queue;
+		stream_queue cbc_queue;
+
+		internal::spsc_ring<uint64_t> completions;
+
+	};
+
+	///
+	// Implementation
+	///
+
+	template <size_t Size>
+	inline job_manager<Size>::key::key(const_byte_view<KEY_SIZE> k) noexcept
+		: enc(k), dec(enc)
+	{
+		// L = E(K, 0), K1 = L << 1 and K2 = K1 << 1, reduced by x^128 + x^7 + x^2 + x + 1
+		internal::block l[1] = { internal::block_zero() };
+		internal::encrypt_blocks(l, enc);
+
+		std::array<unsigned char, 16> sub;
+		internal::block_store(sub.data(), l[0]);
+
+		for (auto* out : { &k1, &k2 }) {
+			const unsigned char carry = sub[0] >> 7;
+			for (size_t i = 0; i < 15; i++) {
+				sub[i] = static_cast<unsigned char>(sub[i] << 1 | sub[i + 1] >> 7);
+			}
+			sub[15] = static_cast<unsigned char>(sub[15] << 1) ^ (carry ? 0x87 : 0);
+			*out = internal::block_load(sub.data());
+		}
+
+		krypto::secure_zero(sub);
+	}
+
+	template <size_t Size>
+	inline job_manager<Size>::job_manager(std::chrono::microseconds timeout, size_t capacity) noexcept
+		: timeout(timeout), completions(capacity)
+	{
+	}
+
+	template <size_t Size>
+	inline size_t job_manager<Size>::block_count(const job& j) noexcept
+	{
+		// CMAC of the empty message is one padded block
+		if (j.type == job_type::cmac)
+			return j.size ? (j.size + 15) / 16 : 1;
+		return (j.size + 15) / 16;
+	}
+
+	template <size_t Size>
+	inline bool job_manager<Size>::submit(const job& j) noexcept
+	{
+		if (queued + completions.size() >= completions.capacity())
+			return false;
+
+		if (queued == 0)
+			oldest = std::chrono::steady_clock::now();
+		queued++;
+
+		switch (j.type) {
+		case job_type::cbc_encrypt:
+		case job_type::cmac:
+			waiting.push_back(j);
+			for (auto& l : lanes) {
+				if (!l.busy)
+					start(l);
+			}
+			if (busy == LANES)
+				run_lanes(false);
+			break;
+
+		case job_type::ctr:
+		case job_type::cbc_decrypt: {
+			stream_queue& q = j.type == job_type::ctr ? ctr_queue : cbc_queue;
+			q.push_back({ j, internal::ctr_stream(j.iv.data(), false), block_count(j), 0 });
+			if (q.size() == LANES) {
+				if (j.type == job_type::ctr)
+					run_stream<job_type::ctr>(q);
+				else
+					run_stream<job_type::cbc_decrypt>(q);
+			}
+			break;
+		}
+		}
+
+		return true;
+	}
+
+	template <size_t Size>
+	inline void job_manager<Size>::poll() noexcept
+	{
+		if (queued && std::chrono::steady_clock::now() - oldest >= timeout)
+			flush();
+	}
+
+	template <size_t Size>
+	inline void job_manager<Size>::flush() noexcept
+	{
+		run_stream<job_type::ctr>(ctr_queue);
+		run_stream<job_type::cbc_decrypt>(cbc_queue);
+		run_lanes(true);
+	}
+
+	template <size_t Size>
+	inline std::optional<uint64_t> job_manager<Size>::pop() noexcept
+	{
+		return completions.pop();
+	}
+
+	template <size_t Size>
+	inline void job_manager<Size>::complete(const job& j) noexcept
+	{
+		// Room is reserved by submit
+		completions.push(j.user);
+		queued--;
+	}
+
+	template <size_t Size>
+	inline void job_manager<Size>::start(lane& l) noexcept
+	{
+		while (!waiting.empty()) {
+			const job j = waiting.front();
+			waiting.pop_front();
+
+			const size_t blocks = block_count(j);
+			if (blocks == 0) {
+				complete(j);
+				continue;
+			}
+
+			l.j = j;
+			l.block = 0;
+			l.blocks = blocks;
+			l.chain = j.type == job_type::cmac ? internal::block_zero() : internal::block_load(j.iv.data());
+			l.busy = true;
+			busy++;
+			return;
+		}
+	}
+
+	template <size_t Size>
+	inline internal::block job_manager<Size>::cmac_block(const lane& l) const noexcept
+	{
+		const job& j = l.j;
+		const size_t offset = l.block * 16;
+
+		if (l.block + 1 < l.blocks)
+			return internal::block_load(j.in + offset);
+
+		// Last block, XOR'ed with K1 if complete, else padded with 10* and XOR'ed with K2
+		const size_t rest = j.size - offset;
+		if (rest == 16)
+			return internal::block_xor(internal::block_load(j.in + offset), j.k->k1);
+
+		std::array<unsigned char, 16> last{};
+		std::copy_n(j.in + offset, rest, last.begin());
+		last[rest] = 0x80;
+		return internal::block_xor(internal::block_load(last.data()), j.k->k2);
+	}
+
+	template <size_t Size>
+	inline void job_manager<Size>::run_lanes(bool drain) noexcept
+	{
+		while (drain ? busy > 0 : busy == LANES) {
+			internal::block b[LANES];
+			const internal::key_schedule<Size>* ks[LANES];
+
+			// Idle lanes encrypt a zero block under the key of a busy one
+			const internal::key_schedule<Size>* any = nullptr;
+			for (const auto& l : lanes) {
+				if (l.busy)
+					any = &l.j.k->enc;
+			}
+
+			for (size_t n = 0; n < LANES; n++) {
+				const lane& l = lanes[n];
+				if (!l.busy) {
+					b[n] = internal::block_zero();
+					ks[n] = any;
+				}
+				else {
+					const internal::block m = l.j.type == job_type::cmac ? cmac_block(l) : internal::block_load(l.j.in + l.block * 16);
+					b[n] = internal::block_xor(l.chain, m);
+					ks[n] = &l.j.k->enc;
+				}
+			}
+
+			internal::encrypt_lanes(b, ks);
+
+			for (size_t n = 0; n < LANES; n++) {
+				lane& l = lanes[n];
+				if (!l.busy)
+					continue;
+
+				l.chain = b[n];
+				if (l.j.type == job_type::cbc_encrypt)
+					internal::block_store(l.j.out + l.block * 16, b[n]);
+
+				if (++l.block == l.blocks) {
+					if (l.j.type == job_type::cmac)
+						internal::block_store(l.j.out, b[n]);
+
+					l.busy = false;
+					busy--;
+					complete(l.j);
+					start(l);
+				}
+			}
+		}
+	}
+
+	template <size_t Size>
+	template <job_type Type>
+	inline void job_manager<Size>::run_stream(stream_queue& q) noexcept
+	{
+		constexpr bool CTR = Type == job_type::ctr;
+
+		// Whole groups of LANES blocks of a job go through the single key kernels
+		for (auto& sj : q) {
+			const job& j = sj.j;
+			sj.first = j.size / 16 / LANES * LANES;
+			if (sj.first == 0)
+				continue;
+
+			if constexpr (CTR)
+				internal::ctr_xor(j.in, j.out, sj.first * 16, j.k->enc, sj.ctr, 0);
+			else
+				internal::decrypt_cbc(j.in, j.out, sj.first, j.iv.data(), j.k->dec);
+		}
+
+		// Cursor over the remaining blocks of all jobs
+		size_t s = 0;
+		size_t next = q.empty() ? 0 : q[0].first;
+
+		while (s < q.size()) {
+			const stream_job* job_of[LANES];
+			size_t at[LANES];
+			size_t count = 0;
+
+			while (count < LANES && s < q.size()) {
+				const stream_job& sj = q[s];
+				if (next == sj.blocks) {
+					// No block left for the groups, done in the kernels above
+					if (next == sj.first)
+						complete(sj.j);
+					if (++s < q.size())
+						next = q[s].first;
+					continue;
+				}
+				job_of[count] = &sj;
+				at[count] = next++;
+				count++;
+			}
+
+			if (count == 0)
+				break;
+
+			internal::block b[LANES];
+			using schedule = std::conditional_t<CTR, internal::key_schedule<Size>, internal::inv_key_schedule<Size>>;
+			const schedule* ks[LANES];
+
+			// Lanes past count repeat the first block
+			for (size_t n = 0; n < LANES; n++) {
+				const size_t m = n < count ? n : 0;
+				if constexpr (CTR) {
+					b[n] = job_of[m]->ctr[at[m]];
+					ks[n] = &job_of[m]->j.k->enc;
+				}
+				else {
+					b[n] = internal::block_load(job_of[m]->j.in + at[m] * 16);
+					ks[n] = &job_of[m]->j.k->dec;
+				}
+			}
+
+			if constexpr (CTR)
+				internal::encrypt_lanes(b, ks);
+			else
+				internal::decrypt_lanes(b, ks);
+
+			for (size_t n = 0; n < count; n++) {
+				const job& j = job_of[n]->j;
+				const size_t offset = at[n] * 16;
+
+				if constexpr (CTR) {
+					if (offset + 16 <= j.size) {
+						internal::block_store(j.out + offset, internal::block_xor(b[n], internal::block_load(j.in + offset)));
+					}
+					else {
+						std::array<unsigned char, 16> stream;
+						internal::block_store(stream.data(), b[n]);
+						for (size_t i = 0; offset + i < j.size; i++) {
+							j.out[offset + i] = j.in[offset + i] ^ stream[i];
+						}
+					}
+				}
+				else {
+					const unsigned char* prev = at[n] == 0 ? j.iv.data() : j.in + offset - 16;
+					internal::block_store(j.out + offset, internal::block_xor(b[n], internal::block_load(prev)));
+				}
+
+				if (at[n] + 1 == job_of[n]->blocks)
+					complete(j);
+			}
+		}
+
+		q.clear();
+	}
+
+}
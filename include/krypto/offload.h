@@ -0,0 +1,637 @@
+#pragma once
+
+#include <cstdint>
+#include <cerrno>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "job_manager.h"
+#include "internal/ring.h"
+
+/**
+ * Layout of the shared memory of an offload service. POSIX only.
+ *
+ * The registry, named by the service, has an entry per client. A client claims
+ * a free entry, creates its segment named service.index and marks the entry
+ * active. The segment holds the keys of the client, its submission and
+ * completion rings and the input and output buffers of its slots.
+ */
+namespace krypto::internal::offload {
+
+	constexpr uint32_t MAGIC = 0x6b6f6666;
+	constexpr uint32_t VERSION = 1;
+
+	// Clients of a service
+	constexpr size_t CLIENTS = 64;
+	// Jobs in flight per client
+	constexpr size_t SLOTS = 256;
+	// Largest input of a job
+	constexpr size_t SLOT_SIZE = 8192;
+	// Keys per client
+	constexpr size_t KEYS = 64;
+
+	// States of a registry entry
+	enum : uint32_t {
+		FREE,
+		// Segment being created by the client
+		CLAIMED,
+		ACTIVE,
+		// Client gone, the server releases the entry
+		CLOSING
+	};
+
+	struct client_entry {
+		std::atomic<uint32_t> state;
+		std::atomic<int32_t> pid;
+	};
+
+	struct registry {
+		uint32_t magic;
+		uint32_t version;
+		client_entry clients[CLIENTS];
+	};
+
+	struct key_entry {
+		// 0 until raw is written, then 16 or 32
+		std::atomic<uint32_t> size;
+		unsigned char raw[32];
+	};
+
+	struct request {
+		job_type type;
+		uint32_t slot;
+		uint32_t key;
+		uint32_t size;
+		std::array<unsigned char, 16> iv;
+		uint64_t user;
+	};
+
+	struct response {
+		uint64_t user;
+		uint32_t slot;
+		// Bytes of output
+		uint32_t size;
+		bool ok;
+	};
+
+	struct segment {
+		uint32_t magic;
+		uint32_t version;
+		key_entry keys[KEYS];
+		shared_ring<request, SLOTS> submissions;
+		shared_ring<response, SLOTS> completions;
+		alignas(64) unsigned char in[SLOTS][SLOT_SIZE];
+		alignas(64) unsigned char out[SLOTS][SLOT_SIZE];
+	};
+
+	inline std::string segment_name(const std::string& service, size_t index) noexcept;
+
+	/**
+	 * Map the shared memory object name as a T, created and zeroed if create is set
+	 * Returns nullptr on failure
+	 */
+	template <typename T>
+	inline T* map(const std::string& name, bool create) noexcept;
+
+	template <typename T>
+	inline void unmap(T* p) noexcept;
+
+	inline bool alive(int32_t pid) noexcept;
+
+}
+
+namespace krypto {
+
+	struct offload_job {
+		job_type type;
+		// Index returned by offload_client::add_key
+		uint32_t key;
+		// Initial counter block for CTR, IV for CBC, unused by CMAC
+		std::array<unsigned char, 16> iv;
+		// Bytes of input written to the slot
+		uint32_t size;
+		// Returned with the completion
+		uint64_t user;
+	};
+
+	struct offload_completion {
+		uint64_t user;
+		uint32_t slot;
+		// Bytes of output in the slot, the 16 byte tag for CMAC
+		uint32_t size;
+		// False if the server rejected the job
+		bool ok;
+	};
+
+	/**
+	 * Client of an offload_server, submits AES jobs through shared memory.
+	 *
+	 * Input is written into the buffer of a slot and the job is pushed to the
+	 * submission ring, the output is read from the slot once the completion
+	 * arrives. Submitting and polling are plain loads and stores, no system calls.
+	 * A client is used by one thread, keys are readable by the server.
+	 */
+	class offload_client {
+	public:
+		constexpr static size_t SLOT_SIZE = internal::offload::SLOT_SIZE;
+
+		/**
+		 * Connect to a running server
+		 * Returns nullptr if there is none or all client entries are taken
+		 */
+		static std::unique_ptr<offload_client> connect(const std::string& service = "/krypto") noexcept;
+
+		~offload_client();
+
+		offload_client(const offload_client&) = delete;
+		offload_client& operator=(const offload_client&) = delete;
+
+		/**
+		 * Register a 16 or 32 byte AES key
+		 * Returns the index of the key, or empty optional if the key table is full
+		 */
+		std::optional<uint32_t> add_key(const_byte_view<> key) noexcept;
+
+		/**
+		 * Free slot for a job, empty optional if all slots are in flight
+		 */
+		std::optional<uint32_t> acquire() noexcept;
+
+		/**
+		 * Give slot back once its output is consumed
+		 */
+		void release(uint32_t slot) noexcept;
+
+		byte_view<SLOT_SIZE> input(uint32_t slot) noexcept;
+		const_byte_view<SLOT_SIZE> output(uint32_t slot) const noexcept;
+
+		/**
+		 * Submit the job whose input is in slot
+		 */
+		void submit(uint32_t slot, const offload_job& job) noexcept;
+
+		/**
+		 * Next completed job, empty optional if there is none
+		 */
+		std::optional<offload_completion> poll() noexcept;
+
+	private:
+
+		offload_client(std::string service, size_t index, internal::offload::registry* reg, internal::offload::segment* seg) noexcept;
+
+		std::string service;
+		size_t index;
+		internal::offload::registry* reg;
+		internal::offload::segment* seg;
+
+		std::vector<uint32_t> free;
+		uint32_t keys = 0;
+
+	};
+
+	/**
+	 * Server of an offload service, runs the jobs of its clients.
+	 *
+	 * Worker threads are pinned to dedicated cores, each serves a share of the
+	 * clients with one job_manager per key size, so jobs of different clients
+	 * fill the same lanes. While submissions keep arriving the managers batch
+	 * them, up to their timeout. When a pass over the rings finds nothing new
+	 * the queued jobs are flushed, and a worker idle for a while sleeps briefly
+	 * between passes. Entries of clients that exited without closing are
+	 * released.
+	 */
+	class offload_server {
+	public:
+
+		/**
+		 * Create the registry of service, replacing a stale one
+		 * Returns nullptr on failure
+		 */
+		static std::unique_ptr<offload_server> create(const std::string& service = "/krypto") noexcept;
+
+		~offload_server();
+
+		offload_server(const offload_server&) = delete;
+		offload_server& operator=(const offload_server&) = delete;
+
+		/**
+		 * Serve clients until stop is set. One worker per entry of cores, pinned to it,
+		 * or a single unpinned worker if cores is empty
+		 */
+		void run(const std::atomic<bool>& stop, const std::vector<int>& cores = {}) noexcept;
+
+	private:
+
+		// Passes without work before a worker sleeps between passes
+		constexpr static size_t SPIN = 1 << 12;
+
+		struct connection {
+			internal::offload::segment* seg = nullptr;
+			int32_t pid = 0;
+
+			std::array<std::unique_ptr<job_manager<128>::key>, internal::offload::KEYS> keys_128;
+			std::array<std::unique_ptr<job_manager<256>::key>, internal::offload::KEYS> keys_256;
+
+			// Request of each slot in flight
+			std::array<internal::offload::request, internal::offload::SLOTS> jobs;
+		};
+
+		struct worker {
+			std::vector<connection> connections = std::vector<connection>(internal::offload::CLIENTS);
+			job_manager<128> jobs_128 = job_manager<128>(std::chrono::microseconds(20), internal::offload::CLIENTS * internal::offload::SLOTS);
+			job_manager<256> jobs_256 = job_manager<256>(std::chrono::microseconds(20), internal::offload::CLIENTS * internal::offload::SLOTS);
+		};
+
+		explicit offload_server(std::string service, internal::offload::registry* reg) noexcept;
+
+		void serve(size_t first, size_t step, const std::atomic<bool>& stop) noexcept;
+
+		void dispatch(worker& w, size_t index, const internal::offload::request& r) noexcept;
+
+		/**
+		 * Complete queued jobs and return them to their clients
+		 */
+		void drain(worker& w, bool flush) noexcept;
+
+		void detach(worker& w, size_t index, bool dead) noexcept;
+
+		std::string service;
+		internal::offload::registry* reg;
+
+	};
+
+	///
+	// Implementation
+	///
+
+	namespace internal::offload {
+
+		inline std::string segment_name(const std::string& service, size_t index) noexcept
+		{
+			return service + "." + std::to_string(index);
+		}
+
+		template <typename T>
+		inline T* map(const std::string& name, bool create) noexcept
+		{
+			const int fd = ::shm_open(name.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+			if (fd < 0)
+				return nullptr;
+
+			struct stat st;
+			const bool sized = create ? ::ftruncate(fd, sizeof(T)) == 0 : ::fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(T));
+
+			void* p = sized ? ::mmap(nullptr, sizeof(T), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+			::close(fd);
+
+			if (p == MAP_FAILED) {
+				if (create)
+					::shm_unlink(name.c_str());
+				return nullptr;
+			}
+
+			// A new object reads as zeros, the atomics start at 0
+			return create ? new (p) T : static_cast<T*>(p);
+		}
+
+		template <typename T>
+		inline void unmap(T* p) noexcept
+		{
+			::munmap(p, sizeof(T));
+		}
+
+		inline bool alive(int32_t pid) noexcept
+		{
+			return pid > 0 && (::kill(pid, 0) == 0 || errno != ESRCH);
+		}
+
+	}
+
+	inline offload_client::offload_client(std::string service, size_t index, internal::offload::registry* reg, internal::offload::segment* seg) noexcept
+		: service(std::move(service)), index(index), reg(reg), seg(seg)
+	{
+		free.reserve(internal::offload::SLOTS);
+		for (uint32_t i = internal::offload::SLOTS; i-- > 0;) {
+			free.push_back(i);
+		}
+	}
+
+	inline std::unique_ptr<offload_client> offload_client::connect(const std::string& service) noexcept
+	{
+		using namespace internal::offload;
+
+		auto* reg = map<registry>(service, false);
+		if (!reg)
+			return nullptr;
+
+		if (reg->magic != MAGIC || reg->version != VERSION) {
+			unmap(reg);
+			return nullptr;
+		}
+
+		for (size_t i = 0; i < CLIENTS; i++) {
+			client_entry& e = reg->clients[i];
+
+			uint32_t expected = FREE;
+			if (!e.state.compare_exchange_strong(expected, CLAIMED, std::memory_order_acq_rel))
+				continue;
+
+			e.pid.store(::getpid(), std::memory_order_relaxed);
+
+			// Left behind by a client that crashed
+			const auto name = segment_name(service, i);
+			::shm_unlink(name.c_str());
+
+			auto* seg = map<segment>(name, true);
+			if (!seg) {
+				e.state.store(FREE, std::memory_order_release);
+				break;
+			}
+
+			seg->magic = MAGIC;
+			seg->version = VERSION;
+			e.state.store(ACTIVE, std::memory_order_release);
+
+			return std::unique_ptr<offload_client>(new offload_client(service, i, reg, seg));
+		}
+
+		unmap(reg);
+		return nullptr;
+	}
+
+	inline offload_client::~offload_client()
+	{
+		using namespace internal::offload;
+
+		// The server keeps its mapping until it has released the entry
+		reg->clients[index].state.store(CLOSING, std::memory_order_release);
+
+		::shm_unlink(segment_name(service, index).c_str());
+		unmap(seg);
+		unmap(reg);
+	}
+
+	inline std::optional<uint32_t> offload_client::add_key(const_byte_view<> key) noexcept
+	{
+		if (keys == internal::offload::KEYS || (key.size() != 16 && key.size() != 32))
+			return std::nullopt;
+
+		internal::offload::key_entry& e = seg->keys[keys];
+		std::copy(key.begin(), key.end(), e.raw);
+		e.size.store(static_cast<uint32_t>(key.size()), std::memory_order_release);
+
+		return keys++;
+	}
+
+	inline std::optional<uint32_t> offload_client::acquire() noexcept
+	{
+		if (free.empty())
+			return std::nullopt;
+
+		const uint32_t slot = free.back();
+		free.pop_back();
+		return slot;
+	}
+
+	inline void offload_client::release(uint32_t slot) noexcept
+	{
+		free.push_back(slot);
+	}
+
+	inline byte_view<offload_client::SLOT_SIZE> offload_client::input(uint32_t slot) noexcept
+	{
+		return byte_view<SLOT_SIZE>(seg->in[slot], SLOT_SIZE);
+	}
+
+	inline const_byte_view<offload_client::SLOT_SIZE> offload_client::output(uint32_t slot) const noexcept
+	{
+		return const_byte_view<SLOT_SIZE>(seg->out[slot], SLOT_SIZE);
+	}
+
+	inline void offload_client::submit(uint32_t slot, const offload_job& job) noexcept
+	{
+		// At most SLOTS jobs are in flight, the ring has room
+		seg->submissions.push({ job.type, slot, job.key, job.size, job.iv, job.user });
+	}
+
+	inline std::optional<offload_completion> offload_client::poll() noexcept
+	{
+		const auto r = seg->completions.pop();
+		if (!r)
+			return std::nullopt;
+
+		return offload_completion{ r->user, r->slot, r->size, r->ok };
+	}
+
+	inline offload_server::offload_server(std::string service, internal::offload::registry* reg) noexcept
+		: service(std::move(service)), reg(reg)
+	{
+	}
+
+	inline std::unique_ptr<offload_server> offload_server::create(const std::string& service) noexcept
+	{
+		using namespace internal::offload;
+
+		::shm_unlink(service.c_str());
+
+		auto* reg = map<registry>(service, true);
+		if (!reg)
+			return nullptr;
+
+		reg->magic = MAGIC;
+		reg->version = VERSION;
+
+		return std::unique_ptr<offload_server>(new offload_server(service, reg));
+	}
+
+	inline offload_server::~offload_server()
+	{
+		::shm_unlink(service.c_str());
+		internal::offload::unmap(reg);
+	}
+
+	inline void offload_server::run(const std::atomic<bool>& stop, const std::vector<int>& cores) noexcept
+	{
+		const size_t count = std::max<size_t>(cores.size(), 1);
+
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < count; i++) {
+			threads.emplace_back([this, i, count, &stop] { serve(i, count, stop); });
+
+#ifdef __linux__
+			if (!cores.empty()) {
+				cpu_set_t set;
+				CPU_ZERO(&set);
+				CPU_SET(cores[i], &set);
+				::pthread_setaffinity_np(threads.back().native_handle(), sizeof(set), &set);
+			}
+#endif
+		}
+
+		for (auto& t : threads) {
+			t.join();
+		}
+	}
+
+	inline void offload_server::serve(size_t first, size_t step, const std::atomic<bool>& stop) noexcept
+	{
+		using namespace internal::offload;
+
+		auto w = std::make_unique<worker>();
+
+		size_t idle = 0;
+		auto checked = std::chrono::steady_clock::now();
+
+		while (!stop.load(std::memory_order_relaxed)) {
+			bool busy = false;
+
+			// Look for clients that exited without closing about once a second
+			const auto now = std::chrono::steady_clock::now();
+			const bool check = now - checked > std::chrono::seconds(1);
+			if (check)
+				checked = now;
+
+			for (size_t i = first; i < CLIENTS; i += step) {
+				client_entry& e = reg->clients[i];
+				connection& c = w->connections[i];
+				const uint32_t state = e.state.load(std::memory_order_acquire);
+
+				if (!c.seg) {
+					if (state == ACTIVE) {
+						c.seg = map<segment>(segment_name(service, i), false);
+						c.pid = e.pid.load(std::memory_order_relaxed);
+					}
+					else if (state == CLOSING || (state == CLAIMED && check && e.pid.load(std::memory_order_relaxed) && !alive(e.pid.load(std::memory_order_relaxed)))) {
+						e.pid.store(0, std::memory_order_relaxed);
+						e.state.store(FREE, std::memory_order_release);
+					}
+				}
+
+				if (!c.seg)
+					continue;
+
+				if (state != ACTIVE || (check && !alive(c.pid))) {
+					detach(*w, i, state == ACTIVE);
+					continue;
+				}
+
+				while (const auto r = c.seg->submissions.pop()) {
+					dispatch(*w, i, *r);
+					busy = true;
+				}
+			}
+
+			// Nothing new to batch with, complete what is queued
+			drain(*w, !busy);
+
+			if (busy) {
+				idle = 0;
+			}
+			else if (++idle > SPIN) {
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+		}
+
+		for (size_t i = first; i < CLIENTS; i += step) {
+			if (w->connections[i].seg)
+				detach(*w, i, false);
+		}
+	}
+
+	inline void offload_server::dispatch(worker& w, size_t index, const internal::offload::request& r) noexcept
+	{
+		using namespace internal::offload;
+
+		connection& c = w.connections[index];
+
+		// Requests come from another process, check everything
+		bool ok = r.slot < SLOTS && r.size <= SLOT_SIZE && r.key < KEYS && static_cast<uint32_t>(r.type) <= static_cast<uint32_t>(job_type::cmac);
+		if (ok && (r.type == job_type::cbc_encrypt || r.type == job_type::cbc_decrypt))
+			ok = r.size % 16 == 0;
+
+		const uint32_t key_size = ok ? c.seg->keys[r.key].size.load(std::memory_order_acquire) : 0;
+		ok = ok && (key_size == 16 || key_size == 32);
+
+		if (ok) {
+			c.jobs[r.slot] = r;
+			const uint64_t user = static_cast<uint64_t>(index) << 32 | r.slot;
+
+			if (key_size == 16) {
+				auto& k = c.keys_128[r.key];
+				if (!k)
+					k = std::make_unique<job_manager<128>::key>(const_byte_view<16>(c.seg->keys[r.key].raw, 16));
+				ok = w.jobs_128.submit({ r.type, k.get(), r.iv, c.seg->in[r.slot], c.seg->out[r.slot], r.size, user });
+			}
+			else {
+				auto& k = c.keys_256[r.key];
+				if (!k)
+					k = std::make_unique<job_manager<256>::key>(const_byte_view<32>(c.seg->keys[r.key].raw, 32));
+				ok = w.jobs_256.submit({ r.type, k.get(), r.iv, c.seg->in[r.slot], c.seg->out[r.slot], r.size, user });
+			}
+		}
+
+		if (!ok)
+			c.seg->completions.push({ r.user, r.slot, 0, false });
+	}
+
+	inline void offload_server::drain(worker& w, bool flush) noexcept
+	{
+		if (flush) {
+			w.jobs_128.flush();
+			w.jobs_256.flush();
+		}
+		else {
+			w.jobs_128.poll();
+			w.jobs_256.poll();
+		}
+
+		auto complete = [&](uint64_t user) {
+			const connection& c = w.connections[user >> 32];
+			const internal::offload::request& r = c.jobs[user & 0xffffffff];
+			const uint32_t size = r.type == job_type::cmac ? 16 : r.size;
+
+			// A client that does not poll loses completions, never the server
+			c.seg->completions.push({ r.user, r.slot, size, true });
+		};
+
+		while (const auto user = w.jobs_128.pop())
+			complete(*user);
+		while (const auto user = w.jobs_256.pop())
+			complete(*user);
+	}
+
+	inline void offload_server::detach(worker& w, size_t index, bool dead) noexcept
+	{
+		using namespace internal::offload;
+
+		// No queued job may point into the segment once it is unmapped
+		drain(w, true);
+
+		connection& c = w.connections[index];
+		unmap(c.seg);
+		c = connection();
+
+		if (dead)
+			::shm_unlink(segment_name(service, index).c_str());
+
+		reg->clients[index].pid.store(0, std::memory_order_relaxed);
+		reg->clients[index].state.store(FREE, std::memory_order_release);
+	}
+
+}
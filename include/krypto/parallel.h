@@ -0,0 +1,327 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace krypto::internal::parallel {
+
+	// Work per thread below which a loop does not get another thread
+	constexpr size_t GRAIN = 1 << 16;
+
+	/**
+	 * CPUs of CPU time per period allowed by the cgroup of the process, the
+	 * smallest limit of its cgroup and all parents. cgroup v2 cpu.max and v1
+	 * cpu.cfs_quota_us, with proc the contents of /proc/self/cgroup and root
+	 * the cgroup mount. Returns empty optional if there is no limit
+	 */
+	inline std::optional<double> cgroup_cpus(const std::string& proc, const std::string& root) noexcept;
+
+	/**
+	 * CPUs in the affinity mask of the process, which includes its cpuset
+	 */
+	inline size_t affinity_cpus() noexcept;
+
+	/**
+	 * Threads for the environment: the affinity mask, the CPU quota rounded
+	 * down so a full team is not throttled, and the OpenMP maximum
+	 */
+	inline size_t detect() noexcept;
+
+	// 0 until detected or set
+	inline std::atomic<size_t> limit = 0;
+
+	/**
+	 * Threads for a parallel loop, see krypto::max_threads
+	 */
+	inline int threads() noexcept;
+
+	/**
+	 * Threads for a parallel loop over bytes of work, one per GRAIN bytes
+	 */
+	inline int threads(size_t bytes) noexcept;
+
+	/**
+	 * CPU numbers of a sysfs CPU list such as "0-7,16"
+	 */
+	inline std::vector<int> parse_cpus(const std::string& list) noexcept;
+
+	/**
+	 * Performance cores of a hybrid CPU, the cpus of the cpu_core PMU under
+	 * root. Empty if the CPU has only one kind of core
+	 */
+	inline std::vector<int> performance_cpus(const std::string& root = "/sys/devices") noexcept;
+
+}
+
+namespace krypto {
+
+	/**
+	 * Maximum number of threads of the parallel loops in krypto.
+	 *
+	 * Detected once from the environment: the affinity mask (and with it the
+	 * cpuset), the CPU quota of the cgroup, and the OpenMP thread limit. In a
+	 * container with a quota of 2 CPUs on a 64 core host, loops run 2 threads
+	 * instead of 64 that would use the quota in a fraction of the period and
+	 * then be throttled for the rest of it.
+	 */
+	inline size_t max_threads() noexcept;
+
+	/**
+	 * Override the detected limit, 0 detects again
+	 */
+	inline void set_max_threads(size_t threads) noexcept;
+
+	/**
+	 * Runs the calling thread on the performance cores of a hybrid CPU for
+	 * the lifetime of the object, for latency critical calls. The affinity
+	 * mask is narrowed to its performance cores and restored on destruction.
+	 * Does nothing if the CPU is not hybrid or no performance core is allowed.
+	 *
+	 * Parallel loops hand out their work in chunks claimed as threads become
+	 * free, so a loop over efficiency and performance cores is not held up
+	 * by an equal share on the slowest core.
+	 */
+	class performance_scope {
+	public:
+		performance_scope() noexcept;
+		~performance_scope() noexcept;
+
+		performance_scope(const performance_scope&) = delete;
+		performance_scope& operator=(const performance_scope&) = delete;
+
+		/**
+		 * True if the thread was moved to performance cores
+		 */
+		bool active() const noexcept { return pinned; }
+
+	private:
+#ifdef __linux__
+		cpu_set_t saved;
+#endif
+		bool pinned = false;
+	};
+
+	///
+	// Implementation
+	///
+
+	namespace internal::parallel {
+
+		/**
+		 * First number in file, empty optional if missing or "max"
+		 */
+		inline std::optional<double> read_number(const std::string& path, size_t field = 0) noexcept
+		{
+			std::ifstream file(path);
+			std::string word;
+			for (size_t i = 0; i <= field; i++) {
+				if (!(file >> word))
+					return std::nullopt;
+			}
+
+			char* end;
+			const double value = std::strtod(word.c_str(), &end);
+			if (end == word.c_str() || *end != 0)
+				return std::nullopt;
+			return value;
+		}
+
+		/**
+		 * Quota of one cgroup directory, empty optional if unlimited
+		 */
+		inline std::optional<double> quota(const std::string& dir, bool v2) noexcept
+		{
+			std::optional<double> q;
+			std::optional<double> period;
+
+			if (v2) {
+				// "max 100000" or "200000 100000"
+				q = read_number(dir + "/cpu.max", 0);
+				period = read_number(dir + "/cpu.max", 1);
+			}
+			else {
+				// -1 when unlimited
+				q = read_number(dir + "/cpu.cfs_quota_us");
+				period = read_number(dir + "/cpu.cfs_period_us");
+			}
+
+			if (!q || !period || *q <= 0 || *period <= 0)
+				return std::nullopt;
+			return *q / *period;
+		}
+
+		inline std::optional<double> cgroup_cpus(const std::string& proc, const std::string& root) noexcept
+		{
+			std::optional<double> cpus;
+
+			std::istringstream lines(proc);
+			std::string line;
+			while (std::getline(lines, line)) {
+				// hierarchy:controllers:path
+				const size_t a = line.find(':');
+				const size_t b = line.find(':', a + 1);
+				if (a == std::string::npos || b == std::string::npos)
+					continue;
+
+				const std::string controllers = line.substr(a + 1, b - a - 1);
+				const std::string path = line.substr(b + 1);
+
+				std::string mount;
+				bool v2 = false;
+				if (controllers.empty()) {
+					v2 = true;
+					// Unified hierarchy, at the root or next to v1 controllers
+					mount = std::ifstream(root + "/cgroup.controllers") ? root : root + "/unified";
+				}
+				else if (("," + controllers + ",").find(",cpu,") != std::string::npos) {
+					mount = std::ifstream(root + "/" + controllers + "/cpu.cfs_period_us") ? root + "/" + controllers : root + "/cpu";
+				}
+				else {
+					continue;
+				}
+
+				// Limits of parents apply too. In a container the path is
+				// often the host path and only the mount itself exists
+				std::string dir = mount + (path == "/" ? "" : path);
+				while (true) {
+					if (const auto q = quota(dir, v2))
+						cpus = cpus ? std::min(*cpus, *q) : *q;
+
+					if (dir.size() <= mount.size())
+						break;
+					dir = dir.substr(0, dir.rfind('/'));
+				}
+			}
+
+			return cpus;
+		}
+
+		inline size_t affinity_cpus() noexcept
+		{
+#ifdef __linux__
+			cpu_set_t set;
+			if (::sched_getaffinity(0, sizeof(set), &set) == 0)
+				return std::max(CPU_COUNT(&set), 1);
+#endif
+			return std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		inline size_t detect() noexcept
+		{
+			size_t n = affinity_cpus();
+
+#ifdef __linux__
+			std::ifstream file("/proc/self/cgroup");
+			std::stringstream proc;
+			proc << file.rdbuf();
+
+			if (const auto cpus = cgroup_cpus(proc.str(), "/sys/fs/cgroup"))
+				n = std::min(n, std::max<size_t>(static_cast<size_t>(*cpus), 1));
+#endif
+
+#ifdef _OPENMP
+			n = std::min<size_t>(n, omp_get_max_threads());
+#endif
+			return n;
+		}
+
+		inline int threads() noexcept
+		{
+			return static_cast<int>(max_threads());
+		}
+
+		inline int threads(size_t bytes) noexcept
+		{
+			return static_cast<int>(std::clamp<size_t>(bytes / GRAIN, 1, max_threads()));
+		}
+
+		inline std::vector<int> parse_cpus(const std::string& list) noexcept
+		{
+			std::vector<int> cpus;
+
+			std::istringstream ranges(list);
+			std::string range;
+			while (std::getline(ranges, range, ',')) {
+				char* end;
+				const long first = std::strtol(range.c_str(), &end, 10);
+				if (end == range.c_str())
+					continue;
+
+				const long last = *end == '-' ? std::strtol(end + 1, nullptr, 10) : first;
+				for (long cpu = first; cpu <= last; cpu++)
+					cpus.push_back(static_cast<int>(cpu));
+			}
+
+			return cpus;
+		}
+
+		inline std::vector<int> performance_cpus(const std::string& root) noexcept
+		{
+			// Hybrid parts have a PMU per kind of core, cpu_core and cpu_atom
+			std::ifstream file(root + "/cpu_core/cpus");
+			std::string list;
+			if (!std::getline(file, list))
+				return {};
+			return parse_cpus(list);
+		}
+
+	}
+
+	inline size_t max_threads() noexcept
+	{
+		size_t n = internal::parallel::limit.load(std::memory_order_relaxed);
+		if (n == 0) {
+			n = internal::parallel::detect();
+			internal::parallel::limit.store(n, std::memory_order_relaxed);
+		}
+		return n;
+	}
+
+	inline void set_max_threads(size_t threads) noexcept
+	{
+		internal::parallel::limit.store(threads, std::memory_order_relaxed);
+	}
+
+	inline performance_scope::performance_scope() noexcept
+	{
+#ifdef __linux__
+		static const std::vector<int> performance = internal::parallel::performance_cpus();
+		if (performance.empty() || ::sched_getaffinity(0, sizeof(saved), &saved) != 0)
+			return;
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (const int cpu : performance) {
+			if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &saved))
+				CPU_SET(cpu, &set);
+		}
+
+		pinned = CPU_COUNT(&set) > 0 && ::sched_setaffinity(0, sizeof(set), &set) == 0;
+#endif
+	}
+
+	inline performance_scope::~performance_scope() noexcept
+	{
+#ifdef __linux__
+		if (pinned)
+			::sched_setaffinity(0, sizeof(saved), &saved);
+#endif
+	}
+
+}
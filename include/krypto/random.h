@@ -0,0 +1,267 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <limits>
+
+#include "util.h"
+#include "internal/kernels.h"
+
+// Conversions between 64 bit word pairs and blocks, low word first
+namespace krypto::internal::random {
+
+	inline block to_block(const std::array<uint64_t, 2>& words) noexcept
+	{
+		return block_set64(words[1], words[0]);
+	}
+
+	inline std::array<uint64_t, 2> from_block(block b) noexcept
+	{
+		std::array<unsigned char, 16> data;
+		block_store(data.data(), b);
+
+		std::array<uint64_t, 2> words{};
+		for (size_t i = 0; i < 8; i++) {
+			words[0] |= static_cast<uint64_t>(data[i]) << (i * 8);
+			words[1] |= static_cast<uint64_t>(data[i + 8]) << (i * 8);
+		}
+		return words;
+	}
+
+	inline std::array<unsigned char, 16> key_bytes(const std::array<uint64_t, 2>& key) noexcept
+	{
+		std::array<unsigned char, 16> data;
+		block_store(data.data(), to_block(key));
+		return data;
+	}
+
+}
+
+/**
+ * Counter based random number generators in the style of Random123,
+ * see https://www.thesalmons.org/john/random123/papers/random123sc11.pdf
+ *
+ * Not for cryptographic use. Output i of a stream is a keyed bijection of
+ * the counter (stream, i), so any number of independent streams can be
+ * generated in parallel without shared state.
+ */
+namespace krypto::random {
+
+	using key_type = std::array<uint64_t, 2>;
+	using counter_type = std::array<uint64_t, 2>;
+
+	/**
+	 * ARS: reduced round AES with a Weyl sequence as key schedule.
+	 * ARS-7 passes BigCrush, fewer rounds trade quality for speed
+	 */
+	template <size_t Rounds = 7>
+	class ars {
+	public:
+		static_assert(Rounds >= 1 && Rounds <= 10, "Invalid number of rounds");
+
+		explicit ars(key_type key) noexcept;
+
+		/**
+		 * Map N counter blocks to output blocks in place
+		 */
+		template <size_t N>
+		void apply(internal::block (&data)[N]) const noexcept;
+
+		counter_type operator()(counter_type counter) const noexcept;
+
+	private:
+
+		internal::block key;
+
+	};
+
+	/**
+	 * Full AES-128 keyed by key
+	 */
+	class aes {
+	public:
+
+		explicit aes(key_type key) noexcept;
+
+		/**
+		 * Map N counter blocks to output blocks in place
+		 */
+		template <size_t N>
+		void apply(internal::block (&data)[N]) const noexcept;
+
+		counter_type operator()(counter_type counter) const noexcept;
+
+	private:
+
+		internal::key_schedule<128> schedule;
+
+	};
+
+	/**
+	 * Uniform random bit generator over a counter based RNG.
+	 * Stream selects the high counter word, the low word counts blocks
+	 */
+	template <typename Cbrng>
+	class engine {
+	public:
+		using result_type = uint64_t;
+
+		// Blocks generated per refill
+		constexpr static size_t WIDTH = internal::KERNEL_WIDTH;
+
+		explicit engine(key_type key, uint64_t stream = 0) noexcept;
+
+		static constexpr result_type min() noexcept { return std::numeric_limits<result_type>::min(); }
+		static constexpr result_type max() noexcept { return std::numeric_limits<result_type>::max(); }
+
+		result_type operator()() noexcept;
+
+		/**
+		 * Skip the next n values
+		 */
+		void discard(uint64_t n) noexcept;
+
+		/**
+		 * Jump to value n of the stream
+		 */
+		void seek(uint64_t n) noexcept;
+
+	private:
+
+		void refill() noexcept;
+
+		Cbrng cbrng;
+		uint64_t stream;
+
+		// Counter of the next block to generate
+		uint64_t block_index = 0;
+
+		std::array<uint64_t, 2 * WIDTH> buffer{};
+		size_t position = 2 * WIDTH;
+
+	};
+
+	using ars_engine = engine<ars<7>>;
+	using aes_engine = engine<aes>;
+
+	///
+	// Implementation
+	///
+
+	template <size_t Rounds>
+	inline ars<Rounds>::ars(key_type key) noexcept
+		: key(internal::random::to_block(key))
+	{
+	}
+
+	template <size_t Rounds>
+	template <size_t N>
+	inline void ars<Rounds>::apply(internal::block (&data)[N]) const noexcept
+	{
+		using namespace internal;
+
+		// Weyl sequence increments, golden ratio and sqrt(3) - 1
+		const block weyl = block_set64(0xBB67AE8584CAA73B, 0x9E3779B97F4A7C15);
+
+		block k = key;
+
+		KRYPTO_UNROLL
+		for (size_t n = 0; n < N; n++) {
+			data[n] = block_xor(data[n], k);
+		}
+
+		for (size_t r = 1; r < Rounds; r++) {
+			k = block_add64(k, weyl);
+			KRYPTO_UNROLL
+			for (size_t n = 0; n < N; n++) {
+				data[n] = aesenc(data[n], k);
+			}
+		}
+
+		k = block_add64(k, weyl);
+		KRYPTO_UNROLL
+		for (size_t n = 0; n < N; n++) {
+			data[n] = aesenclast(data[n], k);
+		}
+	}
+
+	template <size_t Rounds>
+	inline counter_type ars<Rounds>::operator()(counter_type counter) const noexcept
+	{
+		internal::block b[1] = { internal::random::to_block(counter) };
+		apply(b);
+		return internal::random::from_block(b[0]);
+	}
+
+	inline aes::aes(key_type key) noexcept
+		: schedule(internal::random::key_bytes(key))
+	{
+	}
+
+	template <size_t N>
+	inline void aes::apply(internal::block (&data)[N]) const noexcept
+	{
+		internal::encrypt_blocks(data, schedule);
+	}
+
+	inline counter_type aes::operator()(counter_type counter) const noexcept
+	{
+		internal::block b[1] = { internal::random::to_block(counter) };
+		apply(b);
+		return internal::random::from_block(b[0]);
+	}
+
+	template <typename Cbrng>
+	inline engine<Cbrng>::engine(key_type key, uint64_t stream) noexcept
+		: cbrng(key), stream(stream)
+	{
+	}
+
+	template <typename Cbrng>
+	inline typename engine<Cbrng>::result_type engine<Cbrng>::operator()() noexcept
+	{
+		if (position == buffer.size())
+			refill();
+
+		return buffer[position++];
+	}
+
+	template <typename Cbrng>
+	inline void engine<Cbrng>::discard(uint64_t n) noexcept
+	{
+		// Index of the next value within the stream
+		const uint64_t next = (block_index * 2) - (buffer.size() - position);
+		seek(next + n);
+	}
+
+	template <typename Cbrng>
+	inline void engine<Cbrng>::seek(uint64_t n) noexcept
+	{
+		block_index = (n / buffer.size()) * WIDTH;
+		refill();
+		position = n % buffer.size();
+	}
+
+	template <typename Cbrng>
+	inline void engine<Cbrng>::refill() noexcept
+	{
+		using namespace internal;
+
+		block b[WIDTH];
+		KRYPTO_UNROLL
+		for (size_t n = 0; n < WIDTH; n++) {
+			b[n] = block_set64(stream, block_index + n);
+		}
+		block_index += WIDTH;
+
+		cbrng.apply(b);
+
+		for (size_t n = 0; n < WIDTH; n++) {
+			block_store(reinterpret_cast<unsigned char*>(&buffer[n * 2]), b[n]);
+		}
+
+		position = 0;
+	}
+
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <span>
+#include <optional>
+
+#include "util.h"
+#include "aes.h"
+#include "gcm.h"
+#include "internal/kernels.h"
+#include "internal/ghash.h"
+#include "parallel.h"
+#include "governor.h"
+
+namespace krypto {
+
+	/**
+	 * Re-encryption of cipher text under key A to cipher text under key B in one
+	 * pass, for key rotation.
+	 *
+	 * CTR and GCM cipher text is XOR'ed with both key streams at once, the plain
+	 * text never exists in memory. CBC cipher text is decrypted one stripe at a
+	 * time into a small buffer and encrypted with GCM from there.
+	 * Single objects are split over threads where the mode allows it, batches
+	 * of objects are processed in parallel.
+	 */
+	template <size_t SizeA, size_t SizeB = SizeA>
+	class reencryptor {
+	public:
+		static_assert(SizeA == 128 || SizeA == 194 || SizeA == 256, "Invalid key size");
+		static_assert(SizeB == 128 || SizeB == 194 || SizeB == 256, "Invalid key size");
+
+		// Bytes per thread when a single CTR object is split
+		constexpr static size_t CTR_STRIPE = 1 << 16;
+
+		/**
+		 * Construct from the old key and the new key
+		 */
+		reencryptor(const_byte_view<SizeA / 8> from, const_byte_view<SizeB / 8> to) noexcept;
+
+		/**
+		 * Cipher text of aes<SizeA, modes::ctr, Pad> to aes<SizeB, modes::ctr, Pad>, in place
+		 * A new random IV is used
+		 */
+		void ctr(byte_array& data) const noexcept;
+
+		/**
+		 * Cipher text of gcm<SizeA>::encrypt to gcm<SizeB>::encrypt, in place
+		 * The old tag is checked in the same pass and a new random nonce is used.
+		 * Returns false and restores data if authentication fails
+		 */
+		bool gcm(byte_array& data, const_byte_view<> ad = {}) const noexcept;
+
+		/**
+		 * Cipher text of aes<SizeA, modes::cbc, Pad> to gcm<SizeB>::encrypt
+		 * Returns empty optional if the padding is invalid
+		 */
+		template <typename Pad>
+		std::optional<byte_array> cbc_to_gcm(const_byte_view<> data, const_byte_view<> ad = {}) const noexcept;
+
+		/**
+		 * Re-encrypt many CTR objects in parallel, paced by gov if given
+		 * Returns the indices of objects left unchanged because gov was cancelled
+		 */
+		std::vector<size_t> ctr(std::span<byte_array> objects, governor* gov = nullptr) const noexcept;
+
+		/**
+		 * Re-encrypt many GCM objects without associated data in parallel
+		 * Returns the indices of objects that failed authentication or were not
+		 * processed because gov was cancelled, these are left unchanged
+		 */
+		std::vector<size_t> gcm(std::span<byte_array> objects, governor* gov = nullptr) const noexcept;
+
+		/**
+		 * Re-encrypt many CBC objects to GCM in parallel
+		 * Objects not processed because gov was cancelled are empty
+		 */
+		template <typename Pad>
+		std::vector<std::optional<byte_array>> cbc_to_gcm(std::span<const byte_array> objects, governor* gov = nullptr) const noexcept;
+
+	private:
+
+		/**
+		 * Add the bytes of a batch to the work expected by gov
+		 */
+		template <typename Objects>
+		static void expect(const Objects& objects, governor* gov) noexcept;
+
+		/**
+		 * Indices of the false entries of ok
+		 */
+		static std::vector<size_t> failures(const std::vector<unsigned char>& ok) noexcept;
+
+		internal::gcm::context<SizeA> from;
+		internal::inv_key_schedule<SizeA> from_dec;
+		internal::gcm::context<SizeB> to;
+
+	};
+
+	///
+	// Implementation
+	///
+
+	template <size_t SizeA, size_t SizeB>
+	inline reencryptor<SizeA, SizeB>::reencryptor(const_byte_view<SizeA / 8> from, const_byte_view<SizeB / 8> to) noexcept
+		: from(from), from_dec(this->from.ks), to(to)
+	{
+	}
+
+	template <size_t SizeA, size_t SizeB>
+	inline void reencryptor<SizeA, SizeB>::ctr(byte_array& data) const noexcept
+	{
+		assert(data.size() % 16 == 0 && data.size() >= 32);
+
+		const size_t size = data.size() - 16;
+		const auto iv = krypto::get_srandom_bytes<16>();
+
+		const internal::ctr_stream ctr_a(data.data() + size, false);
+		const internal::ctr_stream ctr_b(iv.data(), false);
+
+		const int64_t stripes = (size + CTR_STRIPE - 1) / CTR_STRIPE;
+
+		#pragma omp parallel for schedule(dynamic) if(stripes > 1) num_threads(internal::parallel::threads())
+		for (int64_t s = 0; s < stripes; s++) {
+			const size_t offset = s * CTR_STRIPE;
+			const size_t n = std::min(CTR_STRIPE, size - offset);
+			internal::ctr_rekey(data.data() + offset, n, from.ks, ctr_a, offset / 16, to.ks, ctr_b, offset / 16);
+		}
+
+		std::copy(iv.begin(), iv.end(), data.end() - 16);
+	}
+
+	template <size_t SizeA, size_t SizeB>
+	inline bool reencryptor<SizeA, SizeB>::gcm(byte_array& data, const_byte_view<> ad) const noexcept
+	{
+		constexpr size_t NONCE_SIZE = krypto::gcm<SizeB>::NONCE_SIZE;
+		constexpr size_t TAG_SIZE = krypto::gcm<SizeB>::TAG_SIZE;
+		constexpr size_t STRIPE = internal::gcm::STRIPE;
+
+		if (data.size() < NONCE_SIZE + TAG_SIZE)
+			return false;
+
+		const size_t size = data.size() - NONCE_SIZE - TAG_SIZE;
+		unsigned char* cipher = data.data();
+		unsigned char* tag = cipher + size;
+		unsigned char* nonce = tag + TAG_SIZE;
+
+		const auto new_nonce = krypto::get_srandom_bytes<NONCE_SIZE>();
+
+		const auto ctr_a = internal::gcm::counter(const_byte_view<NONCE_SIZE>(nonce, NONCE_SIZE));
+		const auto ctr_b = internal::gcm::counter(new_nonce);
+
+		internal::ghash::state hash_a;
+		internal::ghash::state hash_b;
+		hash_a.update(from.hk, ad.data(), ad.size());
+		hash_b.update(to.hk, ad.data(), ad.size());
+
+		// Hash the old cipher text, swap key streams and hash the new one while the stripe is in cache
+		for (size_t i = 0; i < size; i += STRIPE) {
+			const size_t n = std::min(STRIPE, size - i);
+			hash_a.update(from.hk, cipher + i, n);
+			internal::ctr_rekey(cipher + i, n, from.ks, ctr_a, i / 16 + 1, to.ks, ctr_b, i / 16 + 1);
+			hash_b.update(to.hk, cipher + i, n);
+		}
+
+		const auto old_tag = internal::gcm::tag(from, ctr_a, hash_a, ad.size(), size);
+		if (!secure_equal(old_tag, const_byte_view<TAG_SIZE>(tag, TAG_SIZE))) {
+			internal::ctr_rekey(cipher, size, from.ks, ctr_a, 1, to.ks, ctr_b, 1);
+			return false;
+		}
+
+		const auto new_tag = internal::gcm::tag(to, ctr_b, hash_b, ad.size(), size);
+		std::copy(new_tag.begin(), new_tag.end(), tag);
+		std::copy(new_nonce.begin(), new_nonce.end(), nonce);
+
+		return true;
+	}
+
+	template <size_t SizeA, size_t SizeB>
+	template <typename Pad>
+	inline std::optional<byte_array> reencryptor<SizeA, SizeB>::cbc_to_gcm(const_byte_view<> data, const_byte_view<> ad) const noexcept
+	{
+		constexpr size_t NONCE_SIZE = krypto::gcm<SizeB>::NONCE_SIZE;
+		constexpr size_t TAG_SIZE = krypto::gcm<SizeB>::TAG_SIZE;
+		constexpr size_t STRIPE = internal::gcm::STRIPE;
+
+		if (data.size() % 16 != 0 || data.size() < 48)
+			return std::nullopt;
+
+		// Last bytes are IV
+		const size_t size = data.size() - 16;
+		const unsigned char* cipher = data.data();
+		const unsigned char* iv = cipher + size;
+
+		// Padding can span the last two blocks
+		std::array<unsigned char, 32> tail;
+		internal::decrypt_cbc(cipher + size - 32, tail.data(), 2, size > 32 ? cipher + size - 48 : iv, from_dec);
+
+		const uint8_t last = tail.back();
+		if (last == 0 || last >= tail.size() || Pad::detect(tail.end() - 1) != last)
+			return std::nullopt;
+
+		const size_t plain_size = size - last;
+
+		byte_array out(plain_size + TAG_SIZE + NONCE_SIZE);
+
+		const auto nonce = krypto::get_srandom_bytes<NONCE_SIZE>();
+		const auto ctr = internal::gcm::counter(nonce);
+
+		internal::ghash::state hash;
+		hash.update(to.hk, ad.data(), ad.size());
+
+		std::array<unsigned char, STRIPE> buffer;
+
+		for (size_t i = 0; i < plain_size; i += STRIPE) {
+			const size_t n = std::min(STRIPE, plain_size - i);
+
+			internal::decrypt_cbc(cipher + i, buffer.data(), (n + 15) / 16, i == 0 ? iv : cipher + i - 16, from_dec);
+			internal::gcm::encrypt(to, ctr, i, buffer.data(), out.data() + i, n, hash);
+		}
+
+		secure_zero(buffer);
+		secure_zero(tail);
+
+		const auto tag = internal::gcm::tag(to, ctr, hash, ad.size(), plain_size);
+		std::copy(tag.begin(), tag.end(), out.begin() + plain_size);
+		std::copy(nonce.begin(), nonce.end(), out.end() - NONCE_SIZE);
+
+		return out;
+	}
+
+	template <size_t SizeA, size_t SizeB>
+	inline std::vector<size_t> reencryptor<SizeA, SizeB>::ctr(std::span<byte_array> objects, governor* gov) const noexcept
+	{
+		std::vector<unsigned char> ok(objects.size());
+		expect(objects, gov);
+
+		#pragma omp parallel for schedule(dynamic) num_threads(internal::parallel::governed_threads(gov))
+		for (int64_t i = 0; i < static_cast<int64_t>(objects.size()); i++) {
+			ok[i] = internal::parallel::governed(gov, objects[i].size(), [&] { ctr(objects[i]); });
+		}
+
+		return failures(ok);
+	}
+
+	template <size_t SizeA, size_t SizeB>
+	inline std::vector<size_t> reencryptor<SizeA, SizeB>::gcm(std::span<byte_array> objects, governor* gov) const noexcept
+	{
+		std::vector<unsigned char> ok(objects.size());
+		expect(objects, gov);
+
+		#pragma omp parallel for schedule(dynamic) num_threads(internal::parallel::governed_threads(gov))
+		for (int64_t i = 0; i < static_cast<int64_t>(objects.size()); i++) {
+			internal::parallel::governed(gov, objects[i].size(), [&] { ok[i] = gcm(objects[i]); });
+		}
+
+		return failures(ok);
+	}
+
+	template <size_t SizeA, size_t SizeB>
+	template <typename Pad>
+	inline std::vector<std::optional<byte_array>> reencryptor<SizeA, SizeB>::cbc_to_gcm(std::span<const byte_array> objects, governor* gov) const noexcept
+	{
+		std::vector<std::optional<byte_array>> out(objects.size());
+		expect(objects, gov);
+
+		#pragma omp parallel for schedule(dynamic) num_threads(internal::parallel::governed_threads(gov))
+		for (int64_t i = 0; i < static_cast<int64_t>(objects.size()); i++) {
+			internal::parallel::governed(gov, objects[i].size(), [&] { out[i] = cbc_to_gcm<Pad>(objects[i]); });
+		}
+
+		return out;
+	}
+
+	template <size_t SizeA, size_t SizeB>
+	template <typename Objects>
+	inline void reencryptor<SizeA, SizeB>::expect(const Objects& objects, governor* gov) noexcept
+	{
+		if (!gov)
+			return;
+
+		uint64_t total = 0;
+		for (const auto& o : objects)
+			total += o.size();
+		gov->expect(total);
+	}
+
+	template <size_t SizeA, size_t SizeB>
+	inline std::vector<size_t> reencryptor<SizeA, SizeB>::failures(const std::vector<unsigned char>& ok) noexcept
+	{
+		std::vector<size_t> failed;
+		for (size_t i = 0; i < ok.size(); i++) {
+			if (!ok[i])
+				failed.push_back(i);
+		}
+		return failed;
+	}
+
+}
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <cstdint>
+#include <cassert>
+#include <array>
+#include <vector>
+#include <span>
+#include <optional>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+
+#include "util.h"
+#include "aegis.h"
+#include "sha256.h"
+#include "parallel.h"
+
+namespace krypto {
+
+	/**
+	 * In memory key value store whose values are sealed with AEGIS-128L.
+	 *
+	 * Values live in slots. The nonce of a value is its slot index and the
+	 * version of the slot, the version grows on every write so a nonce is
+	 * not reused within a map, and a sealed value moved to another slot
+	 * fails to open. Versions start at 0 in every map, so each map seals
+	 * under its own key: random, or derived from the given key and a random
+	 * salt. Maps sharing a key, or a process restarted with the same key,
+	 * never seal under the same key and nonce. Keys are not encrypted.
+	 * Batched get and put seal and open 4 values at a time, in the 4 lanes of
+	 * the zmm registers when compiled with VAES, and split large batches over threads.
+	 */
+	template <typename Key, typename Hash = std::hash<Key>>
+	class sealed_map {
+	public:
+		constexpr static size_t KEY_SIZE = aegis128l::KEY_SIZE;
+		constexpr static size_t TAG_SIZE = aegis128l::TAG_SIZE;
+
+		/**
+		 * Construct with a random key
+		 */
+		sealed_map() noexcept;
+
+		/**
+		 * Construct with key, values are sealed under HMAC-SHA256(key, random salt)
+		 */
+		explicit sealed_map(const_byte_view<KEY_SIZE> key) noexcept;
+
+		/**
+		 * Insert or replace the value of key
+		 */
+		void put(const Key& key, const_byte_view<> value) noexcept;
+
+		/**
+		 * Value of key
+		 * Returns empty optional if key is missing or its value fails authentication
+		 */
+		std::optional<byte_array> get(const Key& key) const noexcept;
+
+		/**
+		 * Insert or replace many values, keys[i] gets values[i], keys and values must be the same size
+		 */
+		void put(std::span<const Key> keys, std::span<const const_byte_view<>> values) noexcept;
+
+		/**
+		 * Values of many keys, see get
+		 */
+		std::vector<std::optional<byte_array>> get(std::span<const Key> keys) const noexcept;
+
+		/**
+		 * Remove key, returns false if it is missing
+		 */
+		bool erase(const Key& key) noexcept;
+
+		size_t size() const noexcept;
+
+	private:
+
+		struct slot {
+			uint64_t version = 0;
+			// Cipher text followed by tag
+			byte_array sealed;
+		};
+
+		static std::array<unsigned char, 16> nonce(uint64_t index, uint64_t version) noexcept;
+
+		/**
+		 * Slot of key, allocated if missing. Bumps the version
+		 */
+		size_t acquire(const Key& key) noexcept;
+
+		std::array<unsigned char, KEY_SIZE> key;
+
+		mutable std::shared_mutex lock;
+		std::unordered_map<Key, size_t, Hash> index;
+		std::vector<slot> slots;
+		std::vector<size_t> free;
+
+	};
+
+	///
+	// Implementation
+	///
+
+	template <typename Key, typename Hash>
+	inline sealed_map<Key, Hash>::sealed_map() noexcept
+		: key(krypto::get_srandom_bytes<KEY_SIZE>())
+	{
+	}
+
+	template <typename Key, typename Hash>
+	inline sealed_map<Key, Hash>::sealed_map(const_byte_view<KEY_SIZE> key) noexcept
+	{
+		const auto salt = krypto::get_srandom_bytes<16>();
+		auto derived = hmac_sha256::mac(key, salt);
+		std::copy(derived.begin(), derived.begin() + KEY_SIZE, this->key.begin());
+		krypto::secure_zero(derived);
+	}
+
+	template <typename Key, typename Hash>
+	inline std::array<unsigned char, 16> sealed_map<Key, Hash>::nonce(uint64_t index, uint64_t version) noexcept
+	{
+		std::array<unsigned char, 16> n;
+		for (size_t i = 0; i < 8; i++) {
+			n[i] = static_cast<unsigned char>(index >> (i * 8));
+			n[i + 8] = static_cast<unsigned char>(version >> (i * 8));
+		}
+		return n;
+	}
+
+	template <typename Key, typename Hash>
+	inline size_t sealed_map<Key, Hash>::acquire(const Key& key) noexcept
+	{
+		auto it = index.find(key);
+		if (it == index.end()) {
+			size_t i;
+			if (free.empty()) {
+				i = slots.size();
+				slots.emplace_back();
+			}
+			else {
+				i = free.back();
+				free.pop_back();
+			}
+			it = index.emplace(key, i).first;
+		}
+
+		slots[it->second].version++;
+		return it->second;
+	}
+
+	template <typename Key, typename Hash>
+	inline void sealed_map<Key, Hash>::put(const Key& key, const_byte_view<> value) noexcept
+	{
+		using namespace internal::aegis;
+
+		std::unique_lock guard(lock);
+
+		const size_t target = acquire(key);
+		slot& s = slots[target];
+		s.sealed.resize(value.size() + TAG_SIZE);
+
+		const auto n = nonce(target, s.version);
+		const lane l = { n.data(), value.data(), s.sealed.data(), value.size() };
+		seal_lanes<state_128l>(this->key.data(), &l, 1);
+	}
+
+	template <typename Key, typename Hash>
+	inline std::optional<byte_array> sealed_map<Key, Hash>::get(const Key& key) const noexcept
+	{
+		using namespace internal::aegis;
+
+		std::shared_lock guard(lock);
+
+		const auto it = index.find(key);
+		if (it == index.end())
+			return std::nullopt;
+
+		const slot& s = slots[it->second];
+		byte_array value(s.sealed.size() - TAG_SIZE);
+
+		const auto n = nonce(it->second, s.version);
+		const lane l = { n.data(), s.sealed.data(), value.data(), value.size() };
+		bool ok;
+		open_lanes<state_128l>(this->key.data(), &l, 1, &ok);
+
+		if (!ok)
+			return std::nullopt;
+		return value;
+	}
+
+	template <typename Key, typename Hash>
+	inline void sealed_map<Key, Hash>::put(std::span<const Key> keys, std::span<const const_byte_view<>> values) noexcept
+	{
+		assert(keys.size() == values.size());
+
+		using namespace internal::aegis;
+
+		std::unique_lock guard(lock);
+
+		// Slots first, a key given twice keeps the last value
+		std::unordered_map<size_t, size_t> last;
+		for (size_t i = 0; i < keys.size(); i++) {
+			last[acquire(keys[i])] = i;
+		}
+
+		std::vector<std::pair<size_t, size_t>> jobs(last.begin(), last.end());
+		std::vector<std::array<unsigned char, 16>> nonces(jobs.size());
+		for (size_t j = 0; j < jobs.size(); j++) {
+			const auto [target, i] = jobs[j];
+			slot& s = slots[target];
+			nonces[j] = nonce(target, s.version);
+			s.sealed.resize(values[i].size() + TAG_SIZE);
+		}
+
+		const int64_t groups = (jobs.size() + LANES - 1) / LANES;
+
+		#pragma omp parallel for schedule(dynamic, 16) if(groups > 64) num_threads(internal::parallel::threads())
+		for (int64_t g = 0; g < groups; g++) {
+			lane lanes[LANES];
+			const size_t count = std::min(LANES, jobs.size() - g * LANES);
+
+			for (size_t l = 0; l < count; l++) {
+				const auto [target, i] = jobs[g * LANES + l];
+				lanes[l] = { nonces[g * LANES + l].data(), values[i].data(), slots[target].sealed.data(), values[i].size() };
+			}
+
+			seal_lanes<state_128l>(key.data(), lanes, count);
+		}
+	}
+
+	template <typename Key, typename Hash>
+	inline std::vector<std::optional<byte_array>> sealed_map<Key, Hash>::get(std::span<const Key> keys) const noexcept
+	{
+		using namespace internal::aegis;
+
+		std::shared_lock guard(lock);
+
+		std::vector<std::optional<byte_array>> out(keys.size());
+
+		// Found keys and their slots, opened in groups of LANES
+		std::vector<std::pair<size_t, size_t>> found;
+		for (size_t i = 0; i < keys.size(); i++) {
+			const auto it = index.find(keys[i]);
+			if (it == index.end())
+				continue;
+
+			out[i].emplace(slots[it->second].sealed.size() - TAG_SIZE);
+			found.emplace_back(i, it->second);
+		}
+
+		const int64_t groups = (found.size() + LANES - 1) / LANES;
+
+		#pragma omp parallel for schedule(dynamic, 16) if(groups > 64) num_threads(internal::parallel::threads())
+		for (int64_t g = 0; g < groups; g++) {
+			lane lanes[LANES];
+			std::array<unsigned char, 16> nonces[LANES];
+			bool ok[LANES];
+			const size_t count = std::min(LANES, found.size() - g * LANES);
+
+			for (size_t l = 0; l < count; l++) {
+				const auto [i, target] = found[g * LANES + l];
+				const slot& s = slots[target];
+
+				nonces[l] = nonce(target, s.version);
+				lanes[l] = { nonces[l].data(), s.sealed.data(), out[i]->data(), out[i]->size() };
+			}
+
+			open_lanes<state_128l>(key.data(), lanes, count, ok);
+
+			for (size_t l = 0; l < count; l++) {
+				if (!ok[l])
+					out[found[g * LANES + l].first].reset();
+			}
+		}
+
+		return out;
+	}
+
+	template <typename Key, typename Hash>
+	inline bool sealed_map<Key, Hash>::erase(const Key& key) noexcept
+	{
+		std::unique_lock guard(lock);
+
+		const auto it = index.find(key);
+		if (it == index.end())
+			return false;
+
+		// The version is kept, the next value in the slot gets a fresh nonce
+		slot& s = slots[it->second];
+		s.sealed.clear();
+		s.sealed.shrink_to_fit();
+
+		free.push_back(it->second);
+		index.erase(it);
+		return true;
+	}
+
+	template <typename Key, typename Hash>
+	inline size_t sealed_map<Key, Hash>::size() const noexcept
+	{
+		std::shared_lock guard(lock);
+		return index.size();
+	}
+
+}
@@ -0,0 +1,408 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include <span>
+
+#if defined(__SHA__) && defined(__SSE4_1__)
+#include <immintrin.h>
+#define KRYPTO_SHANI 1
+#endif
+
+#include "util.h"
+#include "internal/block.h"
+
+/**
+ * SHA-256 compression function.
+ * The 64 rounds of a block can be run a quarter at a time (begin, rounds<0..3>, end)
+ * so other latency bound work, like CBC encryption, can be scheduled in between.
+ * Uses the SHA extensions when compiled with -msha, otherwise portable code.
+ */
+namespace krypto::internal::sha256 {
+
+	using state = std::array<uint32_t, 8>;
+
+	constexpr state IV = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+	alignas(16) constexpr std::array<uint32_t, 64> K = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+
+	/**
+	 * Working variables and message schedule of one block in progress
+	 */
+	struct work {
+#ifdef KRYPTO_SHANI
+		__m128i abef, cdgh;
+		__m128i abef_save, cdgh_save;
+		__m128i msg[4];
+#else
+		uint32_t v[8];
+		uint32_t w[16];
+#endif
+	};
+
+	inline void begin(work& w, const state& h, const unsigned char* block) noexcept;
+
+	/**
+	 * Rounds 16 * Quarter to 16 * Quarter + 15
+	 */
+	template <size_t Quarter>
+	inline void rounds(work& w) noexcept;
+
+	inline void end(state& h, const work& w) noexcept;
+
+	/**
+	 * Call before a loop using begin / rounds / end
+	 */
+	inline void prepare() noexcept;
+
+	/**
+	 * Compress count consecutive 64 byte blocks into h
+	 */
+	inline void compress(state& h, const unsigned char* blocks, size_t count) noexcept;
+
+	///
+	// Implementation
+	///
+
+#ifdef KRYPTO_SHANI
+
+	inline void prepare() noexcept
+	{
+#ifdef __AVX__
+		// The SHA instructions have no VEX encoding, mixing them with dirty
+		// upper vector state costs a state transition per instruction
+		_mm256_zeroupper();
+#endif
+	}
+
+	inline void begin(work& w, const state& h, const unsigned char* block) noexcept
+	{
+		const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+		// Reorder A..H into the ABEF / CDGH layout of SHA256RNDS2
+		const __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&h[0])), 0xB1);
+		const __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&h[4])), 0x1B);
+
+		w.abef = _mm_alignr_epi8(dcba, efgh, 8);
+		w.cdgh = _mm_blend_epi16(efgh, dcba, 0xF0);
+		w.abef_save = w.abef;
+		w.cdgh_save = w.cdgh;
+
+		for (size_t i = 0; i < 4; i++) {
+			w.msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16)), bswap);
+		}
+	}
+
+	template <size_t Quarter>
+	inline void rounds(work& w) noexcept
+	{
+		KRYPTO_UNROLL
+		for (size_t g = Quarter * 4; g < Quarter * 4 + 4; g++) {
+			__m128i& m = w.msg[g % 4];
+
+			// Message schedule for words 4g .. 4g + 3
+			if (g >= 4) {
+				const __m128i t = _mm_add_epi32(_mm_sha256msg1_epu32(m, w.msg[(g + 1) % 4]), _mm_alignr_epi8(w.msg[(g + 3) % 4], w.msg[(g + 2) % 4], 4));
+				m = _mm_sha256msg2_epu32(t, w.msg[(g + 3) % 4]);
+			}
+
+			__m128i k = _mm_add_epi32(m, _mm_load_si128(reinterpret_cast<const __m128i*>(&K[g * 4])));
+			w.cdgh = _mm_sha256rnds2_epu32(w.cdgh, w.abef, k);
+			k = _mm_shuffle_epi32(k, 0x0E);
+			w.abef = _mm_sha256rnds2_epu32(w.abef, w.cdgh, k);
+		}
+	}
+
+	inline void end(state& h, const work& w) noexcept
+	{
+		const __m128i abef = _mm_add_epi32(w.abef, w.abef_save);
+		const __m128i cdgh = _mm_add_epi32(w.cdgh, w.cdgh_save);
+
+		const __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+		const __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&h[0]), _mm_blend_epi16(feba, dchg, 0xF0));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&h[4]), _mm_alignr_epi8(dchg, feba, 8));
+	}
+
+#else
+
+	inline void prepare() noexcept
+	{
+	}
+
+	constexpr uint32_t rotr(uint32_t x, int n) noexcept
+	{
+		return (x >> n) | (x << (32 - n));
+	}
+
+	inline void begin(work& w, const state& h, const unsigned char* block) noexcept
+	{
+		std::copy(h.begin(), h.end(), w.v);
+
+		for (size_t i = 0; i < 16; i++) {
+			w.w[i] = (static_cast<uint32_t>(block[i * 4]) << 24) | (static_cast<uint32_t>(block[i * 4 + 1]) << 16)
+				| (static_cast<uint32_t>(block[i * 4 + 2]) << 8) | static_cast<uint32_t>(block[i * 4 + 3]);
+		}
+	}
+
+	template <size_t Quarter>
+	inline void rounds(work& w) noexcept
+	{
+		uint32_t a = w.v[0], b = w.v[1], c = w.v[2], d = w.v[3], e = w.v[4], f = w.v[5], g = w.v[6], h = w.v[7];
+
+		KRYPTO_UNROLL
+		for (size_t t = Quarter * 16; t < Quarter * 16 + 16; t++) {
+			uint32_t& wt = w.w[t % 16];
+
+			// The schedule is kept as a rolling window of 16 words
+			if (t >= 16) {
+				const uint32_t w15 = w.w[(t + 1) % 16];
+				const uint32_t w2 = w.w[(t + 14) % 16];
+				wt += (rotr(w15, 7) ^ rotr(w15, 18) ^ (w15 >> 3)) + w.w[(t + 9) % 16] + (rotr(w2, 17) ^ rotr(w2, 19) ^ (w2 >> 10));
+			}
+
+			const uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[t] + wt;
+			const uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+
+		w.v[0] = a; w.v[1] = b; w.v[2] = c; w.v[3] = d;
+		w.v[4] = e; w.v[5] = f; w.v[6] = g; w.v[7] = h;
+	}
+
+	inline void end(state& h, const work& w) noexcept
+	{
+		for (size_t i = 0; i < 8; i++) {
+			h[i] += w.v[i];
+		}
+	}
+
+#endif
+
+	inline void compress(state& h, const unsigned char* blocks, size_t count) noexcept
+	{
+		work w;
+
+		prepare();
+		for (size_t i = 0; i < count; i++) {
+			begin(w, h, blocks + i * 64);
+			rounds<0>(w);
+			rounds<1>(w);
+			rounds<2>(w);
+			rounds<3>(w);
+			end(h, w);
+		}
+	}
+
+}
+
+namespace krypto {
+
+	template <size_t Size, typename Pad>
+	class cbc_hmac_sha256;
+
+	/**
+	 * SHA-256 hash, implementation based on https://nvlpubs.nist.gov/nistpubs/FIPS/NIST.FIPS.180-4.pdf
+	 */
+	class sha256 {
+	public:
+		constexpr static size_t DIGEST_SIZE = 32;
+		constexpr static size_t BLOCK_SIZE = 64;
+
+		using digest_type = std::array<unsigned char, DIGEST_SIZE>;
+
+		sha256() noexcept = default;
+
+		/**
+		 * Add data to the hash
+		 */
+		void update(const_byte_view<> data) noexcept;
+
+		/**
+		 * Digest of all data added so far, the state is not modified
+		 */
+		digest_type digest() const noexcept;
+
+		/**
+		 * Hash data in one call
+		 */
+		static digest_type hash(const_byte_view<> data) noexcept;
+
+	private:
+
+		template <size_t Size, typename Pad>
+		friend class cbc_hmac_sha256;
+
+		internal::sha256::state h = internal::sha256::IV;
+
+		std::array<unsigned char, BLOCK_SIZE> buffer{};
+		size_t buffered = 0;
+		uint64_t total = 0;
+
+	};
+
+	/**
+	 * HMAC-SHA256, see https://www.rfc-editor.org/rfc/rfc2104
+	 * The padded key blocks are hashed once on construction
+	 */
+	class hmac_sha256 {
+	public:
+		constexpr static size_t TAG_SIZE = sha256::DIGEST_SIZE;
+
+		explicit hmac_sha256(const_byte_view<> key) noexcept;
+
+		/**
+		 * Add data to the MAC
+		 */
+		void update(const_byte_view<> data) noexcept;
+
+		/**
+		 * Tag of all data added so far, the state is not modified
+		 */
+		sha256::digest_type digest() const noexcept;
+
+		/**
+		 * MAC data in one call
+		 */
+		static sha256::digest_type mac(const_byte_view<> key, const_byte_view<> data) noexcept;
+
+	private:
+
+		template <size_t Size, typename Pad>
+		friend class cbc_hmac_sha256;
+
+		sha256 inner;
+		sha256 outer;
+
+	};
+
+	///
+	// Implementation
+	///
+
+	inline void sha256::update(const_byte_view<> data) noexcept
+	{
+		const unsigned char* in = data.data();
+		size_t size = data.size();
+
+		total += size;
+
+		if (buffered) {
+			const size_t take = std::min(BLOCK_SIZE - buffered, size);
+			std::copy_n(in, take, buffer.begin() + buffered);
+			buffered += take;
+			in += take;
+			size -= take;
+
+			if (buffered < BLOCK_SIZE)
+				return;
+
+			internal::sha256::compress(h, buffer.data(), 1);
+			buffered = 0;
+		}
+
+		const size_t blocks = size / BLOCK_SIZE;
+		internal::sha256::compress(h, in, blocks);
+		in += blocks * BLOCK_SIZE;
+		size -= blocks * BLOCK_SIZE;
+
+		std::copy_n(in, size, buffer.begin());
+		buffered = size;
+	}
+
+	inline sha256::digest_type sha256::digest() const noexcept
+	{
+		auto state = h;
+
+		// Pad with 0x80, zeros and the 64 bit big endian bit length
+		std::array<unsigned char, 2 * BLOCK_SIZE> last{};
+		std::copy_n(buffer.begin(), buffered, last.begin());
+		last[buffered] = 0x80;
+
+		const size_t blocks = buffered + 9 > BLOCK_SIZE ? 2 : 1;
+		const uint64_t bits = total * 8;
+		for (size_t i = 0; i < 8; i++) {
+			last[blocks * BLOCK_SIZE - 1 - i] = static_cast<unsigned char>(bits >> (i * 8));
+		}
+
+		internal::sha256::compress(state, last.data(), blocks);
+
+		digest_type out;
+		for (size_t i = 0; i < 8; i++) {
+			out[i * 4] = static_cast<unsigned char>(state[i] >> 24);
+			out[i * 4 + 1] = static_cast<unsigned char>(state[i] >> 16);
+			out[i * 4 + 2] = static_cast<unsigned char>(state[i] >> 8);
+			out[i * 4 + 3] = static_cast<unsigned char>(state[i]);
+		}
+		return out;
+	}
+
+	inline sha256::digest_type sha256::hash(const_byte_view<> data) noexcept
+	{
+		sha256 h;
+		h.update(data);
+		return h.digest();
+	}
+
+	inline hmac_sha256::hmac_sha256(const_byte_view<> key) noexcept
+	{
+		std::array<unsigned char, sha256::BLOCK_SIZE> block{};
+
+		// Keys longer than a block are hashed first
+		if (key.size() > sha256::BLOCK_SIZE) {
+			const auto digest = sha256::hash(key);
+			std::copy(digest.begin(), digest.end(), block.begin());
+		}
+		else {
+			std::copy(key.begin(), key.end(), block.begin());
+		}
+
+		for (auto& c : block)
+			c ^= 0x36;
+		inner.update(block);
+
+		for (auto& c : block)
+			c ^= 0x36 ^ 0x5c;
+		outer.update(block);
+	}
+
+	inline void hmac_sha256::update(const_byte_view<> data) noexcept
+	{
+		inner.update(data);
+	}
+
+	inline sha256::digest_type hmac_sha256::digest() const noexcept
+	{
+		auto o = outer;
+		o.update(inner.digest());
+		return o.digest();
+	}
+
+	inline sha256::digest_type hmac_sha256::mac(const_byte_view<> key, const_byte_view<> data) noexcept
+	{
+		hmac_sha256 m(key);
+		m.update(data);
+		return m.digest();
+	}
+
+}
@@ -1,5 +1,9 @@
 #pragma once
+#include <cstdint>
+#include <cstring>
 #include <array>
+#include <vector>
+#include <span>
 
 #ifdef WIN32
 #include <immintrin.h>
@@ -7,6 +11,16 @@
 
 namespace krypto {
 
+	using byte_array = std::vector<unsigned char>;
+
+	template <size_t extend = std::dynamic_extent>
+	using byte_view = std::span<unsigned char, extend>;
+
+	template <size_t extend = std::dynamic_extent>
+	using const_byte_view = std::span<const unsigned char, extend>;
+
+	using block128 = std::array<unsigned char, 16>;
+
 	/**
 	 * Compute secure random number.
 	 * https://en.wikipedia.org/wiki/RDRAND
@@ -55,6 +69,34 @@ namespace krypto {
 		return data;
 	}
 
+	/**
+	 * Compare two byte sequences in constant time.
+	 * Used when verifying authentication tags.
+	 */
+	inline bool secure_equal(const_byte_view<> left, const_byte_view<> right) noexcept {
+
+		if (left.size() != right.size())
+			return false;
+
+		unsigned char diff = 0;
+		for (size_t i = 0; i < left.size(); i++) {
+			diff |= left[i] ^ right[i];
+		}
+		return diff == 0;
+	}
+
+	/**
+	 * Overwrite data with zeros, not removed by the optimizer.
+	 * Used to wipe keys and plain text before memory is released.
+	 */
+	inline void secure_zero(byte_view<> data) noexcept {
+
+		volatile unsigned char* p = data.data();
+		for (size_t i = 0; i < data.size(); i++) {
+			p[i] = 0;
+		}
+	}
+
 
 
 
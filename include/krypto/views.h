@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <compare>
+#include <iterator>
+#include <memory>
+#include <ranges>
+
+#include "util.h"
+#include "internal/kernels.h"
+
+namespace krypto::views {
+
+	/**
+	 * Contiguous sized range of bytes
+	 */
+	template <typename R>
+	concept byte_range = std::ranges::contiguous_range<R> && std::ranges::sized_range<R> && sizeof(std::ranges::range_value_t<R>) == 1;
+
+}
+
+namespace krypto::internal::views {
+
+	/**
+	 * Range adaptor closure of encrypt and decrypt, the key is expanded once
+	 */
+	template <size_t Size>
+	struct ctr_adaptor {
+		key_schedule<Size> ks;
+		ctr_stream ctr;
+
+		template <std::ranges::viewable_range R>
+			requires krypto::views::byte_range<const std::views::all_t<R>>
+		auto operator()(R&& r) const noexcept;
+
+		template <std::ranges::viewable_range R>
+			requires krypto::views::byte_range<const std::views::all_t<R>>
+		friend auto operator|(R&& r, const ctr_adaptor& adaptor) noexcept
+		{
+			return adaptor(std::forward<R>(r));
+		}
+	};
+
+}
+
+namespace krypto::views {
+
+	/**
+	 * Lazy AES-CTR over a contiguous byte range.
+	 *
+	 * Bytes are produced as the range is iterated: the chunk holding the
+	 * current position is encrypted into a buffer owned by the view, CHUNK
+	 * bytes at a time with the bulk CTR kernel. An algorithm that stops
+	 * early only pays for the chunks it looked at, and jumping to a position
+	 * costs one chunk. Iterators are random access and return bytes by value.
+	 *
+	 * The counter block of byte i is iv + i / 16, as in krypto::modes::ctr.
+	 * Views are not thread safe, each thread iterates its own copy. The
+	 * buffer is wiped when the view is destroyed.
+	 */
+	template <std::ranges::view V, size_t Size>
+		requires byte_range<const V>
+	class ctr_view : public std::ranges::view_interface<ctr_view<V, Size>> {
+	public:
+		static_assert(Size == 128 || Size == 194 || Size == 256, "Invalid key size");
+
+		constexpr static size_t KEY_SIZE = Size / 8;
+		// Bytes encrypted together, a multiple of the kernel width
+		constexpr static size_t CHUNK = 4096;
+
+		class iterator;
+
+		ctr_view(V base, const_byte_view<KEY_SIZE> key, const_byte_view<16> iv) noexcept;
+		ctr_view(V base, const internal::key_schedule<Size>& ks, const internal::ctr_stream& ctr) noexcept;
+
+		// A copy gets its own empty buffer, a moved from view allocates a new one when it is read
+		ctr_view(const ctr_view& other) noexcept;
+		ctr_view(ctr_view&&) noexcept = default;
+		ctr_view& operator=(const ctr_view& other) noexcept;
+		ctr_view& operator=(ctr_view&&) noexcept = default;
+
+		iterator begin() const noexcept { return iterator(this, 0); }
+		iterator end() const noexcept { return iterator(this, size()); }
+
+		size_t size() const noexcept { return std::ranges::size(input); }
+
+		const V& base() const& noexcept { return input; }
+		V base() && noexcept { return std::move(input); }
+
+	private:
+
+		struct state {
+			~state() { secure_zero(data); }
+
+			// Chunk held in data, none before the first access
+			uint64_t index = UINT64_MAX;
+			std::array<unsigned char, CHUNK> data;
+		};
+
+		/**
+		 * Output byte at position, encrypts its chunk on a miss
+		 */
+		unsigned char at(size_t position) const noexcept;
+		void fill(uint64_t index) const noexcept;
+
+		V input;
+		internal::key_schedule<Size> ks;
+		internal::ctr_stream ctr;
+		// Allocated on the first access
+		mutable std::unique_ptr<state> cache;
+
+	};
+
+	template <std::ranges::view V, size_t Size>
+		requires byte_range<const V>
+	class ctr_view<V, Size>::iterator {
+	public:
+		using iterator_concept = std::random_access_iterator_tag;
+		using iterator_category = std::input_iterator_tag;
+		using value_type = unsigned char;
+		using difference_type = std::ptrdiff_t;
+
+		iterator() noexcept = default;
+		iterator(const ctr_view* parent, size_t position) noexcept : parent(parent), position(position) {}
+
+		unsigned char operator*() const noexcept { return parent->at(position); }
+		unsigned char operator[](difference_type n) const noexcept { return parent->at(position + n); }
+
+		iterator& operator++() noexcept { position++; return *this; }
+		iterator operator++(int) noexcept { auto it = *this; position++; return it; }
+		iterator& operator--() noexcept { position--; return *this; }
+		iterator operator--(int) noexcept { auto it = *this; position--; return it; }
+
+		iterator& operator+=(difference_type n) noexcept { position += n; return *this; }
+		iterator& operator-=(difference_type n) noexcept { position -= n; return *this; }
+
+		friend iterator operator+(iterator it, difference_type n) noexcept { return it += n; }
+		friend iterator operator+(difference_type n, iterator it) noexcept { return it += n; }
+		friend iterator operator-(iterator it, difference_type n) noexcept { return it -= n; }
+		friend difference_type operator-(const iterator& a, const iterator& b) noexcept { return static_cast<difference_type>(a.position - b.position); }
+
+		friend bool operator==(const iterator& a, const iterator& b) noexcept { return a.position == b.position; }
+		friend std::strong_ordering operator<=>(const iterator& a, const iterator& b) noexcept { return a.position <=> b.position; }
+
+		/**
+		 * Byte offset in the range
+		 */
+		size_t offset() const noexcept { return position; }
+
+	private:
+		const ctr_view* parent = nullptr;
+		size_t position = 0;
+	};
+
+	/**
+	 * Range adaptors encrypting or decrypting bytes with AES-CTR as they are read
+	 *     for (auto b : cipher_text | krypto::views::decrypt<256>(key, iv)) ...
+	 * Encryption and decryption are the same operation, both are given for readability
+	 */
+	template <size_t Size>
+	inline internal::views::ctr_adaptor<Size> encrypt(const_byte_view<Size / 8> key, const_byte_view<16> iv) noexcept
+	{
+		return { internal::key_schedule<Size>(key), internal::ctr_stream(iv.data(), false) };
+	}
+
+	template <size_t Size>
+	inline internal::views::ctr_adaptor<Size> decrypt(const_byte_view<Size / 8> key, const_byte_view<16> iv) noexcept
+	{
+		return encrypt<Size>(key, iv);
+	}
+
+	///
+	// Implementation
+	///
+
+	template <std::ranges::view V, size_t Size>
+		requires byte_range<const V>
+	inline ctr_view<V, Size>::ctr_view(V base, const_byte_view<KEY_SIZE> key, const_byte_view<16> iv) noexcept
+		: ctr_view(std::move(base), internal::key_schedule<Size>(key), internal::ctr_stream(iv.data(), false))
+	{
+	}
+
+	template <std::ranges::view V, size_t Size>
+		requires byte_range<const V>
+	inline ctr_view<V, Size>::ctr_view(V base, const internal::key_schedule<Size>& ks, const internal::ctr_stream& ctr) noexcept
+		: input(std::move(base)), ks(ks), ctr(ctr)
+	{
+	}
+
+	template <std::ranges::view V, size_t Size>
+		requires byte_range<const V>
+	inline ctr_view<V, Size>::ctr_view(const ctr_view& other) noexcept
+		: ctr_view(other.input, other.ks, other.ctr)
+	{
+	}
+
+	template <std::ranges::view V, size_t Size>
+		requires byte_range<const V>
+	inline ctr_view<V, Size>& ctr_view<V, Size>::operator=(const ctr_view& other) noexcept
+	{
+		if (this != &other)
+			*this = ctr_view(other);
+		return *this;
+	}
+
+	template <std::ranges::view V, size_t Size>
+		requires byte_range<const V>
+	inline unsigned char ctr_view<V, Size>::at(size_t position) const noexcept
+	{
+		if (!cache)
+			cache = std::make_unique<state>();
+
+		const uint64_t index = position / CHUNK;
+		if (index != cache->index)
+			fill(index);
+
+		return cache->data[position % CHUNK];
+	}
+
+	template <std::ranges::view V, size_t Size>
+		requires byte_range<const V>
+	inline void ctr_view<V, Size>::fill(uint64_t index) const noexcept
+	{
+		const size_t begin = index * CHUNK;
+		const size_t n = std::min(CHUNK, size() - begin);
+		const auto* in = reinterpret_cast<const unsigned char*>(std::ranges::data(input));
+
+		internal::ctr_xor(in + begin, cache->data.data(), n, ks, ctr, begin / 16);
+		cache->index = index;
+	}
+
+}
+
+namespace krypto::internal::views {
+
+	template <size_t Size>
+	template <std::ranges::viewable_range R>
+		requires krypto::views::byte_range<const std::views::all_t<R>>
+	inline auto ctr_adaptor<Size>::operator()(R&& r) const noexcept
+	{
+		return krypto::views::ctr_view<std::views::all_t<R>, Size>(std::views::all(std::forward<R>(r)), ks, ctr);
+	}
+
+}
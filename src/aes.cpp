@@ -0,0 +1,24 @@
+#include "krypto/aes.h"
+
+namespace krypto {
+
+	template class aes<128, modes::ecb, pad::ansix923>;
+	template class aes<128, modes::ecb, pad::pkcs7>;
+	template class aes<128, modes::cbc, pad::ansix923>;
+	template class aes<128, modes::cbc, pad::pkcs7>;
+	template class aes<128, modes::ctr, pad::ansix923>;
+	template class aes<128, modes::ctr, pad::pkcs7>;
+	template class aes<194, modes::ecb, pad::ansix923>;
+	template class aes<194, modes::ecb, pad::pkcs7>;
+	template class aes<194, modes::cbc, pad::ansix923>;
+	template class aes<194, modes::cbc, pad::pkcs7>;
+	template class aes<194, modes::ctr, pad::ansix923>;
+	template class aes<194, modes::ctr, pad::pkcs7>;
+	template class aes<256, modes::ecb, pad::ansix923>;
+	template class aes<256, modes::ecb, pad::pkcs7>;
+	template class aes<256, modes::cbc, pad::ansix923>;
+	template class aes<256, modes::cbc, pad::pkcs7>;
+	template class aes<256, modes::ctr, pad::ansix923>;
+	template class aes<256, modes::ctr, pad::pkcs7>;
+
+}
@@ -0,0 +1,9 @@
+#include "krypto/file_engine.h"
+
+namespace krypto {
+
+	template class file_engine<128>;
+	template class file_engine<194>;
+	template class file_engine<256>;
+
+}
@@ -0,0 +1,32 @@
+// Built with -maes -mvaes -mavx2 -mavx512f -mavx512bw, see src/CMakeLists.txt
+#include "krypto/internal/isa.h"
+#include "krypto/internal/kernels.h"
+
+#include <algorithm>
+
+#ifndef KRYPTO_VAES512
+#error "kernels_vaes512.cpp must be built with -maes -mvaes -mavx2 -mavx512f -mavx512bw"
+#endif
+
+namespace krypto::internal::isa {
+
+	template <size_t Rounds>
+	void ctr_xor_vaes512(const unsigned char* in, unsigned char* out, size_t size, const __m128i* rk, uint64_t hi, uint64_t lo, bool inc32, uint64_t index) noexcept
+	{
+		// Any key size with this many rounds
+		key_schedule<(Rounds - 6) * 32> ks;
+		std::copy(rk, rk + Rounds + 1, ks.rk);
+
+		const std::array<unsigned char, 16> zero{};
+		ctr_stream ctr(zero.data(), inc32);
+		ctr.hi = hi;
+		ctr.lo = lo;
+
+		internal::ctr_xor_vaes512(in, out, size, ks, ctr, index);
+	}
+
+	template void ctr_xor_vaes512<10>(const unsigned char*, unsigned char*, size_t, const __m128i*, uint64_t, uint64_t, bool, uint64_t) noexcept;
+	template void ctr_xor_vaes512<12>(const unsigned char*, unsigned char*, size_t, const __m128i*, uint64_t, uint64_t, bool, uint64_t) noexcept;
+	template void ctr_xor_vaes512<14>(const unsigned char*, unsigned char*, size_t, const __m128i*, uint64_t, uint64_t, bool, uint64_t) noexcept;
+
+}
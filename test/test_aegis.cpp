@@ -0,0 +1,171 @@
+#include "gtest/gtest.h"
+#include "krypto/aegis.h"
+
+#include <array>
+
+class AegisTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+	}
+
+	/**
+	 * Test vectors from draft-irtf-cfrg-aegis-aead
+	 */
+
+	std::array<unsigned char, 16> key_128l		= { 0x10, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	std::array<unsigned char, 16> nonce_128l	= { 0x10, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	std::array<unsigned char, 16> cipher_128l	= { 0xc1, 0xc0, 0xe5, 0x8b, 0xd9, 0x13, 0x00, 0x6f, 0xeb, 0xa0, 0x0f, 0x4b, 0x3c, 0xc3, 0x59, 0x4e };
+	std::array<unsigned char, 16> tag_128l		= { 0xab, 0xe0, 0xec, 0xe8, 0x0c, 0x24, 0x86, 0x8a, 0x22, 0x6a, 0x35, 0xd1, 0x6b, 0xda, 0xe3, 0x7a };
+
+	std::array<unsigned char, 32> key_256		= { 0x10, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+												0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	std::array<unsigned char, 32> nonce_256		= { 0x10, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+												0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	std::array<unsigned char, 16> cipher_256	= { 0x75, 0x4f, 0xc3, 0xd8, 0xc9, 0x73, 0x24, 0x6d, 0xcc, 0x6d, 0x74, 0x14, 0x12, 0xa4, 0xb2, 0x36 };
+	std::array<unsigned char, 16> tag_256		= { 0x3f, 0xe9, 0x19, 0x94, 0x76, 0x8b, 0x33, 0x2e, 0xd7, 0xf5, 0x70, 0xa1, 0x9e, 0xc5, 0x89, 0x6e };
+
+	std::array<unsigned char, 16> plain_text	= {};
+
+};
+
+TEST_F(AegisTest, Seal_128L_TestVector) {
+
+	krypto::aegis128l aegis(key_128l);
+	auto out = aegis.seal(nonce_128l, plain_text);
+
+	ASSERT_EQ(out.size(), cipher_128l.size() + tag_128l.size());
+	for (int i = 0; i < cipher_128l.size(); i++) {
+		ASSERT_EQ(out[i], cipher_128l[i]);
+	}
+	for (int i = 0; i < tag_128l.size(); i++) {
+		ASSERT_EQ(out[cipher_128l.size() + i], tag_128l[i]);
+	}
+
+}
+
+TEST_F(AegisTest, Seal_256_TestVector) {
+
+	krypto::aegis256 aegis(key_256);
+	auto out = aegis.seal(nonce_256, plain_text);
+
+	ASSERT_EQ(out.size(), cipher_256.size() + tag_256.size());
+	for (int i = 0; i < cipher_256.size(); i++) {
+		ASSERT_EQ(out[i], cipher_256[i]);
+	}
+	for (int i = 0; i < tag_256.size(); i++) {
+		ASSERT_EQ(out[cipher_256.size() + i], tag_256[i]);
+	}
+
+}
+
+TEST_F(AegisTest, Open_RejectsModifiedCipher) {
+
+	krypto::aegis128l aegis(key_128l);
+	std::vector<unsigned char> ad = { 0x01, 0x02, 0x03 };
+	auto out = aegis.seal(nonce_128l, plain_text, ad);
+
+	ASSERT_TRUE(aegis.open(nonce_128l, out, ad).has_value());
+
+	out[0] ^= 1;
+	ASSERT_FALSE(aegis.open(nonce_128l, out, ad).has_value());
+
+	out[0] ^= 1;
+	ad[0] ^= 1;
+	ASSERT_FALSE(aegis.open(nonce_128l, out, ad).has_value());
+
+}
+
+TEST_F(AegisTest, EncryptDecrypt_ALL_1_to_1000_BYTE) {
+
+	krypto::aegis128l aegis_128l(key_128l);
+	krypto::aegis256 aegis_256(key_256);
+
+	for (int i = 1; i <= 1000; i++) {
+
+		std::vector<unsigned char> data;
+		std::vector<unsigned char> ad;
+		for (int j = 0; j < i; j++) {
+			data.push_back(rand() % 256);
+		}
+		for (int j = 0; j < i % 67; j++) {
+			ad.push_back(rand() % 256);
+		}
+
+		{
+			auto out = aegis_128l.encrypt(data, ad);
+			auto res = aegis_128l.decrypt(out, ad);
+
+			ASSERT_TRUE(res.has_value());
+			ASSERT_EQ(res->size(), data.size());
+			for (int k = 0; k < res->size(); k++) {
+				ASSERT_EQ((*res)[k], data[k]);
+			}
+		}
+
+		{
+			auto out = aegis_256.encrypt(data, ad);
+			auto res = aegis_256.decrypt(out, ad);
+
+			ASSERT_TRUE(res.has_value());
+			ASSERT_EQ(res->size(), data.size());
+			for (int k = 0; k < res->size(); k++) {
+				ASSERT_EQ((*res)[k], data[k]);
+			}
+		}
+
+	}
+
+}
+
+TEST_F(AegisTest, Lanes_MatchSeal) {
+
+	krypto::aegis128l aegis_128l(key_128l);
+	krypto::aegis256 aegis_256(key_256);
+
+	// Lanes of different lengths, blocks common to all lanes, full and partial blocks after
+	const size_t sizes[] = { 70, 96, 200, 65 };
+	std::vector<unsigned char> data(200);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = static_cast<unsigned char>(i);
+
+	std::array<unsigned char, 32> nonce[4] = { { 0 }, { 1 }, { 2 }, { 3 } };
+	std::vector<unsigned char> out[4];
+	std::vector<unsigned char> back[4];
+	krypto::internal::aegis::lane lanes[4];
+	bool ok[4];
+
+	for (size_t l = 0; l < 4; l++) {
+		out[l].resize(sizes[l] + 16);
+		lanes[l] = { nonce[l].data(), data.data(), out[l].data(), sizes[l] };
+	}
+
+	krypto::internal::aegis::seal_lanes<krypto::internal::aegis::state_128l>(key_128l.data(), lanes, 4);
+	for (size_t l = 0; l < 4; l++) {
+		ASSERT_EQ(out[l], aegis_128l.seal(krypto::const_byte_view<16>(nonce[l].data(), 16), krypto::const_byte_view<>(data.data(), sizes[l])));
+
+		back[l].resize(sizes[l]);
+		lanes[l] = { nonce[l].data(), out[l].data(), back[l].data(), sizes[l] };
+	}
+
+	out[2][50] ^= 1;
+	krypto::internal::aegis::open_lanes<krypto::internal::aegis::state_128l>(key_128l.data(), lanes, 4, ok);
+	for (size_t l = 0; l < 4; l++) {
+		ASSERT_EQ(ok[l], l != 2);
+		if (ok[l]) {
+			ASSERT_TRUE(std::equal(back[l].begin(), back[l].end(), data.begin()));
+		}
+	}
+
+	for (size_t l = 0; l < 4; l++) {
+		out[l].resize(sizes[l] + 16);
+		lanes[l] = { nonce[l].data(), data.data(), out[l].data(), sizes[l] };
+	}
+
+	krypto::internal::aegis::seal_lanes<krypto::internal::aegis::state_256>(key_256.data(), lanes, 3);
+	for (size_t l = 0; l < 3; l++) {
+		ASSERT_EQ(out[l], aegis_256.seal(nonce[l], krypto::const_byte_view<>(data.data(), sizes[l])));
+	}
+
+}
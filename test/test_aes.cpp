@@ -2,6 +2,8 @@
 #include "krypto/aes.h"
 
 #include <array>
+#include <thread>
+#include <vector>
 
 class AesTest : public ::testing::Test {
 
@@ -162,6 +164,39 @@ TEST_F(AesTest, EncryptDecrypt_CBC_256_16BIT_NOPADDING) {
 }
 
 
+TEST_F(AesTest, Ctr_TestVector) {
+
+	// SP 800-38A F.5.1, first two blocks
+	std::array<unsigned char, 16> key = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+	std::array<unsigned char, 16> counter = { 0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff };
+	std::array<unsigned char, 32> plain = {	0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+											0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51 };
+	std::array<unsigned char, 32> cipher = {	0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce,
+												0x98, 0x06, 0xf6, 0x6b, 0x79, 0x70, 0xfd, 0xff, 0x86, 0x17, 0x18, 0x7b, 0xb9, 0xff, 0xfd, 0xff };
+
+	const krypto::internal::key_schedule<128> ks(key);
+	std::array<unsigned char, 32> out;
+	krypto::internal::ctr_xor(plain.data(), out.data(), out.size(), ks, krypto::internal::ctr_stream(counter.data(), false), 0);
+
+	ASSERT_EQ(out, cipher);
+
+}
+
+TEST_F(AesTest, EncryptDecrypt_CTR_194_16BIT_NOPADDING) {
+
+	krypto::aes<194, krypto::modes::ctr, krypto::pad::pkcs7> aes(key_194);
+	auto out = aes.encrypt(plain_text);
+
+	krypto::aes<194, krypto::modes::ctr, krypto::pad::pkcs7> aes2(key_194);
+	auto out2 = aes2.decrypt(out);
+
+	ASSERT_EQ(out2.size(), plain_text.size());
+	for (int i = 0; i < out2.size(); i++) {
+		ASSERT_EQ(out2[i], plain_text[i]);
+	}
+
+}
+
 TEST_F(AesTest, EncryptDecrypt_ECB_ALL_1_to_256_BIT) {
 
 	krypto::aes<128, krypto::modes::ecb, krypto::pad::ansix923> aes_128(key_128);
@@ -258,13 +293,30 @@ TEST_F(AesTest, EncryptDecrypt_CBC_ALL_1_to_256_BIT) {
 
 }
 
+TEST_F(AesTest, SharedAcrossThreads) {
 
+	// One const object used by all threads, and a copy sharing its schedule
+	const krypto::aes<256, krypto::modes::cbc, krypto::pad::pkcs7> aes(key_256);
+	const auto copy = aes;
 
+	std::vector<std::thread> threads;
+	std::vector<int> ok(4);
 
+	for (size_t t = 0; t < ok.size(); t++) {
+		threads.emplace_back([&, t] {
+			const auto& local = t % 2 ? copy : aes;
+			int good = 1;
+			for (size_t i = 1; i <= 200; i++) {
+				std::vector<unsigned char> data(i * 7, static_cast<unsigned char>(t + i));
+				good &= local.decrypt(local.encrypt(data)) == data;
+			}
+			ok[t] = good;
+		});
+	}
 
+	for (auto& t : threads)
+		t.join();
 
+	ASSERT_EQ(ok, std::vector<int>(ok.size(), 1));
 
-
-
-
-
+}
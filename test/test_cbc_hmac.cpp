@@ -0,0 +1,97 @@
+#include "gtest/gtest.h"
+#include "krypto/cbc_hmac.h"
+
+#include <array>
+#include <vector>
+
+class CbcHmacTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+	}
+
+	std::array<unsigned char, 16> key_128 = {	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+	std::array<unsigned char, 32> key_256 = {	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+												0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f };
+	std::array<unsigned char, 32> mac_key = {	0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
+												0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf };
+	std::array<unsigned char, 16> iv = {		0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff };
+
+};
+
+TEST_F(CbcHmacTest, Seal_MatchesSeparatePasses) {
+
+	krypto::cbc_hmac_sha256<128> cipher(key_128, mac_key);
+	const krypto::internal::key_schedule<128> ks(key_128);
+
+	// Cover sizes below, at and above the stitched 4 block groups
+	for (size_t size : { 0, 15, 16, 47, 64, 100, 255, 1000 }) {
+		std::vector<unsigned char> data(size, 0x5a);
+		const auto out = cipher.seal(iv, data);
+
+		const size_t padded = (size / 16 + 1) * 16;
+		ASSERT_EQ(out.size(), padded + 32);
+
+		// CBC with PKCS#7 padding block by block
+		std::vector<unsigned char> expected(data);
+		expected.resize(padded, static_cast<unsigned char>(padded - size));
+
+		auto prev = krypto::internal::block_load(iv.data());
+		for (size_t i = 0; i < padded; i += 16) {
+			krypto::internal::block b[1] = { krypto::internal::block_xor(krypto::internal::block_load(&expected[i]), prev) };
+			krypto::internal::encrypt_blocks(b, ks);
+			krypto::internal::block_store(&expected[i], b[0]);
+			prev = b[0];
+		}
+
+		// Tag over cipher text followed by IV
+		krypto::hmac_sha256 mac(mac_key);
+		mac.update(expected);
+		mac.update(iv);
+		const auto tag = mac.digest();
+		expected.insert(expected.end(), tag.begin(), tag.end());
+
+		ASSERT_EQ(out, expected);
+	}
+
+}
+
+TEST_F(CbcHmacTest, EncryptDecrypt) {
+
+	krypto::cbc_hmac_sha256<256> cipher(key_256, mac_key);
+
+	for (size_t size : { 0, 1, 16, 63, 64, 65, 4096 }) {
+		std::vector<unsigned char> data(size);
+		for (size_t i = 0; i < size; i++)
+			data[i] = static_cast<unsigned char>(i * 3);
+
+		const auto cipher_text = cipher.encrypt(data);
+		const auto plain_text = cipher.decrypt(cipher_text);
+
+		ASSERT_TRUE(plain_text.has_value());
+		ASSERT_EQ(*plain_text, data);
+	}
+
+}
+
+TEST_F(CbcHmacTest, Decrypt_RejectsTampering) {
+
+	krypto::cbc_hmac_sha256<128, krypto::pad::ansix923> cipher(key_128, mac_key);
+
+	std::vector<unsigned char> data(100, 7);
+	const auto cipher_text = cipher.encrypt(data);
+
+	// Cipher text, tag and IV are all authenticated
+	for (size_t i : { size_t(0), size_t(111), size_t(112), cipher_text.size() - 1 }) {
+		auto tampered = cipher_text;
+		tampered[i] ^= 1;
+		ASSERT_FALSE(cipher.decrypt(tampered).has_value());
+	}
+
+	ASSERT_FALSE(cipher.decrypt(krypto::const_byte_view<>(cipher_text.data(), 40)).has_value());
+
+	krypto::cbc_hmac_sha256<128, krypto::pad::ansix923> other(key_128, key_256);
+	ASSERT_FALSE(other.decrypt(cipher_text).has_value());
+
+}
@@ -0,0 +1,193 @@
+#include "gtest/gtest.h"
+#include "krypto/chunk_cache.h"
+#include "krypto/gcm.h"
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <utility>
+#include <vector>
+
+class ChunkCacheTest : public ::testing::Test {
+
+protected:
+
+	static constexpr size_t CHUNK_SIZE = 1024;
+
+	void SetUp() override {
+		plain_text.resize(10 * CHUNK_SIZE + 100);
+		for (size_t i = 0; i < plain_text.size(); i++)
+			plain_text[i] = static_cast<unsigned char>(i * 13);
+
+		for (size_t i = 0; i * CHUNK_SIZE < plain_text.size(); i++) {
+			const size_t n = std::min(CHUNK_SIZE, plain_text.size() - i * CHUNK_SIZE);
+			chunks.push_back(gcm.seal(nonce(i), krypto::const_byte_view<>(plain_text).subspan(i * CHUNK_SIZE, n)));
+		}
+	}
+
+	static std::array<unsigned char, 12> nonce(uint64_t index) {
+		std::array<unsigned char, 12> n{};
+		for (size_t i = 0; i < 8; i++)
+			n[i] = static_cast<unsigned char>(index >> (i * 8));
+		return n;
+	}
+
+	/**
+	 * Decrypts chunks of file 1 and counts the calls
+	 */
+	auto decryptor() {
+		return [this](uint64_t file, uint64_t index, krypto::byte_view<> out) -> std::optional<size_t> {
+			calls++;
+			if (file != 1 || index >= chunks.size())
+				return 0;
+
+			const auto chunk = gcm.open(nonce(index), chunks[index]);
+			if (!chunk)
+				return std::nullopt;
+
+			std::copy(chunk->begin(), chunk->end(), out.begin());
+			return chunk->size();
+		};
+	}
+
+	krypto::gcm<128> gcm = krypto::gcm<128>(std::array<unsigned char, 16>{ 1, 2, 3 });
+
+	krypto::byte_array plain_text;
+	std::vector<krypto::byte_array> chunks;
+	std::atomic<size_t> calls = 0;
+
+};
+
+TEST_F(ChunkCacheTest, Get_Hits) {
+
+	krypto::chunk_cache cache(decryptor(), 1 << 20, CHUNK_SIZE, 0);
+
+	const auto a = cache.get(1, 3);
+	const auto b = cache.get(1, 3);
+
+	ASSERT_TRUE(a);
+	ASSERT_EQ(a, b);
+	ASSERT_TRUE(std::equal(a->begin(), a->end(), plain_text.begin() + 3 * CHUNK_SIZE));
+	ASSERT_EQ(calls, 1);
+	ASSERT_EQ(cache.hits(), 1);
+	ASSERT_EQ(cache.misses(), 1);
+	ASSERT_EQ(cache.size(), CHUNK_SIZE);
+
+	ASSERT_EQ(cache.get(1, 10)->size(), 100);
+	ASSERT_TRUE(cache.get(1, 11)->empty());
+
+}
+
+TEST_F(ChunkCacheTest, Get_FailedDecryption) {
+
+	chunks[2][5] ^= 1;
+	krypto::chunk_cache cache(decryptor(), 1 << 20, CHUNK_SIZE, 0);
+
+	ASSERT_FALSE(cache.get(1, 2));
+	ASSERT_EQ(cache.size(), 0);
+
+}
+
+TEST_F(ChunkCacheTest, Read) {
+
+	krypto::chunk_cache cache(decryptor(), 1 << 20, CHUNK_SIZE, 0);
+
+	// Across chunk boundaries and past the end of the file
+	std::vector<unsigned char> out(3000);
+	ASSERT_EQ(cache.read(1, 500, out), out.size());
+	ASSERT_TRUE(std::equal(out.begin(), out.end(), plain_text.begin() + 500));
+
+	ASSERT_EQ(cache.read(1, plain_text.size() - 50, out), 50);
+	ASSERT_TRUE(std::equal(out.begin(), out.begin() + 50, plain_text.end() - 50));
+
+	ASSERT_EQ(cache.read(1, plain_text.size() + 10, out), 0);
+
+}
+
+TEST_F(ChunkCacheTest, Budget_Evicts) {
+
+	// 4 chunks in a single shard
+	krypto::chunk_cache cache(decryptor(), 4 * CHUNK_SIZE, CHUNK_SIZE, 0, 1);
+
+	for (uint64_t i = 0; i < 10; i++) {
+		const auto chunk = cache.get(1, i);
+		ASSERT_TRUE(std::equal(chunk->begin(), chunk->end(), plain_text.begin() + i * CHUNK_SIZE));
+		ASSERT_LE(cache.size(), 4 * CHUNK_SIZE);
+	}
+
+	// Evicted chunks stay valid while held
+	const auto held = cache.get(1, 0);
+	for (uint64_t i = 1; i < 10; i++)
+		cache.get(1, i);
+	ASSERT_TRUE(std::equal(held->begin(), held->end(), plain_text.begin()));
+
+	cache.invalidate(1);
+	ASSERT_EQ(cache.size(), 0);
+
+}
+
+TEST_F(ChunkCacheTest, Budget_SmallerThanShards) {
+
+	// Less than a chunk per default shard, still cached in fewer shards
+	krypto::chunk_cache cache(decryptor(), 4 * CHUNK_SIZE, CHUNK_SIZE, 0);
+
+	cache.get(1, 0);
+	cache.get(1, 0);
+	ASSERT_EQ(calls, 1);
+	ASSERT_EQ(cache.size(), CHUNK_SIZE);
+
+	krypto::chunk_cache none(decryptor(), 1 << 20, CHUNK_SIZE, 0, 0);
+	none.get(1, 0);
+	ASSERT_EQ(none.size(), CHUNK_SIZE);
+
+}
+
+TEST_F(ChunkCacheTest, Invalidate_DuringDecryption) {
+
+	// The file is rewritten and invalidated while its old version is decrypted
+	std::function<void()> rewritten;
+	auto decrypt = [&, inner = decryptor()](uint64_t file, uint64_t index, krypto::byte_view<> out) {
+		const auto size = inner(file, index, out);
+		if (rewritten)
+			std::exchange(rewritten, nullptr)();
+		return size;
+	};
+
+	krypto::chunk_cache cache(decrypt, 1 << 20, CHUNK_SIZE, 0);
+	rewritten = [&] { cache.invalidate(1); };
+
+	// Returned to the reader, but not cached
+	ASSERT_TRUE(cache.get(1, 2));
+	ASSERT_EQ(cache.size(), 0);
+
+	cache.get(1, 2);
+	cache.get(1, 2);
+	ASSERT_EQ(calls, 2);
+	ASSERT_EQ(cache.size(), CHUNK_SIZE);
+
+	rewritten = [&] { cache.clear(); };
+	ASSERT_TRUE(cache.get(1, 3));
+	ASSERT_EQ(cache.size(), 0);
+
+}
+
+TEST_F(ChunkCacheTest, Readahead) {
+
+	krypto::chunk_cache cache(decryptor(), 1 << 20, CHUNK_SIZE, 4);
+
+	cache.get(1, 0);
+	ASSERT_EQ(calls, 1);
+
+	// Chunk 0 is cached, so 1 is read sequentially along with 2 to 5
+	cache.get(1, 1);
+	ASSERT_EQ(calls, 6);
+
+	for (uint64_t i = 2; i <= 5; i++)
+		cache.get(1, i);
+	ASSERT_EQ(calls, 6);
+	ASSERT_EQ(cache.hits(), 4);
+
+	cache.clear();
+	ASSERT_EQ(cache.size(), 0);
+
+}
@@ -0,0 +1,160 @@
+#include "gtest/gtest.h"
+#include "krypto/dedup.h"
+
+#include <array>
+#include <vector>
+#include <set>
+#include <random>
+
+class DedupTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+		std::mt19937_64 rng(42);
+		for (auto& b : data)
+			b = static_cast<unsigned char>(rng());
+	}
+
+	/**
+	 * FastCDC written as one serial loop over the whole input
+	 */
+	static std::vector<size_t> reference_split(const krypto::byte_array& in, size_t avg) {
+		const size_t min = avg / 4;
+		const size_t max = avg * 8;
+		const int bits = std::countr_zero(avg);
+		const uint64_t mask_s = ~uint64_t(0) << (64 - (bits + 2));
+		const uint64_t mask_l = ~uint64_t(0) << (64 - (bits - 2));
+
+		std::vector<size_t> ends;
+		size_t start = 0;
+		while (start < in.size()) {
+			size_t end = std::min(start + max, in.size());
+			if (in.size() - start > min) {
+				for (size_t i = start + min - 1; i < end; i++) {
+					// Hash of the 64 bytes ending at i
+					uint64_t h = 0;
+					for (size_t j = i >= 63 ? i - 63 : 0; j <= i; j++)
+						h = (h << 1) + krypto::internal::cdc::GEAR[in[j]];
+
+					const uint64_t mask = i + 1 < start + avg ? mask_s : mask_l;
+					if ((h & mask) == 0 && i + 1 >= start + min) {
+						end = i + 1;
+						break;
+					}
+				}
+			}
+			else {
+				end = in.size();
+			}
+			ends.push_back(end);
+			start = end;
+		}
+		return ends;
+	}
+
+	std::array<unsigned char, 32> secret = { 0x73, 0x65, 0x63, 0x72, 0x65, 0x74 };
+
+	// Several scan segments
+	krypto::byte_array data = krypto::byte_array(3 * (1 << 20) + 12345);
+
+};
+
+TEST_F(DedupTest, Split_MatchesReference) {
+
+	for (size_t avg : { 1024, 8192 }) {
+		krypto::fastcdc cdc(avg);
+
+		const auto ends = cdc.split(data);
+		ASSERT_EQ(ends, reference_split(data, avg));
+
+		for (size_t i = 0; i + 1 < ends.size(); i++) {
+			const size_t size = ends[i] - (i == 0 ? 0 : ends[i - 1]);
+			ASSERT_GE(size, cdc.min_size());
+			ASSERT_LE(size, cdc.max_size());
+		}
+		ASSERT_EQ(ends.back(), data.size());
+	}
+
+	krypto::fastcdc cdc;
+	ASSERT_TRUE(cdc.split(krypto::byte_array()).empty());
+	ASSERT_EQ(cdc.split(krypto::byte_array(100)), std::vector<size_t>{ 100 });
+
+}
+
+TEST_F(DedupTest, Split_ResistsShift) {
+
+	krypto::fastcdc cdc;
+
+	auto shifted = data;
+	shifted.insert(shifted.begin() + 1000, { 1, 2, 3, 4, 5 });
+
+	const auto a = cdc.split(data);
+	const auto b = cdc.split(shifted);
+
+	// All boundaries after the insert move by its length
+	std::set<size_t> moved;
+	for (size_t end : b)
+		moved.insert(end - 5);
+
+	size_t same = 0;
+	for (size_t end : a)
+		same += moved.count(end);
+
+	ASSERT_GE(same + 2, a.size());
+
+}
+
+TEST_F(DedupTest, Encrypt_Deduplicates) {
+
+	krypto::dedup<256> client_a(secret);
+	krypto::dedup<256> client_b(secret);
+
+	auto shifted = data;
+	shifted.insert(shifted.begin(), { 1, 2, 3 });
+
+	const auto chunks_a = client_a.encrypt(data);
+	const auto chunks_b = client_b.encrypt(shifted);
+
+	std::set<krypto::dedup<256>::id_type> ids;
+	for (const auto& c : chunks_a)
+		ids.insert(c.id);
+
+	size_t shared = 0;
+	for (const auto& c : chunks_b)
+		shared += ids.count(c.id);
+
+	ASSERT_GE(shared + 2, chunks_a.size());
+
+	// Another secret gives other ids
+	auto other = secret;
+	other[0] ^= 1;
+	krypto::dedup<256> client_c(other);
+	ASSERT_NE(client_c.encrypt_chunk(data).id, client_a.encrypt_chunk(data).id);
+
+}
+
+TEST_F(DedupTest, EncryptDecrypt) {
+
+	krypto::dedup<128> client(secret, krypto::fastcdc(4096));
+
+	const auto chunks = client.encrypt(data);
+
+	size_t offset = 0;
+	for (const auto& c : chunks) {
+		ASSERT_EQ(c.offset, offset);
+
+		const auto plain_text = client.decrypt(c.key, c.cipher_text);
+		ASSERT_TRUE(plain_text.has_value());
+		ASSERT_TRUE(std::equal(plain_text->begin(), plain_text->end(), data.begin() + offset));
+		ASSERT_NE(c.cipher_text, *plain_text);
+
+		offset += c.cipher_text.size();
+	}
+	ASSERT_EQ(offset, data.size());
+
+	auto tampered = chunks[0].cipher_text;
+	tampered[10] ^= 1;
+	ASSERT_FALSE(client.decrypt(chunks[0].key, tampered).has_value());
+
+}
@@ -0,0 +1,110 @@
+#include "gtest/gtest.h"
+#include "krypto/dispatch.h"
+#include "krypto/internal/kernels.h"
+
+#include <array>
+#include <string>
+#include <vector>
+
+class DispatchTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+		saved = krypto::get_dispatch_policy();
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = static_cast<unsigned char>(i * 13 + 1);
+	}
+
+	void TearDown() override {
+		krypto::set_dispatch_policy(saved);
+	}
+
+	/**
+	 * ctr_xor under every width against the 128 bit kernel
+	 */
+	template <size_t Size>
+	void check(const std::array<unsigned char, 16>& iv, bool inc32) {
+		const std::array<unsigned char, Size / 8> key = { 0x2b, 0x7e, 0x15, 0x16 };
+		const krypto::internal::key_schedule<Size> ks(key);
+		const krypto::internal::ctr_stream ctr(iv.data(), inc32);
+
+		const krypto::dispatch_policy policies[] = { { SIZE_MAX, SIZE_MAX }, { 0, SIZE_MAX }, { 0, 0 } };
+
+		for (const size_t size : { 0, 15, 16, 255, 256, 511, 512, 1000, 2048, 4099 }) {
+			for (const uint64_t index : { 0, 3, 1000 }) {
+				std::vector<unsigned char> expected(size);
+				krypto::internal::ctr_xor_128(data.data(), expected.data(), size, ks, ctr, index);
+
+				for (const auto& p : policies) {
+					krypto::set_dispatch_policy(p);
+
+					std::vector<unsigned char> out(size);
+					krypto::internal::ctr_xor(data.data(), out.data(), size, ks, ctr, index);
+					ASSERT_EQ(out, expected) << size << " " << index << " " << p.vaes256 << " " << p.vaes512;
+
+					// In place
+					out.assign(data.begin(), data.begin() + size);
+					krypto::internal::ctr_xor(out.data(), out.data(), size, ks, ctr, index);
+					ASSERT_EQ(out, expected);
+				}
+			}
+		}
+	}
+
+	krypto::dispatch_policy saved;
+	std::array<unsigned char, 4099> data;
+
+};
+
+TEST_F(DispatchTest, Policy) {
+
+	krypto::set_dispatch_policy({ 1024, 8192 });
+	const auto p = krypto::get_dispatch_policy();
+	ASSERT_EQ(p.vaes256, 1024);
+	ASSERT_EQ(p.vaes512, 8192);
+
+}
+
+TEST_F(DispatchTest, AllWidths_MatchNarrow) {
+
+	check<128>({ 0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff }, false);
+	check<194>({ 1, 2, 3 }, true);
+	check<256>({ 9 }, false);
+
+}
+
+TEST_F(DispatchTest, AllWidths_CounterCarry) {
+
+	// Low 64 bits about to carry into the high word
+	check<128>({ 0, 0, 0, 0, 0, 0, 0, 1, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xf0 }, false);
+	// Low 32 bits about to wrap, as in GCM
+	check<128>({ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 7, 0xff, 0xff, 0xff, 0xf0 }, true);
+
+}
+
+TEST_F(DispatchTest, Backend) {
+
+#if defined(KRYPTO_VAES512)
+	ASSERT_EQ(std::string(krypto::backend()), "vaes512");
+#elif defined(KRYPTO_VAES256)
+	ASSERT_EQ(std::string(krypto::backend()), "vaes256");
+#elif defined(KRYPTO_RUNTIME_VAES)
+	// Kernels of the compiled library the CPU supports
+	const std::string runtime = krypto::internal::isa::vaes512() ? "vaes512" : krypto::internal::isa::vaes256() ? "vaes256" : "aesni";
+	ASSERT_EQ(std::string(krypto::backend()), runtime);
+#elif defined(KRYPTO_AESNI)
+	ASSERT_EQ(std::string(krypto::backend()), "aesni");
+#else
+	ASSERT_EQ(std::string(krypto::backend()), "table");
+#endif
+
+#if defined(KRYPTO_BACKEND_TABLE)
+	ASSERT_EQ(std::string(krypto::backend()), "table");
+#elif defined(KRYPTO_BACKEND_AESNI)
+	ASSERT_EQ(std::string(krypto::backend()), "aesni");
+#elif defined(KRYPTO_BACKEND_VAES)
+	ASSERT_NE(std::string(krypto::backend()).find("vaes"), std::string::npos);
+#endif
+
+}
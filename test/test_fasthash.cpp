@@ -0,0 +1,112 @@
+#include "gtest/gtest.h"
+#include "krypto/fasthash.h"
+
+#include <array>
+#include <vector>
+#include <set>
+#include <string>
+#include <cstdio>
+#include <fstream>
+
+class FastHashTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+		data.resize(1000);
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = static_cast<unsigned char>(i * 7 + 3);
+	}
+
+	std::vector<unsigned char> data;
+
+};
+
+TEST_F(FastHashTest, Hash_IsDeterministic) {
+
+	ASSERT_EQ(krypto::fast_hash::hash(data), krypto::fast_hash::hash(data));
+	ASSERT_NE(krypto::fast_hash::hash(data, 1), krypto::fast_hash::hash(data, 2));
+
+}
+
+TEST_F(FastHashTest, KnownAnswers) {
+
+	// Digests are stored as checksums, the table and AES-NI rounds must keep giving these
+	struct vector {
+		size_t size;
+		uint64_t seed;
+		krypto::block128 digest;
+	};
+
+	const std::vector<vector> vectors = {
+		{ 0, 0, { 0x5c, 0x17, 0x99, 0xec, 0x27, 0x19, 0x06, 0x1f, 0x8f, 0x42, 0x53, 0xbb, 0x78, 0xfa, 0x45, 0xc7 } },
+		{ 1, 0, { 0x92, 0x06, 0xb0, 0xa5, 0x1a, 0x9c, 0x16, 0x91, 0x56, 0x29, 0xb0, 0x4d, 0x89, 0x08, 0xa6, 0xe5 } },
+		{ 64, 0, { 0x85, 0xc8, 0xd4, 0x4d, 0x0b, 0xf0, 0xe6, 0x7b, 0x42, 0xda, 0x24, 0xea, 0xf6, 0x62, 0xf3, 0x41 } },
+		{ 1000, 0, { 0x86, 0x64, 0x8c, 0x96, 0x72, 0x84, 0x8e, 0xb3, 0x7d, 0xb1, 0x9a, 0xb3, 0x02, 0x8d, 0x1b, 0xd5 } },
+		{ 0, 0x0123456789abcdef, { 0x28, 0xc5, 0x25, 0xb5, 0xe4, 0x1b, 0xce, 0xac, 0x7b, 0x9b, 0xfb, 0xe2, 0x5e, 0xb1, 0x62, 0xb9 } },
+		{ 1, 0x0123456789abcdef, { 0xb4, 0x9c, 0x73, 0xe1, 0x69, 0xb5, 0x5b, 0x3a, 0x72, 0xbb, 0x01, 0x2d, 0xfd, 0x9a, 0x1a, 0x07 } },
+		{ 64, 0x0123456789abcdef, { 0xfd, 0x28, 0x8e, 0x4e, 0x4a, 0x15, 0x80, 0x39, 0xa1, 0x22, 0xe4, 0x27, 0x05, 0x77, 0x74, 0xbe } },
+		{ 1000, 0x0123456789abcdef, { 0x28, 0x9f, 0x6a, 0xde, 0x7f, 0xad, 0x73, 0x08, 0x97, 0x97, 0xac, 0x02, 0x18, 0x06, 0x04, 0xe4 } },
+	};
+
+	for (const auto& v : vectors)
+		ASSERT_EQ(krypto::fast_hash::hash(krypto::const_byte_view<>(data.data(), v.size), v.seed), v.digest) << v.size << " " << v.seed;
+
+}
+
+TEST_F(FastHashTest, Update_MatchesOneShot) {
+
+	const auto expected = krypto::fast_hash::hash(data);
+
+	// Split at every offset to cover the partial stripe buffer
+	for (size_t split : { 0, 1, 15, 63, 64, 65, 127, 128, 500, 999, 1000 }) {
+		krypto::fast_hash h;
+		h.update(krypto::const_byte_view<>(data.data(), split));
+		h.update(krypto::const_byte_view<>(data.data() + split, data.size() - split));
+		ASSERT_EQ(h.digest(), expected);
+	}
+
+	krypto::fast_hash h;
+	for (auto c : data)
+		h.update(krypto::const_byte_view<>(&c, 1));
+	ASSERT_EQ(h.digest(), expected);
+
+}
+
+TEST_F(FastHashTest, Hash_SeparatesLengthsAndBits) {
+
+	std::set<krypto::block128> seen;
+
+	// Zero filled inputs only differ in length
+	std::vector<unsigned char> zeros(200);
+	for (size_t n = 0; n <= zeros.size(); n++)
+		ASSERT_TRUE(seen.insert(krypto::fast_hash::hash(krypto::const_byte_view<>(zeros.data(), n))).second);
+
+	for (size_t bit = 0; bit < data.size() * 8; bit += 13) {
+		auto flipped = data;
+		flipped[bit / 8] ^= 1 << (bit % 8);
+		ASSERT_TRUE(seen.insert(krypto::fast_hash::hash(flipped)).second);
+	}
+
+}
+
+TEST_F(FastHashTest, HashFile_MatchesHash) {
+
+	const std::string path = testing::TempDir() + "krypto_fasthash_test.bin";
+
+	{
+		std::ofstream file(path, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	}
+
+	const auto res = krypto::hash_file(path, 5);
+	ASSERT_TRUE(res.has_value());
+	ASSERT_EQ(*res, krypto::fast_hash::hash(data, 5));
+
+	std::ofstream(path, std::ios::binary | std::ios::trunc).close();
+	ASSERT_EQ(krypto::hash_file(path), krypto::fast_hash::hash({}));
+
+	std::remove(path.c_str());
+	ASSERT_FALSE(krypto::hash_file(path).has_value());
+
+}
@@ -0,0 +1,110 @@
+#include "gtest/gtest.h"
+#include "krypto/file_engine.h"
+
+#include <array>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+class FileEngineTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+		std::mt19937_64 rng(3);
+		for (auto& b : data)
+			b = static_cast<unsigned char>(rng());
+		write(path_in, data);
+	}
+
+	void TearDown() override {
+		std::remove(path_in.c_str());
+		std::remove(path_out.c_str());
+	}
+
+	static void write(const std::string& path, const krypto::byte_array& content) {
+		std::ofstream f(path, std::ios::binary | std::ios::trunc);
+		f.write(reinterpret_cast<const char*>(content.data()), content.size());
+	}
+
+	static krypto::byte_array read(const std::string& path) {
+		std::ifstream f(path, std::ios::binary);
+		return krypto::byte_array(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	}
+
+	static krypto::byte_array ctr(const krypto::byte_array& in, const std::array<unsigned char, 32>& key, const std::array<unsigned char, 16>& iv) {
+		krypto::byte_array out(in.size());
+		const krypto::internal::key_schedule<256> ks(key);
+		krypto::internal::ctr_xor(in.data(), out.data(), in.size(), ks, krypto::internal::ctr_stream(iv.data(), false), 0);
+		return out;
+	}
+
+	std::string path_in = "krypto_file_engine_in.bin";
+	std::string path_out = "krypto_file_engine_out.bin";
+
+	// Not a multiple of the buffer size or the alignment
+	krypto::byte_array data = krypto::byte_array((1 << 20) + 12345);
+
+	std::array<unsigned char, 32> key_a = { 1 };
+	std::array<unsigned char, 32> key_b = { 2 };
+	std::array<unsigned char, 16> iv_a = { 3 };
+	std::array<unsigned char, 16> iv_b = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xf0 };
+
+};
+
+TEST_F(FileEngineTest, Ctr) {
+
+	// Small buffers, several in flight
+	krypto::file_engine<256> engine(64 * 1024, 3);
+
+	ASSERT_EQ(engine.ctr(path_in, path_out, key_a, iv_a), data.size());
+	ASSERT_EQ(read(path_out), ctr(data, key_a, iv_a));
+
+	// Back in place
+	ASSERT_EQ(engine.ctr(path_out, path_out, key_a, iv_a), data.size());
+	ASSERT_EQ(read(path_out), data);
+
+}
+
+TEST_F(FileEngineTest, Ctr_AliasedPath) {
+
+	krypto::file_engine<256> engine(64 * 1024, 3);
+
+	// The same file under another name is encrypted in place, not truncated first
+	ASSERT_EQ(engine.ctr(path_in, "./" + path_in, key_a, iv_a), data.size());
+	ASSERT_EQ(read(path_in), ctr(data, key_a, iv_a));
+
+	std::filesystem::create_symlink(path_in, path_out);
+	ASSERT_EQ(engine.ctr(path_out, path_in, key_a, iv_a), data.size());
+	ASSERT_EQ(read(path_in), data);
+	std::remove(path_out.c_str());
+
+	std::filesystem::create_hard_link(path_in, path_out);
+	ASSERT_EQ(engine.rekey(path_in, path_out, key_a, iv_a, key_b, iv_b), data.size());
+	ASSERT_EQ(read(path_in), ctr(ctr(data, key_a, iv_a), key_b, iv_b));
+
+}
+
+TEST_F(FileEngineTest, Rekey) {
+
+	krypto::file_engine<256> engine(64 * 1024, 2);
+
+	write(path_out, ctr(data, key_a, iv_a));
+	ASSERT_EQ(engine.rekey(path_out, path_out, key_a, iv_a, key_b, iv_b), data.size());
+	ASSERT_EQ(read(path_out), ctr(data, key_b, iv_b));
+
+}
+
+TEST_F(FileEngineTest, Errors) {
+
+	krypto::file_engine<256> engine;
+
+	ASSERT_FALSE(engine.ctr("krypto_file_engine_missing.bin", path_out, key_a, iv_a));
+
+	write(path_in, {});
+	ASSERT_EQ(engine.ctr(path_in, path_out, key_a, iv_a), 0);
+	ASSERT_TRUE(read(path_out).empty());
+
+}
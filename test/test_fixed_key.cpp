@@ -0,0 +1,127 @@
+#include "gtest/gtest.h"
+#include "krypto/fixed_key.h"
+
+#include <array>
+#include <vector>
+
+class FixedKeyTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+		// Not a multiple of the kernel width, covers the tail
+		data.resize(37);
+		for (auto& b : data) {
+			for (auto& c : b) {
+				c = rand() % 256;
+			}
+		}
+	}
+
+	// Reference permutation using the single block AES
+	krypto::block128 pi(krypto::block128 x, const std::array<unsigned char, 16>& key) {
+		const auto expanded = krypto::internal::aes::expand_key<128>(key);
+		krypto::internal::aes::encrypt<176>(x, expanded);
+		return x;
+	}
+
+	krypto::block128 xor_block(krypto::block128 x, const krypto::block128& y) {
+		for (size_t i = 0; i < 16; i++) {
+			x[i] ^= y[i];
+		}
+		return x;
+	}
+
+	std::array<unsigned char, 16> key_128 = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+
+	std::vector<krypto::block128> data;
+
+};
+
+TEST_F(FixedKeyTest, Permute_MatchesAes) {
+
+	krypto::fixed_key_aes aes(key_128);
+
+	auto out = data;
+	aes.permute(out);
+
+	for (size_t i = 0; i < data.size(); i++) {
+		ASSERT_EQ(out[i], pi(data[i], key_128));
+	}
+
+}
+
+TEST_F(FixedKeyTest, Hash_IsPermutationXorInput) {
+
+	krypto::fixed_key_aes aes;
+
+	auto out = data;
+	aes.hash(out);
+
+	for (size_t i = 0; i < data.size(); i++) {
+		ASSERT_EQ(out[i], xor_block(pi(data[i], krypto::fixed_key_aes::DEFAULT_KEY), data[i]));
+	}
+
+}
+
+TEST_F(FixedKeyTest, CcrHash_AppliesSigma) {
+
+	krypto::fixed_key_aes aes(key_128);
+
+	auto out = data;
+	aes.ccr_hash(out);
+
+	for (size_t i = 0; i < data.size(); i++) {
+		krypto::block128 s;
+		for (size_t k = 0; k < 8; k++) {
+			s[k] = data[i][8 + k];
+			s[8 + k] = data[i][k] ^ data[i][8 + k];
+		}
+		ASSERT_EQ(out[i], xor_block(pi(s, key_128), s));
+	}
+
+}
+
+TEST_F(FixedKeyTest, TccrHash_UsesIndexAsTweak) {
+
+	krypto::fixed_key_aes aes(key_128);
+
+	auto out = data;
+	aes.tccr_hash(out, 1000);
+
+	for (size_t i = 0; i < data.size(); i++) {
+		krypto::block128 tweak{};
+		const uint64_t t = 1000 + i;
+		std::memcpy(tweak.data(), &t, 8);
+
+		const auto p = pi(data[i], key_128);
+		ASSERT_EQ(out[i], xor_block(pi(xor_block(p, tweak), key_128), p));
+	}
+
+}
+
+TEST_F(FixedKeyTest, Prg_IsCounterMode) {
+
+	krypto::prg prg(key_128, 5);
+
+	std::vector<krypto::block128> out(data.size());
+	prg.generate(out);
+	ASSERT_EQ(prg.position(), 5 + out.size());
+
+	for (size_t i = 0; i < out.size(); i++) {
+		krypto::block128 ctr{};
+		const uint64_t c = 5 + i;
+		std::memcpy(ctr.data(), &c, 8);
+		ASSERT_EQ(out[i], pi(ctr, key_128));
+	}
+
+	// Byte output continues the same stream
+	krypto::prg bytes(key_128, 5);
+	std::vector<unsigned char> raw(out.size() * 16 - 3);
+	bytes.generate(std::span<unsigned char>(raw));
+
+	for (size_t i = 0; i < raw.size(); i++) {
+		ASSERT_EQ(raw[i], out[i / 16][i % 16]);
+	}
+
+}
@@ -0,0 +1,163 @@
+#include "gtest/gtest.h"
+#include "krypto/gcm.h"
+#include "krypto/parallel.h"
+
+#include <array>
+#include <vector>
+
+class GcmTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+	}
+
+	/**
+	 * Test vectors from the GCM specification, test cases 2, 3, 4 and 14
+	 */
+
+	std::array<unsigned char, 16> key_zero_128 = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	std::array<unsigned char, 32> key_zero_256 = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+													0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	std::array<unsigned char, 12> nonce_zero = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	std::array<unsigned char, 16> block_zero = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	std::array<unsigned char, 16> cipher_2 = { 0x03, 0x88, 0xda, 0xce, 0x60, 0xb6, 0xa3, 0x92, 0xf3, 0x28, 0xc2, 0xb9, 0x71, 0xb2, 0xfe, 0x78 };
+	std::array<unsigned char, 16> tag_2 = { 0xab, 0x6e, 0x47, 0xd4, 0x2c, 0xec, 0x13, 0xbd, 0xf5, 0x3a, 0x67, 0xb2, 0x12, 0x57, 0xbd, 0xdf };
+	std::array<unsigned char, 16> cipher_14 = { 0xce, 0xa7, 0x40, 0x3d, 0x4d, 0x60, 0x6b, 0x6e, 0x07, 0x4e, 0xc5, 0xd3, 0xba, 0xf3, 0x9d, 0x18 };
+	std::array<unsigned char, 16> tag_14 = { 0xd0, 0xd1, 0xc8, 0xa7, 0x99, 0x99, 0x6b, 0xf0, 0x26, 0x5b, 0x98, 0xb5, 0xd4, 0x8a, 0xb9, 0x19 };
+
+	std::array<unsigned char, 16> key_3 = { 0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c, 0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08 };
+	std::array<unsigned char, 12> nonce_3 = { 0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88 };
+	std::array<unsigned char, 64> plain_3 = { 0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5, 0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+													0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda, 0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+													0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53, 0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+													0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57, 0xba, 0x63, 0x7b, 0x39, 0x1a, 0xaf, 0xd2, 0x55 };
+	std::array<unsigned char, 64> cipher_3 = { 0x42, 0x83, 0x1e, 0xc2, 0x21, 0x77, 0x74, 0x24, 0x4b, 0x72, 0x21, 0xb7, 0x84, 0xd0, 0xd4, 0x9c,
+													0xe3, 0xaa, 0x21, 0x2f, 0x2c, 0x02, 0xa4, 0xe0, 0x35, 0xc1, 0x7e, 0x23, 0x29, 0xac, 0xa1, 0x2e,
+													0x21, 0xd5, 0x14, 0xb2, 0x54, 0x66, 0x93, 0x1c, 0x7d, 0x8f, 0x6a, 0x5a, 0xac, 0x84, 0xaa, 0x05,
+													0x1b, 0xa3, 0x0b, 0x39, 0x6a, 0x0a, 0xac, 0x97, 0x3d, 0x58, 0xe0, 0x91, 0x47, 0x3f, 0x59, 0x85 };
+	std::array<unsigned char, 16> tag_3 = { 0x4d, 0x5c, 0x2a, 0xf3, 0x27, 0xcd, 0x64, 0xa6, 0x2c, 0xf3, 0x5a, 0xbd, 0x2b, 0xa6, 0xfa, 0xb4 };
+	std::array<unsigned char, 20> ad_4 = { 0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef, 0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+													0xab, 0xad, 0xda, 0xd2 };
+	std::array<unsigned char, 16> tag_4 = { 0x5b, 0xc9, 0x4f, 0xbc, 0x32, 0x21, 0xa5, 0xdb, 0x94, 0xfa, 0xe9, 0x5a, 0xe7, 0x12, 0x1a, 0x47 };
+
+};
+
+TEST_F(GcmTest, Seal_TestVectors) {
+
+	krypto::gcm<128> gcm_128(key_zero_128);
+	auto out = gcm_128.seal(nonce_zero, block_zero);
+
+	ASSERT_EQ(std::vector<unsigned char>(out.begin(), out.begin() + 16), std::vector<unsigned char>(cipher_2.begin(), cipher_2.end()));
+	ASSERT_EQ(std::vector<unsigned char>(out.begin() + 16, out.end()), std::vector<unsigned char>(tag_2.begin(), tag_2.end()));
+
+	krypto::gcm<256> gcm_256(key_zero_256);
+	out = gcm_256.seal(nonce_zero, block_zero);
+
+	ASSERT_EQ(std::vector<unsigned char>(out.begin(), out.begin() + 16), std::vector<unsigned char>(cipher_14.begin(), cipher_14.end()));
+	ASSERT_EQ(std::vector<unsigned char>(out.begin() + 16, out.end()), std::vector<unsigned char>(tag_14.begin(), tag_14.end()));
+
+	krypto::gcm<128> gcm_3(key_3);
+	out = gcm_3.seal(nonce_3, plain_3);
+
+	ASSERT_EQ(std::vector<unsigned char>(out.begin(), out.begin() + 64), std::vector<unsigned char>(cipher_3.begin(), cipher_3.end()));
+	ASSERT_EQ(std::vector<unsigned char>(out.begin() + 64, out.end()), std::vector<unsigned char>(tag_3.begin(), tag_3.end()));
+
+	// Test case 4 is test case 3 truncated to 60 bytes with associated data
+	out = gcm_3.seal(nonce_3, krypto::const_byte_view<>(plain_3).first(60), ad_4);
+
+	ASSERT_EQ(std::vector<unsigned char>(out.begin(), out.begin() + 60), std::vector<unsigned char>(cipher_3.begin(), cipher_3.begin() + 60));
+	ASSERT_EQ(std::vector<unsigned char>(out.begin() + 60, out.end()), std::vector<unsigned char>(tag_4.begin(), tag_4.end()));
+
+}
+
+TEST_F(GcmTest, EncryptDecrypt) {
+
+	krypto::gcm<194> gcm(std::array<unsigned char, 24>{ 1, 2, 3 });
+
+	// Cover partial blocks, the 4 block GHASH path and several stripes
+	for (size_t size : { 0, 1, 16, 63, 64, 65, 1000, 5000 }) {
+		std::vector<unsigned char> data(size);
+		for (size_t i = 0; i < size; i++)
+			data[i] = static_cast<unsigned char>(i * 5);
+
+		const auto cipher_text = gcm.encrypt(data, ad_4);
+		ASSERT_EQ(cipher_text.size(), size + krypto::gcm<194>::TAG_SIZE + krypto::gcm<194>::NONCE_SIZE);
+
+		const auto plain_text = gcm.decrypt(cipher_text, ad_4);
+		ASSERT_TRUE(plain_text.has_value());
+		ASSERT_EQ(*plain_text, data);
+	}
+
+}
+
+TEST_F(GcmTest, Decrypt_RejectsTampering) {
+
+	krypto::gcm<128> gcm(key_3);
+	const auto cipher_text = gcm.encrypt(plain_3, ad_4);
+
+	for (size_t i = 0; i < cipher_text.size(); i += 7) {
+		auto tampered = cipher_text;
+		tampered[i] ^= 0x80;
+		ASSERT_FALSE(gcm.decrypt(tampered, ad_4).has_value());
+	}
+
+	ASSERT_FALSE(gcm.decrypt(cipher_text).has_value());
+	ASSERT_FALSE(gcm.decrypt(krypto::const_byte_view<>(cipher_text).first(20), ad_4).has_value());
+
+}
+
+TEST_F(GcmTest, Ghash_Combine) {
+
+	std::vector<unsigned char> data(16 * 37);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = static_cast<unsigned char>(i * 7 + 3);
+
+	const krypto::internal::ghash::key hk(key_3.data());
+
+	krypto::internal::ghash::state whole;
+	whole.update(hk, data.data(), data.size());
+
+	// Any split point, the second part hashed from a new state
+	for (size_t split : { 0, 1, 4, 5, 36, 37 }) {
+		krypto::internal::ghash::state first, second;
+		first.update(hk, data.data(), split * 16);
+		second.update(hk, data.data() + split * 16, data.size() - split * 16);
+		first.combine(hk, second, 37 - split);
+
+		std::array<unsigned char, 16> a, b;
+		auto copy = whole;
+		copy.finish(hk, 0, data.size(), a.data());
+		first.finish(hk, 0, data.size(), b.data());
+		ASSERT_EQ(a, b) << split;
+	}
+
+}
+
+TEST_F(GcmTest, Parallel_MatchesSerial) {
+
+	krypto::gcm<256> gcm(key_zero_256);
+
+	// Several segments, the last one partial and not a multiple of 16
+	std::vector<unsigned char> data(3 * krypto::internal::gcm::SEGMENT + 12345);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = static_cast<unsigned char>(i * 11);
+
+	krypto::set_max_threads(1);
+	const auto serial = gcm.seal(nonce_3, data, ad_4);
+
+	krypto::set_max_threads(4);
+	const auto parallel = gcm.seal(nonce_3, data, ad_4);
+	ASSERT_EQ(parallel, serial);
+
+	const auto plain_text = gcm.open(nonce_3, serial, ad_4);
+	ASSERT_TRUE(plain_text.has_value());
+	ASSERT_EQ(*plain_text, data);
+
+	auto tampered = serial;
+	tampered[2 * krypto::internal::gcm::SEGMENT + 5] ^= 1;
+	ASSERT_FALSE(gcm.open(nonce_3, tampered, ad_4).has_value());
+
+	krypto::set_max_threads(0);
+
+}
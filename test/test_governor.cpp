@@ -0,0 +1,209 @@
+#include "gtest/gtest.h"
+#include "krypto/governor.h"
+#include "krypto/file_engine.h"
+#include "krypto/reencrypt.h"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+static double seconds(clock_type::time_point start) {
+	return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+TEST(GovernorTest, Unlimited) {
+
+	krypto::governor gov;
+	gov.expect(300);
+
+	int runs = 0;
+	for (int i = 0; i < 3; i++)
+		ASSERT_TRUE(gov.run(100, [&] { runs++; }));
+
+	ASSERT_EQ(runs, 3);
+	ASSERT_EQ(gov.processed(), 300);
+	ASSERT_EQ(gov.total(), 300);
+	ASSERT_DOUBLE_EQ(gov.progress(), 1);
+	ASSERT_EQ(gov.threads(), krypto::max_threads());
+
+}
+
+TEST(GovernorTest, ByteRate) {
+
+	// 10 chunks of 10 KB at 200 KB/s, the first starts at once
+	krypto::governor gov({ .bytes_per_second = 200000 });
+
+	const auto start = clock_type::now();
+	for (int i = 0; i < 10; i++)
+		gov.run(10000, [] {});
+
+	ASSERT_GE(seconds(start), 0.04);
+	ASSERT_EQ(gov.processed(), 100000);
+
+	// Lifting the limit takes effect at once
+	gov.set_budget({});
+	const auto after = clock_type::now();
+	for (int i = 0; i < 10; i++)
+		gov.run(1 << 20, [] {});
+	ASSERT_LT(seconds(after), 0.04);
+
+}
+
+TEST(GovernorTest, CpuShare) {
+
+	// Busy for 10 ms, idle for about 30 ms after
+	krypto::governor gov({ .cpu_share = 0.25 });
+
+	const auto start = clock_type::now();
+	gov.run(1, [] { std::this_thread::sleep_for(std::chrono::milliseconds(10)); });
+
+	ASSERT_GE(seconds(start), 0.035);
+
+}
+
+TEST(GovernorTest, Threads) {
+
+	krypto::governor gov({ .threads = 1 });
+	ASSERT_EQ(gov.threads(), 1);
+	ASSERT_EQ(krypto::internal::parallel::governed_threads(&gov), 1);
+	ASSERT_EQ(krypto::internal::parallel::governed_threads(nullptr), krypto::max_threads());
+
+	gov.set_budget({ .threads = 1000 });
+	ASSERT_EQ(gov.threads(), krypto::max_threads());
+
+}
+
+TEST(GovernorTest, Cancel) {
+
+	krypto::governor gov;
+	gov.cancel();
+	ASSERT_TRUE(gov.cancelled());
+
+	bool ran = false;
+	ASSERT_FALSE(gov.run(100, [&] { ran = true; }));
+	ASSERT_FALSE(ran);
+	ASSERT_EQ(gov.processed(), 0);
+	ASSERT_DOUBLE_EQ(gov.progress(), 0);
+
+}
+
+TEST(GovernorTest, FileEngine) {
+
+	const std::string path_in = "krypto_governor_in.bin";
+	const std::string path_out = "krypto_governor_out.bin";
+	const std::array<unsigned char, 32> key = { 1 };
+	const std::array<unsigned char, 16> iv = { 2 };
+
+	const krypto::byte_array data(1 << 20, 0x5a);
+	std::ofstream(path_in, std::ios::binary).write(reinterpret_cast<const char*>(data.data()), data.size());
+
+	krypto::file_engine<256> engine(1 << 18, 2);
+
+	krypto::governor gov({ .threads = 1 });
+	ASSERT_EQ(engine.ctr(path_in, path_out, key, iv, &gov), data.size());
+	ASSERT_EQ(gov.processed(), data.size());
+	ASSERT_DOUBLE_EQ(gov.progress(), 1);
+
+	// Same output as without a governor
+	ASSERT_EQ(engine.ctr(path_out, path_out, key, iv), data.size());
+	std::ifstream f(path_out, std::ios::binary);
+	ASSERT_EQ(krypto::byte_array(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()), data);
+
+	krypto::governor cancelled;
+	cancelled.cancel();
+	ASSERT_FALSE(engine.ctr(path_in, path_out, key, iv, &cancelled));
+	ASSERT_EQ(cancelled.processed(), 0);
+
+	std::remove(path_in.c_str());
+	std::remove(path_out.c_str());
+
+}
+
+TEST(GovernorTest, FileEngine_CancelInPlace) {
+
+	const std::string path = "krypto_governor_cancel.bin";
+	const std::array<unsigned char, 32> key = { 1 };
+	const std::array<unsigned char, 16> iv = { 2 };
+	constexpr size_t buffer = 1 << 16;
+
+	krypto::byte_array data(32 * buffer + 100);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = static_cast<unsigned char>(i * 7);
+	std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(data.data()), data.size());
+
+	krypto::file_engine<256> engine(buffer, 2);
+
+	// Slow enough to be cancelled after a few buffers
+	krypto::governor gov({ .bytes_per_second = 1 << 20, .threads = 1 });
+	std::thread cancel([&] {
+		while (gov.processed() < 3 * buffer)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		gov.cancel();
+	});
+
+	uint64_t committed = 0;
+	ASSERT_FALSE(engine.ctr(path, path, key, iv, &gov, &committed));
+	cancel.join();
+
+	// Whole buffers, all that were converted
+	ASSERT_GE(committed, 3 * buffer);
+	ASSERT_LT(committed, data.size());
+	ASSERT_EQ(committed % buffer, 0);
+	ASSERT_EQ(gov.processed(), committed);
+
+	krypto::byte_array expected = data;
+	const krypto::internal::key_schedule<256> ks(key);
+	krypto::internal::ctr_xor(data.data(), expected.data(), committed, ks, krypto::internal::ctr_stream(iv.data(), false), 0);
+
+	std::ifstream f(path, std::ios::binary);
+	ASSERT_EQ(krypto::byte_array(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()), expected);
+	f.close();
+
+	// A separate output holds only the prefix
+	const std::string path_out = "krypto_governor_cancel_out.bin";
+	krypto::governor cancelled;
+	cancelled.cancel();
+	ASSERT_FALSE(engine.ctr(path, path_out, key, iv, &cancelled, &committed));
+	ASSERT_EQ(committed, 0);
+	ASSERT_EQ(std::filesystem::file_size(path_out), 0);
+
+	std::remove(path.c_str());
+	std::remove(path_out.c_str());
+
+}
+
+TEST(GovernorTest, Reencryptor) {
+
+	const std::array<unsigned char, 16> key_128 = { 1 };
+	const std::array<unsigned char, 32> key_256 = { 2 };
+	krypto::reencryptor<128, 256> rekey(key_128, key_256);
+
+	krypto::aes<128, krypto::modes::ctr, krypto::pad::pkcs7> a(key_128);
+	krypto::aes<256, krypto::modes::ctr, krypto::pad::pkcs7> b(key_256);
+
+	std::vector<krypto::byte_array> objects;
+	for (size_t i = 0; i < 8; i++)
+		objects.push_back(a.encrypt(krypto::byte_array(1000 + i, static_cast<unsigned char>(i))));
+
+	krypto::governor gov;
+	ASSERT_TRUE(rekey.ctr(objects, &gov).empty());
+	ASSERT_DOUBLE_EQ(gov.progress(), 1);
+	for (size_t i = 0; i < objects.size(); i++)
+		ASSERT_EQ(b.decrypt(objects[i]), krypto::byte_array(1000 + i, static_cast<unsigned char>(i)));
+
+	// Cancelled work is reported and left unchanged
+	const auto before = objects;
+	gov.cancel();
+	ASSERT_EQ(rekey.ctr(objects, &gov).size(), objects.size());
+	ASSERT_EQ(objects, before);
+
+	ASSERT_EQ(rekey.gcm(objects, &gov).size(), objects.size());
+	ASSERT_EQ(objects, before);
+
+}
@@ -0,0 +1,82 @@
+#include "gtest/gtest.h"
+#include "krypto/haraka.h"
+
+#include <array>
+#include <vector>
+
+class HarakaTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+		for (size_t i = 0; i < input.size(); i++) {
+			input[i] = static_cast<unsigned char>(i);
+		}
+	}
+
+	/**
+	 * Test vectors from the Haraka v2 reference implementation
+	 * Input is the bytes 0x00, 0x01, 0x02 ...
+	 */
+
+	std::array<unsigned char, 64> input{};
+
+	std::array<unsigned char, 32> digest_256 = {	0x80, 0x27, 0xcc, 0xb8, 0x79, 0x49, 0x77, 0x4b, 0x78, 0xd0, 0x54, 0x5f, 0xb7, 0x2b, 0xf7, 0x0c,
+													0x69, 0x5c, 0x2a, 0x09, 0x23, 0xcb, 0xd4, 0x7b, 0xba, 0x11, 0x59, 0xef, 0xbf, 0x2b, 0x2c, 0x1c };
+	std::array<unsigned char, 32> digest_512 = {	0xbe, 0x7f, 0x72, 0x3b, 0x4e, 0x80, 0xa9, 0x98, 0x13, 0xb2, 0x92, 0x28, 0x7f, 0x30, 0x6f, 0x62,
+													0x5a, 0x6d, 0x57, 0x33, 0x1c, 0xae, 0x5f, 0x34, 0xdd, 0x92, 0x77, 0xb0, 0x94, 0x5b, 0xe2, 0xaa };
+
+};
+
+TEST_F(HarakaTest, Haraka256_TestVector) {
+
+	std::array<unsigned char, 32> out{};
+	krypto::haraka256(out, std::span<const unsigned char, 32>(input.data(), 32));
+
+	for (int i = 0; i < out.size(); i++) {
+		ASSERT_EQ(out[i], digest_256[i]);
+	}
+
+}
+
+TEST_F(HarakaTest, Haraka512_TestVector) {
+
+	std::array<unsigned char, 32> out{};
+	krypto::haraka512(out, input);
+
+	for (int i = 0; i < out.size(); i++) {
+		ASSERT_EQ(out[i], digest_512[i]);
+	}
+
+}
+
+TEST_F(HarakaTest, Batch_MatchesSingle) {
+
+	// 4 lane groups plus a tail
+	const size_t count = 11;
+
+	std::vector<unsigned char> data(count * 64);
+	for (auto& c : data) {
+		c = rand() % 256;
+	}
+
+	std::vector<unsigned char> out_256(count * 32);
+	std::vector<unsigned char> out_512(count * 32);
+	krypto::haraka256_batch(out_256, std::span<const unsigned char>(data.data(), count * 32));
+	krypto::haraka512_batch(out_512, data);
+
+	for (size_t i = 0; i < count; i++) {
+		std::array<unsigned char, 32> out{};
+
+		krypto::haraka256(out, std::span<const unsigned char, 32>(&data[i * 32], 32));
+		for (int k = 0; k < out.size(); k++) {
+			ASSERT_EQ(out_256[i * 32 + k], out[k]);
+		}
+
+		krypto::haraka512(out, std::span<const unsigned char, 64>(&data[i * 64], 64));
+		for (int k = 0; k < out.size(); k++) {
+			ASSERT_EQ(out_512[i * 32 + k], out[k]);
+		}
+	}
+
+}
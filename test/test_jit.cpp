@@ -0,0 +1,86 @@
+#include "gtest/gtest.h"
+#include "krypto/jit.h"
+
+#include <array>
+#include <vector>
+
+class JitTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = static_cast<unsigned char>(i * 13 + 1);
+	}
+
+	/**
+	 * jit_ctr of every width against the generic kernel
+	 */
+	template <size_t Size>
+	void check(const std::array<unsigned char, 16>& iv) {
+		const std::array<unsigned char, Size / 8> key = { 0x2b, 0x7e, 0x15, 0x16 };
+		const krypto::internal::key_schedule<Size> ks(key);
+		const krypto::internal::ctr_stream ctr(iv.data(), false);
+
+		for (size_t width = 1; width <= krypto::internal::jit::MAX_WIDTH; width++) {
+			const krypto::jit_ctr<Size> jit(key, width);
+			ASSERT_EQ(jit.compiled(), krypto::internal::jit::supported());
+			ASSERT_EQ(jit.width(), width);
+
+			for (const size_t size : { 0, 15, 16, 255, 1000, 4099 }) {
+				for (const uint64_t index : { 0, 3 }) {
+					std::vector<unsigned char> expected(size);
+					krypto::internal::ctr_xor_128(data.data(), expected.data(), size, ks, ctr, index);
+
+					std::vector<unsigned char> out(size);
+					jit.apply(krypto::const_byte_view<>(data.data(), size), out, iv, index);
+					ASSERT_EQ(out, expected) << width << " " << size << " " << index;
+
+					// In place
+					out.assign(data.begin(), data.begin() + size);
+					jit.apply(out, out, iv, index);
+					ASSERT_EQ(out, expected);
+				}
+			}
+		}
+	}
+
+	std::array<unsigned char, 4099> data;
+
+};
+
+TEST_F(JitTest, MatchesGeneric) {
+
+	check<128>({ 0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff });
+	check<194>({ 1, 2, 3 });
+	check<256>({ 9 });
+
+}
+
+TEST_F(JitTest, CounterCarry) {
+
+	// Low 64 bits about to carry into the high word
+	check<128>({ 0, 0, 0, 0, 0, 0, 0, 1, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xf0 });
+	// Low 32 bits about to carry, the kernel adds on 64 bits
+	check<256>({ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 7, 0xff, 0xff, 0xff, 0xf0 });
+
+}
+
+TEST_F(JitTest, DefaultWidth) {
+
+	const std::array<unsigned char, 16> key = { 1 };
+	const krypto::jit_ctr<128> jit(key);
+	ASSERT_EQ(jit.width(), krypto::internal::jit::default_width());
+
+	// Shared by threads, the kernel only reads its page
+	const std::vector<unsigned char> in(1 << 16, 3);
+	std::vector<unsigned char> a(in.size()), b(in.size());
+	const std::array<unsigned char, 16> iv = { 2 };
+
+	#pragma omp parallel for num_threads(2)
+	for (int i = 0; i < 2; i++)
+		jit.apply(in, i ? b : a, iv);
+
+	ASSERT_EQ(a, b);
+
+}
@@ -0,0 +1,178 @@
+#include "gtest/gtest.h"
+#include "krypto/job_manager.h"
+
+#include <array>
+#include <vector>
+#include <random>
+#include <set>
+
+class JobManagerTest : public ::testing::Test {
+
+protected:
+
+	using manager = krypto::job_manager<128>;
+
+	/**
+	 * SP 800-38A F.2.1 and RFC 4493 key and plain text
+	 */
+
+	std::array<unsigned char, 16> key			= { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+	std::array<unsigned char, 16> iv			= { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+	std::array<unsigned char, 64> plain_text	= { 0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+												0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+												0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+												0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10 };
+	std::array<unsigned char, 64> cbc_cipher	= { 0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d,
+												0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72, 0x19, 0xee, 0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2,
+												0x73, 0xbe, 0xd6, 0xb8, 0xe3, 0xc1, 0x74, 0x3b, 0x71, 0x16, 0xe6, 0x9e, 0x22, 0x22, 0x95, 0x16,
+												0x3f, 0xf1, 0xca, 0xa1, 0x68, 0x1f, 0xac, 0x09, 0x12, 0x0e, 0xca, 0x30, 0x75, 0x86, 0xe1, 0xa7 };
+
+	// CMAC of the first 0, 16, 40 and 64 bytes
+	std::array<std::array<unsigned char, 16>, 4> cmac_tags = { {
+		{ 0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28, 0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46 },
+		{ 0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44, 0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c },
+		{ 0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27 },
+		{ 0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92, 0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe }
+	} };
+	const size_t cmac_sizes[4] = { 0, 16, 40, 64 };
+
+};
+
+TEST_F(JobManagerTest, TestVectors) {
+
+	const manager::key k(key);
+	manager jobs;
+
+	std::array<unsigned char, 64> cbc_out;
+	std::array<unsigned char, 64> cbc_back;
+	std::array<std::array<unsigned char, 16>, 4> tags;
+
+	ASSERT_TRUE(jobs.submit({ krypto::job_type::cbc_encrypt, &k, iv, plain_text.data(), cbc_out.data(), 64, 100 }));
+	ASSERT_TRUE(jobs.submit({ krypto::job_type::cbc_decrypt, &k, iv, cbc_cipher.data(), cbc_back.data(), 64, 101 }));
+	for (size_t i = 0; i < 4; i++) {
+		ASSERT_TRUE(jobs.submit({ krypto::job_type::cmac, &k, {}, plain_text.data(), tags[i].data(), cmac_sizes[i], i }));
+	}
+
+	jobs.flush();
+	ASSERT_EQ(jobs.pending(), 0);
+
+	ASSERT_EQ(cbc_out, cbc_cipher);
+	ASSERT_EQ(cbc_back, plain_text);
+	ASSERT_EQ(tags, cmac_tags);
+
+	std::set<uint64_t> done;
+	while (auto user = jobs.pop())
+		done.insert(*user);
+	ASSERT_EQ(done, (std::set<uint64_t>{ 0, 1, 2, 3, 100, 101 }));
+
+}
+
+TEST_F(JobManagerTest, Mixed_MatchesKernels) {
+
+	std::mt19937_64 rng(7);
+
+	// Jobs with different keys, modes and sizes interleaved
+	std::vector<std::array<unsigned char, 16>> raw_keys(5);
+	std::vector<manager::key> keys;
+	for (auto& r : raw_keys) {
+		for (auto& b : r)
+			b = static_cast<unsigned char>(rng());
+		keys.emplace_back(r);
+	}
+
+	const size_t count = 500;
+	std::vector<manager::job> submitted(count);
+	std::vector<krypto::byte_array> in(count);
+	std::vector<krypto::byte_array> out(count);
+
+	manager jobs(std::chrono::microseconds(0), 64);
+
+	size_t completed = 0;
+	for (size_t i = 0; i < count; i++) {
+		const auto type = static_cast<krypto::job_type>(rng() % 4);
+		const bool blocks = type == krypto::job_type::cbc_encrypt || type == krypto::job_type::cbc_decrypt;
+		const size_t size = blocks ? 16 * (rng() % 20) : rng() % 300;
+
+		in[i].resize(size);
+		for (auto& b : in[i])
+			b = static_cast<unsigned char>(rng());
+		out[i].resize(type == krypto::job_type::cmac ? 16 : size);
+
+		auto& j = submitted[i];
+		j = { type, &keys[i % keys.size()], {}, in[i].data(), out[i].data(), size, i };
+		for (auto& b : j.iv)
+			b = static_cast<unsigned char>(rng());
+
+		// Full, drain completions and retry
+		while (!jobs.submit(j)) {
+			jobs.poll();
+			while (jobs.pop())
+				completed++;
+		}
+	}
+
+	jobs.flush();
+	while (jobs.pop())
+		completed++;
+	ASSERT_EQ(completed, count);
+
+	for (size_t i = 0; i < count; i++) {
+		const auto& j = submitted[i];
+		const auto& raw = raw_keys[i % keys.size()];
+		const krypto::internal::key_schedule<128> ks(raw);
+
+		krypto::byte_array expected(out[i].size());
+		switch (j.type) {
+		case krypto::job_type::ctr:
+			krypto::internal::ctr_xor(in[i].data(), expected.data(), j.size, ks, krypto::internal::ctr_stream(j.iv.data(), false), 0);
+			break;
+
+		case krypto::job_type::cbc_encrypt:
+		case krypto::job_type::cbc_decrypt: {
+			// Round trip through the other direction
+			const manager::key k(raw);
+			manager single;
+			const auto other = j.type == krypto::job_type::cbc_encrypt ? krypto::job_type::cbc_decrypt : krypto::job_type::cbc_encrypt;
+			single.submit({ other, &k, j.iv, out[i].data(), expected.data(), j.size, 0 });
+			single.flush();
+			ASSERT_EQ(expected, in[i]);
+			continue;
+		}
+
+		case krypto::job_type::cmac: {
+			// The job alone, lane filling must not change the tag
+			const manager::key k(raw);
+			manager single;
+			single.submit({ j.type, &k, {}, in[i].data(), expected.data(), j.size, 0 });
+			single.flush();
+			break;
+		}
+		}
+
+		ASSERT_EQ(out[i], expected);
+	}
+
+}
+
+TEST_F(JobManagerTest, Capacity) {
+
+	const manager::key k(key);
+	manager jobs(std::chrono::seconds(10), 4);
+
+	std::array<unsigned char, 16> tag;
+	for (size_t i = 0; i < 4; i++) {
+		ASSERT_TRUE(jobs.submit({ krypto::job_type::cmac, &k, {}, plain_text.data(), tag.data(), 16, i }));
+	}
+	ASSERT_FALSE(jobs.submit({ krypto::job_type::cmac, &k, {}, plain_text.data(), tag.data(), 16, 4 }));
+
+	// Not yet timed out
+	jobs.poll();
+	ASSERT_EQ(jobs.pending(), 4);
+
+	jobs.flush();
+	ASSERT_FALSE(jobs.submit({ krypto::job_type::cmac, &k, {}, plain_text.data(), tag.data(), 16, 4 }));
+
+	ASSERT_EQ(jobs.pop(), 0);
+	ASSERT_TRUE(jobs.submit({ krypto::job_type::cmac, &k, {}, plain_text.data(), tag.data(), 16, 4 }));
+
+}
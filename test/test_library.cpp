@@ -0,0 +1,55 @@
+#include "gtest/gtest.h"
+#include "krypto/aes.h"
+#include "krypto/gcm.h"
+#include "krypto/aegis.h"
+
+#include <array>
+#include <vector>
+
+/**
+ * Built with -maes -mpclmul against krypto::static, which is built without them
+ */
+
+TEST(LibraryTest, Aes_OtherFlags) {
+
+	// FIPS-197 C.1
+	const std::array<unsigned char, 16> key = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+	const std::array<unsigned char, 16> plain = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+	const std::array<unsigned char, 16> cipher = { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+
+	krypto::aes<128, krypto::modes::ecb, krypto::pad::pkcs7> aes(key);
+	const auto out = aes.encrypt(plain);
+
+	ASSERT_EQ(std::vector<unsigned char>(out.begin(), out.begin() + 16), std::vector<unsigned char>(cipher.begin(), cipher.end()));
+	ASSERT_EQ(aes.decrypt(out), krypto::byte_array(plain.begin(), plain.end()));
+
+}
+
+TEST(LibraryTest, Gcm_OtherFlags) {
+
+	// Reference tag from OpenSSL
+	const std::array<unsigned char, 16> key = {};
+	const std::array<unsigned char, 12> nonce = {};
+	const std::array<unsigned char, 16> cipher = { 0x02, 0x89, 0xdb, 0xcf, 0x61, 0xb7, 0xa2, 0x93, 0xf2, 0x29, 0xc3, 0xb8, 0x70, 0xb3, 0xff, 0x79 };
+	const std::array<unsigned char, 16> tag = { 0xba, 0x77, 0x31, 0xe6, 0x9f, 0x5b, 0x4f, 0xb8, 0xaf, 0x91, 0xc8, 0x20, 0x57, 0x5c, 0x03, 0xfb };
+	const krypto::byte_array plain(100, 0x01);
+
+	krypto::gcm<128> gcm(key);
+	const auto out = gcm.seal(nonce, plain);
+
+	ASSERT_EQ(std::vector<unsigned char>(out.begin(), out.begin() + 16), std::vector<unsigned char>(cipher.begin(), cipher.end()));
+	ASSERT_EQ(std::vector<unsigned char>(out.end() - 16, out.end()), std::vector<unsigned char>(tag.begin(), tag.end()));
+	ASSERT_EQ(gcm.open(nonce, out), plain);
+
+}
+
+TEST(LibraryTest, Aegis_OtherFlags) {
+
+	const std::array<unsigned char, 16> key = { 1 };
+	const std::array<unsigned char, 16> nonce = { 2 };
+	const krypto::byte_array plain(1000, 0x5a);
+
+	krypto::aegis128l aegis(key);
+	ASSERT_EQ(aegis.open(nonce, aegis.seal(nonce, plain)), plain);
+
+}
@@ -0,0 +1,141 @@
+#include "gtest/gtest.h"
+#include "krypto/offload.h"
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+class OffloadTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+		server = krypto::offload_server::create(service);
+		ASSERT_TRUE(server);
+		thread = std::thread([this] { server->run(stop); });
+	}
+
+	void TearDown() override {
+		stop = true;
+		thread.join();
+	}
+
+	/**
+	 * Wait for the next completion
+	 */
+	static krypto::offload_completion wait(krypto::offload_client& client) {
+		while (true) {
+			if (auto c = client.poll())
+				return *c;
+			std::this_thread::yield();
+		}
+	}
+
+	std::string service = "/krypto_test." + std::to_string(::getpid());
+	std::unique_ptr<krypto::offload_server> server;
+	std::atomic<bool> stop = false;
+	std::thread thread;
+
+	std::array<unsigned char, 16> key_128 = { 1, 2, 3 };
+	std::array<unsigned char, 32> key_256 = { 4, 5, 6 };
+
+};
+
+TEST_F(OffloadTest, MatchesJobManager) {
+
+	auto client = krypto::offload_client::connect(service);
+	ASSERT_TRUE(client);
+
+	const uint32_t k128 = *client->add_key(key_128);
+	const uint32_t k256 = *client->add_key(key_256);
+
+	// Expected output of every job from a local manager
+	const krypto::job_manager<128>::key local_128(key_128);
+	const krypto::job_manager<256>::key local_256(key_256);
+	krypto::job_manager<128> local_jobs_128;
+	krypto::job_manager<256> local_jobs_256;
+
+	const size_t count = 200;
+	std::vector<krypto::byte_array> expected(count);
+	std::map<uint64_t, uint32_t> slots;
+
+	for (uint64_t i = 0; i < count; i++) {
+		const auto type = static_cast<krypto::job_type>(i % 4);
+		const uint32_t size = type == krypto::job_type::cbc_encrypt || type == krypto::job_type::cbc_decrypt ? 16 * (i % 9) : i * 7 % 500;
+		const std::array<unsigned char, 16> iv = { static_cast<unsigned char>(i) };
+
+		const auto slot = client->acquire();
+		ASSERT_TRUE(slot);
+		slots[i] = *slot;
+
+		auto in = client->input(*slot);
+		for (uint32_t n = 0; n < size; n++)
+			in[n] = static_cast<unsigned char>(n * i);
+
+		expected[i].resize(type == krypto::job_type::cmac ? 16 : size);
+		if (i % 2)
+			local_jobs_128.submit({ type, &local_128, iv, in.data(), expected[i].data(), size, i });
+		else
+			local_jobs_256.submit({ type, &local_256, iv, in.data(), expected[i].data(), size, i });
+
+		client->submit(*slot, { type, i % 2 ? k128 : k256, iv, size, i });
+	}
+
+	local_jobs_128.flush();
+	local_jobs_256.flush();
+
+	for (size_t n = 0; n < count; n++) {
+		const auto c = wait(*client);
+		ASSERT_TRUE(c.ok);
+		ASSERT_EQ(c.slot, slots[c.user]);
+		ASSERT_EQ(c.size, expected[c.user].size());
+
+		const auto out = client->output(c.slot);
+		ASSERT_TRUE(std::equal(expected[c.user].begin(), expected[c.user].end(), out.begin()));
+		client->release(c.slot);
+	}
+
+}
+
+TEST_F(OffloadTest, RejectsInvalidJobs) {
+
+	auto client = krypto::offload_client::connect(service);
+	ASSERT_TRUE(client);
+
+	ASSERT_FALSE(client->add_key(std::array<unsigned char, 24>{}));
+	const uint32_t key = *client->add_key(key_128);
+
+	const uint32_t slot = *client->acquire();
+
+	// Unknown key, CBC of a partial block, larger than a slot
+	client->submit(slot, { krypto::job_type::ctr, key + 1, {}, 16, 1 });
+	client->submit(slot, { krypto::job_type::cbc_encrypt, key, {}, 17, 2 });
+	client->submit(slot, { krypto::job_type::ctr, key, {}, krypto::offload_client::SLOT_SIZE + 1, 3 });
+
+	for (uint64_t user = 1; user <= 3; user++) {
+		const auto c = wait(*client);
+		ASSERT_EQ(c.user, user);
+		ASSERT_FALSE(c.ok);
+	}
+
+}
+
+TEST_F(OffloadTest, Reconnect) {
+
+	// Entries are released when clients close
+	for (size_t i = 0; i < 2 * krypto::internal::offload::CLIENTS; i++) {
+		auto client = krypto::offload_client::connect(service);
+		ASSERT_TRUE(client);
+
+		const uint32_t key = *client->add_key(key_128);
+		const uint32_t slot = *client->acquire();
+		client->submit(slot, { krypto::job_type::cmac, key, {}, 0, i });
+		ASSERT_TRUE(wait(*client).ok);
+	}
+
+	ASSERT_FALSE(krypto::offload_client::connect(service + ".missing"));
+
+}
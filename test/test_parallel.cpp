@@ -0,0 +1,127 @@
+#include "gtest/gtest.h"
+#include "krypto/parallel.h"
+#include "krypto/aes.h"
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class ParallelTest : public ::testing::Test {
+
+protected:
+
+	void TearDown() override {
+		std::filesystem::remove_all(root);
+		krypto::set_max_threads(0);
+	}
+
+	void write(const std::string& path, const std::string& content) {
+		std::filesystem::create_directories(std::filesystem::path(root + path).parent_path());
+		std::ofstream(root + path) << content << "\n";
+	}
+
+	// Fake cgroup mount
+	std::string root = "krypto_parallel_cgroup";
+
+};
+
+TEST_F(ParallelTest, CgroupV2) {
+
+	write("/cgroup.controllers", "cpu cpuset");
+	write("/cpu.max", "max 100000");
+	write("/kubepods/cpu.max", "400000 100000");
+	write("/kubepods/pod/cpu.max", "150000 100000");
+
+	// Smallest quota of the cgroup and its parents
+	const auto cpus = krypto::internal::parallel::cgroup_cpus("0::/kubepods/pod\n", root);
+	ASSERT_TRUE(cpus);
+	ASSERT_DOUBLE_EQ(*cpus, 1.5);
+
+	write("/kubepods/pod/cpu.max", "max 100000");
+	ASSERT_DOUBLE_EQ(*krypto::internal::parallel::cgroup_cpus("0::/kubepods/pod\n", root), 4);
+
+}
+
+TEST_F(ParallelTest, CgroupV1) {
+
+	write("/cpu,cpuacct/cpu.cfs_quota_us", "-1");
+	write("/cpu,cpuacct/cpu.cfs_period_us", "100000");
+	write("/cpu,cpuacct/docker/cpu.cfs_quota_us", "200000");
+	write("/cpu,cpuacct/docker/cpu.cfs_period_us", "100000");
+
+	const std::string proc = "4:memory:/docker\n3:cpu,cpuacct:/docker\n2:cpuset:/\n";
+	ASSERT_DOUBLE_EQ(*krypto::internal::parallel::cgroup_cpus(proc, root), 2);
+
+}
+
+TEST_F(ParallelTest, Container) {
+
+	// The path is the host path, only the mount of the container exists
+	write("/cpu.max", "50000 100000");
+	write("/cgroup.controllers", "cpu");
+
+	ASSERT_DOUBLE_EQ(*krypto::internal::parallel::cgroup_cpus("0::/system.slice/host.scope\n", root), 0.5);
+
+}
+
+TEST_F(ParallelTest, Unlimited) {
+
+	write("/cgroup.controllers", "cpu");
+	write("/cpu.max", "max 100000");
+
+	ASSERT_FALSE(krypto::internal::parallel::cgroup_cpus("0::/\n", root));
+	ASSERT_FALSE(krypto::internal::parallel::cgroup_cpus("", root));
+	ASSERT_FALSE(krypto::internal::parallel::cgroup_cpus("0::/\n", root + ".missing"));
+
+}
+
+TEST_F(ParallelTest, MaxThreads) {
+
+	const size_t detected = krypto::max_threads();
+	ASSERT_GE(detected, 1);
+	ASSERT_LE(detected, krypto::internal::parallel::affinity_cpus());
+
+	krypto::set_max_threads(3);
+	ASSERT_EQ(krypto::max_threads(), 3);
+	ASSERT_EQ(krypto::internal::parallel::threads(), 3);
+
+	// One thread per GRAIN of work
+	ASSERT_EQ(krypto::internal::parallel::threads(100), 1);
+	ASSERT_EQ(krypto::internal::parallel::threads(2 * krypto::internal::parallel::GRAIN), 2);
+	ASSERT_EQ(krypto::internal::parallel::threads(100 * krypto::internal::parallel::GRAIN), 3);
+
+	// Loops still produce the same output with a single thread
+	krypto::set_max_threads(1);
+	const std::array<unsigned char, 16> key = { 1 };
+	krypto::aes<128, krypto::modes::ecb, krypto::pad::pkcs7> aes(key);
+	const std::vector<unsigned char> data(5 * krypto::internal::parallel::GRAIN, 7);
+	ASSERT_EQ(aes.decrypt(aes.encrypt(data)), data);
+
+	krypto::set_max_threads(0);
+	ASSERT_EQ(krypto::max_threads(), detected);
+
+}
+
+TEST_F(ParallelTest, PerformanceCores) {
+
+	ASSERT_EQ(krypto::internal::parallel::parse_cpus("0-3,8,10-11\n"), (std::vector<int>{ 0, 1, 2, 3, 8, 10, 11 }));
+	ASSERT_TRUE(krypto::internal::parallel::parse_cpus("").empty());
+
+	write("/cpu_core/cpus", "0-7");
+	write("/cpu_atom/cpus", "8-15");
+	ASSERT_EQ(krypto::internal::parallel::performance_cpus(root).size(), 8);
+	ASSERT_TRUE(krypto::internal::parallel::performance_cpus(root + ".missing").empty());
+
+	// Not hybrid or pinned, the affinity is the same after the scope
+	const size_t before = krypto::internal::parallel::affinity_cpus();
+	{
+		krypto::performance_scope scope;
+		if (krypto::internal::parallel::performance_cpus().empty()) {
+			ASSERT_FALSE(scope.active());
+		}
+	}
+	ASSERT_EQ(krypto::internal::parallel::affinity_cpus(), before);
+
+}
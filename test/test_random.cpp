@@ -0,0 +1,101 @@
+#include "gtest/gtest.h"
+#include "krypto/random.h"
+#include "krypto/internal/aes_core.h"
+
+#include <array>
+#include <random>
+#include <set>
+#include <concepts>
+
+static_assert(std::uniform_random_bit_generator<krypto::random::ars_engine>);
+static_assert(std::uniform_random_bit_generator<krypto::random::aes_engine>);
+
+class RandomTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+	}
+
+	krypto::random::key_type key = { 0x0706050403020100, 0x0f0e0d0c0b0a0908 };
+
+};
+
+TEST_F(RandomTest, Aes_MatchesBlockCipher) {
+
+	krypto::random::aes aes(key);
+	const auto out = aes({ 0x7766554433221100, 0xffeeddccbbaa9988 });
+
+	// FIPS-197 appendix C.1 with key 00 01 .. 0f and plain text 00 11 .. ff
+	std::array<unsigned char, 16> cipher_text = { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+
+	for (size_t i = 0; i < 16; i++) {
+		ASSERT_EQ(static_cast<unsigned char>(out[i / 8] >> ((i % 8) * 8)), cipher_text[i]);
+	}
+
+}
+
+TEST_F(RandomTest, Engine_IsCounterBased) {
+
+	krypto::random::ars<7> ars(key);
+	krypto::random::ars_engine engine(key, 42);
+
+	for (uint64_t i = 0; i < 100; i++) {
+		const auto block = ars({ i, 42 });
+		ASSERT_EQ(engine(), block[0]);
+		ASSERT_EQ(engine(), block[1]);
+	}
+
+}
+
+TEST_F(RandomTest, Engine_SeekAndDiscard) {
+
+	krypto::random::aes_engine engine(key);
+
+	std::vector<uint64_t> values;
+	for (size_t i = 0; i < 100; i++) {
+		values.push_back(engine());
+	}
+
+	krypto::random::aes_engine seeked(key);
+	seeked.seek(37);
+	for (size_t i = 37; i < values.size(); i++) {
+		ASSERT_EQ(seeked(), values[i]);
+	}
+
+	krypto::random::aes_engine discarded(key);
+	discarded();
+	discarded.discard(20);
+	ASSERT_EQ(discarded(), values[21]);
+	discarded.discard(1);
+	ASSERT_EQ(discarded(), values[23]);
+
+}
+
+TEST_F(RandomTest, Engine_StreamsAreIndependent) {
+
+	std::set<uint64_t> seen;
+
+	for (uint64_t stream = 0; stream < 16; stream++) {
+		krypto::random::ars_engine engine(key, stream);
+		for (size_t i = 0; i < 256; i++) {
+			ASSERT_TRUE(seen.insert(engine()).second);
+		}
+	}
+
+}
+
+TEST_F(RandomTest, Engine_WorksWithDistributions) {
+
+	krypto::random::ars_engine engine(key);
+	std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+	double sum = 0;
+	const size_t count = 100000;
+	for (size_t i = 0; i < count; i++) {
+		sum += dist(engine);
+	}
+
+	ASSERT_NEAR(sum / count, 0.5, 0.01);
+
+}
@@ -0,0 +1,143 @@
+#include "gtest/gtest.h"
+#include "krypto/reencrypt.h"
+
+#include <array>
+#include <vector>
+
+class ReencryptTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+		for (size_t i = 0; i < plain_text.size(); i++)
+			plain_text[i] = static_cast<unsigned char>(i * 7 + 3);
+	}
+
+	std::array<unsigned char, 16> key_128 = {	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+	std::array<unsigned char, 32> key_256 = {	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+												0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f };
+
+	std::array<unsigned char, 3> ad = { 0x61, 0x64, 0x00 };
+
+	// Spans several GCM stripes and ends in a partial block
+	krypto::byte_array plain_text = krypto::byte_array(5000);
+
+};
+
+TEST_F(ReencryptTest, Ctr) {
+
+	krypto::aes<128, krypto::modes::ctr, krypto::pad::pkcs7> aes_a(key_128);
+	krypto::aes<256, krypto::modes::ctr, krypto::pad::pkcs7> aes_b(key_256);
+	krypto::reencryptor<128, 256> rekey(key_128, key_256);
+
+	// Large enough to be split over threads
+	krypto::byte_array data(3 * krypto::reencryptor<128, 256>::CTR_STRIPE + 100, 0x5a);
+
+	auto cipher_text = aes_a.encrypt(data);
+	rekey.ctr(cipher_text);
+
+	ASSERT_EQ(aes_b.decrypt(cipher_text), data);
+
+}
+
+TEST_F(ReencryptTest, Gcm) {
+
+	krypto::gcm<128> gcm_a(key_128);
+	krypto::gcm<256> gcm_b(key_256);
+	krypto::reencryptor<128, 256> rekey(key_128, key_256);
+
+	auto cipher_text = gcm_a.encrypt(plain_text, ad);
+	ASSERT_TRUE(rekey.gcm(cipher_text, ad));
+
+	ASSERT_FALSE(gcm_a.decrypt(cipher_text, ad).has_value());
+
+	const auto result = gcm_b.decrypt(cipher_text, ad);
+	ASSERT_TRUE(result.has_value());
+	ASSERT_EQ(*result, plain_text);
+
+}
+
+TEST_F(ReencryptTest, Gcm_RejectsTampering) {
+
+	krypto::gcm<128> gcm_a(key_128);
+	krypto::reencryptor<128, 256> rekey(key_128, key_256);
+
+	auto cipher_text = gcm_a.encrypt(plain_text, ad);
+	cipher_text[100] ^= 1;
+	const auto tampered = cipher_text;
+
+	ASSERT_FALSE(rekey.gcm(cipher_text, ad));
+	ASSERT_EQ(cipher_text, tampered);
+
+}
+
+TEST_F(ReencryptTest, CbcToGcm) {
+
+	krypto::gcm<256> gcm_b(key_256);
+	krypto::reencryptor<128, 256> rekey(key_128, key_256);
+
+	// Cover every padding length
+	for (size_t size = 1; size < 40; size++) {
+		const krypto::const_byte_view<> data(plain_text.data(), size);
+
+		krypto::aes<128, krypto::modes::cbc, krypto::pad::pkcs7> pkcs7(key_128);
+		const auto pkcs7_result = rekey.cbc_to_gcm<krypto::pad::pkcs7>(pkcs7.encrypt(data), ad);
+		ASSERT_TRUE(pkcs7_result.has_value());
+		ASSERT_EQ(gcm_b.decrypt(*pkcs7_result, ad).value(), krypto::byte_array(data.begin(), data.end()));
+
+		krypto::aes<128, krypto::modes::cbc, krypto::pad::ansix923> ansix923(key_128);
+		const auto ansix923_result = rekey.cbc_to_gcm<krypto::pad::ansix923>(ansix923.encrypt(data), ad);
+		ASSERT_TRUE(ansix923_result.has_value());
+		ASSERT_EQ(gcm_b.decrypt(*ansix923_result, ad).value(), krypto::byte_array(data.begin(), data.end()));
+	}
+
+	krypto::aes<128, krypto::modes::cbc, krypto::pad::pkcs7> aes_a(key_128);
+	const auto result = rekey.cbc_to_gcm<krypto::pad::pkcs7>(aes_a.encrypt(plain_text));
+	ASSERT_TRUE(result.has_value());
+	ASSERT_EQ(gcm_b.decrypt(*result).value(), plain_text);
+
+	// Wrong key gives invalid padding, except by chance for about 1 in 256 random IVs
+	krypto::reencryptor<256, 256> wrong(key_256, key_256);
+	size_t accepted = 0;
+	for (size_t i = 0; i < 64; i++) {
+		if (wrong.cbc_to_gcm<krypto::pad::pkcs7>(aes_a.encrypt(plain_text)).has_value())
+			accepted++;
+	}
+	ASSERT_LT(accepted, 8);
+
+}
+
+TEST_F(ReencryptTest, Batch) {
+
+	krypto::gcm<128> gcm_a(key_128);
+	krypto::gcm<128> gcm_b(krypto::const_byte_view<16>(key_256.data(), 16));
+	krypto::reencryptor<128> rekey(key_128, krypto::const_byte_view<16>(key_256.data(), 16));
+
+	std::vector<krypto::byte_array> objects;
+	for (size_t i = 0; i < 20; i++) {
+		objects.push_back(gcm_a.encrypt(krypto::const_byte_view<>(plain_text.data(), i * 97)));
+	}
+	objects[7].back() ^= 1;
+
+	const auto failed = rekey.gcm(objects);
+	ASSERT_EQ(failed, std::vector<size_t>{ 7 });
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		if (i == 7)
+			continue;
+		ASSERT_EQ(gcm_b.decrypt(objects[i]).value(), krypto::byte_array(plain_text.begin(), plain_text.begin() + i * 97));
+	}
+
+	krypto::aes<128, krypto::modes::cbc, krypto::pad::pkcs7> aes_a(key_128);
+	std::vector<krypto::byte_array> cbc_objects;
+	for (size_t i = 0; i < 20; i++) {
+		cbc_objects.push_back(aes_a.encrypt(krypto::const_byte_view<>(plain_text.data(), (i + 1) * 97)));
+	}
+
+	const auto converted = rekey.cbc_to_gcm<krypto::pad::pkcs7>(cbc_objects);
+	for (size_t i = 0; i < converted.size(); i++) {
+		ASSERT_TRUE(converted[i].has_value());
+		ASSERT_EQ(gcm_b.decrypt(*converted[i]).value(), krypto::byte_array(plain_text.begin(), plain_text.begin() + (i + 1) * 97));
+	}
+
+}
@@ -0,0 +1,82 @@
+#include "gtest/gtest.h"
+#include "krypto/sealed_map.h"
+
+#include <array>
+#include <string>
+#include <vector>
+
+class SealedMapTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+	}
+
+	static krypto::byte_array value(size_t i) {
+		krypto::byte_array v(i % 70);
+		for (size_t j = 0; j < v.size(); j++)
+			v[j] = static_cast<unsigned char>(i + j);
+		return v;
+	}
+
+	std::array<unsigned char, 16> key = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+
+};
+
+TEST_F(SealedMapTest, PutGet) {
+
+	krypto::sealed_map<std::string> map(key);
+
+	ASSERT_FALSE(map.get("missing").has_value());
+
+	map.put("a", value(5));
+	map.put("b", value(40));
+	ASSERT_EQ(map.get("a").value(), value(5));
+	ASSERT_EQ(map.get("b").value(), value(40));
+
+	map.put("a", value(69));
+	ASSERT_EQ(map.get("a").value(), value(69));
+	ASSERT_EQ(map.size(), 2);
+
+	ASSERT_TRUE(map.erase("a"));
+	ASSERT_FALSE(map.erase("a"));
+	ASSERT_FALSE(map.get("a").has_value());
+
+	// Reuses the slot of a
+	map.put("c", value(7));
+	ASSERT_EQ(map.get("c").value(), value(7));
+	ASSERT_EQ(map.size(), 2);
+
+}
+
+TEST_F(SealedMapTest, Batch) {
+
+	krypto::sealed_map<uint64_t> map;
+
+	// Enough groups to be split over threads
+	std::vector<uint64_t> keys;
+	std::vector<krypto::byte_array> values;
+	for (uint64_t i = 0; i < 1000; i++) {
+		keys.push_back(i * 7);
+		values.push_back(value(i));
+	}
+	// Repeated key keeps the last value
+	keys.push_back(0);
+	values.push_back(value(3));
+
+	std::vector<krypto::const_byte_view<>> views(values.begin(), values.end());
+	map.put(keys, views);
+	ASSERT_EQ(map.size(), 1000);
+
+	keys.push_back(1);
+	const auto out = map.get(keys);
+	ASSERT_EQ(out.size(), keys.size());
+
+	ASSERT_EQ(out[0].value(), value(3));
+	for (size_t i = 1; i < 1000; i++) {
+		ASSERT_EQ(out[i].value(), value(i));
+		ASSERT_EQ(map.get(keys[i]).value(), value(i));
+	}
+	ASSERT_FALSE(out.back().has_value());
+
+}
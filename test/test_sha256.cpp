@@ -0,0 +1,71 @@
+#include "gtest/gtest.h"
+#include "krypto/sha256.h"
+
+#include <array>
+#include <string>
+#include <vector>
+
+class Sha256Test : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+	}
+
+	static krypto::const_byte_view<> bytes(const std::string& s) {
+		return krypto::const_byte_view<>(reinterpret_cast<const unsigned char*>(s.data()), s.size());
+	}
+
+};
+
+TEST_F(Sha256Test, Hash_TestVectors) {
+
+	// FIPS 180-2 appendix B
+	std::array<unsigned char, 32> empty = {	0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14, 0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+											0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c, 0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55 };
+	std::array<unsigned char, 32> abc = {	0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+											0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad };
+	std::array<unsigned char, 32> two = {	0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+											0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1 };
+
+	ASSERT_EQ(krypto::sha256::hash({}), empty);
+	ASSERT_EQ(krypto::sha256::hash(bytes("abc")), abc);
+	ASSERT_EQ(krypto::sha256::hash(bytes("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")), two);
+
+}
+
+TEST_F(Sha256Test, Update_MatchesOneShot) {
+
+	std::vector<unsigned char> data(300);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = static_cast<unsigned char>(i);
+
+	const auto expected = krypto::sha256::hash(data);
+
+	for (size_t split : { 0, 1, 55, 56, 63, 64, 65, 128, 299 }) {
+		krypto::sha256 h;
+		h.update(krypto::const_byte_view<>(data.data(), split));
+		h.update(krypto::const_byte_view<>(data.data() + split, data.size() - split));
+		ASSERT_EQ(h.digest(), expected);
+	}
+
+}
+
+TEST_F(Sha256Test, Hmac_TestVectors) {
+
+	// RFC 4231 test cases 1, 2 and 6
+	std::array<unsigned char, 32> tag_1 = {	0xb0, 0x34, 0x4c, 0x61, 0xd8, 0xdb, 0x38, 0x53, 0x5c, 0xa8, 0xaf, 0xce, 0xaf, 0x0b, 0xf1, 0x2b,
+											0x88, 0x1d, 0xc2, 0x00, 0xc9, 0x83, 0x3d, 0xa7, 0x26, 0xe9, 0x37, 0x6c, 0x2e, 0x32, 0xcf, 0xf7 };
+	std::array<unsigned char, 32> tag_2 = {	0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e, 0x6a, 0x04, 0x24, 0x26, 0x08, 0x95, 0x75, 0xc7,
+											0x5a, 0x00, 0x3f, 0x08, 0x9d, 0x27, 0x39, 0x83, 0x9d, 0xec, 0x58, 0xb9, 0x64, 0xec, 0x38, 0x43 };
+	std::array<unsigned char, 32> tag_6 = {	0x60, 0xe4, 0x31, 0x59, 0x1e, 0xe0, 0xb6, 0x7f, 0x0d, 0x8a, 0x26, 0xaa, 0xcb, 0xf5, 0xb7, 0x7f,
+											0x8e, 0x0b, 0xc6, 0x21, 0x37, 0x28, 0xc5, 0x14, 0x05, 0x46, 0x04, 0x0f, 0x0e, 0xe3, 0x7f, 0x54 };
+
+	std::vector<unsigned char> key_1(20, 0x0b);
+	std::vector<unsigned char> key_6(131, 0xaa);
+
+	ASSERT_EQ(krypto::hmac_sha256::mac(key_1, bytes("Hi There")), tag_1);
+	ASSERT_EQ(krypto::hmac_sha256::mac(bytes("Jefe"), bytes("what do ya want for nothing?")), tag_2);
+	ASSERT_EQ(krypto::hmac_sha256::mac(key_6, bytes("Test Using Larger Than Block-Size Key - Hash Key First")), tag_6);
+
+}
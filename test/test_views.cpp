@@ -0,0 +1,103 @@
+#include "gtest/gtest.h"
+#include "krypto/views.h"
+#include "krypto/aes.h"
+
+#include <algorithm>
+#include <array>
+#include <ranges>
+#include <vector>
+
+class ViewsTest : public ::testing::Test {
+
+protected:
+
+	void SetUp() override {
+		for (size_t i = 0; i < plain_text.size(); i++)
+			plain_text[i] = static_cast<unsigned char>(i * 7 + 3);
+	}
+
+	std::array<unsigned char, 16> key = {	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+	std::array<unsigned char, 16> iv = {	0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff };
+
+	// Several chunks, ending in a partial chunk and a partial block
+	krypto::byte_array plain_text = krypto::byte_array(3 * 4096 + 1000 + 5);
+
+};
+
+TEST_F(ViewsTest, MatchesKernel) {
+
+	const krypto::internal::key_schedule<128> ks(key);
+	krypto::byte_array expected(plain_text.size());
+	krypto::internal::ctr_xor(plain_text.data(), expected.data(), plain_text.size(), ks, krypto::internal::ctr_stream(iv.data(), false), 0);
+
+	auto cipher_text = plain_text | krypto::views::encrypt<128>(key, iv);
+	static_assert(std::ranges::random_access_range<decltype(cipher_text)>);
+	static_assert(std::ranges::sized_range<decltype(cipher_text)>);
+
+	ASSERT_EQ(cipher_text.size(), plain_text.size());
+	ASSERT_TRUE(std::ranges::equal(cipher_text, expected));
+
+	// Round trip, and random access in any order
+	auto back = expected | krypto::views::decrypt<128>(key, iv);
+	ASSERT_TRUE(std::ranges::equal(back, plain_text));
+
+	for (size_t n = 0; n < plain_text.size(); n += 701) {
+		const size_t i = plain_text.size() - 1 - n;
+		ASSERT_EQ(back[i], plain_text[i]);
+	}
+
+}
+
+TEST_F(ViewsTest, MatchesAesCtr) {
+
+	krypto::aes<256, krypto::modes::ctr, krypto::pad::pkcs7> aes(std::array<unsigned char, 32>{ 1, 2, 3 });
+	const auto cipher_text = aes.encrypt(plain_text);
+
+	// Cipher text of modes::ctr is followed by its IV, padding is left in the output
+	const auto body = std::span(cipher_text).first(cipher_text.size() - 16);
+	const auto tail = std::span(cipher_text).last<16>();
+
+	auto plain = body | krypto::views::decrypt<256>(std::array<unsigned char, 32>{ 1, 2, 3 }, tail);
+	ASSERT_TRUE(std::ranges::equal(plain | std::views::take(plain_text.size()), plain_text));
+
+}
+
+TEST_F(ViewsTest, EarlyStop) {
+
+	krypto::byte_array cipher_text(plain_text.size());
+	std::ranges::copy(plain_text | krypto::views::encrypt<128>(key, iv), cipher_text.begin());
+
+	// Composes with standard views and algorithms
+	auto plain = cipher_text | krypto::views::decrypt<128>(key, iv);
+	const auto it = std::ranges::find(plain, plain_text[5000]);
+	ASSERT_EQ(it.offset(), std::ranges::find(plain_text, plain_text[5000]) - plain_text.begin());
+
+	auto odd = cipher_text | krypto::views::decrypt<128>(key, iv) | std::views::drop(4096) | std::views::take(10);
+	ASSERT_TRUE(std::ranges::equal(odd, plain_text | std::views::drop(4096) | std::views::take(10)));
+
+	// Empty input
+	krypto::byte_array empty;
+	ASSERT_TRUE(std::ranges::empty(empty | krypto::views::decrypt<128>(key, iv)));
+
+}
+
+TEST_F(ViewsTest, CopyAndMove) {
+
+	krypto::byte_array cipher_text(plain_text.size());
+	std::ranges::copy(plain_text | krypto::views::encrypt<128>(key, iv), cipher_text.begin());
+
+	auto view = plain_text | krypto::views::encrypt<128>(key, iv);
+	auto copy = view;
+	ASSERT_TRUE(std::ranges::equal(copy, cipher_text));
+
+	// A moved from view can still be copied, assigned and read
+	auto moved = std::move(view);
+	ASSERT_TRUE(std::ranges::equal(moved, cipher_text));
+
+	auto from_moved = view;
+	copy = view;
+	ASSERT_EQ(view.begin()[5000], cipher_text[5000]);
+	ASSERT_TRUE(std::ranges::equal(from_moved, cipher_text));
+	ASSERT_TRUE(std::ranges::equal(copy, cipher_text));
+
+}
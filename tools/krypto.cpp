@@ -0,0 +1,779 @@
+#include "krypto/gcm.h"
+#include "krypto/aegis.h"
+#include "krypto/sha256.h"
+#include "krypto/dispatch.h"
+#include "krypto/parallel.h"
+#include "krypto/file_engine.h"
+#include "krypto/util.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Authenticated encryption of files and pipes.
+ *
+ *     krypto encrypt|decrypt [-in path] [-out path] [-key-file path] [-key-env name]
+ *                            [-algorithm aes-256-gcm|aegis-256] [-chunk bytes]
+ *                            [-threads n] [-io mmap|direct|read] [-quiet]
+ *
+ * in and out default to stdin and stdout. The key is 32 bytes, raw or as
+ * 64 hex digits, from -key-file or else the environment variable -key-env,
+ * by default KRYPTO_KEY. Throughput and CPU time are reported on stderr.
+ *
+ * The input is cut into chunks sealed independently, so a batch of chunks
+ * is sealed or opened on all threads while the previous batch is written.
+ * Input is mapped when it is a regular file, read with O_DIRECT through an
+ * aligned buffer with -io direct, or read into a buffer.
+ *
+ * Format:
+ *   header   "krypto" 0 1, algorithm, 3 zero bytes, chunk size as 32 bit
+ *            little endian, 16 byte random salt
+ *   chunks   cipher text of chunk size bytes of input followed by the tag.
+ *            The last is shorter, and empty if the input is a multiple of
+ *            the chunk size
+ *
+ * Each file is sealed with HMAC-SHA256(key, "krypto file key" || salt).
+ * Chunk i has nonce i as 8 bytes big endian, then zeros, with the last
+ * byte 1 for the last chunk, and the header as associated data. Changed,
+ * reordered, dropped or appended chunks fail to open.
+ */
+
+namespace files = krypto::internal::files;
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr size_t HEADER_SIZE = 32;
+constexpr size_t SALT_SIZE = 16;
+constexpr size_t KEY_SIZE = 32;
+constexpr size_t DEFAULT_CHUNK = 1 << 20;
+constexpr size_t MAX_CHUNK = 1 << 28;
+// Chunks per thread in a batch
+constexpr size_t BATCH = 4;
+// Aligned reads of -io direct
+constexpr size_t STAGE = 1 << 20;
+
+constexpr std::array<unsigned char, 8> MAGIC = { 'k', 'r', 'y', 'p', 't', 'o', 0, 1 };
+
+enum class algorithm : unsigned char {
+	aes_256_gcm = 1,
+	aegis_256 = 2
+};
+
+enum class io_mode {
+	mmap,
+	direct,
+	read
+};
+
+static const char* name(algorithm a) {
+	return a == algorithm::aegis_256 ? "aegis-256" : "aes-256-gcm";
+}
+
+/**
+ * Input, mapped or read in batches
+ */
+class source {
+public:
+	source() = default;
+	source(const source&) = delete;
+	source& operator=(const source&) = delete;
+	~source();
+
+	/**
+	 * Open path, "-" is stdin. mmap falls back to reads for pipes and empty files
+	 */
+	bool open(const std::string& path, io_mode mode);
+
+	/**
+	 * Next n bytes, fewer only at the end of the input. Valid until the next call
+	 * Returns empty optional on a read error
+	 */
+	std::optional<krypto::const_byte_view<>> next(size_t n);
+
+	int descriptor() const { return fd; }
+
+private:
+
+	size_t fill(unsigned char* out, size_t n);
+
+	int fd = -1;
+	bool owned = false;
+	io_mode mode = io_mode::read;
+
+	const unsigned char* map = nullptr;
+	size_t map_size = 0;
+	size_t position = 0;
+
+	// -io direct
+	files::buffer stage;
+	size_t stage_begin = 0;
+	size_t stage_end = 0;
+	uint64_t offset = 0;
+	uint64_t size = 0;
+	bool direct = false;
+
+	std::vector<unsigned char> data;
+	bool failed = false;
+};
+
+/**
+ * Output written in order. A regular file is written to a temporary file
+ * next to it and renamed over it on success, so a failed run leaves an
+ * existing file untouched
+ */
+class sink {
+public:
+	sink() = default;
+	sink(const sink&) = delete;
+	sink& operator=(const sink&) = delete;
+	~sink();
+
+	/**
+	 * Open path, "-" is stdout. drop_behind drops written pages from the page cache
+	 */
+	bool open(const std::string& path, bool drop_behind);
+
+	bool write(krypto::const_byte_view<> data);
+
+	/**
+	 * Sync a file and move it into place, or remove it if the run failed
+	 */
+	bool finish(bool ok);
+
+private:
+	int fd = -1;
+	std::string path;
+	// Only regular files go through a temporary file and are synced
+	std::string temporary;
+	bool drop = false;
+	uint64_t offset = 0;
+};
+
+struct header {
+	algorithm cipher;
+	uint32_t chunk;
+	std::array<unsigned char, SALT_SIZE> salt;
+
+	std::array<unsigned char, HEADER_SIZE> bytes() const;
+	static std::optional<header> parse(krypto::const_byte_view<> data);
+};
+
+/**
+ * Source
+ */
+
+source::~source() {
+	if (map)
+		::munmap(const_cast<unsigned char*>(map), map_size);
+	if (owned && fd >= 0)
+		::close(fd);
+
+	// Plain text when encrypting
+	krypto::secure_zero(data);
+	if (stage)
+		krypto::secure_zero(krypto::byte_view<>(stage.get(), STAGE));
+}
+
+bool source::open(const std::string& path, io_mode m) {
+	mode = m;
+
+	if (path == "-") {
+		fd = STDIN_FILENO;
+		mode = io_mode::read;
+		return true;
+	}
+
+	owned = true;
+	if (mode == io_mode::direct) {
+		fd = files::open_direct(path, O_RDONLY, direct);
+		stage.reset(static_cast<unsigned char*>(std::aligned_alloc(files::ALIGNMENT, STAGE)));
+
+		struct stat st;
+		if (fd < 0 || !stage || ::fstat(fd, &st) != 0)
+			return false;
+		size = st.st_size;
+		return true;
+	}
+
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (mode == io_mode::mmap && ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void* p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			map = static_cast<const unsigned char*>(p);
+			map_size = st.st_size;
+			::madvise(p, map_size, MADV_SEQUENTIAL);
+			return true;
+		}
+	}
+
+	mode = io_mode::read;
+	return true;
+}
+
+std::optional<krypto::const_byte_view<>> source::next(size_t n) {
+	if (map) {
+		const size_t m = std::min(n, map_size - position);
+		const krypto::const_byte_view<> view(map + position, m);
+		position += m;
+		return view;
+	}
+
+	if (data.size() < n)
+		data.resize(n);
+
+	const size_t m = fill(data.data(), n);
+	if (failed)
+		return std::nullopt;
+	return krypto::const_byte_view<>(data.data(), m);
+}
+
+size_t source::fill(unsigned char* out, size_t n) {
+	size_t done = 0;
+
+	if (mode == io_mode::direct) {
+		while (done < n) {
+			if (stage_begin == stage_end) {
+				if (offset >= size)
+					break;
+
+				// Whole aligned blocks, the last read is short
+				const size_t got = files::read_full(fd, stage.get(), STAGE, offset);
+				if (got < std::min<uint64_t>(STAGE, size - offset)) {
+					failed = true;
+					break;
+				}
+#ifdef POSIX_FADV_DONTNEED
+				if (!direct)
+					::posix_fadvise(fd, offset, got, POSIX_FADV_DONTNEED);
+#endif
+				offset += got;
+				stage_begin = 0;
+				stage_end = got;
+			}
+
+			const size_t m = std::min(n - done, stage_end - stage_begin);
+			std::memcpy(out + done, stage.get() + stage_begin, m);
+			stage_begin += m;
+			done += m;
+		}
+		return done;
+	}
+
+	while (done < n) {
+		const ssize_t got = ::read(fd, out + done, n - done);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got < 0)
+			failed = true;
+		if (got <= 0)
+			break;
+		done += got;
+	}
+	return done;
+}
+
+/**
+ * Sink
+ */
+
+sink::~sink() {
+	if (fd >= 0 && fd != STDOUT_FILENO)
+		::close(fd);
+	if (fd >= 0 && !temporary.empty())
+		::unlink(temporary.c_str());
+}
+
+bool sink::open(const std::string& p, bool drop_behind) {
+	path = p;
+	drop = drop_behind;
+
+	if (path == "-") {
+		fd = STDOUT_FILENO;
+		drop = false;
+		return true;
+	}
+
+	// Devices and pipes are written in place
+	struct stat st;
+	if (::stat(path.c_str(), &st) == 0 && !S_ISREG(st.st_mode)) {
+		fd = ::open(path.c_str(), O_WRONLY);
+		drop = false;
+		return fd >= 0;
+	}
+
+	// Replace the file a link points to, not the link
+	if (char* resolved = ::realpath(path.c_str(), nullptr)) {
+		path = resolved;
+		std::free(resolved);
+	}
+
+	temporary = path + ".XXXXXX";
+	fd = ::mkstemp(temporary.data());
+	if (fd < 0)
+		temporary.clear();
+	return fd >= 0;
+}
+
+bool sink::write(krypto::const_byte_view<> data) {
+	size_t done = 0;
+	while (done < data.size()) {
+		const ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+
+#ifdef POSIX_FADV_DONTNEED
+	if (drop)
+		::posix_fadvise(fd, offset, data.size(), POSIX_FADV_DONTNEED);
+#endif
+	offset += data.size();
+	return true;
+}
+
+bool sink::finish(bool ok) {
+	if (temporary.empty())
+		return ok;
+
+	ok = ok && ::fdatasync(fd) == 0;
+	ok = ::close(fd) == 0 && ok;
+	fd = -1;
+
+	ok = ok && ::rename(temporary.c_str(), path.c_str()) == 0;
+	if (!ok) {
+		::unlink(temporary.c_str());
+		return false;
+	}
+
+	// Make the rename durable
+	const auto slash = path.find_last_of('/');
+	const std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+	const int dir = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+	if (dir >= 0) {
+		::fsync(dir);
+		::close(dir);
+	}
+	return true;
+}
+
+/**
+ * Whether fd and path are the same file, writing it would destroy the input
+ */
+static bool same_file(int fd, const std::string& path) {
+	struct stat in, out;
+	if (::fstat(fd, &in) != 0)
+		return false;
+	if (path == "-" ? ::fstat(STDOUT_FILENO, &out) != 0 : ::stat(path.c_str(), &out) != 0)
+		return false;
+	return S_ISREG(in.st_mode) && in.st_dev == out.st_dev && in.st_ino == out.st_ino;
+}
+
+/**
+ * Format
+ */
+
+std::array<unsigned char, HEADER_SIZE> header::bytes() const {
+	std::array<unsigned char, HEADER_SIZE> out{};
+	std::copy(MAGIC.begin(), MAGIC.end(), out.begin());
+	out[8] = static_cast<unsigned char>(cipher);
+	for (size_t i = 0; i < 4; i++)
+		out[12 + i] = static_cast<unsigned char>(chunk >> (i * 8));
+	std::copy(salt.begin(), salt.end(), out.begin() + 16);
+	return out;
+}
+
+std::optional<header> header::parse(krypto::const_byte_view<> data) {
+	if (data.size() != HEADER_SIZE || !std::equal(MAGIC.begin(), MAGIC.end(), data.begin()))
+		return std::nullopt;
+
+	header h;
+	h.cipher = static_cast<algorithm>(data[8]);
+	if (h.cipher != algorithm::aes_256_gcm && h.cipher != algorithm::aegis_256)
+		return std::nullopt;
+	if (data[9] != 0 || data[10] != 0 || data[11] != 0)
+		return std::nullopt;
+
+	h.chunk = 0;
+	for (size_t i = 0; i < 4; i++)
+		h.chunk |= static_cast<uint32_t>(data[12 + i]) << (i * 8);
+	if (h.chunk == 0 || h.chunk > MAX_CHUNK)
+		return std::nullopt;
+
+	std::copy(data.begin() + 16, data.end(), h.salt.begin());
+	return h;
+}
+
+static std::array<unsigned char, KEY_SIZE> file_key(const std::array<unsigned char, KEY_SIZE>& key, const header& h) {
+	static const char label[] = "krypto file key";
+
+	krypto::hmac_sha256 mac(key);
+	mac.update(krypto::const_byte_view<>(reinterpret_cast<const unsigned char*>(label), sizeof(label) - 1));
+	mac.update(h.salt);
+	return mac.digest();
+}
+
+template <typename Aead>
+static std::array<unsigned char, Aead::NONCE_SIZE> nonce(uint64_t index, bool last) {
+	std::array<unsigned char, Aead::NONCE_SIZE> n{};
+	for (size_t i = 0; i < 8; i++)
+		n[i] = static_cast<unsigned char>(index >> (56 - i * 8));
+	n[11] = last ? 1 : 0;
+	return n;
+}
+
+/**
+ * Seal or open all chunks of in to out, returns the bytes of plain text or
+ * an error message
+ */
+template <typename Aead>
+static std::optional<uint64_t> run(bool encrypt, source& in, sink& out, const header& h, const std::array<unsigned char, KEY_SIZE>& key, std::string& error) {
+	auto k = file_key(key, h);
+	const Aead aead(k);
+	krypto::secure_zero(k);
+	const auto ad = h.bytes();
+
+	const size_t chunk = h.chunk;
+	const size_t record = chunk + Aead::TAG_SIZE;
+	const size_t per_batch = BATCH * krypto::internal::parallel::threads();
+	const size_t batch = per_batch * (encrypt ? chunk : record);
+
+	uint64_t plain = 0;
+	uint64_t index = 0;
+	bool last = false;
+
+	// Writes the previous batch while the next is sealed or opened
+	std::thread writer;
+	bool written = true;
+
+	while (!last) {
+		const auto data = in.next(batch);
+		if (!data) {
+			error = "read error";
+			break;
+		}
+
+		last = data->size() < batch;
+		const size_t step = encrypt ? chunk : record;
+		const size_t rest = data->size() % step;
+
+		// The last chunk is shorter than a full one, and may be empty
+		if (last && !encrypt && rest < Aead::TAG_SIZE) {
+			error = "truncated input";
+			break;
+		}
+		const size_t count = data->size() / step + (last ? 1 : 0);
+
+		std::vector<krypto::byte_array> results(count);
+		std::atomic<bool> ok = true;
+
+		#pragma omp parallel for schedule(dynamic) num_threads(krypto::internal::parallel::threads())
+		for (int64_t i = 0; i < static_cast<int64_t>(count); i++) {
+			const size_t begin = i * step;
+			const auto part = data->subspan(begin, std::min(step, data->size() - begin));
+			const auto n = nonce<Aead>(index + i, last && i + 1 == static_cast<int64_t>(count));
+
+			if (encrypt) {
+				results[i] = aead.seal(n, part, ad);
+			}
+			else if (auto opened = aead.open(n, part, ad)) {
+				results[i] = std::move(*opened);
+			}
+			else {
+				ok = false;
+			}
+		}
+
+		if (!ok) {
+			error = "authentication failed";
+			break;
+		}
+
+		index += count;
+		plain += encrypt ? data->size() : data->size() - count * Aead::TAG_SIZE;
+
+		if (writer.joinable())
+			writer.join();
+		if (!written) {
+			error = "write error";
+			break;
+		}
+
+		writer = std::thread([&, results = std::move(results)] {
+			for (const auto& r : results)
+				written = written && out.write(r);
+		});
+	}
+
+	if (writer.joinable())
+		writer.join();
+	if (error.empty() && !written)
+		error = "write error";
+
+	if (!error.empty())
+		return std::nullopt;
+	return plain;
+}
+
+/**
+ * Key
+ */
+
+static std::optional<std::array<unsigned char, KEY_SIZE>> parse_key(std::string text) {
+	std::array<unsigned char, KEY_SIZE> key;
+
+	if (text.size() == KEY_SIZE) {
+		std::copy(text.begin(), text.end(), key.begin());
+		krypto::secure_zero(krypto::byte_view<>(reinterpret_cast<unsigned char*>(text.data()), text.size()));
+		return key;
+	}
+
+	while (!text.empty() && (text.back() == '\n' || text.back() == '\r' || text.back() == ' '))
+		text.pop_back();
+
+	const auto digit = [](char c) {
+		if (c >= '0' && c <= '9')
+			return c - '0';
+		if (c >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F')
+			return c - 'A' + 10;
+		return -1;
+	};
+
+	bool valid = text.size() == 2 * KEY_SIZE;
+	for (size_t i = 0; valid && i < KEY_SIZE; i++) {
+		const int hi = digit(text[2 * i]);
+		const int lo = digit(text[2 * i + 1]);
+		valid = hi >= 0 && lo >= 0;
+		key[i] = static_cast<unsigned char>(hi << 4 | lo);
+	}
+
+	krypto::secure_zero(krypto::byte_view<>(reinterpret_cast<unsigned char*>(text.data()), text.size()));
+	if (!valid)
+		return std::nullopt;
+	return key;
+}
+
+static std::optional<std::array<unsigned char, KEY_SIZE>> load_key(const std::string& file, const std::string& env) {
+	if (file.empty()) {
+		const char* value = std::getenv(env.c_str());
+		if (!value)
+			return std::nullopt;
+		return parse_key(value);
+	}
+
+	std::FILE* f = std::fopen(file.c_str(), "rb");
+	if (!f)
+		return std::nullopt;
+
+	std::string text(2 * KEY_SIZE + 2, 0);
+	text.resize(std::fread(text.data(), 1, text.size(), f));
+	std::fclose(f);
+	return parse_key(std::move(text));
+}
+
+/**
+ * Report
+ */
+
+static double cpu_seconds() {
+	struct rusage usage;
+	if (::getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+
+	const auto seconds = [](const timeval& t) { return t.tv_sec + t.tv_usec / 1e6; };
+	return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+}
+
+static void usage() {
+	std::fprintf(stderr,
+		"usage: krypto encrypt|decrypt [-in path] [-out path] [-key-file path] [-key-env name]\n"
+		"                              [-algorithm aes-256-gcm|aegis-256] [-chunk bytes]\n"
+		"                              [-threads n] [-io mmap|direct|read] [-quiet]\n");
+}
+
+int main(int argc, char** argv) {
+
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+
+	const std::string command = argv[1];
+	if (command != "encrypt" && command != "decrypt") {
+		usage();
+		return 1;
+	}
+	const bool encrypt = command == "encrypt";
+
+	std::string in_path = "-";
+	std::string out_path = "-";
+	std::string key_file;
+	std::string key_env = "KRYPTO_KEY";
+	algorithm cipher = algorithm::aes_256_gcm;
+	unsigned long long chunk = DEFAULT_CHUNK;
+	long threads = 0;
+	io_mode mode = io_mode::mmap;
+	bool quiet = false;
+
+	for (int i = 2; i < argc; i++) {
+		const std::string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+
+		if (arg == "-in" && has_value) {
+			in_path = argv[++i];
+		}
+		else if (arg == "-out" && has_value) {
+			out_path = argv[++i];
+		}
+		else if (arg == "-key-file" && has_value) {
+			key_file = argv[++i];
+		}
+		else if (arg == "-key-env" && has_value) {
+			key_env = argv[++i];
+		}
+		else if (arg == "-algorithm" && has_value) {
+			const std::string a = argv[++i];
+			if (a == "aes-256-gcm") {
+				cipher = algorithm::aes_256_gcm;
+			}
+			else if (a == "aegis-256") {
+				cipher = algorithm::aegis_256;
+			}
+			else {
+				usage();
+				return 1;
+			}
+		}
+		else if (arg == "-chunk" && has_value) {
+			chunk = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (arg == "-threads" && has_value) {
+			threads = std::strtol(argv[++i], nullptr, 10);
+		}
+		else if (arg == "-io" && has_value) {
+			const std::string m = argv[++i];
+			if (m == "mmap") {
+				mode = io_mode::mmap;
+			}
+			else if (m == "direct") {
+				mode = io_mode::direct;
+			}
+			else if (m == "read") {
+				mode = io_mode::read;
+			}
+			else {
+				usage();
+				return 1;
+			}
+		}
+		else if (arg == "-quiet") {
+			quiet = true;
+		}
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	if (chunk == 0 || chunk > MAX_CHUNK || threads < 0) {
+		usage();
+		return 1;
+	}
+
+	if (threads > 0)
+		krypto::set_max_threads(threads);
+
+	auto key = load_key(key_file, key_env);
+	if (!key) {
+		std::fprintf(stderr, "krypto: no 32 byte key in %s\n", key_file.empty() ? ("$" + key_env).c_str() : key_file.c_str());
+		return 1;
+	}
+
+	source in;
+	if (!in.open(in_path, mode)) {
+		std::fprintf(stderr, "krypto: cannot open %s\n", in_path.c_str());
+		return 1;
+	}
+
+	if (same_file(in.descriptor(), out_path)) {
+		std::fprintf(stderr, "krypto: %s is the input\n", out_path.c_str());
+		return 1;
+	}
+
+	sink out;
+	if (!out.open(out_path, mode == io_mode::direct)) {
+		std::fprintf(stderr, "krypto: cannot create %s\n", out_path.c_str());
+		return 1;
+	}
+
+	const auto start = clock_type::now();
+	const double cpu_start = cpu_seconds();
+
+	std::optional<header> h;
+	std::string error;
+
+	if (encrypt) {
+		h = header{ cipher, static_cast<uint32_t>(chunk), krypto::get_srandom_bytes<SALT_SIZE>() };
+		if (!out.write(h->bytes()))
+			error = "write error";
+	}
+	else {
+		const auto data = in.next(HEADER_SIZE);
+		if (data)
+			h = header::parse(*data);
+		if (!h)
+			error = "not a krypto file";
+	}
+
+	std::optional<uint64_t> bytes;
+	if (error.empty()) {
+		if (h->cipher == algorithm::aegis_256)
+			bytes = run<krypto::aegis256>(encrypt, in, out, *h, *key, error);
+		else
+			bytes = run<krypto::gcm<256>>(encrypt, in, out, *h, *key, error);
+	}
+
+	krypto::secure_zero(*key);
+
+	if (!out.finish(error.empty()) && error.empty())
+		error = "write error";
+
+	if (!error.empty()) {
+		std::fprintf(stderr, "krypto: %s\n", error.c_str());
+		return 1;
+	}
+
+	const double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+	const double cpu = cpu_seconds() - cpu_start;
+
+	if (!quiet) {
+		std::fprintf(stderr, "krypto: %s %llu bytes with %s in %.3f s, %.1f MB/s, CPU %.3f s (%.1f cores), %d threads, %s\n",
+			encrypt ? "encrypted" : "decrypted", static_cast<unsigned long long>(*bytes), name(h->cipher), seconds,
+			seconds > 0 ? *bytes / seconds / 1e6 : 0.0, cpu, seconds > 0 ? cpu / seconds : 0.0,
+			krypto::internal::parallel::threads(), krypto::backend());
+	}
+
+	return 0;
+}
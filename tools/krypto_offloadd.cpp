@@ -0,0 +1,44 @@
+#include "krypto/offload.h"
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/**
+ * Offload daemon, serves krypto::offload_client jobs until SIGINT or SIGTERM.
+ *
+ *     krypto_offloadd [service] [core...]
+ *
+ * service defaults to /krypto, one worker is pinned to each core given.
+ */
+
+static std::atomic<bool> stop = false;
+
+static void on_signal(int) {
+	stop = true;
+}
+
+int main(int argc, char** argv) {
+
+	const std::string service = argc > 1 ? argv[1] : "/krypto";
+
+	std::vector<int> cores;
+	for (int i = 2; i < argc; i++)
+		cores.push_back(std::atoi(argv[i]));
+
+	auto server = krypto::offload_server::create(service);
+	if (!server) {
+		std::fprintf(stderr, "krypto_offloadd: cannot create %s\n", service.c_str());
+		return 1;
+	}
+
+	std::signal(SIGINT, on_signal);
+	std::signal(SIGTERM, on_signal);
+
+	server->run(stop, cores);
+
+	return 0;
+}
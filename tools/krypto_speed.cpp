@@ -0,0 +1,462 @@
+#include "krypto/aes.h"
+#include "krypto/aegis.h"
+#include "krypto/gcm.h"
+#include "krypto/cbc_hmac.h"
+#include "krypto/sha256.h"
+#include "krypto/jit.h"
+#include "krypto/dispatch.h"
+#include "krypto/parallel.h"
+#include "krypto/internal/kernels.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Throughput of every algorithm, mode, key size and backend, like openssl speed.
+ *
+ *     krypto_speed [-seconds s] [-bytes n,...] [-multi n] [-backend name]
+ *                  [-decrypt] [-format text|json|csv] [-list] [algorithm...]
+ *
+ * Each test calls the public API in a loop for -seconds on one thread, and
+ * again on -multi threads at once, each with its own object and buffers.
+ * Loops inside krypto run a single thread during the tests, so -multi
+ * threads use as many cores. algorithm selects tests by name prefix, as
+ * aes-128 or gcm. The workloads are those of bench/bench_aes.cpp, timed
+ * here without Google Benchmark so the tool runs on any host.
+ */
+
+using clock_type = std::chrono::steady_clock;
+using work_type = std::function<void()>;
+
+struct test {
+	// aes-128-ctr, aegis-128l, ...
+	std::string name;
+	std::string algorithm;
+	std::string mode;
+	size_t key_bits;
+	// Kernel the dispatch policy selects for the test
+	std::string backend;
+	krypto::dispatch_policy policy;
+	// Work on a message of bytes, decrypt or encrypt, for one thread
+	std::function<work_type(size_t, bool)> make;
+};
+
+struct result {
+	const test* t;
+	int threads;
+	size_t bytes;
+	double seconds;
+	uint64_t operations;
+
+	double bytes_per_second() const { return seconds > 0 ? operations * static_cast<double>(bytes) / seconds : 0; }
+};
+
+// Keeps the output of the work alive
+static thread_local volatile unsigned char sink;
+
+static void consume(const krypto::byte_array& data) {
+	sink = data.empty() ? 0 : data.back();
+}
+
+/**
+ * Work through the public API
+ */
+
+template <size_t Size, typename Mode>
+static work_type aes_work(size_t bytes, bool decrypt) {
+	const std::array<unsigned char, Size / 8> key = { 1 };
+	const krypto::aes<Size, Mode, krypto::pad::pkcs7> cipher(key);
+	krypto::byte_array data(bytes, 1);
+	if (decrypt)
+		data = cipher.encrypt(data);
+
+	return [=] { consume(decrypt ? cipher.decrypt(data) : cipher.encrypt(data)); };
+}
+
+template <size_t Size>
+static work_type jit_work(size_t bytes, bool) {
+	const std::array<unsigned char, Size / 8> key = { 1 };
+	auto cipher = std::make_shared<const krypto::jit_ctr<Size>>(key);
+	auto data = std::make_shared<krypto::byte_array>(bytes, 1);
+	const std::array<unsigned char, 16> iv = { 2 };
+
+	// Same stream both ways
+	return [=] {
+		cipher->apply(*data, *data, iv);
+		consume(*data);
+	};
+}
+
+template <typename Aead, size_t KeySize, size_t NonceSize>
+static work_type aead_work(size_t bytes, bool decrypt) {
+	const std::array<unsigned char, KeySize> key = { 1 };
+	const std::array<unsigned char, NonceSize> nonce = { 2 };
+	auto cipher = std::make_shared<const Aead>(key);
+	krypto::byte_array data(bytes, 1);
+	if (decrypt)
+		data = cipher->seal(nonce, data);
+
+	return [=] {
+		if (decrypt)
+			consume(cipher->open(nonce, data).value_or(krypto::byte_array{}));
+		else
+			consume(cipher->seal(nonce, data));
+	};
+}
+
+template <size_t Size>
+static work_type cbc_hmac_work(size_t bytes, bool decrypt) {
+	const std::array<unsigned char, Size / 8> key = { 1 };
+	const std::array<unsigned char, 16> iv = { 2 };
+	auto cipher = std::make_shared<const krypto::cbc_hmac_sha256<Size>>(key, key);
+	krypto::byte_array data(bytes, 1);
+	if (decrypt)
+		data = cipher->seal(iv, data);
+
+	return [=] {
+		if (decrypt)
+			consume(cipher->open(iv, data).value_or(krypto::byte_array{}));
+		else
+			consume(cipher->seal(iv, data));
+	};
+}
+
+static work_type sha256_work(size_t bytes, bool) {
+	const krypto::byte_array data(bytes, 1);
+	return [=] { sink = krypto::sha256::hash(data)[0]; };
+}
+
+/**
+ * Tests
+ */
+
+struct backend {
+	std::string name;
+	krypto::dispatch_policy policy;
+};
+
+// CTR kernels available on this CPU, each forced by the dispatch policy
+static std::vector<backend> ctr_backends() {
+#ifdef KRYPTO_FORCED_BACKEND
+	return { { krypto::backend(), krypto::get_dispatch_policy() } };
+#else
+	const size_t off = SIZE_MAX;
+#ifdef KRYPTO_AESNI
+	std::vector<backend> backends = { { "aesni", { off, off } } };
+#else
+	std::vector<backend> backends = { { "table", { off, off } } };
+#endif
+
+	[[maybe_unused]] bool vaes256 = false;
+	[[maybe_unused]] bool vaes512 = false;
+#ifdef KRYPTO_VAES256
+	vaes256 = true;
+#endif
+#ifdef KRYPTO_VAES512
+	vaes512 = true;
+#endif
+#ifdef KRYPTO_RUNTIME_VAES
+	vaes256 = vaes256 || krypto::internal::isa::vaes256();
+	vaes512 = vaes512 || krypto::internal::isa::vaes512();
+#endif
+
+	if (vaes256)
+		backends.push_back({ "vaes256", { 0, off } });
+	if (vaes512)
+		backends.push_back({ "vaes512", { 0, 0 } });
+	return backends;
+#endif
+}
+
+// Backend of the block functions, for tests that do not go through the CTR kernels
+static std::string block_backend() {
+#ifdef KRYPTO_AESNI
+	return "aesni";
+#else
+	return "table";
+#endif
+}
+
+static std::vector<test> tests() {
+	const auto policy = krypto::get_dispatch_policy();
+	const auto ctr = ctr_backends();
+
+	std::vector<test> all;
+	const auto add = [&](const std::string& name, const std::string& algorithm, const std::string& mode, size_t key_bits, const std::string& backend, const krypto::dispatch_policy& p, std::function<work_type(size_t, bool)> make) {
+		all.push_back({ name, algorithm, mode, key_bits, backend, p, std::move(make) });
+	};
+	const auto add_ctr = [&](const std::string& name, const std::string& algorithm, const std::string& mode, size_t key_bits, std::function<work_type(size_t, bool)> make) {
+		for (const auto& b : ctr)
+			add(name, algorithm, mode, key_bits, b.name, b.policy, make);
+	};
+
+	// ECB and CBC run the table implementation on any CPU
+	add("aes-128-ecb", "aes", "ecb", 128, "table", policy, aes_work<128, krypto::modes::ecb>);
+	add("aes-192-ecb", "aes", "ecb", 192, "table", policy, aes_work<194, krypto::modes::ecb>);
+	add("aes-256-ecb", "aes", "ecb", 256, "table", policy, aes_work<256, krypto::modes::ecb>);
+
+	add("aes-128-cbc", "aes", "cbc", 128, "table", policy, aes_work<128, krypto::modes::cbc>);
+	add("aes-192-cbc", "aes", "cbc", 192, "table", policy, aes_work<194, krypto::modes::cbc>);
+	add("aes-256-cbc", "aes", "cbc", 256, "table", policy, aes_work<256, krypto::modes::cbc>);
+
+	add_ctr("aes-128-ctr", "aes", "ctr", 128, aes_work<128, krypto::modes::ctr>);
+	add_ctr("aes-192-ctr", "aes", "ctr", 192, aes_work<194, krypto::modes::ctr>);
+	add_ctr("aes-256-ctr", "aes", "ctr", 256, aes_work<256, krypto::modes::ctr>);
+
+	// Generated kernels, only where executable memory is allowed
+	const std::array<unsigned char, 16> probe = { 1 };
+	if (krypto::jit_ctr<128>(probe).compiled()) {
+		add("aes-128-ctr", "aes", "ctr", 128, "jit", policy, jit_work<128>);
+		add("aes-192-ctr", "aes", "ctr", 192, "jit", policy, jit_work<194>);
+		add("aes-256-ctr", "aes", "ctr", 256, "jit", policy, jit_work<256>);
+	}
+
+	add_ctr("aes-128-gcm", "aes", "gcm", 128, aead_work<krypto::gcm<128>, 16, 12>);
+	add_ctr("aes-192-gcm", "aes", "gcm", 192, aead_work<krypto::gcm<194>, 24, 12>);
+	add_ctr("aes-256-gcm", "aes", "gcm", 256, aead_work<krypto::gcm<256>, 32, 12>);
+
+	add("aes-128-cbc-hmac-sha256", "aes", "cbc-hmac-sha256", 128, block_backend(), policy, cbc_hmac_work<128>);
+	add("aes-192-cbc-hmac-sha256", "aes", "cbc-hmac-sha256", 192, block_backend(), policy, cbc_hmac_work<194>);
+	add("aes-256-cbc-hmac-sha256", "aes", "cbc-hmac-sha256", 256, block_backend(), policy, cbc_hmac_work<256>);
+
+	add("aegis-128l", "aegis", "aead", 128, block_backend(), policy, aead_work<krypto::aegis128l, 16, 16>);
+	add("aegis-256", "aegis", "aead", 256, block_backend(), policy, aead_work<krypto::aegis256, 32, 32>);
+
+	add("sha256", "sha256", "hash", 0, "generic", policy, sha256_work);
+
+	return all;
+}
+
+/**
+ * Run a test on threads for seconds
+ */
+static result measure(const test& t, size_t bytes, int threads, double seconds, bool decrypt) {
+	krypto::set_dispatch_policy(t.policy);
+
+	std::vector<work_type> work;
+	for (int i = 0; i < threads; i++) {
+		work.push_back(t.make(bytes, decrypt));
+		work.back()();
+	}
+
+	// Check the clock about every 64 KiB of work
+	const uint64_t batch = std::max<uint64_t>(1, (1 << 16) / std::max<size_t>(bytes, 1));
+
+	std::atomic<int> ready = 0;
+	std::atomic<bool> go = false;
+	std::atomic<bool> stop = false;
+	std::vector<uint64_t> operations(threads, 0);
+
+	std::vector<std::thread> workers;
+	for (int i = 0; i < threads; i++) {
+		workers.emplace_back([&, i] {
+			ready++;
+			while (!go)
+				std::this_thread::yield();
+
+			uint64_t n = 0;
+			while (!stop) {
+				for (uint64_t k = 0; k < batch; k++)
+					work[i]();
+				n += batch;
+			}
+			operations[i] = n;
+		});
+	}
+
+	while (ready < threads)
+		std::this_thread::yield();
+
+	const auto start = clock_type::now();
+	go = true;
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	stop = true;
+	for (auto& w : workers)
+		w.join();
+	const double elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+
+	uint64_t total = 0;
+	for (const auto n : operations)
+		total += n;
+
+	return { &t, threads, bytes, elapsed, total };
+}
+
+/**
+ * Output
+ */
+
+static void print_text(const std::vector<result>& results, const std::vector<size_t>& sizes) {
+	std::printf("The numbers are in MB/s of input processed\n");
+	std::printf("%-24s %-8s %7s", "algorithm", "backend", "threads");
+	for (const size_t s : sizes)
+		std::printf(" %10zu B", s);
+	std::printf("\n");
+
+	// One row per test and thread count, one column per size
+	for (size_t i = 0; i < results.size(); i += sizes.size()) {
+		std::printf("%-24s %-8s %7d", results[i].t->name.c_str(), results[i].t->backend.c_str(), results[i].threads);
+		for (size_t j = 0; j < sizes.size(); j++)
+			std::printf(" %12.2f", results[i + j].bytes_per_second() / 1e6);
+		std::printf("\n");
+	}
+}
+
+static void print_json(const std::vector<result>& results, const char* direction) {
+	std::printf("{\n  \"backend\": \"%s\",\n  \"direction\": \"%s\",\n  \"results\": [\n", krypto::backend(), direction);
+	for (size_t i = 0; i < results.size(); i++) {
+		const auto& r = results[i];
+		std::printf("    { \"name\": \"%s\", \"algorithm\": \"%s\", \"mode\": \"%s\", \"key_bits\": %zu, \"backend\": \"%s\", \"threads\": %d, \"bytes\": %zu, \"seconds\": %.6f, \"operations\": %llu, \"bytes_per_second\": %.0f }%s\n",
+			r.t->name.c_str(), r.t->algorithm.c_str(), r.t->mode.c_str(), r.t->key_bits, r.t->backend.c_str(), r.threads, r.bytes, r.seconds,
+			static_cast<unsigned long long>(r.operations), r.bytes_per_second(), i + 1 < results.size() ? "," : "");
+	}
+	std::printf("  ]\n}\n");
+}
+
+static void print_csv(const std::vector<result>& results, const char* direction) {
+	std::printf("name,algorithm,mode,key_bits,backend,direction,threads,bytes,seconds,operations,bytes_per_second\n");
+	for (const auto& r : results) {
+		std::printf("%s,%s,%s,%zu,%s,%s,%d,%zu,%.6f,%llu,%.0f\n",
+			r.t->name.c_str(), r.t->algorithm.c_str(), r.t->mode.c_str(), r.t->key_bits, r.t->backend.c_str(), direction, r.threads, r.bytes, r.seconds,
+			static_cast<unsigned long long>(r.operations), r.bytes_per_second());
+	}
+}
+
+static void usage() {
+	std::fprintf(stderr,
+		"usage: krypto_speed [-seconds s] [-bytes n,...] [-multi n] [-backend name]\n"
+		"                    [-decrypt] [-format text|json|csv] [-list] [algorithm...]\n");
+}
+
+// "16,64,1024", empty if malformed
+static std::vector<size_t> parse_sizes(const char* list) {
+	std::vector<size_t> sizes;
+	const char* p = list;
+	while (true) {
+		char* end;
+		const unsigned long long n = std::strtoull(p, &end, 10);
+		if (end == p || n == 0)
+			return {};
+		sizes.push_back(static_cast<size_t>(n));
+
+		if (*end == 0)
+			return sizes;
+		if (*end != ',')
+			return {};
+		p = end + 1;
+	}
+}
+
+int main(int argc, char** argv) {
+
+	double seconds = 0.25;
+	std::vector<size_t> sizes = { 16, 64, 256, 1024, 8192, 16384, 1 << 20 };
+	int multi = static_cast<int>(krypto::max_threads());
+	std::string format = "text";
+	std::string backend_filter;
+	bool decrypt = false;
+	bool list = false;
+	std::vector<std::string> names;
+
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+
+		if (arg == "-seconds" && has_value) {
+			seconds = std::atof(argv[++i]);
+		}
+		else if (arg == "-bytes" && has_value) {
+			sizes = parse_sizes(argv[++i]);
+		}
+		else if (arg == "-multi" && has_value) {
+			multi = std::atoi(argv[++i]);
+		}
+		else if (arg == "-backend" && has_value) {
+			backend_filter = argv[++i];
+		}
+		else if (arg == "-format" && has_value) {
+			format = argv[++i];
+		}
+		else if (arg == "-decrypt") {
+			decrypt = true;
+		}
+		else if (arg == "-list") {
+			list = true;
+		}
+		else if (!arg.empty() && arg[0] != '-') {
+			names.push_back(arg);
+		}
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	if (seconds <= 0 || sizes.empty() || multi < 1 || (format != "text" && format != "json" && format != "csv")) {
+		usage();
+		return 1;
+	}
+
+	const auto all = tests();
+	std::vector<const test*> selected;
+	for (const auto& t : all) {
+		bool match = names.empty();
+		for (const auto& n : names)
+			match = match || t.name.compare(0, n.size(), n) == 0;
+		if (match && (backend_filter.empty() || t.backend == backend_filter))
+			selected.push_back(&t);
+	}
+
+	if (list) {
+		for (const auto* t : selected)
+			std::printf("%-24s %s\n", t->name.c_str(), t->backend.c_str());
+		return 0;
+	}
+
+	if (selected.empty()) {
+		std::fprintf(stderr, "krypto_speed: no test matches\n");
+		return 1;
+	}
+
+	std::vector<int> thread_counts = { 1 };
+	if (multi > 1)
+		thread_counts.push_back(multi);
+
+	// Each worker a single thread, the loops of krypto would otherwise share the cores
+	const auto saved_policy = krypto::get_dispatch_policy();
+	krypto::set_max_threads(1);
+
+	std::vector<result> results;
+	for (const auto* t : selected) {
+		for (const int threads : thread_counts) {
+			for (const size_t s : sizes) {
+				std::fprintf(stderr, "Doing %s %s on %d thread%s for %zu byte messages for %.2fs\n",
+					t->name.c_str(), t->backend.c_str(), threads, threads > 1 ? "s" : "", s, seconds);
+				results.push_back(measure(*t, s, threads, seconds, decrypt));
+			}
+		}
+	}
+
+	krypto::set_dispatch_policy(saved_policy);
+	krypto::set_max_threads(0);
+
+	const char* direction = decrypt ? "decrypt" : "encrypt";
+	if (format == "json")
+		print_json(results, direction);
+	else if (format == "csv")
+		print_csv(results, direction);
+	else
+		print_text(results, sizes);
+
+	return 0;
+}